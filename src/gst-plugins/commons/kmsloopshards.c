@@ -0,0 +1,160 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+
+#include "kmsloopshards.h"
+
+#define GST_CAT_DEFAULT kms_loop_shards_debug
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+#define GST_DEFAULT_NAME "kmsloopshards"
+
+struct _KmsLoopShard
+{
+  KmsLoop *loop;
+  guint users;
+};
+
+static void
+kms_loop_shards_init_debug (void)
+{
+  static gsize done = 0;
+
+  if (g_once_init_enter (&done)) {
+    GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+        GST_DEFAULT_NAME);
+    g_once_init_leave (&done, 1);
+  }
+}
+
+void
+kms_loop_shards_set_size (KmsLoopShards * pool, guint size)
+{
+  kms_loop_shards_init_debug ();
+
+  g_mutex_lock (&pool->mutex);
+
+  if (pool->shards != NULL && size != pool->n_shards) {
+    GST_WARNING ("Event loop pool '%s' already running with %u threads,"
+        " ignoring new size %u", pool->name, pool->n_shards, size);
+  } else {
+    GST_INFO ("Event loop pool '%s' size set to %u", pool->name, size);
+    pool->size = size;
+  }
+
+  g_mutex_unlock (&pool->mutex);
+}
+
+guint
+kms_loop_shards_get_size (KmsLoopShards * pool)
+{
+  guint size;
+
+  g_mutex_lock (&pool->mutex);
+  size = (pool->size < 0) ? g_get_num_processors () : (guint) pool->size;
+  g_mutex_unlock (&pool->mutex);
+
+  return size;
+}
+
+/* Must be called with the pool mutex held */
+static void
+kms_loop_shards_create (KmsLoopShards * pool)
+{
+  guint i;
+
+  pool->n_shards = (pool->size < 0) ? g_get_num_processors () :
+      (guint) pool->size;
+  pool->shards = g_new0 (KmsLoopShard, pool->n_shards);
+
+  for (i = 0; i < pool->n_shards; i++) {
+    pool->shards[i].loop = kms_loop_new ();
+  }
+
+  GST_INFO ("Created event loop pool '%s' with %u threads", pool->name,
+      pool->n_shards);
+}
+
+KmsLoop *
+kms_loop_shards_acquire (KmsLoopShards * pool, guint * shard)
+{
+  KmsLoopShard *shards;
+  KmsLoop *loop;
+  guint i, selected = 0;
+
+  kms_loop_shards_init_debug ();
+
+  g_mutex_lock (&pool->mutex);
+
+  if (pool->size == 0) {
+    g_mutex_unlock (&pool->mutex);
+    *shard = KMS_LOOP_SHARDS_DEDICATED;
+
+    return kms_loop_new ();
+  }
+
+  if (pool->shards == NULL) {
+    kms_loop_shards_create (pool);
+  }
+
+  shards = pool->shards;
+
+  /* Least loaded shard; the pool is sized to the number of cores, so a
+   * linear scan is cheaper than keeping a heap up to date */
+  for (i = 1; i < pool->n_shards; i++) {
+    if (shards[i].users < shards[selected].users) {
+      selected = i;
+    }
+  }
+
+  shards[selected].users++;
+  loop = g_object_ref (shards[selected].loop);
+
+  GST_DEBUG ("Assigned event loop shard %u of '%s' (%u users)", selected,
+      pool->name, shards[selected].users);
+
+  g_mutex_unlock (&pool->mutex);
+
+  *shard = selected;
+
+  return loop;
+}
+
+void
+kms_loop_shards_release (KmsLoopShards * pool, KmsLoop * loop, guint shard)
+{
+  if (shard != KMS_LOOP_SHARDS_DEDICATED) {
+    g_mutex_lock (&pool->mutex);
+
+    if (shard < pool->n_shards && pool->shards[shard].users > 0) {
+      pool->shards[shard].users--;
+    } else {
+      GST_ERROR ("Releasing unknown event loop shard %u of '%s'", shard,
+          pool->name);
+    }
+
+    g_mutex_unlock (&pool->mutex);
+  }
+
+  /* Shared loops are kept alive by the pool, so this only joins the thread
+   * for dedicated loops */
+  g_object_unref (loop);
+}
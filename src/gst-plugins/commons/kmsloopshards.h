@@ -0,0 +1,64 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef __KMS_LOOP_SHARDS_H__
+#define __KMS_LOOP_SHARDS_H__
+
+#include <commons/kmsloop.h>
+
+G_BEGIN_DECLS
+
+/* Shard id used for loops that are not part of the shared pool */
+#define KMS_LOOP_SHARDS_DEDICATED G_MAXUINT
+
+typedef struct _KmsLoopShard KmsLoopShard;
+typedef struct _KmsLoopShards KmsLoopShards;
+
+/*
+ * Pool of event loop threads shared by all the elements of one kind.
+ *
+ * Every element is pinned to one shard for its whole life, so all the
+ * sources it attaches are dispatched from the same thread and keep their
+ * relative ordering. Loops are created on the first acquire, one per CPU
+ * core unless another size is set before. A size of 0 disables the pool
+ * and gives each element its own dedicated loop.
+ *
+ * Pools are meant to be static variables initialized with
+ * KMS_LOOP_SHARDS_INIT.
+ */
+struct _KmsLoopShards
+{
+  /*< private > */
+  GMutex mutex;
+  const gchar *name;
+  KmsLoopShard *shards;
+  guint n_shards;
+  gint size;                    /* -1: not configured, use number of cores */
+};
+
+#define KMS_LOOP_SHARDS_INIT(name) { { 0 }, (name), NULL, 0, -1 }
+
+void kms_loop_shards_set_size (KmsLoopShards * pool, guint size);
+guint kms_loop_shards_get_size (KmsLoopShards * pool);
+
+KmsLoop * kms_loop_shards_acquire (KmsLoopShards * pool, guint * shard);
+void kms_loop_shards_release (KmsLoopShards * pool, KmsLoop * loop,
+    guint shard);
+
+G_END_DECLS
+
+#endif /* __KMS_LOOP_SHARDS_H__ */
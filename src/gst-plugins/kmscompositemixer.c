@@ -26,6 +26,7 @@
 #include <math.h>
 
 #define LATENCY 600             //ms
+#define LAYOUT_TIMEOUT 500      //ms
 
 #define PLUGIN_NAME "compositemixer"
 
@@ -97,6 +98,11 @@ struct _KmsCompositeMixerPrivate
   GRecMutex mutex;
   gint n_elems;
   gint output_width, output_height;
+  /* Pad positions waiting to be applied together on an output frame */
+  GMutex layout_mutex;
+  GSList *layout_moves;
+  gint64 layout_deadline;
+  gint layout_pending;
 };
 
 /* class initialization */
@@ -122,8 +128,20 @@ typedef struct _KmsCompositeMixerData
   gulong latency_probe_id;
   GstPad *video_mixer_pad;
   GstPad *tee_sink_pad;
+  /* Geometry last requested for this port, -1 when not placed yet */
+  gint left, top, width, height;
 } KmsCompositeMixerData;
 
+typedef struct _KmsCompositeMixerMove
+{
+  GstPad *pad;
+  gint left, top, width, height;
+  /* Position must wait until the pad is fed with the new size */
+  gboolean resized;
+  /* Pad was never placed and is kept transparent until then */
+  gboolean reveal;
+} KmsCompositeMixerMove;
+
 #define KMS_COMPOSITE_MIXER_REF(data) \
   kms_ref_struct_ref (KMS_REF_STRUCT_CAST (data))
 #define KMS_COMPOSITE_MIXER_UNREF(data) \
@@ -156,16 +174,202 @@ compare_port_data (gconstpointer a, gconstpointer b)
   return port_data_a->id - port_data_b->id;
 }
 
+static void
+kms_composite_mixer_move_free (KmsCompositeMixerMove * move)
+{
+  g_object_unref (move->pad);
+  g_slice_free (KmsCompositeMixerMove, move);
+}
+
+static gint
+compare_move_pad (gconstpointer a, gconstpointer b)
+{
+  const KmsCompositeMixerMove *move = a;
+
+  return move->pad == b ? 0 : 1;
+}
+
+/* Must be called with layout_mutex held */
+static void
+kms_composite_mixer_queue_move (KmsCompositeMixer * self, GstPad * pad,
+    gint left, gint top, gint width, gint height, gboolean resized,
+    gboolean reveal)
+{
+  KmsCompositeMixerMove *move;
+  GSList *l;
+
+  l = g_slist_find_custom (self->priv->layout_moves, pad, compare_move_pad);
+
+  if (l != NULL) {
+    move = l->data;
+  } else {
+    move = g_slice_new0 (KmsCompositeMixerMove);
+    move->pad = g_object_ref (pad);
+    self->priv->layout_moves = g_slist_prepend (self->priv->layout_moves,
+        move);
+  }
+
+  move->left = left;
+  move->top = top;
+  move->width = width;
+  move->height = height;
+  move->resized |= resized;
+  move->reveal |= reveal;
+}
+
+static void
+kms_composite_mixer_forget_moves (KmsCompositeMixer * self, GstPad * pad)
+{
+  GSList *l;
+
+  g_mutex_lock (&self->priv->layout_mutex);
+
+  l = g_slist_find_custom (self->priv->layout_moves, pad, compare_move_pad);
+
+  if (l != NULL) {
+    kms_composite_mixer_move_free (l->data);
+    self->priv->layout_moves =
+        g_slist_delete_link (self->priv->layout_moves, l);
+  }
+
+  g_mutex_unlock (&self->priv->layout_mutex);
+}
+
+static gboolean
+kms_composite_mixer_pad_has_size (GstPad * pad, gint width, gint height)
+{
+  GstStructure *st;
+  GstCaps *caps;
+  gint w = -1, h = -1;
+
+  caps = gst_pad_get_current_caps (pad);
+
+  if (caps == NULL) {
+    return FALSE;
+  }
+
+  st = gst_caps_get_structure (caps, 0);
+  gst_structure_get_int (st, "width", &w);
+  gst_structure_get_int (st, "height", &h);
+  gst_caps_unref (caps);
+
+  return w == width && h == height;
+}
+
+/* Must be called with layout_mutex held. Returns NULL while a resized pad */
+/* is still being renegotiated, unless the layout timed out */
+static GSList *
+kms_composite_mixer_take_moves (KmsCompositeMixer * self)
+{
+  GSList *moves, *l;
+
+  if (g_get_monotonic_time () < self->priv->layout_deadline) {
+    for (l = self->priv->layout_moves; l != NULL; l = l->next) {
+      KmsCompositeMixerMove *move = l->data;
+
+      if (move->resized && !kms_composite_mixer_pad_has_size (move->pad,
+              move->width, move->height)) {
+        return NULL;
+      }
+    }
+  } else {
+    GST_WARNING_OBJECT (self, "Layout not negotiated after %d ms, applying",
+        LAYOUT_TIMEOUT);
+  }
+
+  moves = self->priv->layout_moves;
+  self->priv->layout_moves = NULL;
+  g_atomic_int_set (&self->priv->layout_pending, FALSE);
+
+  return moves;
+}
+
+/* Runs on the compositor streaming thread once an output frame has been */
+/* pushed. Nothing is aggregated until it returns, so every position set */
+/* here is picked up by the same next frame. */
+static GstPadProbeReturn
+kms_composite_mixer_layout_probe (GstPad * pad, GstPadProbeInfo * info,
+    gpointer data)
+{
+  KmsCompositeMixer *self = KMS_COMPOSITE_MIXER (data);
+  GSList *moves, *l;
+
+  if (!g_atomic_int_get (&self->priv->layout_pending)) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  g_mutex_lock (&self->priv->layout_mutex);
+  moves = kms_composite_mixer_take_moves (self);
+  g_mutex_unlock (&self->priv->layout_mutex);
+
+  for (l = moves; l != NULL; l = l->next) {
+    KmsCompositeMixerMove *move = l->data;
+
+    g_object_set (move->pad, "xpos", move->left, "ypos", move->top, NULL);
+
+    if (move->reveal) {
+      g_object_set (move->pad, "alpha", 1.0, NULL);
+    }
+  }
+
+  g_slist_free_full (moves, (GDestroyNotify) kms_composite_mixer_move_free);
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* Must be called with layout_mutex held */
+static void
+kms_composite_mixer_apply_geometry (KmsCompositeMixer * self,
+    KmsCompositeMixerData * port_data, gint left, gint top, gint width,
+    gint height)
+{
+  gboolean resized, moved;
+
+  resized = port_data->width != width || port_data->height != height;
+  moved = port_data->left != left || port_data->top != top;
+
+  GST_DEBUG_OBJECT (self, "port %d top %d left %d width %d height %d%s%s",
+      port_data->id, top, left, width, height, resized ? " resized" : "",
+      moved ? " moved" : "");
+
+  if (resized) {
+    GstCaps *filtercaps;
+
+    filtercaps =
+        gst_caps_new_simple ("video/x-raw",
+        "width", G_TYPE_INT, width, "height", G_TYPE_INT, height,
+        "pixel-aspect-ratio", GST_TYPE_FRACTION, 1, 1, NULL);
+    g_object_set (port_data->capsfilter, "caps", filtercaps, NULL);
+    gst_caps_unref (filtercaps);
+  }
+
+  /* Resized ports keep their old position until they are fed with the */
+  /* new size, so the whole layout changes on a single output frame */
+  if (port_data->left < 0) {
+    g_object_set (port_data->video_mixer_pad, "alpha", 0.0, NULL);
+  }
+
+  if (resized || moved) {
+    kms_composite_mixer_queue_move (self, port_data->video_mixer_pad, left,
+        top, width, height, resized, port_data->left < 0);
+  }
+
+  port_data->left = left;
+  port_data->top = top;
+  port_data->width = width;
+  port_data->height = height;
+}
+
 static void
 kms_composite_mixer_recalculate_sizes (gpointer data)
 {
   KmsCompositeMixer *self = KMS_COMPOSITE_MIXER (data);
-  GstCaps *filtercaps;
   gint width, height, top, left, counter, n_columns, n_rows;
   GList *l;
   GList *values = g_hash_table_get_values (self->priv->ports);
 
   if (self->priv->n_elems <= 0) {
+    g_list_free (values);
     return;
   }
 
@@ -180,6 +384,9 @@ kms_composite_mixer_recalculate_sizes (gpointer data)
   width = self->priv->output_width / n_columns;
   height = self->priv->output_height / n_rows;
 
+  /* Only ports whose tile changed are touched */
+  g_mutex_lock (&self->priv->layout_mutex);
+
   for (l = values; l != NULL; l = l->next) {
     KmsCompositeMixerData *port_data = l->data;
 
@@ -187,25 +394,22 @@ kms_composite_mixer_recalculate_sizes (gpointer data)
       continue;
     }
 
-    filtercaps =
-        gst_caps_new_simple ("video/x-raw",
-        "width", G_TYPE_INT, width, "height", G_TYPE_INT, height,
-        "pixel-aspect-ratio", GST_TYPE_FRACTION, 1, 1, NULL);
-    g_object_set (port_data->capsfilter, "caps", filtercaps, NULL);
-    gst_caps_unref (filtercaps);
-
     top = ((counter / n_columns) * height);
     left = ((counter % n_columns) * width);
-
-    g_object_set (port_data->video_mixer_pad, "xpos", left, "ypos", top,
-        "alpha", 1.0, NULL);
     counter++;
 
-    GST_DEBUG_OBJECT (self, "counter %d id_port %d ", counter, port_data->id);
-    GST_DEBUG_OBJECT (self, "top %d left %d width %d height %d", top, left,
-        width, height);
+    kms_composite_mixer_apply_geometry (self, port_data, left, top, width,
+        height);
+  }
+
+  if (self->priv->layout_moves != NULL) {
+    self->priv->layout_deadline = g_get_monotonic_time () +
+        LAYOUT_TIMEOUT * G_TIME_SPAN_MILLISECOND;
+    g_atomic_int_set (&self->priv->layout_pending, TRUE);
   }
 
+  g_mutex_unlock (&self->priv->layout_mutex);
+
   g_list_free (values);
 }
 
@@ -225,6 +429,7 @@ remove_elements_from_pipeline (KmsCompositeMixerData * port_data)
   }
 
   if (port_data->video_mixer_pad != NULL) {
+    kms_composite_mixer_forget_moves (self, port_data->video_mixer_pad);
     gst_element_release_request_pad (self->priv->videomixer,
         port_data->video_mixer_pad);
     g_object_unref (port_data->video_mixer_pad);
@@ -531,6 +736,8 @@ kms_composite_mixer_port_data_create (KmsCompositeMixer * mixer, gint id)
   data->input = FALSE;
   data->removing = FALSE;
   data->eos_managed = FALSE;
+  data->left = data->top = -1;
+  data->width = data->height = -1;
 
 
   // Link AUDIO input
@@ -659,6 +866,8 @@ kms_composite_mixer_handle_port (KmsBaseHub * mixer,
   KMS_COMPOSITE_MIXER_LOCK (self);
 
   if (self->priv->videomixer == NULL) {
+    GstPad *srcpad;
+
     self->priv->videomixer = gst_element_factory_make ("compositor", NULL);
     g_object_set (G_OBJECT (self->priv->videomixer), "background",
         1 /*black */ , "start-time-selection", 1 /*first */ ,
@@ -723,6 +932,11 @@ kms_composite_mixer_handle_port (KmsBaseHub * mixer,
     gst_element_sync_state_with_parent (self->priv->mixer_video_agnostic);
 
     gst_element_link (self->priv->videomixer, self->priv->mixer_video_agnostic);
+
+    srcpad = gst_element_get_static_pad (self->priv->videomixer, "src");
+    gst_pad_add_probe (srcpad, GST_PAD_PROBE_TYPE_BUFFER,
+        kms_composite_mixer_layout_probe, self, NULL);
+    g_object_unref (srcpad);
   }
 
   if (self->priv->audiomixer == NULL) {
@@ -783,6 +997,9 @@ kms_composite_mixer_finalize (GObject * object)
   KmsCompositeMixer *self = KMS_COMPOSITE_MIXER (object);
 
   g_rec_mutex_clear (&self->priv->mutex);
+  g_mutex_clear (&self->priv->layout_mutex);
+  g_slist_free_full (self->priv->layout_moves,
+      (GDestroyNotify) kms_composite_mixer_move_free);
 
   if (self->priv->ports != NULL) {
     g_hash_table_unref (self->priv->ports);
@@ -830,6 +1047,7 @@ kms_composite_mixer_init (KmsCompositeMixer * self)
   self->priv = KMS_COMPOSITE_MIXER_GET_PRIVATE (self);
 
   g_rec_mutex_init (&self->priv->mutex);
+  g_mutex_init (&self->priv->layout_mutex);
 
   self->priv->ports = g_hash_table_new_full (g_int_hash, g_int_equal,
       release_gint, kms_composite_mixer_port_data_destroy);
@@ -20,6 +20,7 @@
 #endif
 
 #include <gst/gst.h>
+#include <gst/app/gstappsrc.h>
 #include <commons/kmsagnosticcaps.h>
 #include <commons/kms-core-marshal.h>
 
@@ -363,8 +364,6 @@ static GstFlowReturn
 kms_http_post_endpoint_push_buffer_action (KmsHttpPostEndpoint * self,
     GstBuffer * buffer)
 {
-  GstFlowReturn ret;
-
   KMS_ELEMENT_LOCK (self);
 
   if (KMS_HTTP_ENDPOINT (self)->pipeline == NULL)
@@ -372,16 +371,14 @@ kms_http_post_endpoint_push_buffer_action (KmsHttpPostEndpoint * self,
 
   KMS_ELEMENT_UNLOCK (self);
 
-  g_signal_emit_by_name (self->priv->appsrc, "push-buffer", buffer, &ret);
-
-  return ret;
+  /* Called for every received chunk, avoid another signal emission */
+  return gst_app_src_push_buffer (GST_APP_SRC (self->priv->appsrc),
+      gst_buffer_ref (buffer));
 }
 
 static GstFlowReturn
 kms_http_post_endpoint_end_of_stream_action (KmsHttpPostEndpoint * self)
 {
-  GstFlowReturn ret;
-
   KMS_ELEMENT_LOCK (self);
 
   if (KMS_HTTP_ENDPOINT (self)->pipeline == NULL) {
@@ -393,9 +390,7 @@ kms_http_post_endpoint_end_of_stream_action (KmsHttpPostEndpoint * self)
 
   KMS_ELEMENT_UNLOCK (self);
 
-  g_signal_emit_by_name (self->priv->appsrc, "end-of-stream", &ret);
-
-  return ret;
+  return gst_app_src_end_of_stream (GST_APP_SRC (self->priv->appsrc));
 }
 
 static void
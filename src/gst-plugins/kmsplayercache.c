@@ -0,0 +1,593 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "kmsplayercache.h"
+#include <glib/gstdio.h>
+#include <gst/app/gstappsink.h>
+#include <commons/kmsloop.h>
+#include <commons/kmsagnosticcaps.h>
+
+#define GST_DEFAULT_NAME "playercache"
+#define GST_CAT_DEFAULT kms_player_cache_debug_category
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+
+#define STREAM_KEY "kms-player-cache-stream"
+G_DEFINE_QUARK (STREAM_KEY, stream);
+
+typedef struct _KmsPlayerClipSample
+{
+  guint stream;
+  GstClockTime offset;
+  GstSample *sample;
+} KmsPlayerClipSample;
+
+struct _KmsPlayerClip
+{
+  gint ref;
+  gchar *key;
+  GPtrArray *caps;              /* <GstCaps> per stream */
+  GArray *samples;              /* <KmsPlayerClipSample> */
+  GstClockTime duration;
+  gsize size;
+  GList link;                   /* in the LRU list, protected by the mutex */
+};
+
+typedef struct _KmsPlayerClipLoader
+{
+  gchar *key;
+  GstElement *pipeline;
+
+  /* Appsinks of all streams append to the same clip */
+  GMutex mutex;
+  KmsPlayerClip *clip;
+  guint n_streams;
+  gboolean done;
+  gboolean complete;
+} KmsPlayerClipLoader;
+
+static GMutex cache_mutex;
+static guint64 max_size = 0;
+static guint64 cache_size = 0;
+static GHashTable *clips = NULL;        /* key -> KmsPlayerClip */
+static GQueue lru = G_QUEUE_INIT;       /* most recently used first */
+static GHashTable *loaders = NULL;      /* key -> KmsPlayerClipLoader */
+
+/* Loading pipelines are torn down here, never from their own threads */
+static KmsLoop *loop = NULL;
+
+static void
+kms_player_cache_init (void)
+{
+  if (clips != NULL) {
+    return;
+  }
+
+  GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+      GST_DEFAULT_NAME);
+  clips = g_hash_table_new (g_str_hash, g_str_equal);
+  loaders = g_hash_table_new (g_str_hash, g_str_equal);
+}
+
+static gchar *
+kms_player_cache_get_key (const gchar * uri)
+{
+  GStatBuf st;
+  gchar *filename;
+  gchar *key;
+
+  /* A changed file must never be served from memory */
+  filename = g_filename_from_uri (uri, NULL, NULL);
+
+  if (filename == NULL) {
+    return NULL;
+  }
+
+  if (g_stat (filename, &st) != 0 || !S_ISREG (st.st_mode)) {
+    g_free (filename);
+    return NULL;
+  }
+
+  key = g_strdup_printf ("%s|%" G_GINT64_FORMAT "|%" G_GINT64_FORMAT, uri,
+      (gint64) st.st_mtime, (gint64) st.st_size);
+  g_free (filename);
+
+  return key;
+}
+
+static KmsPlayerClip *
+kms_player_clip_new (gchar * key)
+{
+  KmsPlayerClip *clip = g_slice_new0 (KmsPlayerClip);
+
+  clip->ref = 1;
+  clip->key = key;
+  clip->caps = g_ptr_array_new_with_free_func ((GDestroyNotify) gst_caps_unref);
+  clip->samples = g_array_new (FALSE, FALSE, sizeof (KmsPlayerClipSample));
+  clip->link.data = clip;
+
+  return clip;
+}
+
+KmsPlayerClip *
+kms_player_clip_ref (KmsPlayerClip * clip)
+{
+  g_atomic_int_inc (&clip->ref);
+
+  return clip;
+}
+
+void
+kms_player_clip_unref (KmsPlayerClip * clip)
+{
+  guint i;
+
+  if (!g_atomic_int_dec_and_test (&clip->ref)) {
+    return;
+  }
+
+  for (i = 0; i < clip->samples->len; i++) {
+    gst_sample_unref (g_array_index (clip->samples, KmsPlayerClipSample,
+            i).sample);
+  }
+
+  g_array_free (clip->samples, TRUE);
+  g_ptr_array_unref (clip->caps);
+  g_free (clip->key);
+
+  g_slice_free (KmsPlayerClip, clip);
+}
+
+/* Call with the mutex held */
+static void
+kms_player_cache_evict (guint64 size)
+{
+  GList *l;
+
+  while (cache_size > size && (l = g_queue_pop_tail_link (&lru)) != NULL) {
+    KmsPlayerClip *clip = l->data;
+
+    GST_DEBUG ("Evicting %s (%" G_GSIZE_FORMAT " bytes)", clip->key,
+        clip->size);
+    g_hash_table_remove (clips, clip->key);
+    cache_size -= clip->size;
+    kms_player_clip_unref (clip);
+  }
+}
+
+void
+kms_player_cache_request_size (guint64 size)
+{
+  g_mutex_lock (&cache_mutex);
+
+  kms_player_cache_init ();
+
+  if (size > max_size) {
+    GST_INFO ("Cache limit raised to %" G_GUINT64_FORMAT " bytes", size);
+    max_size = size;
+  }
+
+  g_mutex_unlock (&cache_mutex);
+}
+
+static gint
+compare_samples (gconstpointer a, gconstpointer b)
+{
+  const KmsPlayerClipSample *sa = a;
+  const KmsPlayerClipSample *sb = b;
+
+  if (sa->offset != sb->offset) {
+    return sa->offset < sb->offset ? -1 : 1;
+  }
+
+  return 0;
+}
+
+static gboolean
+kms_player_cache_finish_load (KmsPlayerClipLoader * loader)
+{
+  KmsPlayerClip *clip = NULL;
+  GstClockTime first = GST_CLOCK_TIME_NONE;
+  GstBus *bus;
+  guint i;
+
+  gst_element_set_state (loader->pipeline, GST_STATE_NULL);
+
+  bus = gst_pipeline_get_bus (GST_PIPELINE (loader->pipeline));
+  gst_bus_set_sync_handler (bus, NULL, NULL, NULL);
+  g_object_unref (bus);
+
+  if (loader->complete && loader->clip->samples->len > 0) {
+    clip = loader->clip;
+    loader->clip = NULL;
+  }
+
+  if (clip != NULL) {
+    /* Offsets are relative to the first sample of any stream */
+    for (i = 0; i < clip->samples->len; i++) {
+      first = MIN (first, g_array_index (clip->samples, KmsPlayerClipSample,
+              i).offset);
+    }
+
+    for (i = 0; i < clip->samples->len; i++) {
+      KmsPlayerClipSample *s =
+          &g_array_index (clip->samples, KmsPlayerClipSample, i);
+
+      s->offset -= first;
+      clip->duration = MAX (clip->duration, s->offset);
+    }
+
+    /* g_array_sort is a merge sort, streams keep their own order */
+    g_array_sort (clip->samples, compare_samples);
+  }
+
+  g_mutex_lock (&cache_mutex);
+
+  g_hash_table_remove (loaders, loader->key);
+
+  if (clip != NULL && clip->size <= max_size &&
+      !g_hash_table_contains (clips, clip->key)) {
+    GST_INFO ("Cached %s: %u samples, %" G_GSIZE_FORMAT " bytes", clip->key,
+        clip->samples->len, clip->size);
+    kms_player_cache_evict (max_size - clip->size);
+    g_hash_table_insert (clips, clip->key, clip);
+    g_queue_push_head_link (&lru, &clip->link);
+    cache_size += clip->size;
+    clip = NULL;
+  } else {
+    GST_DEBUG ("Not caching %s", loader->key);
+  }
+
+  g_mutex_unlock (&cache_mutex);
+
+  if (clip != NULL) {
+    kms_player_clip_unref (clip);
+  }
+
+  if (loader->clip != NULL) {
+    kms_player_clip_unref (loader->clip);
+  }
+
+  gst_object_unref (loader->pipeline);
+  g_mutex_clear (&loader->mutex);
+  g_free (loader->key);
+  g_slice_free (KmsPlayerClipLoader, loader);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Call with the loader mutex held */
+static void
+kms_player_cache_done (KmsPlayerClipLoader * loader, gboolean complete)
+{
+  if (loader->done) {
+    return;
+  }
+
+  loader->done = TRUE;
+  loader->complete = complete;
+  kms_loop_idle_add_full (loop, G_PRIORITY_DEFAULT,
+      (GSourceFunc) kms_player_cache_finish_load, loader, NULL);
+}
+
+static GstFlowReturn
+appsink_new_sample_cb (GstAppSink * appsink, gpointer user_data)
+{
+  KmsPlayerClipLoader *loader = user_data;
+  KmsPlayerClipSample s;
+  GstBuffer *buffer;
+  guint64 limit;
+
+  s.sample = gst_app_sink_pull_sample (appsink);
+
+  if (s.sample == NULL) {
+    return GST_FLOW_OK;
+  }
+
+  buffer = gst_sample_get_buffer (s.sample);
+  s.stream = GPOINTER_TO_UINT (g_object_get_qdata (G_OBJECT (appsink),
+          stream_quark ())) - 1;
+  s.offset = GST_BUFFER_PTS_IS_VALID (buffer) ? GST_BUFFER_PTS (buffer) :
+      GST_BUFFER_DTS (buffer);
+
+  g_mutex_lock (&cache_mutex);
+  limit = max_size;
+  g_mutex_unlock (&cache_mutex);
+
+  g_mutex_lock (&loader->mutex);
+
+  if (loader->done) {
+    g_mutex_unlock (&loader->mutex);
+    gst_sample_unref (s.sample);
+    return GST_FLOW_EOS;
+  }
+
+  if (!GST_CLOCK_TIME_IS_VALID (s.offset)) {
+    /* It could not be paced */
+    GST_WARNING_OBJECT (appsink, "Sample without timestamp, not caching");
+    kms_player_cache_done (loader, FALSE);
+  } else if (loader->clip->size + gst_buffer_get_size (buffer) > limit) {
+    GST_DEBUG_OBJECT (appsink, "Clip does not fit in the cache");
+    kms_player_cache_done (loader, FALSE);
+  } else {
+    if (loader->clip->caps->len <= s.stream) {
+      g_ptr_array_set_size (loader->clip->caps, s.stream + 1);
+    }
+
+    if (g_ptr_array_index (loader->clip->caps, s.stream) == NULL) {
+      g_ptr_array_index (loader->clip->caps, s.stream) =
+          gst_caps_ref (gst_sample_get_caps (s.sample));
+    }
+
+    loader->clip->size += gst_buffer_get_size (buffer);
+    g_array_append_val (loader->clip->samples, s);
+    s.sample = NULL;
+  }
+
+  g_mutex_unlock (&loader->mutex);
+
+  if (s.sample != NULL) {
+    gst_sample_unref (s.sample);
+    return GST_FLOW_EOS;
+  }
+
+  return GST_FLOW_OK;
+}
+
+static void
+kms_player_cache_pad_added (GstElement * uridecodebin, GstPad * pad,
+    KmsPlayerClipLoader * loader)
+{
+  GstAppSinkCallbacks callbacks = { NULL };
+  GstElement *appsink;
+  GstPad *sinkpad;
+  guint stream;
+
+  g_mutex_lock (&loader->mutex);
+  stream = loader->n_streams++;
+  g_mutex_unlock (&loader->mutex);
+
+  /* Not synchronized, the file is read as fast as possible */
+  appsink = gst_element_factory_make ("appsink", NULL);
+  g_object_set (appsink, "enable-last-sample", FALSE, "emit-signals", FALSE,
+      "qos", FALSE, "sync", FALSE, "async", FALSE, NULL);
+  g_object_set_qdata (G_OBJECT (appsink), stream_quark (),
+      GUINT_TO_POINTER (stream + 1));
+
+  callbacks.new_sample = appsink_new_sample_cb;
+  gst_app_sink_set_callbacks (GST_APP_SINK (appsink), &callbacks, loader,
+      NULL);
+
+  gst_bin_add (GST_BIN (loader->pipeline), appsink);
+
+  sinkpad = gst_element_get_static_pad (appsink, "sink");
+  gst_pad_link (pad, sinkpad);
+  g_object_unref (sinkpad);
+
+  gst_element_sync_state_with_parent (appsink);
+}
+
+static GstBusSyncReply
+kms_player_cache_bus_sync_handler (GstBus * bus, GstMessage * msg,
+    gpointer data)
+{
+  KmsPlayerClipLoader *loader = data;
+
+  if (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_EOS ||
+      GST_MESSAGE_TYPE (msg) == GST_MESSAGE_ERROR) {
+    GST_DEBUG_OBJECT (loader->pipeline, "Load finished: %" GST_PTR_FORMAT,
+        msg);
+    g_mutex_lock (&loader->mutex);
+    kms_player_cache_done (loader, GST_MESSAGE_TYPE (msg) == GST_MESSAGE_EOS);
+    g_mutex_unlock (&loader->mutex);
+  }
+
+  return GST_BUS_DROP;
+}
+
+/* Call with the mutex held */
+static KmsPlayerClipLoader *
+kms_player_cache_load (gchar * key, const gchar * uri)
+{
+  KmsPlayerClipLoader *loader;
+  GstElement *uridecodebin;
+  GstCaps *deco_caps;
+  GstBus *bus;
+
+  if (loop == NULL) {
+    loop = kms_loop_new ();
+  }
+
+  loader = g_slice_new0 (KmsPlayerClipLoader);
+  loader->key = key;
+  loader->clip = kms_player_clip_new (g_strdup (key));
+  g_mutex_init (&loader->mutex);
+
+  loader->pipeline = gst_pipeline_new ("cachepipeline");
+  uridecodebin = gst_element_factory_make ("uridecodebin", NULL);
+
+  /* Only parse and demux, agnosticbin transcodes if consumers need it */
+  deco_caps = gst_caps_from_string (KMS_AGNOSTIC_NO_RTP_CAPS);
+  g_object_set (uridecodebin, "uri", uri, "caps", deco_caps, NULL);
+  gst_caps_unref (deco_caps);
+
+  g_signal_connect (uridecodebin, "pad-added",
+      G_CALLBACK (kms_player_cache_pad_added), loader);
+  gst_bin_add (GST_BIN (loader->pipeline), uridecodebin);
+
+  bus = gst_pipeline_get_bus (GST_PIPELINE (loader->pipeline));
+  gst_bus_set_sync_handler (bus, kms_player_cache_bus_sync_handler, loader,
+      NULL);
+  g_object_unref (bus);
+
+  g_hash_table_insert (loaders, loader->key, loader);
+
+  GST_DEBUG_OBJECT (loader->pipeline, "Loading %s", key);
+
+  return loader;
+}
+
+static void
+kms_player_cache_start (KmsPlayerClipLoader * loader)
+{
+  if (gst_element_set_state (loader->pipeline,
+          GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+    g_mutex_lock (&loader->mutex);
+    kms_player_cache_done (loader, FALSE);
+    g_mutex_unlock (&loader->mutex);
+  }
+}
+
+KmsPlayerClip *
+kms_player_cache_lookup (const gchar * uri)
+{
+  KmsPlayerClipLoader *loader = NULL;
+  KmsPlayerClip *clip;
+  gchar *key;
+
+  g_return_val_if_fail (uri != NULL, NULL);
+
+  key = kms_player_cache_get_key (uri);
+
+  if (key == NULL) {
+    return NULL;
+  }
+
+  g_mutex_lock (&cache_mutex);
+
+  kms_player_cache_init ();
+
+  if (max_size == 0) {
+    g_mutex_unlock (&cache_mutex);
+    g_free (key);
+    return NULL;
+  }
+
+  clip = g_hash_table_lookup (clips, key);
+
+  if (clip != NULL) {
+    g_queue_unlink (&lru, &clip->link);
+    g_queue_push_head_link (&lru, &clip->link);
+    kms_player_clip_ref (clip);
+    g_free (key);
+  } else if (!g_hash_table_contains (loaders, key)) {
+    loader = kms_player_cache_load (key, uri);
+  } else {
+    g_free (key);
+  }
+
+  g_mutex_unlock (&cache_mutex);
+
+  if (loader != NULL) {
+    kms_player_cache_start (loader);
+  }
+
+  return clip;
+}
+
+guint
+kms_player_clip_get_n_streams (KmsPlayerClip * clip)
+{
+  return clip->caps->len;
+}
+
+GstCaps *
+kms_player_clip_get_caps (KmsPlayerClip * clip, guint stream)
+{
+  g_return_val_if_fail (stream < clip->caps->len, NULL);
+
+  return g_ptr_array_index (clip->caps, stream);
+}
+
+GstClockTime
+kms_player_clip_get_duration (KmsPlayerClip * clip)
+{
+  return clip->duration;
+}
+
+gsize
+kms_player_clip_get_size (KmsPlayerClip * clip)
+{
+  return clip->size;
+}
+
+guint
+kms_player_clip_get_n_samples (KmsPlayerClip * clip)
+{
+  return clip->samples->len;
+}
+
+GstSample *
+kms_player_clip_get_sample (KmsPlayerClip * clip, guint index, guint * stream,
+    GstClockTime * offset)
+{
+  KmsPlayerClipSample *s;
+
+  g_return_val_if_fail (index < clip->samples->len, NULL);
+
+  s = &g_array_index (clip->samples, KmsPlayerClipSample, index);
+
+  if (stream != NULL) {
+    *stream = s->stream;
+  }
+
+  if (offset != NULL) {
+    *offset = s->offset;
+  }
+
+  return s->sample;
+}
+
+static gboolean
+kms_player_clip_is_key_unit (KmsPlayerClip * clip, guint index)
+{
+  KmsPlayerClipSample *s =
+      &g_array_index (clip->samples, KmsPlayerClipSample, index);
+  GstStructure *st;
+
+  if (GST_BUFFER_FLAG_IS_SET (gst_sample_get_buffer (s->sample),
+          GST_BUFFER_FLAG_DELTA_UNIT)) {
+    return FALSE;
+  }
+
+  st = gst_caps_get_structure (gst_sample_get_caps (s->sample), 0);
+
+  return g_str_has_prefix (gst_structure_get_name (st), "video/");
+}
+
+guint
+kms_player_clip_find_position (KmsPlayerClip * clip, GstClockTime position)
+{
+  guint index = 0, i;
+
+  while (index < clip->samples->len &&
+      g_array_index (clip->samples, KmsPlayerClipSample,
+          index).offset <= position) {
+    index++;
+  }
+
+  /* Video must be resumed from the last key frame before the position */
+  for (i = index; i > 0; i--) {
+    if (kms_player_clip_is_key_unit (clip, i - 1)) {
+      return i - 1;
+    }
+  }
+
+  return index > 0 ? index - 1 : 0;
+}
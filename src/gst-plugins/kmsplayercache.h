@@ -0,0 +1,62 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef _KMS_PLAYER_CACHE_H_
+#define _KMS_PLAYER_CACHE_H_
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Process-wide LRU cache of demuxed, still encoded, local clips, keyed by
+ * URI, modification time and size. A clip missing from the cache is
+ * loaded in the background, as fast as possible, by a pipeline that only
+ * parses and demuxes the file; clips that do not fit in the memory limit
+ * are not kept. Clips are immutable and reference counted, so evicting a
+ * clip does not affect the players using it.
+ */
+typedef struct _KmsPlayerClip KmsPlayerClip;
+
+/*
+ * Raises the memory limit of the cache to @size. Players ask for their own
+ * budget, and the cache is as large as the biggest one; it is never lowered,
+ * so no player can shrink the cache others rely on.
+ */
+void kms_player_cache_request_size (guint64 size);
+
+/* Returns a new reference, or NULL after starting to load the clip */
+KmsPlayerClip * kms_player_cache_lookup (const gchar * uri);
+
+KmsPlayerClip * kms_player_clip_ref (KmsPlayerClip * clip);
+void kms_player_clip_unref (KmsPlayerClip * clip);
+
+guint kms_player_clip_get_n_streams (KmsPlayerClip * clip);
+GstCaps * kms_player_clip_get_caps (KmsPlayerClip * clip, guint stream);
+GstClockTime kms_player_clip_get_duration (KmsPlayerClip * clip);
+gsize kms_player_clip_get_size (KmsPlayerClip * clip);
+
+/* Samples are sorted by their offset from the start of the clip */
+guint kms_player_clip_get_n_samples (KmsPlayerClip * clip);
+GstSample * kms_player_clip_get_sample (KmsPlayerClip * clip, guint index,
+    guint * stream, GstClockTime * offset);
+
+/* Index of the sample to start from to play at @position */
+guint kms_player_clip_find_position (KmsPlayerClip * clip,
+    GstClockTime position);
+
+G_END_DECLS
+#endif /* _KMS_PLAYER_CACHE_H_ */
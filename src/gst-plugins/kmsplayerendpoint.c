@@ -24,7 +24,11 @@
 #include <commons/kmselement.h>
 #include <commons/kmsagnosticcaps.h>
 #include "kmsplayerendpoint.h"
+#include "kmsplayersource.h"
+#include "kmsplayercache.h"
+#include "kmsplayerindex.h"
 #include <commons/kmsloop.h>
+#include "commons/kmsloopshards.h"
 #include <kms-elements-marshal.h>
 
 #include <gst/app/gstappsrc.h>
@@ -44,8 +48,12 @@ G_DEFINE_QUARK (APPSINK_KEY, appsink);
 #define PTS_KEY "pts-key"
 G_DEFINE_QUARK (PTS_KEY, pts);
 
+#define REUSED_APPSRC_KEY "reused-appsrc-key"
+G_DEFINE_QUARK (REUSED_APPSRC_KEY, reused_appsrc);
+
 #define NETWORK_CACHE_DEFAULT 2000
 #define PORT_RANGE_DEFAULT "0-0"
+#define SYNC_DEFAULT TRUE
 #define IS_PREROLL TRUE
 
 GST_DEBUG_CATEGORY_STATIC (kms_player_endpoint_debug_category);
@@ -69,6 +77,19 @@ GST_DEBUG_CATEGORY_STATIC (kms_player_endpoint_debug_category);
 
 typedef void (*KmsActionFunc) (gpointer user_data);
 
+typedef struct _KmsPlayerClipFeeder KmsPlayerClipFeeder;
+
+typedef struct _KmsPlayerSeekStats
+{
+  guint count;
+  guint coalesced;
+  guint skipped;
+  guint measured;
+  GstClockTime last_latency;
+  GstClockTime total_latency;
+  GstClockTime max_latency;
+} KmsPlayerSeekStats;
+
 typedef struct _KmsPlayerStats
 {
   gboolean enabled;
@@ -82,9 +103,11 @@ struct _KmsPlayerEndpointPrivate
   GstElement *pipeline;
   GstElement *uridecodebin;
   KmsLoop *loop;
+  guint loop_shard;
   gboolean use_encoded_media;
   gint network_cache;
   gchar *port_range;
+  gboolean sync;
 
   GMutex base_time_mutex;
   gboolean reset;
@@ -92,6 +115,36 @@ struct _KmsPlayerEndpointPrivate
   GstClockTime base_time_preroll;
 
   KmsPlayerStats stats;
+
+  /* Shared source mode */
+  gboolean shared_source;
+  GMutex source_mutex;
+  KmsPlayerSource *source;
+  GHashTable *shared_streams;   /* <GstAppSink, KmsPlayerSharedStream> */
+
+  /* Clip cache mode, protected by the source mutex */
+  guint64 clip_cache_size;
+  KmsPlayerClip *clip;
+  KmsPlayerClipFeeder *feeder;
+  GstClockTime clip_position;
+
+  /* Seeks of the internal pipeline */
+  GMutex seek_mutex;
+  KmsPlayerIndex *index;
+  gboolean seeking;             /* until the pipeline prerolls again */
+  gint64 pending_position;
+  gboolean pending_accurate;
+  GstClockTime seek_keyframe;
+  gint64 seek_start;
+  gint measuring;               /* atomic, waiting for the first sample */
+  KmsPlayerSeekStats seek_stats;
+
+  /* Playlist, the next item is prerolled while the current one plays */
+  GRecMutex playlist_mutex;
+  GQueue playlist;              /* <gchar *> URIs not prerolled yet */
+  GstElement *next_pipeline;
+  GstElement *next_uridecodebin;
+  gchar *next_uri;
 };
 
 enum
@@ -103,6 +156,9 @@ enum
   PROP_NETWORK_CACHE,
   PROP_PORT_RANGE,
   PROP_PIPELINE,
+  PROP_SHARED_SOURCE,
+  PROP_CLIP_CACHE_SIZE,
+  PROP_SYNC,
   N_PROPERTIES
 };
 
@@ -112,6 +168,7 @@ enum
   SIGNAL_INVALID_URI,
   SIGNAL_INVALID_MEDIA,
   SIGNAL_SET_POSITION,
+  SIGNAL_ENQUEUE_URI,
   LAST_SIGNAL
 };
 
@@ -132,8 +189,27 @@ typedef struct _KmsPtsData
   GstClockTime last_pts;
   GstClockTime last_pts_orig;
   gboolean pts_handled;
+
+  /* Encoded video streams of the internal pipeline feed the key frame index */
+  gboolean index_keyframes;
+  GstClockTime last_keyframe;
+
+  /* Stream state cached for every buffer pushed, instead of looked up */
+  KmsPlayerEndpoint *self;
+  GstAppSrc *appsrc;
+  GstElement *appsink;          /* upstream of the appsrc, if any */
+  gint eos;                     /* atomic, an EOS went out of the appsrc */
 } KmsPtsData;
 
+/*
+ * Internal bus messages (EOS and errors) are dispatched from a process-wide
+ * set of loops, one per CPU core, instead of one dedicated thread for each
+ * player. Every player keeps the same loop for its whole life, so its
+ * signals are still emitted in order. Only this loop is shared: the
+ * streaming threads of the internal pipeline still belong to each player.
+ */
+static KmsLoopShards player_loops = KMS_LOOP_SHARDS_INIT ("player");
+
 static void
 kms_pts_data_destroy (gpointer data)
 {
@@ -152,6 +228,7 @@ kms_pts_data_new ()
   data->last_pts = GST_CLOCK_TIME_NONE;
   data->last_pts_orig = GST_CLOCK_TIME_NONE;
   data->pts_handled = FALSE;
+  data->last_keyframe = GST_CLOCK_TIME_NONE;
 
   return data;
 }
@@ -163,6 +240,28 @@ kms_pts_data_reset (KmsPtsData * data)
   data->last_pts_orig = GST_CLOCK_TIME_NONE;
 }
 
+/* Branch of this player for a stream of a shared source */
+typedef struct _KmsPlayerSharedStream
+{
+  GstAppSrc *appsrc;
+  KmsPtsData *pts_data;
+  GstCaps *caps;
+} KmsPlayerSharedStream;
+
+static void
+kms_player_shared_stream_destroy (gpointer data)
+{
+  KmsPlayerSharedStream *shared = data;
+
+  kms_pts_data_destroy (shared->pts_data);
+  gst_caps_replace (&shared->caps, NULL);
+
+  g_slice_free (KmsPlayerSharedStream, shared);
+}
+
+static gboolean kms_player_endpoint_query_clip (KmsPlayerEndpoint * self,
+    gint64 * position, gint64 * duration);
+
 static void
 kms_player_endpoint_disable_decoding (KmsPlayerEndpoint * self)
 {
@@ -201,6 +300,18 @@ kms_player_endpoint_set_property (GObject * object, guint property_id,
       g_free (playerendpoint->priv->port_range);
       playerendpoint->priv->port_range = g_value_dup_string (value);
       break;
+    case PROP_SHARED_SOURCE:
+      playerendpoint->priv->shared_source = g_value_get_boolean (value);
+      break;
+    case PROP_CLIP_CACHE_SIZE:
+      playerendpoint->priv->clip_cache_size = g_value_get_uint64 (value);
+      if (playerendpoint->priv->clip_cache_size > 0) {
+        kms_player_cache_request_size (playerendpoint->priv->clip_cache_size);
+      }
+      break;
+    case PROP_SYNC:
+      playerendpoint->priv->sync = g_value_get_boolean (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -224,7 +335,21 @@ kms_player_endpoint_get_property (GObject * object, guint property_id,
       gboolean seekable = FALSE;
       GstFormat format;
       GstStructure *video_data = NULL;
-      GstQuery *query = gst_query_new_seeking (GST_FORMAT_TIME);
+      GstQuery *query;
+
+      if (kms_player_endpoint_query_clip (playerendpoint, NULL, &duration)) {
+        /* Cached clips are always seekable */
+        video_data = gst_structure_new ("video_data",
+            "isSeekable", G_TYPE_BOOLEAN, TRUE,
+            "seekableInit", G_TYPE_INT64, G_GINT64_CONSTANT (0),
+            "seekableEnd", G_TYPE_INT64, duration,
+            "duration", G_TYPE_INT64, duration, NULL);
+
+        g_value_take_boxed (value, video_data);
+        break;
+      }
+
+      query = gst_query_new_seeking (GST_FORMAT_TIME);
 
       if (gst_element_query (playerendpoint->priv->pipeline, query)) {
         gst_query_parse_seeking (query,
@@ -255,7 +380,9 @@ kms_player_endpoint_get_property (GObject * object, guint property_id,
       gint64 position = -1;
       gboolean ret = FALSE;
 
-      if (playerendpoint->priv->pipeline != NULL) {
+      if (kms_player_endpoint_query_clip (playerendpoint, &position, NULL)) {
+        ret = TRUE;
+      } else if (playerendpoint->priv->pipeline != NULL) {
         ret = gst_element_query_position (playerendpoint->priv->pipeline,
             GST_FORMAT_TIME, &position);
       }
@@ -277,6 +404,15 @@ kms_player_endpoint_get_property (GObject * object, guint property_id,
     case PROP_PORT_RANGE:
       g_value_set_string (value, playerendpoint->priv->port_range);
       break;
+    case PROP_SHARED_SOURCE:
+      g_value_set_boolean (value, playerendpoint->priv->shared_source);
+      break;
+    case PROP_CLIP_CACHE_SIZE:
+      g_value_set_uint64 (value, playerendpoint->priv->clip_cache_size);
+      break;
+    case PROP_SYNC:
+      g_value_set_boolean (value, playerendpoint->priv->sync);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -334,23 +470,35 @@ kms_player_endpoint_enable_latency_probe (KmsPlayerEndpoint * self)
   g_object_unref (pad);
 }
 
+static void kms_player_endpoint_detach_source (KmsPlayerEndpoint * self);
+static void kms_player_endpoint_release_clip (KmsPlayerEndpoint * self);
+static void kms_player_endpoint_reset_seeks (KmsPlayerEndpoint * self);
+static void kms_player_endpoint_discard_next (KmsPlayerEndpoint * self);
+static void kms_player_endpoint_preroll_next (KmsPlayerEndpoint * self);
+static void kms_player_endpoint_acquire_index (KmsPlayerEndpoint * self,
+    const gchar * uri);
+static GstElement *kms_player_endpoint_create_pipeline (KmsPlayerEndpoint *
+    self, const gchar * name, GstElement ** uridecodebin);
+static void kms_player_endpoint_destroy_pipeline (GstElement * pipeline);
+
 static void
 kms_player_endpoint_dispose (GObject * object)
 {
   KmsPlayerEndpoint *self = KMS_PLAYER_ENDPOINT (object);
 
-  g_clear_object (&self->priv->loop);
+  kms_player_endpoint_detach_source (self);
+  kms_player_endpoint_release_clip (self);
+  kms_player_endpoint_reset_seeks (self);
+  kms_player_endpoint_discard_next (self);
 
-  if (self->priv->pipeline != NULL) {
-    GstBus *bus;
-
-    bus = gst_pipeline_get_bus (GST_PIPELINE (self->priv->pipeline));
-    gst_bus_set_sync_handler (bus, NULL, NULL, NULL);
-    gst_bus_remove_watch(bus);
-    g_object_unref (bus);
+  if (self->priv->loop != NULL) {
+    kms_loop_shards_release (&player_loops, self->priv->loop,
+        self->priv->loop_shard);
+    self->priv->loop = NULL;
+  }
 
-    gst_element_set_state (self->priv->pipeline, GST_STATE_NULL);
-    gst_object_unref (GST_OBJECT (self->priv->pipeline));
+  if (self->priv->pipeline != NULL) {
+    kms_player_endpoint_destroy_pipeline (self->priv->pipeline);
     self->priv->pipeline = NULL;
   }
 
@@ -367,6 +515,12 @@ kms_player_endpoint_finalize (GObject * object)
   GST_DEBUG_OBJECT (self, "finalize");
 
   g_mutex_clear (&self->priv->base_time_mutex);
+  g_mutex_clear (&self->priv->source_mutex);
+  g_mutex_clear (&self->priv->seek_mutex);
+  g_rec_mutex_clear (&self->priv->playlist_mutex);
+  g_queue_foreach (&self->priv->playlist, (GFunc) g_free, NULL);
+  g_queue_clear (&self->priv->playlist);
+  g_hash_table_unref (self->priv->shared_streams);
   g_clear_object (&self->priv->stats.src);
   kms_list_unref (self->priv->stats.probes);
 
@@ -427,6 +581,17 @@ kms_player_endpoint_reset_base_time (KmsPlayerEndpoint * self)
   BASE_TIME_UNLOCK (self);
 }
 
+/* For sources that never preroll, the reset can not wait for it */
+static void
+kms_player_endpoint_clear_base_time (KmsPlayerEndpoint * self)
+{
+  BASE_TIME_LOCK (self);
+  self->priv->base_time_preroll = GST_CLOCK_TIME_NONE;
+  self->priv->base_time = GST_CLOCK_TIME_NONE;
+  self->priv->reset = FALSE;
+  BASE_TIME_UNLOCK (self);
+}
+
 static void
 kms_player_endpoint_mark_reset_base_time (KmsPlayerEndpoint * self)
 {
@@ -435,58 +600,76 @@ kms_player_endpoint_mark_reset_base_time (KmsPlayerEndpoint * self)
   BASE_TIME_UNLOCK (self);
 }
 
-static GstStateChangeReturn
-kms_player_endpoint_mark_reset_base_time_and_set_state (KmsPlayerEndpoint *
-    self, GstState state)
+static void
+set_appsrc_flushing (const GValue * item, gpointer flushing)
 {
-  kms_player_endpoint_mark_reset_base_time (self);
+  GstElement *element = g_value_get_object (item);
+  GstPad *pad;
+
+  if (!GST_IS_APP_SRC (element)) {
+    return;
+  }
 
-  return gst_element_set_state (self->priv->pipeline, state);
+  pad = gst_element_get_static_pad (element, "src");
+  gst_pad_send_event (pad, GPOINTER_TO_INT (flushing) ?
+      gst_event_new_flush_start () : gst_event_new_flush_stop (FALSE));
+  g_object_unref (pad);
 }
 
-static GstFlowReturn
-process_sample (GstAppSink * appsink, GstAppSrc * appsrc, GstSample * sample,
-    gboolean is_preroll)
+/* Without sync, appsrcs block the internal pipeline while downstream is */
+/* busy. Its streaming threads must be released to change its state */
+static void
+kms_player_endpoint_set_appsrcs_flushing (KmsPlayerEndpoint * self,
+    gboolean flushing)
 {
-  KmsPlayerEndpoint *self = KMS_PLAYER_ENDPOINT (GST_ELEMENT_PARENT (appsrc));
-  KmsPtsData *pts_data;
-  GstBuffer *buffer = NULL;
-  GstPad *src, *sink;
-  GstClockTime pts_orig, base_time, offset_time;
-  GstFlowReturn ret = GST_FLOW_OK;
-  gint64 diff;
+  GstIterator *it;
 
-  if (sample == NULL) {
-    GST_ERROR_OBJECT (appsink, "Cannot get sample");
-    return GST_FLOW_OK;
+  if (self->priv->sync) {
+    return;
   }
 
-  if (gst_sample_get_buffer_list (sample) != NULL) {
-    GST_ERROR_OBJECT (appsink, "BufferList not supported");
-    g_warning ("BufferList not supported");
-  }
+  it = gst_bin_iterate_elements (GST_BIN (self));
 
-  buffer = gst_sample_get_buffer (sample);
-  if (buffer == NULL) {
-    GST_ERROR_OBJECT (appsink, "Cannot get buffer");
-    goto end;
+  while (gst_iterator_foreach (it, set_appsrc_flushing,
+          GINT_TO_POINTER (flushing)) == GST_ITERATOR_RESYNC) {
+    gst_iterator_resync (it);
   }
 
-  gst_buffer_ref (buffer);
-  buffer = gst_buffer_make_writable (buffer);
+  gst_iterator_free (it);
+}
+
+static GstStateChangeReturn
+kms_player_endpoint_mark_reset_base_time_and_set_state (KmsPlayerEndpoint *
+    self, GstState state)
+{
+  GstStateChangeReturn ret;
+
+  kms_player_endpoint_mark_reset_base_time (self);
+
+  kms_player_endpoint_set_appsrcs_flushing (self, TRUE);
+  ret = gst_element_set_state (self->priv->pipeline, state);
+  kms_player_endpoint_set_appsrcs_flushing (self, FALSE);
 
-  pts_data =
-      (KmsPtsData *) g_object_get_qdata (G_OBJECT (appsink), pts_quark ());
+  return ret;
+}
+
+/* Returns FALSE if the buffer must not be pushed. Buffer must be writable */
+static gboolean
+kms_player_endpoint_adjust_buffer (KmsPlayerEndpoint * self,
+    GstAppSink * appsink, KmsPtsData * pts_data, GstBuffer * buffer,
+    gboolean is_preroll)
+{
+  GstClockTime pts_orig, base_time, offset_time;
+  gint64 diff;
 
   if (!GST_BUFFER_PTS_IS_VALID (buffer) && !GST_BUFFER_DTS_IS_VALID (buffer)) {
     if (pts_data->pts_handled) {
       GST_ERROR_OBJECT (appsink,
           "PTS and DTS are not valid and a previous buffer was handled.");
-      ret = GST_FLOW_OK;
-      goto end;
+      return FALSE;
     }
 
-    goto push;
+    return TRUE;
   } else if (!GST_BUFFER_PTS_IS_VALID (buffer)) {
     GST_BUFFER_PTS (buffer) = GST_BUFFER_DTS (buffer);
   } else if (!GST_BUFFER_DTS_IS_VALID (buffer)) {
@@ -538,13 +721,13 @@ process_sample (GstAppSink * appsink, GstAppSrc * appsrc, GstSample * sample,
           ", is preroll: %d). Not pushing",
           GST_TIME_ARGS (pts_data->last_pts_orig), GST_TIME_ARGS (pts_orig),
           is_preroll);
-      goto end;
+      return FALSE;
     } else if (pts_orig == pts_data->last_pts_orig) {
       GST_DEBUG_OBJECT (appsink,
           "Original PTS equals last PTS (original PTS: %" GST_TIME_FORMAT
           ", is preroll: %d). Seems to be already pushed.",
           GST_TIME_ARGS (pts_orig), is_preroll);
-      goto end;
+      return FALSE;
     }
   }
 
@@ -569,14 +752,26 @@ process_sample (GstAppSink * appsink, GstAppSrc * appsrc, GstSample * sample,
         GST_TIME_FORMAT ", PTS: %" GST_TIME_FORMAT
         ", is preroll: %d). Not pushing", GST_TIME_ARGS (pts_data->last_pts),
         GST_TIME_ARGS (GST_BUFFER_PTS (buffer)), is_preroll);
-    goto end;
+    return FALSE;
   }
 
   pts_data->last_pts = GST_BUFFER_PTS (buffer);
   pts_data->last_pts_orig = pts_orig;
 
-push:
-  src = gst_element_get_static_pad (GST_ELEMENT (appsrc), "src");
+  return TRUE;
+}
+
+static void
+kms_player_endpoint_prepare_push (KmsPtsData * pts_data)
+{
+  GstPad *src, *sink;
+
+  /* Nothing to do until an EOS is sent, which is seldom */
+  if (!g_atomic_int_get (&pts_data->eos)) {
+    return;
+  }
+
+  src = gst_element_get_static_pad (GST_ELEMENT (pts_data->appsrc), "src");
   sink = gst_pad_get_peer (src);
   g_object_unref (src);
 
@@ -585,9 +780,121 @@ push:
       GST_INFO_OBJECT (sink, "Sending flush events");
       gst_pad_send_event (sink, gst_event_new_flush_start ());
       gst_pad_send_event (sink, gst_event_new_flush_stop (FALSE));
+      g_atomic_int_set (&pts_data->eos, FALSE);
     }
     g_object_unref (sink);
   }
+}
+
+#if KMS_PLAYER_SOURCE_BUFFER_LISTS
+typedef struct _KmsAdjustListData
+{
+  KmsPlayerEndpoint *self;
+  GstAppSink *appsink;
+  KmsPtsData *pts_data;
+  gboolean is_preroll;
+} KmsAdjustListData;
+
+static gboolean
+adjust_list_buffer (GstBuffer ** buffer, guint idx, gpointer user_data)
+{
+  KmsAdjustListData *data = user_data;
+
+  *buffer = gst_buffer_make_writable (*buffer);
+
+  if (!kms_player_endpoint_adjust_buffer (data->self, data->appsink,
+          data->pts_data, *buffer, data->is_preroll)) {
+    /* Removes it from the list */
+    gst_buffer_unref (*buffer);
+    *buffer = NULL;
+  }
+
+  /* Only the first buffer of a list is prerolled */
+  data->is_preroll = FALSE;
+
+  return TRUE;
+}
+
+static GstFlowReturn
+process_buffer_list (GstAppSink * appsink, GstAppSrc * appsrc,
+    KmsPtsData * pts_data, GstBufferList * list, gboolean is_preroll)
+{
+  KmsAdjustListData data;
+  GstFlowReturn ret;
+
+  data.self = pts_data->self;
+  data.appsink = appsink;
+  data.pts_data = pts_data;
+  data.is_preroll = is_preroll;
+
+  /* Timestamps of the whole list are fixed in a single pass */
+  list = gst_buffer_list_make_writable (list);
+  gst_buffer_list_foreach (list, adjust_list_buffer, &data);
+
+  if (gst_buffer_list_length (list) == 0) {
+    gst_buffer_list_unref (list);
+    return GST_FLOW_OK;
+  }
+
+  kms_player_endpoint_prepare_push (pts_data);
+
+  ret = gst_app_src_push_buffer_list (appsrc, list);
+  if (ret != GST_FLOW_OK) {
+    GST_ERROR_OBJECT (appsink,
+        "Could not send buffer list to '%s'. Cause: %s",
+        GST_ELEMENT_NAME (appsrc), gst_flow_get_name (ret));
+  }
+
+  return ret;
+}
+#endif
+
+static GstFlowReturn
+process_sample (GstAppSink * appsink, GstAppSrc * appsrc,
+    KmsPtsData * pts_data, GstSample * sample, gboolean is_preroll)
+{
+  KmsPlayerEndpoint *self = pts_data->self;
+#if KMS_PLAYER_SOURCE_BUFFER_LISTS
+  GstBufferList *list;
+#endif
+  GstBuffer *buffer = NULL;
+  GstFlowReturn ret = GST_FLOW_OK;
+
+  if (sample == NULL) {
+    GST_ERROR_OBJECT (appsink, "Cannot get sample");
+    return GST_FLOW_OK;
+  }
+
+#if KMS_PLAYER_SOURCE_BUFFER_LISTS
+  list = gst_sample_get_buffer_list (sample);
+  if (list != NULL) {
+    /* Release the sample first, so the list is not copied to modify it */
+    gst_buffer_list_ref (list);
+    gst_sample_unref (sample);
+
+    return process_buffer_list (appsink, appsrc, pts_data, list, is_preroll);
+  }
+#endif
+
+  buffer = gst_sample_get_buffer (sample);
+  if (buffer == NULL) {
+    GST_ERROR_OBJECT (appsink, "Cannot get buffer");
+    goto end;
+  }
+
+  /* Release the sample first, so the buffer is not copied to modify it */
+  gst_buffer_ref (buffer);
+  gst_sample_unref (sample);
+  sample = NULL;
+
+  buffer = gst_buffer_make_writable (buffer);
+
+  if (!kms_player_endpoint_adjust_buffer (self, appsink, pts_data, buffer,
+          is_preroll)) {
+    goto end;
+  }
+
+  kms_player_endpoint_prepare_push (pts_data);
 
   ret = gst_app_src_push_buffer (appsrc, buffer);
   buffer = NULL;
@@ -609,33 +916,145 @@ end:
   return ret;
 }
 
+/* Feeds the key frame index */
+static void
+kms_player_endpoint_index_buffer (KmsPlayerEndpoint * self,
+    KmsPtsData * pts_data, GstBuffer * buffer)
+{
+  if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT) ||
+      !GST_BUFFER_PTS_IS_VALID (buffer)) {
+    return;
+  }
+
+  g_mutex_lock (&self->priv->seek_mutex);
+
+  if (self->priv->index != NULL) {
+    kms_player_index_add (self->priv->index, GST_BUFFER_PTS (buffer),
+        pts_data->last_keyframe);
+  }
+
+  g_mutex_unlock (&self->priv->seek_mutex);
+
+  pts_data->last_keyframe = GST_BUFFER_PTS (buffer);
+}
+
+/* Called for every sample of the internal pipeline, before adjusting it */
+static void
+kms_player_endpoint_sample_played (KmsPlayerEndpoint * self,
+    KmsPtsData * pts_data, GstSample * sample, gboolean is_preroll)
+{
+#if KMS_PLAYER_SOURCE_BUFFER_LISTS
+  GstBufferList *list;
+  guint i;
+#endif
+  GstBuffer *buffer;
+  gboolean measuring;
+
+  if (sample == NULL) {
+    return;
+  }
+
+  measuring = g_atomic_int_get (&self->priv->measuring);
+
+  if (measuring) {
+    KmsPlayerSeekStats *stats = &self->priv->seek_stats;
+
+    g_mutex_lock (&self->priv->seek_mutex);
+
+    if (self->priv->seek_start != 0) {
+      /* Time from the seek to its first sample */
+      stats->last_latency =
+          (g_get_monotonic_time () - self->priv->seek_start) * GST_USECOND;
+      stats->total_latency += stats->last_latency;
+      stats->max_latency = MAX (stats->max_latency, stats->last_latency);
+      stats->measured++;
+      self->priv->seek_start = 0;
+      g_atomic_int_set (&self->priv->measuring, FALSE);
+    }
+
+    g_mutex_unlock (&self->priv->seek_mutex);
+  }
+
+  if (pts_data->index_keyframes) {
+    if (is_preroll) {
+      /* Prerolled after a seek, the playback is not continuous */
+      pts_data->last_keyframe = GST_CLOCK_TIME_NONE;
+    }
+
+    buffer = gst_sample_get_buffer (sample);
+
+    if (buffer != NULL) {
+      kms_player_endpoint_index_buffer (self, pts_data, buffer);
+      return;
+    }
+#if KMS_PLAYER_SOURCE_BUFFER_LISTS
+    list = gst_sample_get_buffer_list (sample);
+
+    if (list != NULL) {
+      for (i = 0; i < gst_buffer_list_length (list); i++) {
+        kms_player_endpoint_index_buffer (self, pts_data,
+            gst_buffer_list_get (list, i));
+      }
+    }
+#endif
+  }
+}
+
+static gboolean
+kms_player_endpoint_has_next_item (KmsPlayerEndpoint * self)
+{
+  gboolean ret;
+
+  g_rec_mutex_lock (&self->priv->playlist_mutex);
+  ret = self->priv->next_pipeline != NULL ||
+      !g_queue_is_empty (&self->priv->playlist);
+  g_rec_mutex_unlock (&self->priv->playlist_mutex);
+
+  return ret;
+}
+
 static GstFlowReturn
 appsink_new_preroll_cb (GstAppSink * appsink, gpointer user_data)
 {
+  KmsPtsData *pts_data = user_data;
   GstSample *sample;
 
   sample = gst_app_sink_pull_preroll (appsink);
+  kms_player_endpoint_sample_played (pts_data->self, pts_data, sample,
+      IS_PREROLL);
 
-  return process_sample (appsink, GST_APP_SRC (user_data), sample, IS_PREROLL);
+  return process_sample (appsink, pts_data->appsrc, pts_data, sample,
+      IS_PREROLL);
 }
 
 static GstFlowReturn
 appsink_new_sample_cb (GstAppSink * appsink, gpointer user_data)
 {
+  KmsPtsData *pts_data = user_data;
   GstSample *sample;
 
   sample = gst_app_sink_pull_sample (appsink);
+  kms_player_endpoint_sample_played (pts_data->self, pts_data, sample,
+      !IS_PREROLL);
 
-  return process_sample (appsink, GST_APP_SRC (user_data), sample, !IS_PREROLL);
+  return process_sample (appsink, pts_data->appsrc, pts_data, sample,
+      !IS_PREROLL);
 }
 
 static void
 appsink_eos_cb (GstAppSink * appsink, gpointer user_data)
 {
-  GstAppSrc *appsrc = GST_APP_SRC (user_data);
+  KmsPtsData *pts_data = user_data;
+  GstAppSrc *appsrc = pts_data->appsrc;
   GstFlowReturn ret;
   GstPad *pad;
 
+  if (kms_player_endpoint_has_next_item (pts_data->self)) {
+    /* The stream goes on with the next item of the playlist */
+    GST_DEBUG_OBJECT (appsink, "End of playlist item");
+    return;
+  }
+
   GST_DEBUG_OBJECT (appsink, "Send EOS event to main pipeline (via %s)",
       GST_ELEMENT_NAME (appsrc));
   ret = gst_app_src_end_of_stream (appsrc);
@@ -653,11 +1072,17 @@ appsink_eos_cb (GstAppSink * appsink, gpointer user_data)
 }
 
 static GstPadProbeReturn
-appsrc_query_probe (GstPad * pad, GstPadProbeInfo * info, gpointer element)
+appsrc_query_probe (GstPad * pad, GstPadProbeInfo * info, gpointer data)
 {
   GstQuery *query = gst_pad_probe_info_get_query (info);
   GstQueryType type = GST_QUERY_TYPE (query);
-  GstElement *appsink = GST_ELEMENT (element);
+  KmsPtsData *pts_data = data;
+  GstElement *appsink = pts_data->appsink;
+
+  /* Cached clips have no upstream to query */
+  if (appsink == NULL) {
+    return GST_PAD_PROBE_OK;
+  }
 
   if (type == GST_QUERY_CAPS || type == GST_QUERY_ACCEPT_CAPS) {
     query = gst_query_make_writable (query);
@@ -669,9 +1094,25 @@ appsrc_query_probe (GstPad * pad, GstPadProbeInfo * info, gpointer element)
   return GST_PAD_PROBE_OK;
 }
 
+static GstPadProbeReturn
+appsrc_event_probe (GstPad * pad, GstPadProbeInfo * info, gpointer data)
+{
+  GstEvent *event = gst_pad_probe_info_get_event (info);
+  KmsPtsData *pts_data = data;
+
+  /* Tells the streaming path when the peer may need to be flushed */
+  if (GST_EVENT_TYPE (event) == GST_EVENT_EOS) {
+    g_atomic_int_set (&pts_data->eos, TRUE);
+  } else if (GST_EVENT_TYPE (event) == GST_EVENT_FLUSH_STOP) {
+    g_atomic_int_set (&pts_data->eos, FALSE);
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
 static GstElement *
 kms_player_end_point_add_appsrc (KmsPlayerEndpoint * self,
-    GstElement * agnosticbin, GstElement * appsink)
+    GstElement * agnosticbin, GstElement * appsink, KmsPtsData * pts_data)
 {
   GstElement *appsrc = NULL;
   GstPad *srcpad;
@@ -679,14 +1120,23 @@ kms_player_end_point_add_appsrc (KmsPlayerEndpoint * self,
   /* Create appsrc element and link to agnosticbin */
   appsrc = gst_element_factory_make ("appsrc", NULL);
 
-  g_object_set (G_OBJECT (appsrc), "is-live", TRUE, "do-timestamp", TRUE,
+  /* Without sync, the file timestamps are kept and pushing blocks until */
+  /* downstream consumes, so the file is read as fast as it is processed */
+  g_object_set (G_OBJECT (appsrc), "is-live", TRUE, "do-timestamp",
+      self->priv->sync, "block", !self->priv->sync,
       "min-latency", G_GUINT64_CONSTANT (0), "max-latency",
       G_GUINT64_CONSTANT (0), "format", GST_FORMAT_TIME,
       "emit-signals", FALSE, NULL);
 
+  pts_data->self = self;
+  pts_data->appsrc = GST_APP_SRC (appsrc);
+  pts_data->appsink = appsink;
+
   srcpad = gst_element_get_static_pad (appsrc, "src");
+  gst_pad_add_probe (srcpad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+      appsrc_event_probe, pts_data, NULL);
   gst_pad_add_probe (srcpad, GST_PAD_PROBE_TYPE_QUERY_UPSTREAM,
-      appsrc_query_probe, appsink, NULL);
+      appsrc_query_probe, pts_data, NULL);
   g_object_unref (srcpad);
 
   gst_bin_add (GST_BIN (self), appsrc);
@@ -730,29 +1180,47 @@ kms_player_end_point_remove_stat_probe (KmsPlayerEndpoint * self, GstPad * pad)
   KMS_ELEMENT_UNLOCK (self);
 }
 
+static GstElement *
+kms_player_end_point_get_agnostic_for_caps (KmsPlayerEndpoint * self,
+    GstCaps * caps, KmsMediaType * type)
+{
+  if (caps == NULL) {
+    return NULL;
+  }
+
+  GST_DEBUG_OBJECT (self, "Prepare for input caps: %" GST_PTR_FORMAT, caps);
+
+  if (kms_utils_caps_is_audio (caps)) {
+    GST_DEBUG_OBJECT (self, "Detected audio caps");
+    *type = KMS_MEDIA_TYPE_AUDIO;
+    return kms_element_get_audio_agnosticbin (KMS_ELEMENT (self));
+  } else if (kms_utils_caps_is_video (caps)) {
+    GST_DEBUG_OBJECT (self, "Detected video caps");
+    *type = KMS_MEDIA_TYPE_VIDEO;
+    return kms_element_get_video_agnosticbin (KMS_ELEMENT (self));
+  }
+
+  return NULL;
+}
+
 static GstElement *
 kms_player_end_point_get_agnostic_for_pad (KmsPlayerEndpoint * self,
     GstPad * pad)
 {
   GstCaps *caps;
-  GstElement *agnosticbin = NULL;
+  GstElement *agnosticbin;
+  KmsMediaType type;
 
   caps = gst_pad_query_caps (pad, NULL);
   if (caps == NULL) {
     return NULL;
   }
 
-  GST_DEBUG_OBJECT (pad, "Prepare for input caps: %" GST_PTR_FORMAT, caps);
-
   /* TODO: Update latency probe to set valid and media type */
-  if (kms_utils_caps_is_audio (caps)) {
-    GST_DEBUG_OBJECT (pad, "Detected audio caps");
-    agnosticbin = kms_element_get_audio_agnosticbin (KMS_ELEMENT (self));
-    kms_player_end_point_add_stat_probe (self, pad, KMS_MEDIA_TYPE_AUDIO);
-  } else if (kms_utils_caps_is_video (caps)) {
-    GST_DEBUG_OBJECT (pad, "Detected video caps");
-    agnosticbin = kms_element_get_video_agnosticbin (KMS_ELEMENT (self));
-    kms_player_end_point_add_stat_probe (self, pad, KMS_MEDIA_TYPE_VIDEO);
+  agnosticbin = kms_player_end_point_get_agnostic_for_caps (self, caps, &type);
+
+  if (agnosticbin != NULL) {
+    kms_player_end_point_add_stat_probe (self, pad, type);
   }
 
   gst_caps_unref (caps);
@@ -818,47 +1286,150 @@ appsink_event_query_probe (GstPad * pad, GstPadProbeInfo * info, gpointer elemen
   return GST_PAD_PROBE_OK;
 }
 
-static void
-kms_player_endpoint_uridecodebin_pad_added (GstElement * element, GstPad * pad,
-    KmsPlayerEndpoint * self)
+/* Appsrc of the current item that feeds @agnosticbin, if any */
+static GstElement *
+kms_player_endpoint_get_stream_appsrc (KmsPlayerEndpoint * self,
+    GstElement * agnosticbin)
 {
-  GstElement *appsink, *appsrc;
-  GstElement *agnosticbin;
-  GstPad *sinkpad;
-  GstPadLinkReturn link_ret;
+  GstElement *appsrc = NULL;
+  GstPad *sinkpad, *peer;
+
+  sinkpad = gst_element_get_static_pad (agnosticbin, "sink");
+  peer = gst_pad_get_peer (sinkpad);
+  g_object_unref (sinkpad);
+
+  if (peer == NULL) {
+    return NULL;
+  }
+
+  appsrc = gst_pad_get_parent_element (peer);
+  g_object_unref (peer);
+
+  /* Only appsrcs of the internal pipeline are handed to the next item */
+  if (appsrc != NULL && g_object_get_qdata (G_OBJECT (appsrc),
+          pts_quark ()) == NULL) {
+    g_clear_object (&appsrc);
+  }
+
+  if (appsrc != NULL) {
+    /* Still referenced by the bin */
+    g_object_unref (appsrc);
+  }
+
+  return appsrc;
+}
+
+static void
+kms_player_endpoint_set_appsink_callbacks (GstElement * appsink,
+    KmsPtsData * pts_data)
+{
+  GstAppSinkCallbacks callbacks;
+
+  callbacks.eos = appsink_eos_cb;
+  callbacks.new_preroll = appsink_new_preroll_cb;
+  callbacks.new_sample = appsink_new_sample_cb;
+  gst_app_sink_set_callbacks (GST_APP_SINK (appsink), &callbacks, pts_data,
+      NULL);
+}
+
+/* Decoded frames are all key frames, indexing them would only waste memory */
+static gboolean
+kms_player_endpoint_pad_is_encoded (GstPad * pad)
+{
+  GstCaps *caps;
+  gboolean ret;
+
+  caps = gst_pad_get_current_caps (pad);
+
+  if (caps == NULL) {
+    caps = gst_pad_query_caps (pad, NULL);
+  }
+
+  ret = gst_caps_get_size (caps) > 0 &&
+      !g_str_has_prefix (gst_structure_get_name (gst_caps_get_structure (caps,
+              0)), "video/x-raw");
+  gst_caps_unref (caps);
+
+  return ret;
+}
+
+static void
+kms_player_endpoint_uridecodebin_pad_added (GstElement * element, GstPad * pad,
+    KmsPlayerEndpoint * self)
+{
+  GstElement *appsink, *appsrc = NULL;
+  GstElement *agnosticbin;
+  GstPad *sinkpad;
+  GstPadLinkReturn link_ret;
+  gboolean is_next;
 
   GST_DEBUG_OBJECT (pad, "Pad added");
 
+  g_rec_mutex_lock (&self->priv->playlist_mutex);
+
+  /* Streams of the next item wait, prerolled, until it is switched in */
+  is_next = element == self->priv->next_uridecodebin;
+
+  if (!is_next && element != self->priv->uridecodebin) {
+    GST_DEBUG_OBJECT (pad, "Item already discarded");
+    g_rec_mutex_unlock (&self->priv->playlist_mutex);
+    return;
+  }
+
   agnosticbin = kms_player_end_point_get_agnostic_for_pad (self, pad);
 
   if (agnosticbin != NULL) {
-    GstAppSinkCallbacks callbacks;
+    KmsPtsData *pts_data = NULL;
 
     /* Create appsink */
     appsink = gst_element_factory_make ("appsink", NULL);
-    appsrc = kms_player_end_point_add_appsrc (self, agnosticbin, appsink);
 
     g_object_set (appsink, "enable-last-sample", FALSE, "emit-signals", FALSE,
         "qos", FALSE, "max-buffers", 1, NULL);
 
-    callbacks.eos = appsink_eos_cb;
-    callbacks.new_preroll = appsink_new_preroll_cb;
-    callbacks.new_sample = appsink_new_sample_cb;
-    gst_app_sink_set_callbacks (GST_APP_SINK (appsink), &callbacks, appsrc,
-        NULL);
+#if KMS_PLAYER_SOURCE_BUFFER_LISTS
+    if (g_object_class_find_property (G_OBJECT_GET_CLASS (appsink),
+            "buffer-list") != NULL) {
+      g_object_set (appsink, "buffer-list", TRUE, NULL);
+    }
+#endif
 
-    g_object_set_qdata_full (G_OBJECT (appsink), pts_quark (),
-        kms_pts_data_new (), kms_pts_data_destroy);
+    if (is_next) {
+      appsrc = kms_player_endpoint_get_stream_appsrc (self, agnosticbin);
+    }
+
+    if (appsrc != NULL) {
+      /* Keeps the stream of the current item, timestamps go on from it */
+      g_object_set_qdata (G_OBJECT (pad), reused_appsrc_quark (), appsrc);
+    } else {
+      pts_data = kms_pts_data_new ();
+      pts_data->index_keyframes =
+          agnosticbin ==
+          kms_element_get_video_agnosticbin (KMS_ELEMENT (self)) &&
+          kms_player_endpoint_pad_is_encoded (pad);
+      appsrc = kms_player_end_point_add_appsrc (self, agnosticbin, appsink,
+          pts_data);
+
+      /* Owned by the appsrc, so it can be handed to the next item */
+      g_object_set_qdata_full (G_OBJECT (appsrc), pts_quark (), pts_data,
+          kms_pts_data_destroy);
+      g_object_set_qdata (G_OBJECT (pad), appsrc_quark (), appsrc);
+    }
+
+    if (!is_next) {
+      kms_player_endpoint_set_appsink_callbacks (appsink, pts_data);
+    }
 
     g_object_set_qdata (G_OBJECT (pad), appsink_quark (), appsink);
-    g_object_set_qdata (G_OBJECT (pad), appsrc_quark (), appsrc);
   } else {
     GST_WARNING_OBJECT (self, "No supported pad: %" GST_PTR_FORMAT
         ". Connecting it to a fakesink", pad);
     appsink = gst_element_factory_make ("fakesink", NULL);
   }
 
-  g_object_set (appsink, "sync", TRUE, "async", TRUE, NULL);
+  g_rec_mutex_unlock (&self->priv->playlist_mutex);
+
+  g_object_set (appsink, "sync", self->priv->sync, "async", TRUE, NULL);
 
   sinkpad = gst_element_get_static_pad (appsink, "sink");
 
@@ -868,7 +1439,7 @@ kms_player_endpoint_uridecodebin_pad_added (GstElement * element, GstPad * pad,
         appsrc, NULL);
   }
 
-  gst_bin_add (GST_BIN (self->priv->pipeline), appsink);
+  gst_bin_add (GST_BIN (GST_ELEMENT_PARENT (element)), appsink);
 
   link_ret = gst_pad_link (pad, sinkpad);
 
@@ -907,8 +1478,541 @@ kms_player_endpoint_uridecodebin_pad_removed (GstElement * element,
   }
 
   if (appsink != NULL) {
-    kms_utils_bin_remove (GST_BIN (self->priv->pipeline), appsink);
+    kms_utils_bin_remove (GST_BIN (GST_ELEMENT_PARENT (element)), appsink);
+  }
+}
+
+static GstBusSyncReply bus_sync_signal_handler (GstBus * bus,
+    GstMessage * msg, gpointer data);
+
+static void
+shared_stream_added_cb (KmsPlayerSource * source, GstAppSink * stream,
+    GstCaps * caps, gpointer user_data)
+{
+  KmsPlayerEndpoint *self = KMS_PLAYER_ENDPOINT (user_data);
+  KmsPlayerSharedStream *shared;
+  GstElement *agnosticbin;
+  KmsMediaType type;
+
+  agnosticbin = kms_player_end_point_get_agnostic_for_caps (self, caps, &type);
+
+  if (agnosticbin == NULL) {
+    GST_WARNING_OBJECT (self, "Ignoring unsupported shared stream: %"
+        GST_PTR_FORMAT, caps);
+    return;
+  }
+
+  shared = g_slice_new0 (KmsPlayerSharedStream);
+  shared->pts_data = kms_pts_data_new ();
+  shared->appsrc = GST_APP_SRC (kms_player_end_point_add_appsrc (self,
+          agnosticbin, GST_ELEMENT (stream), shared->pts_data));
+
+  /* Shared players always sync, so this is already the case: pushing from
+   * the shared streaming thread must not wait for this player */
+  g_object_set (shared->appsrc, "block", FALSE, NULL);
+
+  g_hash_table_insert (self->priv->shared_streams, stream, shared);
+}
+
+static void
+shared_stream_removed_cb (KmsPlayerSource * source, GstAppSink * stream,
+    gpointer user_data)
+{
+  KmsPlayerEndpoint *self = KMS_PLAYER_ENDPOINT (user_data);
+  KmsPlayerSharedStream *shared;
+
+  shared = g_hash_table_lookup (self->priv->shared_streams, stream);
+
+  if (shared == NULL) {
+    return;
+  }
+
+  kms_utils_bin_remove (GST_BIN (self), GST_ELEMENT (shared->appsrc));
+  g_hash_table_remove (self->priv->shared_streams, stream);
+}
+
+static GstFlowReturn
+shared_new_sample_cb (KmsPlayerSource * source, GstAppSink * stream,
+    GstSample * sample, gboolean is_preroll, gpointer user_data)
+{
+  KmsPlayerEndpoint *self = KMS_PLAYER_ENDPOINT (user_data);
+  KmsPlayerSharedStream *shared;
+  GstCaps *caps;
+
+  shared = g_hash_table_lookup (self->priv->shared_streams, stream);
+
+  if (shared == NULL) {
+    return GST_FLOW_OK;
+  }
+
+  /* Caps events do not leave the shared pipeline, samples carry them */
+  caps = gst_sample_get_caps (sample);
+  if (caps != NULL && caps != shared->caps) {
+    GST_DEBUG_OBJECT (shared->appsrc, "Set new caps: %" GST_PTR_FORMAT, caps);
+    gst_caps_replace (&shared->caps, caps);
+    gst_app_src_set_caps (shared->appsrc, caps);
+  }
+
+  /* Buffers are shared with other players, they are copied on write */
+  return process_sample (stream, shared->appsrc, shared->pts_data,
+      gst_sample_ref (sample), is_preroll);
+}
+
+static void
+shared_stream_eos_cb (KmsPlayerSource * source, GstAppSink * stream,
+    gpointer user_data)
+{
+  KmsPlayerEndpoint *self = KMS_PLAYER_ENDPOINT (user_data);
+  KmsPlayerSharedStream *shared;
+
+  shared = g_hash_table_lookup (self->priv->shared_streams, stream);
+
+  if (shared != NULL) {
+    appsink_eos_cb (stream, shared->pts_data);
+  }
+}
+
+static void
+shared_bus_message_cb (KmsPlayerSource * source, GstMessage * message,
+    gpointer user_data)
+{
+  bus_sync_signal_handler (NULL, message, user_data);
+}
+
+static const KmsPlayerSourceCallbacks shared_callbacks = {
+  shared_stream_added_cb,
+  shared_stream_removed_cb,
+  shared_new_sample_cb,
+  shared_stream_eos_cb,
+  shared_bus_message_cb
+};
+
+/* Shared sources are live, they can not be played as fast as possible */
+static gboolean
+kms_player_endpoint_is_shared (KmsPlayerEndpoint * self)
+{
+  return self->priv->shared_source && self->priv->sync;
+}
+
+static void
+kms_player_endpoint_attach_source (KmsPlayerEndpoint * self)
+{
+  g_mutex_lock (&self->priv->source_mutex);
+
+  if (self->priv->source == NULL) {
+    self->priv->source =
+        kms_player_source_acquire (KMS_URI_ENDPOINT (self)->uri,
+        self->priv->use_encoded_media, self->priv->network_cache,
+        self->priv->port_range);
+    kms_player_source_subscribe (self->priv->source, &shared_callbacks, self);
+  }
+
+  g_mutex_unlock (&self->priv->source_mutex);
+}
+
+static void
+kms_player_endpoint_detach_source (KmsPlayerEndpoint * self)
+{
+  g_mutex_lock (&self->priv->source_mutex);
+
+  if (self->priv->source != NULL) {
+    kms_player_source_unsubscribe (self->priv->source, self);
+    kms_player_source_release (self->priv->source);
+    self->priv->source = NULL;
+
+    /* Joining again never prerolls */
+    kms_player_endpoint_clear_base_time (self);
+  }
+
+  g_mutex_unlock (&self->priv->source_mutex);
+}
+
+static gboolean kms_player_endpoint_emit_EOS_signal (gpointer data);
+
+/* Pushes a cached clip to the appsrcs, paced by the element clock */
+struct _KmsPlayerClipFeeder
+{
+  gint ref;
+  GMutex mutex;
+  KmsPlayerEndpoint *self;
+  KmsPlayerClip *clip;
+  guint n_streams;
+  GstAppSrc **appsrcs;          /* NULL for unsupported streams */
+  KmsPtsData **pts_data;
+  GstCaps **caps;
+
+  GstClock *clock;
+  GstClockID clock_id;
+  GstClockTime start;           /* clock time of first_offset */
+  GstClockTime first_offset;
+  GstClockTime position;
+  guint next;
+  gboolean stopped;
+};
+
+static KmsPlayerClipFeeder *
+kms_player_clip_feeder_ref (KmsPlayerClipFeeder * feeder)
+{
+  g_atomic_int_inc (&feeder->ref);
+
+  return feeder;
+}
+
+static void
+kms_player_clip_feeder_unref (KmsPlayerClipFeeder * feeder)
+{
+  guint i;
+
+  if (!g_atomic_int_dec_and_test (&feeder->ref)) {
+    return;
+  }
+
+  for (i = 0; i < feeder->n_streams; i++) {
+    if (feeder->appsrcs[i] != NULL) {
+      gst_object_unref (feeder->appsrcs[i]);
+      kms_pts_data_destroy (feeder->pts_data[i]);
+      gst_caps_replace (&feeder->caps[i], NULL);
+    }
+  }
+
+  g_free (feeder->appsrcs);
+  g_free (feeder->pts_data);
+  g_free (feeder->caps);
+
+  if (feeder->clock_id != NULL) {
+    gst_clock_id_unref (feeder->clock_id);
+  }
+
+  gst_object_unref (feeder->clock);
+  kms_player_clip_unref (feeder->clip);
+  g_mutex_clear (&feeder->mutex);
+
+  g_slice_free (KmsPlayerClipFeeder, feeder);
+}
+
+static gboolean kms_player_clip_feeder_cb (GstClock * clock,
+    GstClockTime time, GstClockID id, gpointer user_data);
+
+/* Call with the feeder mutex held */
+static void
+kms_player_clip_feeder_schedule (KmsPlayerClipFeeder * feeder,
+    GstClockTime time)
+{
+  if (feeder->clock_id != NULL) {
+    gst_clock_id_unref (feeder->clock_id);
+  }
+
+  feeder->clock_id = gst_clock_new_single_shot_id (feeder->clock, time);
+  gst_clock_id_wait_async (feeder->clock_id, kms_player_clip_feeder_cb,
+      kms_player_clip_feeder_ref (feeder),
+      (GDestroyNotify) kms_player_clip_feeder_unref);
+}
+
+/* Call with the feeder mutex held */
+static void
+kms_player_clip_feeder_push (KmsPlayerClipFeeder * feeder, guint stream,
+    GstSample * sample)
+{
+  GstAppSrc *appsrc = feeder->appsrcs[stream];
+  GstCaps *caps;
+
+  if (appsrc == NULL) {
+    return;
+  }
+
+  caps = gst_sample_get_caps (sample);
+  if (caps != NULL && caps != feeder->caps[stream]) {
+    GST_DEBUG_OBJECT (appsrc, "Set new caps: %" GST_PTR_FORMAT, caps);
+    gst_caps_replace (&feeder->caps[stream], caps);
+    gst_app_src_set_caps (appsrc, caps);
+  }
+
+  /* Cached buffers are shared with other players, they are copied on write */
+  process_sample (NULL, appsrc, feeder->pts_data[stream],
+      gst_sample_ref (sample), !IS_PREROLL);
+}
+
+static gboolean
+kms_player_clip_feeder_cb (GstClock * clock, GstClockTime time,
+    GstClockID id, gpointer user_data)
+{
+  KmsPlayerClipFeeder *feeder = user_data;
+  guint n_samples = kms_player_clip_get_n_samples (feeder->clip);
+  GstClockTime now, target = GST_CLOCK_TIME_NONE;
+  guint i;
+
+  g_mutex_lock (&feeder->mutex);
+
+  if (feeder->stopped) {
+    g_mutex_unlock (&feeder->mutex);
+    return TRUE;
+  }
+
+  now = gst_clock_get_time (clock);
+
+  while (feeder->next < n_samples) {
+    GstClockTime offset;
+    GstSample *sample;
+    guint stream;
+
+    sample = kms_player_clip_get_sample (feeder->clip, feeder->next, &stream,
+        &offset);
+    target = feeder->start + offset - feeder->first_offset;
+
+    if (target > now) {
+      break;
+    }
+
+    kms_player_clip_feeder_push (feeder, stream, sample);
+    feeder->position = offset;
+    feeder->next++;
+  }
+
+  if (feeder->next < n_samples) {
+    kms_player_clip_feeder_schedule (feeder, target);
+    g_mutex_unlock (&feeder->mutex);
+    return TRUE;
+  }
+
+  GST_DEBUG_OBJECT (feeder->self, "Cached clip finished");
+
+  for (i = 0; i < feeder->n_streams; i++) {
+    if (feeder->appsrcs[i] != NULL) {
+      appsink_eos_cb (NULL, feeder->pts_data[i]);
+    }
+  }
+
+  feeder->stopped = TRUE;
+
+  kms_loop_idle_add_full (feeder->self->priv->loop, G_PRIORITY_HIGH_IDLE,
+      kms_player_endpoint_emit_EOS_signal, g_object_ref (feeder->self),
+      g_object_unref);
+
+  g_mutex_unlock (&feeder->mutex);
+
+  return TRUE;
+}
+
+static KmsPlayerClipFeeder *
+kms_player_clip_feeder_new (KmsPlayerEndpoint * self, KmsPlayerClip * clip,
+    GstClockTime position)
+{
+  KmsPlayerClipFeeder *feeder;
+  guint i;
+
+  feeder = g_slice_new0 (KmsPlayerClipFeeder);
+  feeder->ref = 1;
+  g_mutex_init (&feeder->mutex);
+  feeder->self = self;
+  feeder->clip = kms_player_clip_ref (clip);
+  feeder->n_streams = kms_player_clip_get_n_streams (clip);
+  feeder->appsrcs = g_new0 (GstAppSrc *, feeder->n_streams);
+  feeder->pts_data = g_new0 (KmsPtsData *, feeder->n_streams);
+  feeder->caps = g_new0 (GstCaps *, feeder->n_streams);
+
+  for (i = 0; i < feeder->n_streams; i++) {
+    GstCaps *caps = kms_player_clip_get_caps (clip, i);
+    GstElement *agnosticbin, *appsrc;
+    KmsMediaType type;
+
+    agnosticbin = kms_player_end_point_get_agnostic_for_caps (self, caps,
+        &type);
+
+    if (agnosticbin == NULL) {
+      GST_WARNING_OBJECT (self, "Ignoring unsupported cached stream: %"
+          GST_PTR_FORMAT, caps);
+      continue;
+    }
+
+    feeder->pts_data[i] = kms_pts_data_new ();
+    appsrc = kms_player_end_point_add_appsrc (self, agnosticbin, NULL,
+        feeder->pts_data[i]);
+    gst_app_src_set_caps (GST_APP_SRC (appsrc), caps);
+    feeder->appsrcs[i] = GST_APP_SRC (gst_object_ref (appsrc));
+    feeder->caps[i] = gst_caps_ref (caps);
+  }
+
+  feeder->clock = gst_element_get_clock (GST_ELEMENT (self));
+  if (feeder->clock == NULL) {
+    feeder->clock = gst_system_clock_obtain ();
+  }
+
+  feeder->next = kms_player_clip_find_position (clip, position);
+  kms_player_clip_get_sample (clip, feeder->next, NULL, &feeder->first_offset);
+  feeder->position = feeder->first_offset;
+
+  /* A fresh start, timestamps are generated again from the first buffer */
+  kms_player_endpoint_clear_base_time (self);
+
+  g_mutex_lock (&feeder->mutex);
+  feeder->start = gst_clock_get_time (feeder->clock);
+  kms_player_clip_feeder_schedule (feeder, feeder->start);
+  g_mutex_unlock (&feeder->mutex);
+
+  return feeder;
+}
+
+/* Returns the position the clip was stopped at */
+static GstClockTime
+kms_player_clip_feeder_stop (KmsPlayerClipFeeder * feeder)
+{
+  GstClockTime position;
+  guint i;
+
+  /* Waits for a push in progress, nothing is pushed after this */
+  g_mutex_lock (&feeder->mutex);
+  feeder->stopped = TRUE;
+  gst_clock_id_unschedule (feeder->clock_id);
+  position = feeder->position;
+  g_mutex_unlock (&feeder->mutex);
+
+  for (i = 0; i < feeder->n_streams; i++) {
+    if (feeder->appsrcs[i] != NULL) {
+      kms_utils_bin_remove (GST_BIN (feeder->self),
+          GST_ELEMENT (feeder->appsrcs[i]));
+    }
+  }
+
+  kms_player_clip_feeder_unref (feeder);
+
+  return position;
+}
+
+/* Returns TRUE if the player plays a cached clip */
+static gboolean
+kms_player_endpoint_play_clip (KmsPlayerEndpoint * self)
+{
+  gboolean ret;
+
+  g_mutex_lock (&self->priv->source_mutex);
+
+  /* Only on a fresh start, a paused pipeline goes on by itself */
+  if (self->priv->clip == NULL && self->priv->clip_cache_size > 0 &&
+      self->priv->sync && GST_STATE (self->priv->pipeline) == GST_STATE_NULL) {
+    self->priv->clip = kms_player_cache_lookup (KMS_URI_ENDPOINT (self)->uri);
+    self->priv->clip_position = 0;
+
+    /* Cached by a player with a larger budget */
+    if (self->priv->clip != NULL &&
+        kms_player_clip_get_size (self->priv->clip) >
+        self->priv->clip_cache_size) {
+      GST_DEBUG_OBJECT (self, "%s is over the clip cache size of the player",
+          KMS_URI_ENDPOINT (self)->uri);
+      kms_player_clip_unref (self->priv->clip);
+      self->priv->clip = NULL;
+    }
+
+    if (self->priv->clip != NULL) {
+      GST_DEBUG_OBJECT (self, "Playing %s from the cache",
+          KMS_URI_ENDPOINT (self)->uri);
+    }
+  }
+
+  if (self->priv->clip != NULL && self->priv->feeder == NULL) {
+    self->priv->feeder = kms_player_clip_feeder_new (self, self->priv->clip,
+        self->priv->clip_position);
+  }
+
+  ret = self->priv->clip != NULL;
+
+  g_mutex_unlock (&self->priv->source_mutex);
+
+  return ret;
+}
+
+/* Returns TRUE if the player plays a cached clip */
+static gboolean
+kms_player_endpoint_pause_clip (KmsPlayerEndpoint * self)
+{
+  gboolean ret;
+
+  g_mutex_lock (&self->priv->source_mutex);
+
+  if (self->priv->feeder != NULL) {
+    self->priv->clip_position =
+        kms_player_clip_feeder_stop (self->priv->feeder);
+    self->priv->feeder = NULL;
+  }
+
+  ret = self->priv->clip != NULL;
+
+  g_mutex_unlock (&self->priv->source_mutex);
+
+  return ret;
+}
+
+/* Returns TRUE if the player plays a cached clip */
+static gboolean
+kms_player_endpoint_seek_clip (KmsPlayerEndpoint * self, gint64 position)
+{
+  gboolean ret;
+
+  g_mutex_lock (&self->priv->source_mutex);
+
+  ret = self->priv->clip != NULL;
+
+  if (ret) {
+    self->priv->clip_position = MAX (position, 0);
+  }
+
+  if (self->priv->feeder != NULL) {
+    kms_player_clip_feeder_stop (self->priv->feeder);
+    self->priv->feeder = kms_player_clip_feeder_new (self, self->priv->clip,
+        self->priv->clip_position);
+  }
+
+  g_mutex_unlock (&self->priv->source_mutex);
+
+  return ret;
+}
+
+static void
+kms_player_endpoint_release_clip (KmsPlayerEndpoint * self)
+{
+  g_mutex_lock (&self->priv->source_mutex);
+
+  if (self->priv->feeder != NULL) {
+    kms_player_clip_feeder_stop (self->priv->feeder);
+    self->priv->feeder = NULL;
+  }
+
+  if (self->priv->clip != NULL) {
+    kms_player_clip_unref (self->priv->clip);
+    self->priv->clip = NULL;
+  }
+
+  self->priv->clip_position = 0;
+
+  g_mutex_unlock (&self->priv->source_mutex);
+}
+
+static gboolean
+kms_player_endpoint_query_clip (KmsPlayerEndpoint * self, gint64 * position,
+    gint64 * duration)
+{
+  gboolean ret;
+
+  g_mutex_lock (&self->priv->source_mutex);
+
+  ret = self->priv->clip != NULL;
+
+  if (ret && position != NULL) {
+    if (self->priv->feeder != NULL) {
+      g_mutex_lock (&self->priv->feeder->mutex);
+      *position = self->priv->feeder->position;
+      g_mutex_unlock (&self->priv->feeder->mutex);
+    } else {
+      *position = self->priv->clip_position;
+    }
   }
+
+  if (ret && duration != NULL) {
+    *duration = kms_player_clip_get_duration (self->priv->clip);
+  }
+
+  g_mutex_unlock (&self->priv->source_mutex);
+
+  return ret;
 }
 
 static gboolean
@@ -918,6 +2022,11 @@ kms_player_endpoint_stopped (KmsUriEndpoint * obj, GError ** error)
 
   GST_DEBUG_OBJECT (self, "Pipeline stopped");
 
+  kms_player_endpoint_detach_source (self);
+  kms_player_endpoint_release_clip (self);
+  kms_player_endpoint_reset_seeks (self);
+  kms_player_endpoint_discard_next (self);
+
   // Set internal pipeline to NULL state
   kms_player_endpoint_mark_reset_base_time_and_set_state (self, GST_STATE_NULL);
 
@@ -934,6 +2043,26 @@ kms_player_endpoint_started (KmsUriEndpoint * obj, GError ** error)
 
   GST_DEBUG_OBJECT (self, "Pipeline started");
 
+  if (kms_player_endpoint_is_shared (self)) {
+    kms_player_endpoint_attach_source (self);
+
+    KMS_URI_ENDPOINT_GET_CLASS (self)->change_state (KMS_URI_ENDPOINT (self),
+        KMS_URI_ENDPOINT_STATE_START);
+
+    return TRUE;
+  }
+
+  if (kms_player_endpoint_play_clip (self)) {
+    kms_player_endpoint_preroll_next (self);
+
+    KMS_URI_ENDPOINT_GET_CLASS (self)->change_state (KMS_URI_ENDPOINT (self),
+        KMS_URI_ENDPOINT_STATE_START);
+
+    return TRUE;
+  }
+
+  kms_player_endpoint_acquire_index (self, KMS_URI_ENDPOINT (self)->uri);
+
   /* Set uri property in uridecodebin */
   g_object_set (G_OBJECT (self->priv->uridecodebin), "uri",
       KMS_URI_ENDPOINT (self)->uri, NULL);
@@ -941,6 +2070,8 @@ kms_player_endpoint_started (KmsUriEndpoint * obj, GError ** error)
   /* Set internal pipeline to playing */
   gst_element_set_state (self->priv->pipeline, GST_STATE_PLAYING);
 
+  kms_player_endpoint_preroll_next (self);
+
   KMS_URI_ENDPOINT_GET_CLASS (self)->change_state (KMS_URI_ENDPOINT (self),
       KMS_URI_ENDPOINT_STATE_START);
 
@@ -948,10 +2079,158 @@ kms_player_endpoint_started (KmsUriEndpoint * obj, GError ** error)
 }
 
 static gboolean
-kms_player_endpoint_set_position (KmsPlayerEndpoint * self, gint64 position)
+kms_player_endpoint_seek (KmsPlayerEndpoint * self, gint64 position,
+    gboolean accurate)
 {
-  GstQuery *query;
+  GstClockTime keyframe = GST_CLOCK_TIME_NONE, next = GST_CLOCK_TIME_NONE;
+  GstSeekFlags flags;
+  gint64 current = -1;
   GstEvent *seek;
+  gboolean ret;
+
+  gst_element_query_position (self->priv->pipeline, GST_FORMAT_TIME,
+      &current);
+
+  g_mutex_lock (&self->priv->seek_mutex);
+
+  if (self->priv->seeking) {
+    /* Only the last of a burst of seeks is done */
+    self->priv->pending_position = position;
+    self->priv->pending_accurate = accurate;
+    self->priv->seek_stats.coalesced++;
+    g_mutex_unlock (&self->priv->seek_mutex);
+    return TRUE;
+  }
+
+  if (!accurate && self->priv->index != NULL && position >= 0) {
+    kms_player_index_lookup (self->priv->index, position, &keyframe, &next);
+  }
+
+  if (GST_CLOCK_TIME_IS_VALID (keyframe) &&
+      keyframe == self->priv->seek_keyframe && current >= 0 &&
+      (GstClockTime) current >= keyframe && (GstClockTime) current < next) {
+    /* It would start again from the key frame being played */
+    GST_DEBUG_OBJECT (self, "Skipping seek to %" GST_TIME_FORMAT,
+        GST_TIME_ARGS (position));
+    self->priv->seek_stats.skipped++;
+    g_mutex_unlock (&self->priv->seek_mutex);
+    return TRUE;
+  }
+
+  self->priv->seeking = TRUE;
+  self->priv->seek_keyframe = keyframe;
+  self->priv->seek_start = g_get_monotonic_time ();
+  self->priv->seek_stats.count++;
+  g_atomic_int_set (&self->priv->measuring, TRUE);
+
+  g_mutex_unlock (&self->priv->seek_mutex);
+
+  /* Demuxers jump to the previous key frame from their own index, instead */
+  /* of decoding and dropping everything up to the position */
+  if (accurate) {
+    flags = GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_ACCURATE;
+  } else {
+    flags = GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT |
+        GST_SEEK_FLAG_SNAP_BEFORE;
+  }
+
+  if (GST_CLOCK_TIME_IS_VALID (keyframe)) {
+    position = keyframe;
+  }
+
+  seek = gst_event_new_seek (1.0, GST_FORMAT_TIME, flags,
+      /* start */ GST_SEEK_TYPE_SET, position,
+      /* stop */ GST_SEEK_TYPE_SET, GST_CLOCK_TIME_NONE);
+
+  kms_player_endpoint_mark_reset_base_time (self);
+
+  kms_player_endpoint_set_appsrcs_flushing (self, TRUE);
+  ret = gst_element_send_event (self->priv->pipeline, seek);
+  kms_player_endpoint_set_appsrcs_flushing (self, FALSE);
+
+  if (!ret) {
+    GST_WARNING_OBJECT (self, "Seek failed");
+
+    g_mutex_lock (&self->priv->seek_mutex);
+    self->priv->seeking = FALSE;
+    self->priv->pending_position = -1;
+    self->priv->seek_keyframe = GST_CLOCK_TIME_NONE;
+    self->priv->seek_start = 0;
+    g_atomic_int_set (&self->priv->measuring, FALSE);
+    g_mutex_unlock (&self->priv->seek_mutex);
+
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* The internal pipeline prerolled, the seek in progress is done */
+static gboolean
+kms_player_endpoint_seek_done (gpointer data)
+{
+  KmsPlayerEndpoint *self = KMS_PLAYER_ENDPOINT (data);
+  gboolean accurate;
+  gint64 position;
+
+  g_mutex_lock (&self->priv->seek_mutex);
+
+  if (!self->priv->seeking) {
+    g_mutex_unlock (&self->priv->seek_mutex);
+    return G_SOURCE_REMOVE;
+  }
+
+  self->priv->seeking = FALSE;
+  position = self->priv->pending_position;
+  accurate = self->priv->pending_accurate;
+  self->priv->pending_position = -1;
+
+  g_mutex_unlock (&self->priv->seek_mutex);
+
+  if (position >= 0) {
+    kms_player_endpoint_seek (self, position, accurate);
+  }
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+kms_player_endpoint_acquire_index (KmsPlayerEndpoint * self, const gchar * uri)
+{
+  g_mutex_lock (&self->priv->seek_mutex);
+
+  if (self->priv->index == NULL) {
+    self->priv->index = kms_player_index_acquire (uri);
+  }
+
+  g_mutex_unlock (&self->priv->seek_mutex);
+}
+
+static void
+kms_player_endpoint_reset_seeks (KmsPlayerEndpoint * self)
+{
+  g_mutex_lock (&self->priv->seek_mutex);
+
+  if (self->priv->index != NULL) {
+    kms_player_index_release (self->priv->index);
+    self->priv->index = NULL;
+  }
+
+  self->priv->seeking = FALSE;
+  self->priv->pending_position = -1;
+  self->priv->seek_keyframe = GST_CLOCK_TIME_NONE;
+  self->priv->seek_start = 0;
+  g_atomic_int_set (&self->priv->measuring, FALSE);
+
+  g_mutex_unlock (&self->priv->seek_mutex);
+}
+
+/* Seeks the internal pipeline */
+static gboolean
+kms_player_endpoint_seek_pipeline (KmsPlayerEndpoint * self, gint64 position,
+    gboolean accurate)
+{
+  GstQuery *query;
   gboolean seekable = FALSE;
 
   query = gst_query_new_seeking (GST_FORMAT_TIME);
@@ -969,18 +2248,210 @@ kms_player_endpoint_set_position (KmsPlayerEndpoint * self, gint64 position)
     return FALSE;
   }
 
-  seek = gst_event_new_seek (1.0, GST_FORMAT_TIME,
-      GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_ACCURATE,
-      /* start */ GST_SEEK_TYPE_SET, position,
-      /* stop */ GST_SEEK_TYPE_SET, GST_CLOCK_TIME_NONE);
+  return kms_player_endpoint_seek (self, position, accurate);
+}
 
-  kms_player_endpoint_mark_reset_base_time (self);
+static gboolean
+kms_player_endpoint_set_position (KmsPlayerEndpoint * self, gint64 position)
+{
+  if (kms_player_endpoint_is_shared (self)) {
+    GST_WARNING_OBJECT (self, "Shared sources are not seekable");
+    return FALSE;
+  }
 
-  if (!gst_element_send_event (self->priv->pipeline, seek)) {
-    GST_WARNING_OBJECT (self, "Seek failed");
+  if (kms_player_endpoint_seek_clip (self, position)) {
+    return TRUE;
+  }
+
+  return kms_player_endpoint_seek_pipeline (self, position, FALSE);
+}
+
+/* Starts prerolling the next item of the playlist, if not done yet */
+static void
+kms_player_endpoint_preroll_next (KmsPlayerEndpoint * self)
+{
+  g_rec_mutex_lock (&self->priv->playlist_mutex);
+
+  if (self->priv->next_pipeline != NULL ||
+      g_queue_is_empty (&self->priv->playlist)) {
+    g_rec_mutex_unlock (&self->priv->playlist_mutex);
+    return;
+  }
+
+  self->priv->next_uri = g_queue_pop_head (&self->priv->playlist);
+  self->priv->next_pipeline = kms_player_endpoint_create_pipeline (self,
+      "nextpipeline", &self->priv->next_uridecodebin);
+  g_object_set (G_OBJECT (self->priv->next_uridecodebin), "uri",
+      self->priv->next_uri, NULL);
+
+  GST_DEBUG_OBJECT (self, "Prerolling next item: %s", self->priv->next_uri);
+
+  /* Held until the preroll starts, the item can not be switched before */
+  gst_element_set_state (self->priv->next_pipeline, GST_STATE_PAUSED);
+
+  g_rec_mutex_unlock (&self->priv->playlist_mutex);
+}
+
+/* The prerolled item goes back to the playlist */
+static void
+kms_player_endpoint_discard_next (KmsPlayerEndpoint * self)
+{
+  GstElement *pipeline;
+
+  g_rec_mutex_lock (&self->priv->playlist_mutex);
+
+  pipeline = self->priv->next_pipeline;
+
+  if (pipeline == NULL) {
+    g_rec_mutex_unlock (&self->priv->playlist_mutex);
+    return;
+  }
+
+  g_queue_push_head (&self->priv->playlist, self->priv->next_uri);
+  self->priv->next_uri = NULL;
+  self->priv->next_pipeline = NULL;
+  self->priv->next_uridecodebin = NULL;
+
+  g_rec_mutex_unlock (&self->priv->playlist_mutex);
+
+  /* Appsrcs of the current item are not removed with it */
+  kms_player_endpoint_destroy_pipeline (pipeline);
+}
+
+static void
+kms_player_endpoint_take_stream (KmsPlayerEndpoint * self, GstPad * pad,
+    GstElement * old_uridecodebin)
+{
+  GstElement *appsink, *appsrc;
+  KmsPtsData *pts_data;
+  GstIterator *it;
+  GValue item = G_VALUE_INIT;
+
+  appsink = g_object_get_qdata (G_OBJECT (pad), appsink_quark ());
+  appsrc = g_object_steal_qdata (G_OBJECT (pad), reused_appsrc_quark ());
+
+  if (appsrc != NULL) {
+    /* The previous item must not remove it any more */
+    it = gst_element_iterate_src_pads (old_uridecodebin);
+    while (gst_iterator_next (it, &item) == GST_ITERATOR_OK) {
+      GstPad *old_pad = g_value_get_object (&item);
+
+      if (g_object_get_qdata (G_OBJECT (old_pad), appsrc_quark ()) == appsrc) {
+        g_object_steal_qdata (G_OBJECT (old_pad), appsrc_quark ());
+      }
+      g_value_reset (&item);
+    }
+    g_value_unset (&item);
+    gst_iterator_free (it);
+
+    g_object_set_qdata (G_OBJECT (pad), appsrc_quark (), appsrc);
+  } else {
+    appsrc = g_object_get_qdata (G_OBJECT (pad), appsrc_quark ());
+  }
+
+  if (appsink == NULL || appsrc == NULL) {
+    return;
+  }
+
+  pts_data = g_object_get_qdata (G_OBJECT (appsrc), pts_quark ());
+  pts_data->appsink = appsink;
+  pts_data->last_keyframe = GST_CLOCK_TIME_NONE;
+  kms_pts_data_reset (pts_data);
+
+  kms_player_endpoint_set_appsink_callbacks (appsink, pts_data);
+}
+
+/* Switches in the next item of the playlist when the current one ends */
+static gboolean
+kms_player_endpoint_next_item (KmsPlayerEndpoint * self)
+{
+  GstElement *old_pipeline, *old_uridecodebin;
+  GstIterator *it;
+  GValue item = G_VALUE_INIT;
+  gboolean playing_clip;
+  gchar *uri;
+
+  g_mutex_lock (&self->priv->source_mutex);
+  playing_clip = self->priv->feeder != NULL;
+  g_mutex_unlock (&self->priv->source_mutex);
+
+  if (playing_clip) {
+    /* Cached clips have their own appsrcs, the next item can not take */
+    /* them, so it is prerolled again once they are removed */
+    kms_player_endpoint_release_clip (self);
+    kms_player_endpoint_discard_next (self);
+  }
+
+  g_rec_mutex_lock (&self->priv->playlist_mutex);
+
+  kms_player_endpoint_preroll_next (self);
+
+  if (self->priv->next_pipeline == NULL) {
+    g_rec_mutex_unlock (&self->priv->playlist_mutex);
     return FALSE;
   }
 
+  GST_DEBUG_OBJECT (self, "Switching to next item: %s", self->priv->next_uri);
+
+  old_pipeline = self->priv->pipeline;
+  old_uridecodebin = self->priv->uridecodebin;
+  self->priv->pipeline = self->priv->next_pipeline;
+  self->priv->uridecodebin = self->priv->next_uridecodebin;
+  uri = self->priv->next_uri;
+  self->priv->next_pipeline = NULL;
+  self->priv->next_uridecodebin = NULL;
+  self->priv->next_uri = NULL;
+
+  /* Streams added from now on are handled as the current item ones */
+  it = gst_element_iterate_src_pads (self->priv->uridecodebin);
+  while (gst_iterator_next (it, &item) == GST_ITERATOR_OK) {
+    kms_player_endpoint_take_stream (self, g_value_get_object (&item),
+        old_uridecodebin);
+    g_value_reset (&item);
+  }
+  g_value_unset (&item);
+  gst_iterator_free (it);
+
+  g_rec_mutex_unlock (&self->priv->playlist_mutex);
+
+  /* Removes the streams the next item does not have */
+  kms_player_endpoint_destroy_pipeline (old_pipeline);
+
+  /* Timestamps go on from the last ones pushed */
+  kms_player_endpoint_clear_base_time (self);
+  kms_player_endpoint_reset_seeks (self);
+  kms_player_endpoint_acquire_index (self, uri);
+  g_free (uri);
+
+  gst_element_set_state (self->priv->pipeline, GST_STATE_PLAYING);
+
+  kms_player_endpoint_preroll_next (self);
+
+  return TRUE;
+}
+
+static gboolean
+kms_player_endpoint_enqueue_uri (KmsPlayerEndpoint * self, const gchar * uri)
+{
+  if (uri == NULL || !gst_uri_is_valid (uri)) {
+    GST_WARNING_OBJECT (self, "Invalid URI: %s", GST_STR_NULL (uri));
+    return FALSE;
+  }
+
+  if (self->priv->shared_source) {
+    GST_WARNING_OBJECT (self, "Shared sources can not play a playlist");
+    return FALSE;
+  }
+
+  g_rec_mutex_lock (&self->priv->playlist_mutex);
+  g_queue_push_tail (&self->priv->playlist, g_strdup (uri));
+  g_rec_mutex_unlock (&self->priv->playlist_mutex);
+
+  if (kms_uri_endpoint_get_state (KMS_URI_ENDPOINT (self)) ==
+      KMS_URI_ENDPOINT_STATE_START) {
+    kms_player_endpoint_preroll_next (self);
+  }
+
   return TRUE;
 }
 
@@ -992,6 +2463,23 @@ kms_player_endpoint_paused (KmsUriEndpoint * obj, GError ** error)
 
   GST_DEBUG_OBJECT (self, "Pipeline paused");
 
+  if (kms_player_endpoint_is_shared (self)) {
+    /* Others keep playing the source, this player just leaves it */
+    kms_player_endpoint_detach_source (self);
+
+    KMS_URI_ENDPOINT_GET_CLASS (self)->change_state (KMS_URI_ENDPOINT (self),
+        KMS_URI_ENDPOINT_STATE_PAUSE);
+
+    return TRUE;
+  }
+
+  if (kms_player_endpoint_pause_clip (self)) {
+    KMS_URI_ENDPOINT_GET_CLASS (self)->change_state (KMS_URI_ENDPOINT (self),
+        KMS_URI_ENDPOINT_STATE_PAUSE);
+
+    return TRUE;
+  }
+
   /* Set internal pipeline to paused */
   ret =
       kms_player_endpoint_mark_reset_base_time_and_set_state (self,
@@ -1006,7 +2494,7 @@ kms_player_endpoint_paused (KmsUriEndpoint * obj, GError ** error)
 
     gst_element_query_position (self->priv->pipeline,
         GST_FORMAT_TIME, &position);
-    kms_player_endpoint_set_position (self, position);
+    kms_player_endpoint_seek_pipeline (self, position, TRUE);
     kms_player_endpoint_mark_reset_base_time_and_set_state (self,
         GST_STATE_PAUSED);
   }
@@ -1057,6 +2545,37 @@ kms_player_endpoint_collect_media_stats (KmsElement * obj, gboolean enable)
       (kms_player_endpoint_parent_class)->collect_media_stats (obj, enable);
 }
 
+static GstStructure *
+kms_player_endpoint_stats (KmsElement * obj, gchar * selector)
+{
+  KmsPlayerEndpoint *self = KMS_PLAYER_ENDPOINT (obj);
+  KmsPlayerSeekStats seek_stats;
+  GstStructure *stats, *s_stats;
+
+  /* chain up */
+  stats =
+      KMS_ELEMENT_CLASS (kms_player_endpoint_parent_class)->stats (obj,
+      selector);
+
+  g_mutex_lock (&self->priv->seek_mutex);
+  seek_stats = self->priv->seek_stats;
+  g_mutex_unlock (&self->priv->seek_mutex);
+
+  /* Latencies go from the seek to its first sample */
+  s_stats = gst_structure_new ("seeks",
+      "count", G_TYPE_UINT, seek_stats.count,
+      "coalesced", G_TYPE_UINT, seek_stats.coalesced,
+      "skipped", G_TYPE_UINT, seek_stats.skipped,
+      "last-latency", G_TYPE_UINT64, seek_stats.last_latency,
+      "avg-latency", G_TYPE_UINT64, seek_stats.measured > 0 ?
+      seek_stats.total_latency / seek_stats.measured : 0,
+      "max-latency", G_TYPE_UINT64, seek_stats.max_latency, NULL);
+  gst_structure_set (stats, "seeks", GST_TYPE_STRUCTURE, s_stats, NULL);
+  gst_structure_free (s_stats);
+
+  return stats;
+}
+
 static void
 kms_player_endpoint_class_init (KmsPlayerEndpointClass * klass)
 {
@@ -1080,8 +2599,10 @@ kms_player_endpoint_class_init (KmsPlayerEndpointClass * klass)
 
   kms_element_class->collect_media_stats =
       GST_DEBUG_FUNCPTR (kms_player_endpoint_collect_media_stats);
+  kms_element_class->stats = GST_DEBUG_FUNCPTR (kms_player_endpoint_stats);
 
   klass->set_position = kms_player_endpoint_set_position;
+  klass->enqueue_uri = kms_player_endpoint_enqueue_uri;
 
   g_object_class_install_property (gobject_class, PROP_USE_ENCODED_MEDIA,
       g_param_spec_boolean ("use-encoded-media", "use encoded media",
@@ -1111,6 +2632,29 @@ kms_player_endpoint_class_init (KmsPlayerEndpointClass * klass)
           "eg. '3000-3005' ('0-0' = no restrictions)", PORT_RANGE_DEFAULT,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_SHARED_SOURCE,
+      g_param_spec_boolean ("shared-source", "Shared source",
+          "Play from a source and decoder shared with the other players of "
+          "the same URI. Shared sources are live: they can not be seeked "
+          "and pausing leaves the stream", FALSE,
+          G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_CLIP_CACHE_SIZE,
+      g_param_spec_uint64 ("clip-cache-size", "Clip cache size",
+          "Memory budget, in bytes, of this player in the cache of local files "
+          "shared by all players. The cache is as large as the biggest budget "
+          "set, and the player only plays from it files that fit in its own. "
+          "Cached files are played without reading them again. 0 does not "
+          "use the cache",
+          0, G_MAXUINT64, 0, G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_SYNC,
+      g_param_spec_boolean ("sync", "Sync",
+          "Play at the pace of the clock. Otherwise the media is pushed, with "
+          "its original timestamps, as fast as downstream consumes it. Not "
+          "synchronized players do not use shared sources nor the clip cache",
+          SYNC_DEFAULT, G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY));
+
   g_object_class_install_property (gobject_class, PROP_PIPELINE,
       g_param_spec_object ("pipeline", "Internal pipeline",
           "PlayerEndpoint's private pipeline",
@@ -1144,6 +2688,14 @@ kms_player_endpoint_class_init (KmsPlayerEndpointClass * klass)
       G_STRUCT_OFFSET (KmsPlayerEndpointClass, set_position), NULL, NULL,
       __kms_elements_marshal_BOOLEAN__INT64, G_TYPE_BOOLEAN, 1, G_TYPE_INT64);
 
+  kms_player_endpoint_signals[SIGNAL_ENQUEUE_URI] =
+      g_signal_new ("enqueue-uri",
+      G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_ACTION | G_SIGNAL_RUN_LAST,
+      G_STRUCT_OFFSET (KmsPlayerEndpointClass, enqueue_uri), NULL, NULL,
+      __kms_elements_marshal_BOOLEAN__STRING, G_TYPE_BOOLEAN, 1,
+      G_TYPE_STRING);
+
   /* Registers a private structure for the instantiatable type */
   g_type_class_add_private (klass, sizeof (KmsPlayerEndpointPrivate));
 }
@@ -1151,6 +2703,10 @@ kms_player_endpoint_class_init (KmsPlayerEndpointClass * klass)
 static gboolean
 kms_player_endpoint_emit_EOS_signal (gpointer data)
 {
+  if (kms_player_endpoint_next_item (KMS_PLAYER_ENDPOINT (data))) {
+    return G_SOURCE_REMOVE;
+  }
+
   GST_DEBUG ("Emit 'EOS' signal and stop endpoint");
   kms_player_endpoint_stopped (KMS_URI_ENDPOINT (data), NULL);
   g_signal_emit (G_OBJECT (data), kms_player_endpoint_signals[SIGNAL_EOS], 0);
@@ -1253,6 +2809,10 @@ bus_sync_signal_handler (GstBus * bus, GstMessage * msg, gpointer data)
       kms_loop_idle_add_full (self->priv->loop, G_PRIORITY_HIGH_IDLE,
           kms_player_endpoint_post_media_error, data, delete_error_data);
     }
+  } else if (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_ASYNC_DONE &&
+      GST_MESSAGE_SRC (msg) == GST_OBJECT (self->priv->pipeline)) {
+    kms_loop_idle_add_full (self->priv->loop, G_PRIORITY_HIGH_IDLE,
+        kms_player_endpoint_seek_done, g_object_ref (self), g_object_unref);
   }
   return GST_BUS_PASS;
 }
@@ -1352,47 +2912,83 @@ process_bus_message (GstBus * bus, GstMessage * msg, KmsPlayerEndpoint * self)
   return TRUE;
 }
 
-static void
-kms_player_endpoint_init (KmsPlayerEndpoint * self)
+/* Internal pipeline with an uridecodebin, for the current or next item */
+static GstElement *
+kms_player_endpoint_create_pipeline (KmsPlayerEndpoint * self,
+    const gchar * name, GstElement ** uridecodebin)
 {
+  GstElement *pipeline;
   GstBus *bus;
 
-  self->priv = KMS_PLAYER_ENDPOINT_GET_PRIVATE (self);
-
-  g_mutex_init (&self->priv->base_time_mutex);
-  self->priv->base_time = GST_CLOCK_TIME_NONE;
-  self->priv->base_time_preroll = GST_CLOCK_TIME_NONE;
-
-  self->priv->loop = kms_loop_new ();
-  self->priv->pipeline = gst_pipeline_new ("internalpipeline");
-  self->priv->uridecodebin =
-      gst_element_factory_make ("uridecodebin", NULL);
-  self->priv->network_cache = NETWORK_CACHE_DEFAULT;
-  self->priv->port_range = g_strdup (PORT_RANGE_DEFAULT);
-
-  self->priv->stats.probes = kms_list_new_full (g_direct_equal, g_object_unref,
-      (GDestroyNotify) kms_stats_probe_destroy);
+  pipeline = gst_pipeline_new (name);
+  *uridecodebin = gst_element_factory_make ("uridecodebin", NULL);
 
   /* Connect to signals */
-  g_signal_connect (self->priv->uridecodebin, "pad-added",
+  g_signal_connect (*uridecodebin, "pad-added",
       G_CALLBACK (kms_player_endpoint_uridecodebin_pad_added), self);
-  g_signal_connect (self->priv->uridecodebin, "pad-removed",
+  g_signal_connect (*uridecodebin, "pad-removed",
       G_CALLBACK (kms_player_endpoint_uridecodebin_pad_removed), self);
-  g_signal_connect (self->priv->uridecodebin, "source-setup",
+  g_signal_connect (*uridecodebin, "source-setup",
       G_CALLBACK (kms_player_endpoint_uridecodebin_source_setup), self);
-  g_signal_connect (self->priv->uridecodebin, "element-added",
+  g_signal_connect (*uridecodebin, "element-added",
       G_CALLBACK (kms_player_endpoint_uridecodebin_element_added), self);
 
   /* Eat all async messages such as buffering messages */
-  bus = gst_pipeline_get_bus (GST_PIPELINE (self->priv->pipeline));
+  bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
   gst_bus_add_watch (bus, (GstBusFunc) process_bus_message, self);
 
-  g_object_set (self->priv->uridecodebin, "download", TRUE, NULL);
+  g_object_set (*uridecodebin, "download", TRUE, NULL);
 
-  gst_bin_add (GST_BIN (self->priv->pipeline), self->priv->uridecodebin);
+  gst_bin_add (GST_BIN (pipeline), *uridecodebin);
 
   gst_bus_set_sync_handler (bus, bus_sync_signal_handler, self, NULL);
   g_object_unref (bus);
+
+  return pipeline;
+}
+
+static void
+kms_player_endpoint_destroy_pipeline (GstElement * pipeline)
+{
+  GstBus *bus;
+
+  bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+  gst_bus_set_sync_handler (bus, NULL, NULL, NULL);
+  gst_bus_remove_watch (bus);
+  g_object_unref (bus);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (GST_OBJECT (pipeline));
+}
+
+static void
+kms_player_endpoint_init (KmsPlayerEndpoint * self)
+{
+  self->priv = KMS_PLAYER_ENDPOINT_GET_PRIVATE (self);
+
+  g_mutex_init (&self->priv->base_time_mutex);
+  g_mutex_init (&self->priv->source_mutex);
+  g_mutex_init (&self->priv->seek_mutex);
+  self->priv->pending_position = -1;
+  self->priv->seek_keyframe = GST_CLOCK_TIME_NONE;
+  self->priv->shared_streams = g_hash_table_new_full (g_direct_hash,
+      g_direct_equal, NULL, kms_player_shared_stream_destroy);
+  self->priv->base_time = GST_CLOCK_TIME_NONE;
+  self->priv->base_time_preroll = GST_CLOCK_TIME_NONE;
+
+  g_rec_mutex_init (&self->priv->playlist_mutex);
+  g_queue_init (&self->priv->playlist);
+
+  self->priv->loop =
+      kms_loop_shards_acquire (&player_loops, &self->priv->loop_shard);
+  self->priv->pipeline = kms_player_endpoint_create_pipeline (self,
+      "internalpipeline", &self->priv->uridecodebin);
+  self->priv->network_cache = NETWORK_CACHE_DEFAULT;
+  self->priv->port_range = g_strdup (PORT_RANGE_DEFAULT);
+  self->priv->sync = SYNC_DEFAULT;
+
+  self->priv->stats.probes = kms_list_new_full (g_direct_equal, g_object_unref,
+      (GDestroyNotify) kms_stats_probe_destroy);
 }
 
 gboolean
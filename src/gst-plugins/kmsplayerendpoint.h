@@ -54,6 +54,7 @@ struct _KmsPlayerEndpointClass
 
   /*Actions*/
   gboolean (*set_position) (KmsPlayerEndpoint * self, gint64 position);
+  gboolean (*enqueue_uri) (KmsPlayerEndpoint * self, const gchar * uri);
 
   /* Signals*/
   void (*eos_signal) (KmsPlayerEndpoint * self);
@@ -0,0 +1,253 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "kmsplayerindex.h"
+#include <glib/gstdio.h>
+
+#define GST_DEFAULT_NAME "playerindex"
+#define GST_CAT_DEFAULT kms_player_index_debug_category
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+
+/* Indexes of URIs that are not played any more */
+#define MAX_IDLE_INDEXES 64
+/* Memory used by the entries of all indexes together */
+#define MAX_TOTAL_BYTES (8 * 1024 * 1024)
+#define MAX_TOTAL_ENTRIES ((gint) (MAX_TOTAL_BYTES / \
+    sizeof (KmsPlayerIndexEntry)))
+/* A single URI may not take more than a quarter of them */
+#define MAX_ENTRIES (MAX_TOTAL_ENTRIES / 4)
+
+typedef struct _KmsPlayerIndexEntry
+{
+  GstClockTime keyframe;
+  /* The next entry is the next key frame */
+  gboolean next_known;
+} KmsPlayerIndexEntry;
+
+struct _KmsPlayerIndex
+{
+  /* Protected by the registry mutex */
+  guint ref;
+  gchar *key;
+  GList link;                   /* in the idle list while not used */
+
+  GMutex mutex;
+  GArray *entries;              /* <KmsPlayerIndexEntry> sorted */
+};
+
+static GMutex registry_mutex;
+static GHashTable *registry = NULL;
+static GQueue idle = G_QUEUE_INIT;      /* most recently used first */
+static gint total_entries = 0;  /* atomic */
+
+static gchar *
+kms_player_index_get_key (const gchar * uri)
+{
+  GStatBuf st;
+  gchar *filename;
+  gchar *key;
+
+  filename = g_filename_from_uri (uri, NULL, NULL);
+
+  if (filename == NULL) {
+    return g_strdup (uri);
+  }
+
+  /* Rewritten files must not use an old index */
+  if (g_stat (filename, &st) == 0) {
+    key = g_strdup_printf ("%s|%" G_GINT64_FORMAT "|%" G_GINT64_FORMAT, uri,
+        (gint64) st.st_mtime, (gint64) st.st_size);
+  } else {
+    key = g_strdup (uri);
+  }
+
+  g_free (filename);
+
+  return key;
+}
+
+static void
+kms_player_index_free (KmsPlayerIndex * index)
+{
+  GST_DEBUG ("Index of %s freed (%u key frames)", index->key,
+      index->entries->len);
+
+  g_array_free (index->entries, TRUE);
+  g_mutex_clear (&index->mutex);
+  g_free (index->key);
+
+  g_slice_free (KmsPlayerIndex, index);
+}
+
+KmsPlayerIndex *
+kms_player_index_acquire (const gchar * uri)
+{
+  KmsPlayerIndex *index;
+  gchar *key;
+
+  g_return_val_if_fail (uri != NULL, NULL);
+
+  key = kms_player_index_get_key (uri);
+
+  g_mutex_lock (&registry_mutex);
+
+  if (registry == NULL) {
+    GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+        GST_DEFAULT_NAME);
+    registry = g_hash_table_new (g_str_hash, g_str_equal);
+  }
+
+  index = g_hash_table_lookup (registry, key);
+
+  if (index != NULL) {
+    if (index->ref++ == 0) {
+      g_queue_unlink (&idle, &index->link);
+    }
+
+    g_free (key);
+  } else {
+    index = g_slice_new0 (KmsPlayerIndex);
+    index->ref = 1;
+    index->key = key;
+    index->link.data = index;
+    g_mutex_init (&index->mutex);
+    index->entries = g_array_new (FALSE, FALSE, sizeof (KmsPlayerIndexEntry));
+    g_hash_table_insert (registry, index->key, index);
+  }
+
+  g_mutex_unlock (&registry_mutex);
+
+  return index;
+}
+
+void
+kms_player_index_release (KmsPlayerIndex * index)
+{
+  GSList *evicted = NULL;
+
+  g_mutex_lock (&registry_mutex);
+
+  if (--index->ref == 0) {
+    g_queue_push_head_link (&idle, &index->link);
+
+    /* Oldest idle indexes go first when there are too many or too big */
+    while (idle.length > MAX_IDLE_INDEXES || (idle.length > 0 &&
+            g_atomic_int_get (&total_entries) >= MAX_TOTAL_ENTRIES)) {
+      KmsPlayerIndex *oldest = g_queue_pop_tail_link (&idle)->data;
+
+      g_hash_table_remove (registry, oldest->key);
+      g_atomic_int_add (&total_entries, -(gint) oldest->entries->len);
+      evicted = g_slist_prepend (evicted, oldest);
+    }
+  }
+
+  g_mutex_unlock (&registry_mutex);
+
+  g_slist_free_full (evicted, (GDestroyNotify) kms_player_index_free);
+}
+
+/* Index of the last entry not after @keyframe, -1 if there is none */
+static gint
+kms_player_index_find (KmsPlayerIndex * index, GstClockTime keyframe)
+{
+  gint low = 0, high = (gint) index->entries->len - 1;
+
+  while (low <= high) {
+    gint mid = low + (high - low) / 2;
+
+    if (g_array_index (index->entries, KmsPlayerIndexEntry, mid).keyframe <=
+        keyframe) {
+      low = mid + 1;
+    } else {
+      high = mid - 1;
+    }
+  }
+
+  return high;
+}
+
+void
+kms_player_index_add (KmsPlayerIndex * index, GstClockTime keyframe,
+    GstClockTime previous)
+{
+  KmsPlayerIndexEntry *entry;
+  gint i;
+
+  g_return_if_fail (GST_CLOCK_TIME_IS_VALID (keyframe));
+
+  g_mutex_lock (&index->mutex);
+
+  i = kms_player_index_find (index, keyframe);
+
+  if (i < 0 || g_array_index (index->entries, KmsPlayerIndexEntry,
+          i).keyframe != keyframe) {
+    KmsPlayerIndexEntry new_entry = { keyframe, FALSE };
+
+    if (index->entries->len >= MAX_ENTRIES ||
+        g_atomic_int_get (&total_entries) >= MAX_TOTAL_ENTRIES) {
+      GST_LOG ("Index of %s full, key frame %" GST_TIME_FORMAT " skipped",
+          index->key, GST_TIME_ARGS (keyframe));
+      g_mutex_unlock (&index->mutex);
+      return;
+    }
+
+    g_array_insert_val (index->entries, ++i, new_entry);
+    g_atomic_int_inc (&total_entries);
+  }
+
+  /* Both were played in a row, nothing can be between them */
+  if (GST_CLOCK_TIME_IS_VALID (previous) && previous < keyframe && i > 0) {
+    entry = &g_array_index (index->entries, KmsPlayerIndexEntry, i - 1);
+
+    if (entry->keyframe == previous) {
+      entry->next_known = TRUE;
+    }
+  }
+
+  g_mutex_unlock (&index->mutex);
+}
+
+gboolean
+kms_player_index_lookup (KmsPlayerIndex * index, GstClockTime position,
+    GstClockTime * keyframe, GstClockTime * next)
+{
+  KmsPlayerIndexEntry *entry;
+  gboolean ret = FALSE;
+  gint i;
+
+  g_mutex_lock (&index->mutex);
+
+  i = kms_player_index_find (index, position);
+
+  if (i >= 0) {
+    entry = &g_array_index (index->entries, KmsPlayerIndexEntry, i);
+
+    if (entry->next_known) {
+      *keyframe = entry->keyframe;
+      *next = g_array_index (index->entries, KmsPlayerIndexEntry,
+          i + 1).keyframe;
+      ret = TRUE;
+    }
+  }
+
+  g_mutex_unlock (&index->mutex);
+
+  return ret;
+}
@@ -0,0 +1,45 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef _KMS_PLAYER_INDEX_H_
+#define _KMS_PLAYER_INDEX_H_
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Key frame timestamps of a URI, learned while it is played and shared by
+ * all its players. Only the groups of pictures seen from start to end are
+ * known, so a lookup never misses a key frame. Indexes of URIs nobody plays
+ * are kept for a while, in case they are opened again. All indexes share a
+ * fixed memory budget; key frames beyond it are not indexed.
+ */
+typedef struct _KmsPlayerIndex KmsPlayerIndex;
+
+KmsPlayerIndex * kms_player_index_acquire (const gchar * uri);
+void kms_player_index_release (KmsPlayerIndex * index);
+
+/* @previous is the key frame seen before in the same continuous playback */
+void kms_player_index_add (KmsPlayerIndex * index, GstClockTime keyframe,
+    GstClockTime previous);
+
+/* Gets the group of pictures holding @position, if it is known */
+gboolean kms_player_index_lookup (KmsPlayerIndex * index,
+    GstClockTime position, GstClockTime * keyframe, GstClockTime * next);
+
+G_END_DECLS
+#endif /* _KMS_PLAYER_INDEX_H_ */
@@ -0,0 +1,470 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "kmsplayersource.h"
+#include <commons/kmsutils.h>
+#include <commons/kmsagnosticcaps.h>
+
+#define GST_DEFAULT_NAME "playersource"
+#define GST_CAT_DEFAULT kms_player_source_debug_category
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+
+#define RTSPSRC "rtspsrc"
+
+#define STREAM_KEY "kms-player-source-stream"
+G_DEFINE_QUARK (STREAM_KEY, stream);
+
+#define CAPS_KEY "kms-player-source-caps"
+G_DEFINE_QUARK (CAPS_KEY, caps);
+
+typedef struct _KmsPlayerSourceSubscriber
+{
+  KmsPlayerSourceCallbacks callbacks;
+  gpointer user_data;
+} KmsPlayerSourceSubscriber;
+
+struct _KmsPlayerSource
+{
+  /* Protected by the registry mutex */
+  guint ref;
+  gchar *key;
+
+  gint network_cache;
+  gchar *port_range;
+  GstElement *pipeline;
+  GstElement *uridecodebin;
+
+  /* Streaming threads read streams and subscribers */
+  GRWLock lock;
+  GSList *streams;              /* <GstAppSink> */
+  GSList *subscribers;          /* <KmsPlayerSourceSubscriber> */
+
+  /* Serializes the state changes done when subscribers come and go */
+  GMutex state_mutex;
+};
+
+static GMutex registry_mutex;
+static GHashTable *registry = NULL;
+
+static GstFlowReturn
+kms_player_source_dispatch_sample (KmsPlayerSource * self,
+    GstAppSink * appsink, GstSample * sample, gboolean is_preroll)
+{
+  GSList *l;
+
+  if (sample == NULL) {
+    GST_ERROR_OBJECT (appsink, "Cannot get sample");
+    return GST_FLOW_OK;
+  }
+
+  g_rw_lock_reader_lock (&self->lock);
+
+  /* A player failing to push must not stop the others */
+  for (l = self->subscribers; l != NULL; l = l->next) {
+    KmsPlayerSourceSubscriber *sub = l->data;
+
+    sub->callbacks.new_sample (self, appsink, sample, is_preroll,
+        sub->user_data);
+  }
+
+  g_rw_lock_reader_unlock (&self->lock);
+
+  gst_sample_unref (sample);
+
+  return GST_FLOW_OK;
+}
+
+static GstFlowReturn
+appsink_new_preroll_cb (GstAppSink * appsink, gpointer user_data)
+{
+  return kms_player_source_dispatch_sample (user_data, appsink,
+      gst_app_sink_pull_preroll (appsink), TRUE);
+}
+
+static GstFlowReturn
+appsink_new_sample_cb (GstAppSink * appsink, gpointer user_data)
+{
+  return kms_player_source_dispatch_sample (user_data, appsink,
+      gst_app_sink_pull_sample (appsink), FALSE);
+}
+
+static void
+appsink_eos_cb (GstAppSink * appsink, gpointer user_data)
+{
+  KmsPlayerSource *self = user_data;
+  GSList *l;
+
+  g_rw_lock_reader_lock (&self->lock);
+
+  for (l = self->subscribers; l != NULL; l = l->next) {
+    KmsPlayerSourceSubscriber *sub = l->data;
+
+    sub->callbacks.stream_eos (self, appsink, sub->user_data);
+  }
+
+  g_rw_lock_reader_unlock (&self->lock);
+}
+
+static void
+kms_player_source_pad_added (GstElement * uridecodebin, GstPad * pad,
+    KmsPlayerSource * self)
+{
+  GstAppSinkCallbacks callbacks = { NULL };
+  GstPadLinkReturn link_ret;
+  GstElement *appsink;
+  GstPad *sinkpad;
+  GstCaps *caps;
+  GSList *l;
+
+  GST_DEBUG_OBJECT (pad, "Pad added");
+
+  appsink = gst_element_factory_make ("appsink", NULL);
+  g_object_set (appsink, "enable-last-sample", FALSE, "emit-signals", FALSE,
+      "qos", FALSE, "max-buffers", 1, "sync", TRUE, "async", TRUE, NULL);
+
+#if KMS_PLAYER_SOURCE_BUFFER_LISTS
+  /* Older appsinks lack it and deliver one buffer per sample */
+  if (g_object_class_find_property (G_OBJECT_GET_CLASS (appsink),
+          "buffer-list") != NULL) {
+    g_object_set (appsink, "buffer-list", TRUE, NULL);
+  }
+#endif
+
+  callbacks.eos = appsink_eos_cb;
+  callbacks.new_preroll = appsink_new_preroll_cb;
+  callbacks.new_sample = appsink_new_sample_cb;
+  gst_app_sink_set_callbacks (GST_APP_SINK (appsink), &callbacks, self, NULL);
+
+  gst_bin_add (GST_BIN (self->pipeline), appsink);
+
+  sinkpad = gst_element_get_static_pad (appsink, "sink");
+  link_ret = gst_pad_link (pad, sinkpad);
+  g_object_unref (sinkpad);
+
+  if (GST_PAD_LINK_FAILED (link_ret)) {
+    GST_ERROR_OBJECT (pad, "Cannot link to %" GST_PTR_FORMAT ": %s", appsink,
+        gst_pad_link_get_name (link_ret));
+  }
+
+  g_object_set_qdata (G_OBJECT (pad), stream_quark (), appsink);
+
+  caps = gst_pad_query_caps (pad, NULL);
+
+  g_rw_lock_writer_lock (&self->lock);
+
+  if (caps != NULL) {
+    g_object_set_qdata_full (G_OBJECT (appsink), caps_quark (), caps,
+        (GDestroyNotify) gst_caps_unref);
+  }
+
+  self->streams = g_slist_prepend (self->streams, appsink);
+
+  /* Players get ready before the first sample is prerolled */
+  for (l = self->subscribers; l != NULL; l = l->next) {
+    KmsPlayerSourceSubscriber *sub = l->data;
+
+    sub->callbacks.stream_added (self, GST_APP_SINK (appsink), caps,
+        sub->user_data);
+  }
+
+  g_rw_lock_writer_unlock (&self->lock);
+
+  gst_element_sync_state_with_parent (appsink);
+}
+
+static void
+kms_player_source_pad_removed (GstElement * uridecodebin, GstPad * pad,
+    KmsPlayerSource * self)
+{
+  GstElement *appsink;
+  GSList *l;
+
+  GST_DEBUG_OBJECT (pad, "Pad removed");
+
+  if (GST_PAD_IS_SINK (pad)) {
+    return;
+  }
+
+  appsink = g_object_steal_qdata (G_OBJECT (pad), stream_quark ());
+
+  if (appsink == NULL) {
+    return;
+  }
+
+  g_rw_lock_writer_lock (&self->lock);
+
+  self->streams = g_slist_remove (self->streams, appsink);
+
+  for (l = self->subscribers; l != NULL; l = l->next) {
+    KmsPlayerSourceSubscriber *sub = l->data;
+
+    sub->callbacks.stream_removed (self, GST_APP_SINK (appsink),
+        sub->user_data);
+  }
+
+  g_rw_lock_writer_unlock (&self->lock);
+
+  kms_utils_bin_remove (GST_BIN (self->pipeline), appsink);
+}
+
+static void
+kms_player_source_element_added (GstBin * bin, GstElement * element,
+    KmsPlayerSource * self)
+{
+  if (g_strcmp0 (gst_plugin_feature_get_name (GST_PLUGIN_FEATURE
+              (gst_element_get_factory (element))), RTSPSRC) == 0) {
+    g_object_set (G_OBJECT (element),
+        "latency", self->network_cache,
+        "drop-on-latency", TRUE, "port-range", self->port_range, NULL);
+  }
+}
+
+static GstBusSyncReply
+kms_player_source_bus_sync_handler (GstBus * bus, GstMessage * msg,
+    gpointer data)
+{
+  KmsPlayerSource *self = data;
+  GSList *l;
+
+  if (GST_MESSAGE_TYPE (msg) != GST_MESSAGE_EOS &&
+      GST_MESSAGE_TYPE (msg) != GST_MESSAGE_ERROR) {
+    /* Nobody watches this bus */
+    return GST_BUS_DROP;
+  }
+
+  GST_DEBUG_OBJECT (self->pipeline, "Forwarding %" GST_PTR_FORMAT, msg);
+
+  g_rw_lock_reader_lock (&self->lock);
+
+  for (l = self->subscribers; l != NULL; l = l->next) {
+    KmsPlayerSourceSubscriber *sub = l->data;
+
+    sub->callbacks.bus_message (self, msg, sub->user_data);
+  }
+
+  g_rw_lock_reader_unlock (&self->lock);
+
+  return GST_BUS_DROP;
+}
+
+static KmsPlayerSource *
+kms_player_source_new (gchar * key, const gchar * uri,
+    gboolean use_encoded_media, gint network_cache, const gchar * port_range)
+{
+  KmsPlayerSource *self;
+  GstBus *bus;
+
+  self = g_slice_new0 (KmsPlayerSource);
+  self->ref = 1;
+  self->key = key;
+  self->network_cache = network_cache;
+  self->port_range = g_strdup (port_range);
+  g_rw_lock_init (&self->lock);
+  g_mutex_init (&self->state_mutex);
+
+  self->pipeline = gst_pipeline_new ("sharedsourcepipeline");
+  self->uridecodebin = gst_element_factory_make ("uridecodebin", NULL);
+  g_object_set (self->uridecodebin, "uri", uri, "download", TRUE, NULL);
+
+  if (use_encoded_media) {
+    GstCaps *deco_caps = gst_caps_from_string (KMS_AGNOSTIC_NO_RTP_CAPS);
+
+    g_object_set (self->uridecodebin, "caps", deco_caps, NULL);
+    gst_caps_unref (deco_caps);
+  }
+
+  g_signal_connect (self->uridecodebin, "pad-added",
+      G_CALLBACK (kms_player_source_pad_added), self);
+  g_signal_connect (self->uridecodebin, "pad-removed",
+      G_CALLBACK (kms_player_source_pad_removed), self);
+  g_signal_connect (self->uridecodebin, "element-added",
+      G_CALLBACK (kms_player_source_element_added), self);
+
+  gst_bin_add (GST_BIN (self->pipeline), self->uridecodebin);
+
+  bus = gst_pipeline_get_bus (GST_PIPELINE (self->pipeline));
+  gst_bus_set_sync_handler (bus, kms_player_source_bus_sync_handler, self,
+      NULL);
+  g_object_unref (bus);
+
+  GST_INFO_OBJECT (self->pipeline, "Shared source created for %s", uri);
+
+  return self;
+}
+
+static void
+kms_player_source_free (KmsPlayerSource * self)
+{
+  GstBus *bus;
+
+  GST_INFO_OBJECT (self->pipeline, "Shared source destroyed");
+
+  gst_element_set_state (self->pipeline, GST_STATE_NULL);
+
+  bus = gst_pipeline_get_bus (GST_PIPELINE (self->pipeline));
+  gst_bus_set_sync_handler (bus, NULL, NULL, NULL);
+  g_object_unref (bus);
+
+  gst_object_unref (self->pipeline);
+
+  g_slist_free (self->streams);
+  g_rw_lock_clear (&self->lock);
+  g_mutex_clear (&self->state_mutex);
+  g_free (self->port_range);
+  g_free (self->key);
+
+  g_slice_free (KmsPlayerSource, self);
+}
+
+KmsPlayerSource *
+kms_player_source_acquire (const gchar * uri, gboolean use_encoded_media,
+    gint network_cache, const gchar * port_range)
+{
+  KmsPlayerSource *source;
+  gchar *key;
+
+  g_return_val_if_fail (uri != NULL, NULL);
+
+  /* Only players that would build the very same graph can share it */
+  key = g_strdup_printf ("%s|%d|%d|%s", uri, use_encoded_media, network_cache,
+      GST_STR_NULL (port_range));
+
+  g_mutex_lock (&registry_mutex);
+
+  if (registry == NULL) {
+    GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+        GST_DEFAULT_NAME);
+    registry = g_hash_table_new (g_str_hash, g_str_equal);
+  }
+
+  source = g_hash_table_lookup (registry, key);
+
+  if (source != NULL) {
+    source->ref++;
+    g_free (key);
+  } else {
+    source = kms_player_source_new (key, uri, use_encoded_media,
+        network_cache, port_range);
+    g_hash_table_insert (registry, source->key, source);
+  }
+
+  g_mutex_unlock (&registry_mutex);
+
+  return source;
+}
+
+void
+kms_player_source_release (KmsPlayerSource * source)
+{
+  g_mutex_lock (&registry_mutex);
+
+  if (--source->ref > 0) {
+    g_mutex_unlock (&registry_mutex);
+    return;
+  }
+
+  g_hash_table_remove (registry, source->key);
+
+  g_mutex_unlock (&registry_mutex);
+
+  kms_player_source_free (source);
+}
+
+void
+kms_player_source_subscribe (KmsPlayerSource * source,
+    const KmsPlayerSourceCallbacks * callbacks, gpointer user_data)
+{
+  KmsPlayerSourceSubscriber *sub;
+  gboolean first;
+  GSList *l;
+
+  sub = g_slice_new (KmsPlayerSourceSubscriber);
+  sub->callbacks = *callbacks;
+  sub->user_data = user_data;
+
+  g_mutex_lock (&source->state_mutex);
+  g_rw_lock_writer_lock (&source->lock);
+
+  for (l = source->streams; l != NULL; l = l->next) {
+    sub->callbacks.stream_added (source, GST_APP_SINK (l->data),
+        g_object_get_qdata (G_OBJECT (l->data), caps_quark ()), user_data);
+  }
+
+  first = (source->subscribers == NULL);
+  source->subscribers = g_slist_prepend (source->subscribers, sub);
+
+  g_rw_lock_writer_unlock (&source->lock);
+
+  /* State changes wait for the streaming threads, do not hold the lock */
+  if (first) {
+    gst_element_set_state (source->pipeline, GST_STATE_PLAYING);
+  }
+
+  g_mutex_unlock (&source->state_mutex);
+}
+
+void
+kms_player_source_unsubscribe (KmsPlayerSource * source, gpointer user_data)
+{
+  KmsPlayerSourceSubscriber *sub = NULL;
+  gboolean last;
+  GSList *l;
+
+  g_mutex_lock (&source->state_mutex);
+  g_rw_lock_writer_lock (&source->lock);
+
+  for (l = source->subscribers; l != NULL; l = l->next) {
+    if (((KmsPlayerSourceSubscriber *) l->data)->user_data == user_data) {
+      sub = l->data;
+      source->subscribers = g_slist_delete_link (source->subscribers, l);
+      break;
+    }
+  }
+
+  if (sub != NULL) {
+    for (l = source->streams; l != NULL; l = l->next) {
+      sub->callbacks.stream_removed (source, GST_APP_SINK (l->data),
+          user_data);
+    }
+  }
+
+  last = (sub != NULL && source->subscribers == NULL);
+
+  g_rw_lock_writer_unlock (&source->lock);
+
+  /* The source is not connected while nobody plays it. Stopping it runs
+   * pad-removed, which takes the writer lock again; state_mutex keeps a
+   * new subscriber from starting it in between */
+  if (last) {
+    gst_element_set_state (source->pipeline, GST_STATE_NULL);
+  }
+
+  g_mutex_unlock (&source->state_mutex);
+
+  if (sub != NULL) {
+    g_slice_free (KmsPlayerSourceSubscriber, sub);
+  }
+}
+
+GstElement *
+kms_player_source_get_pipeline (KmsPlayerSource * source)
+{
+  return source->pipeline;
+}
@@ -0,0 +1,71 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef _KMS_PLAYER_SOURCE_H_
+#define _KMS_PLAYER_SOURCE_H_
+
+#include <gst/gst.h>
+#include <gst/app/gstappsink.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Source and decoding graph shared by all the players of the same URI and
+ * settings. Every decoded stream ends in a single appsink whose samples
+ * are handed to each subscriber, so a camera is connected and decoded only
+ * once however many players show it. Subscribers get the same samples and
+ * must not modify them in place.
+ *
+ * The graph plays while there is any subscriber. Callbacks are called from
+ * streaming threads, never after kms_player_source_unsubscribe returns.
+ * new_sample and stream_eos are called for each subscriber in turn, with
+ * the subscriber list locked: they must not block, or every player of the
+ * URI stalls and subscribers can not come or go.
+ */
+typedef struct _KmsPlayerSource KmsPlayerSource;
+
+/* Samples only carry buffer lists since GStreamer 1.16 */
+#define KMS_PLAYER_SOURCE_BUFFER_LISTS GST_CHECK_VERSION (1, 16, 0)
+
+typedef struct _KmsPlayerSourceCallbacks
+{
+  void (*stream_added) (KmsPlayerSource * source, GstAppSink * stream,
+      GstCaps * caps, gpointer user_data);
+  void (*stream_removed) (KmsPlayerSource * source, GstAppSink * stream,
+      gpointer user_data);
+  GstFlowReturn (*new_sample) (KmsPlayerSource * source, GstAppSink * stream,
+      GstSample * sample, gboolean is_preroll, gpointer user_data);
+  void (*stream_eos) (KmsPlayerSource * source, GstAppSink * stream,
+      gpointer user_data);
+  /* EOS and error messages of the shared pipeline */
+  void (*bus_message) (KmsPlayerSource * source, GstMessage * message,
+      gpointer user_data);
+} KmsPlayerSourceCallbacks;
+
+KmsPlayerSource * kms_player_source_acquire (const gchar * uri,
+    gboolean use_encoded_media, gint network_cache, const gchar * port_range);
+void kms_player_source_release (KmsPlayerSource * source);
+
+/* Existing streams are notified with stream_added before returning */
+void kms_player_source_subscribe (KmsPlayerSource * source,
+    const KmsPlayerSourceCallbacks * callbacks, gpointer user_data);
+void kms_player_source_unsubscribe (KmsPlayerSource * source,
+    gpointer user_data);
+
+GstElement * kms_player_source_get_pipeline (KmsPlayerSource * source);
+
+G_END_DECLS
+#endif /* _KMS_PLAYER_SOURCE_H_ */
@@ -25,7 +25,11 @@
 #include <commons/kmsutils.h>
 #include <commons/kmsagnosticcaps.h>
 
+#include <string.h>
+
 #include "kmsavmuxer.h"
+#include "kmsrecordingplaylist.h"
+#include "kmsfilesink.h"
 
 #define OBJECT_NAME "avmuxer"
 #define KMS_AV_MUXER_NAME OBJECT_NAME
@@ -52,6 +56,18 @@ struct _KmsAVMuxerPrivate
   GstElement *sink;
   GstClockTime lastVideoPts;
   GstClockTime lastAudioPts;
+  guint fragment_duration;
+
+  /* Segmented recordings, protected by the muxer lock */
+  guint segment_duration;
+  guint64 max_segment_bytes;
+  GstElement *splitmux;
+  KmsRecordingPlaylist *playlist;
+  gchar *segment_base;
+  gchar *segment_ext;
+  gchar *segment_location;      /* Segment being written */
+  GstClockTime segment_start;
+  GstClockTime media_end;
 
   gboolean sink_signaled;
 };
@@ -62,22 +78,92 @@ typedef struct _BufferListItData
   GstElement *elem;
 } BufferListItData;
 
+enum
+{
+  PROP_0,
+  PROP_FRAGMENT_DURATION,
+  PROP_SEGMENT_DURATION,
+  PROP_MAX_SEGMENT_BYTES,
+  N_PROPERTIES
+};
+
+#define KMS_AV_MUXER_DEFAULT_FRAGMENT_DURATION 0
+#define KMS_AV_MUXER_DEFAULT_SEGMENT_DURATION 0
+#define KMS_AV_MUXER_DEFAULT_MAX_SEGMENT_BYTES 0
+
+static GParamSpec *obj_properties[N_PROPERTIES] = { NULL, };
+
 G_DEFINE_TYPE_WITH_CODE (KmsAVMuxer, kms_av_muxer,
     KMS_TYPE_BASE_MEDIA_MUXER,
     GST_DEBUG_CATEGORY_INIT (kms_av_muxer_debug_category, OBJECT_NAME,
         0, "debug category for muxing pipeline object"));
 
+/* Must be called with the muxer lock held. Returns the location of the
+ * segment being written, listed with kms_av_muxer_list_segment once the
+ * lock is released */
+static gchar *
+kms_av_muxer_take_segment (KmsAVMuxer * self, GstClockTime end,
+    GstClockTime * duration)
+{
+  gchar *location = self->priv->segment_location;
+
+  self->priv->segment_location = NULL;
+  *duration = GST_CLOCK_TIME_NONE;
+
+  if (location != NULL && GST_CLOCK_TIME_IS_VALID (end) &&
+      GST_CLOCK_TIME_IS_VALID (self->priv->segment_start) &&
+      end > self->priv->segment_start) {
+    *duration = end - self->priv->segment_start;
+  }
+
+  return location;
+}
+
+/* Takes @location */
+static void
+kms_av_muxer_list_segment (KmsAVMuxer * self, gchar * location,
+    GstClockTime duration)
+{
+  if (location == NULL) {
+    return;
+  }
+
+  kms_recording_playlist_add_segment (self->priv->playlist, location,
+      duration);
+  g_free (location);
+}
+
 GstStateChangeReturn
 kms_av_muxer_set_state (KmsBaseMediaMuxer * obj, GstState state)
 {
   KmsAVMuxer *self = KMS_AV_MUXER (obj);
+  GstStateChangeReturn ret;
 
   if (state == GST_STATE_NULL || state == GST_STATE_READY) {
     self->priv->lastAudioPts = 0;
     self->priv->lastVideoPts = 0;
   }
 
-  return KMS_BASE_MEDIA_MUXER_CLASS (parent_class)->set_state (obj, state);
+  ret = KMS_BASE_MEDIA_MUXER_CLASS (parent_class)->set_state (obj, state);
+
+  if (self->priv->playlist != NULL &&
+      (state == GST_STATE_NULL || state == GST_STATE_READY)) {
+    GstClockTime duration;
+    gchar *location;
+
+    /* The last segment was closed by the EOS that stopped the recording */
+    KMS_BASE_MEDIA_MUXER_LOCK (self);
+    location = kms_av_muxer_take_segment (self, self->priv->media_end,
+        &duration);
+    KMS_BASE_MEDIA_MUXER_UNLOCK (self);
+
+    if (location != NULL) {
+      kms_av_muxer_list_segment (self, location, duration);
+      kms_recording_playlist_end (self->priv->playlist);
+    }
+  }
+
+  return ret;
 }
 
 static GstElement *
@@ -123,16 +209,105 @@ kms_av_muxer_remove_src (KmsBaseMediaMuxer * obj, const gchar * id)
   return FALSE;
 }
 
+static void
+kms_av_muxer_set_property (GObject * object, guint property_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  KmsAVMuxer *self = KMS_AV_MUXER (object);
+
+  switch (property_id) {
+    case PROP_FRAGMENT_DURATION:
+      self->priv->fragment_duration = g_value_get_uint (value);
+      break;
+    case PROP_SEGMENT_DURATION:
+      self->priv->segment_duration = g_value_get_uint (value);
+      break;
+    case PROP_MAX_SEGMENT_BYTES:
+      self->priv->max_segment_bytes = g_value_get_uint64 (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+static void
+kms_av_muxer_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  KmsAVMuxer *self = KMS_AV_MUXER (object);
+
+  switch (property_id) {
+    case PROP_FRAGMENT_DURATION:
+      g_value_set_uint (value, self->priv->fragment_duration);
+      break;
+    case PROP_SEGMENT_DURATION:
+      g_value_set_uint (value, self->priv->segment_duration);
+      break;
+    case PROP_MAX_SEGMENT_BYTES:
+      g_value_set_uint64 (value, self->priv->max_segment_bytes);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+static void
+kms_av_muxer_finalize (GObject * object)
+{
+  KmsAVMuxer *self = KMS_AV_MUXER (object);
+
+  if (self->priv->playlist != NULL) {
+    kms_recording_playlist_free (self->priv->playlist);
+  }
+
+  g_free (self->priv->segment_base);
+  g_free (self->priv->segment_ext);
+  g_free (self->priv->segment_location);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
 static void
 kms_av_muxer_class_init (KmsAVMuxerClass * klass)
 {
   KmsBaseMediaMuxerClass *basemediamuxerclass;
+  GObjectClass *objclass = G_OBJECT_CLASS (klass);
+
+  objclass->set_property = kms_av_muxer_set_property;
+  objclass->get_property = kms_av_muxer_get_property;
+  objclass->finalize = kms_av_muxer_finalize;
 
   basemediamuxerclass = KMS_BASE_MEDIA_MUXER_CLASS (klass);
   basemediamuxerclass->set_state = kms_av_muxer_set_state;
   basemediamuxerclass->add_src = kms_av_muxer_add_src;
   basemediamuxerclass->remove_src = kms_av_muxer_remove_src;
 
+  obj_properties[PROP_FRAGMENT_DURATION] =
+      g_param_spec_uint (KMS_AV_MUXER_FRAGMENT_DURATION,
+      "MP4 fragment duration",
+      "Milliseconds of media in each fragment of MP4 recordings "
+      "(0 = not fragmented)", 0, G_MAXUINT,
+      KMS_AV_MUXER_DEFAULT_FRAGMENT_DURATION,
+      (G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE));
+
+  obj_properties[PROP_SEGMENT_DURATION] =
+      g_param_spec_uint (KMS_AV_MUXER_SEGMENT_DURATION,
+      "Segment duration",
+      "Milliseconds after which local recordings go on in a new file "
+      "(0 = no limit)", 0, G_MAXUINT, KMS_AV_MUXER_DEFAULT_SEGMENT_DURATION,
+      (G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE));
+
+  obj_properties[PROP_MAX_SEGMENT_BYTES] =
+      g_param_spec_uint64 (KMS_AV_MUXER_MAX_SEGMENT_BYTES,
+      "Max segment bytes",
+      "Bytes after which local recordings go on in a new file "
+      "(0 = no limit)", 0, G_MAXUINT64, KMS_AV_MUXER_DEFAULT_MAX_SEGMENT_BYTES,
+      (G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE));
+
+  g_object_class_install_properties (objclass, N_PROPERTIES, obj_properties);
+
   g_type_class_add_private (klass, sizeof (KmsAVMuxerPrivate));
 }
 
@@ -143,6 +318,8 @@ kms_av_muxer_init (KmsAVMuxer * self)
 
   self->priv->lastVideoPts = G_GUINT64_CONSTANT (0);
   self->priv->lastAudioPts = G_GUINT64_CONSTANT (0);
+  self->priv->segment_start = GST_CLOCK_TIME_NONE;
+  self->priv->media_end = GST_CLOCK_TIME_NONE;
 }
 
 static GstElement *
@@ -166,9 +343,19 @@ kms_av_muxer_create_muxer (KmsAVMuxer * self)
           gst_element_factory_find ("filesink");
       GstElementFactory *sink_factory =
           gst_element_get_factory (self->priv->sink);
-
-      if ((gst_element_factory_get_element_type (sink_factory) !=
-              gst_element_factory_get_element_type (file_sink_factory))) {
+      gboolean seekable = KMS_IS_FILE_SINK (self->priv->sink) ||
+          gst_element_factory_get_element_type (sink_factory) ==
+          gst_element_factory_get_element_type (file_sink_factory);
+
+      if (self->priv->fragment_duration > 0) {
+        /*
+         * Fragments are written as soon as they are complete, so memory does
+         * not grow with the recording and an unfinished file can be played.
+         * Only seekable sinks get the index and duration updated at the end.
+         */
+        g_object_set (mux, "fragment-duration", self->priv->fragment_duration,
+            "streamable", !seekable, NULL);
+      } else if (!seekable) {
         g_object_set (mux, "faststart", TRUE, NULL);
       }
 
@@ -211,36 +398,40 @@ kms_av_muxer_get_sink_pad_name (KmsRecordingProfile profile,
   }
 }
 
-static void
-kms_av_muxer_prepare_pipeline (KmsAVMuxer * self)
+static const gchar *
+kms_av_muxer_get_link_pad_name (KmsAVMuxer * self, KmsElementPadType type)
 {
-  self->priv->videosrc = gst_element_factory_make ("appsrc", "videoSrc");
-  self->priv->audiosrc = gst_element_factory_make ("appsrc", "audioSrc");
-
-  self->priv->sink =
-      KMS_BASE_MEDIA_MUXER_GET_CLASS (self)->create_sink (KMS_BASE_MEDIA_MUXER
-      (self), KMS_BASE_MEDIA_MUXER_GET_URI (self));
-
-  g_object_set (self->priv->videosrc, "block", TRUE, "format", GST_FORMAT_TIME,
-      "max-bytes", 0, NULL);
-  g_object_set (self->priv->audiosrc, "block", TRUE, "format", GST_FORMAT_TIME,
-      "max-bytes", 0, NULL);
+  if (self->priv->splitmux == NULL) {
+    return kms_av_muxer_get_sink_pad_name (KMS_BASE_MEDIA_MUXER_GET_PROFILE
+        (self), type);
+  }
 
-  self->priv->mux = kms_av_muxer_create_muxer (self);
+  /* splitmuxsink requests the pads of its muxer by itself */
+  if (type == KMS_ELEMENT_PAD_TYPE_VIDEO) {
+    return "video";
+  } else if (type == KMS_ELEMENT_PAD_TYPE_AUDIO) {
+    return "audio_%u";
+  } else {
+    return NULL;
+  }
+}
 
-  gst_bin_add_many (GST_BIN (KMS_BASE_MEDIA_MUXER_GET_PIPELINE (self)),
-      self->priv->videosrc, self->priv->audiosrc, self->priv->mux,
-      self->priv->sink, NULL);
+static void
+kms_av_muxer_link_muxer (KmsAVMuxer * self)
+{
+  GstElement *mux = self->priv->mux;
 
-  if (!gst_element_link (self->priv->mux, self->priv->sink)) {
+  if (self->priv->splitmux != NULL) {
+    /* splitmuxsink links its muxer and sink by itself */
+    mux = self->priv->splitmux;
+  } else if (!gst_element_link (self->priv->mux, self->priv->sink)) {
     GST_ERROR_OBJECT (self, "Could not link elements: %"
         GST_PTR_FORMAT ", %" GST_PTR_FORMAT, self->priv->mux, self->priv->sink);
   }
 
   if (kms_recording_profile_supports_type (KMS_BASE_MEDIA_MUXER_GET_PROFILE
           (self), KMS_ELEMENT_PAD_TYPE_VIDEO)) {
-    const gchar *pad_name =
-        kms_av_muxer_get_sink_pad_name (KMS_BASE_MEDIA_MUXER_GET_PROFILE (self),
+    const gchar *pad_name = kms_av_muxer_get_link_pad_name (self,
         KMS_ELEMENT_PAD_TYPE_VIDEO);
 
     if (pad_name == NULL) {
@@ -248,18 +439,16 @@ kms_av_muxer_prepare_pipeline (KmsAVMuxer * self)
       return;
     }
 
-    if (!gst_element_link_pads (self->priv->videosrc, "src", self->priv->mux,
-            pad_name)) {
+    if (!gst_element_link_pads (self->priv->videosrc, "src", mux, pad_name)) {
       GST_ERROR_OBJECT (self,
           "Could not link elements: %" GST_PTR_FORMAT ", %" GST_PTR_FORMAT,
-          self->priv->videosrc, self->priv->mux);
+          self->priv->videosrc, mux);
     }
   }
 
   if (kms_recording_profile_supports_type (KMS_BASE_MEDIA_MUXER_GET_PROFILE
           (self), KMS_ELEMENT_PAD_TYPE_AUDIO)) {
-    const gchar *pad_name =
-        kms_av_muxer_get_sink_pad_name (KMS_BASE_MEDIA_MUXER_GET_PROFILE (self),
+    const gchar *pad_name = kms_av_muxer_get_link_pad_name (self,
         KMS_ELEMENT_PAD_TYPE_AUDIO);
 
     if (pad_name == NULL) {
@@ -267,15 +456,301 @@ kms_av_muxer_prepare_pipeline (KmsAVMuxer * self)
       return;
     }
 
-    if (!gst_element_link_pads (self->priv->audiosrc, "src", self->priv->mux,
-            pad_name)) {
+    if (!gst_element_link_pads (self->priv->audiosrc, "src", mux, pad_name)) {
       GST_ERROR_OBJECT (self,
           "Could not link elements: %" GST_PTR_FORMAT ", %" GST_PTR_FORMAT,
-          self->priv->audiosrc, self->priv->mux);
+          self->priv->audiosrc, mux);
     }
   }
 }
 
+static gboolean
+kms_av_muxer_is_segmented (KmsAVMuxer * self)
+{
+  if (self->priv->segment_duration == 0 && self->priv->max_segment_bytes == 0) {
+    return FALSE;
+  }
+
+  if (KMS_BASE_MEDIA_MUXER_GET_PROFILE (self) ==
+      KMS_RECORDING_PROFILE_JPEG_VIDEO_ONLY) {
+    GST_WARNING_OBJECT (self, "Snapshots can not be segmented");
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static gchar *
+kms_av_muxer_start_segment (KmsAVMuxer * self, guint fragment_id,
+    GstClockTime start)
+{
+  GstClockTime duration;
+  gchar *location, *previous;
+
+  location = g_strdup_printf ("%s_%05u%s", self->priv->segment_base,
+      fragment_id, self->priv->segment_ext);
+
+  KMS_BASE_MEDIA_MUXER_LOCK (self);
+
+  /* The previous segment ends where this one starts */
+  previous = kms_av_muxer_take_segment (self, start, &duration);
+
+  self->priv->segment_location = g_strdup (location);
+  self->priv->segment_start = start;
+
+  KMS_BASE_MEDIA_MUXER_UNLOCK (self);
+
+  kms_av_muxer_list_segment (self, previous, duration);
+
+  GST_DEBUG_OBJECT (self, "Recording segment %s", location);
+
+  return location;
+}
+
+#if GST_CHECK_VERSION (1, 12, 0)
+static GstClockTime
+kms_av_muxer_get_sample_time (GstSample * sample)
+{
+  GstBuffer *buffer;
+  GstSegment *segment;
+  GstClockTime time;
+
+  if (sample == NULL || (buffer = gst_sample_get_buffer (sample)) == NULL) {
+    return GST_CLOCK_TIME_NONE;
+  }
+
+  time = GST_BUFFER_PTS_OR_DTS (buffer);
+  segment = gst_sample_get_segment (sample);
+
+  if (segment != NULL && segment->format == GST_FORMAT_TIME &&
+      GST_CLOCK_TIME_IS_VALID (time)) {
+    time = gst_segment_to_running_time (segment, GST_FORMAT_TIME, time);
+  }
+
+  return time;
+}
+
+static gchar *
+kms_av_muxer_format_location (GstElement * splitmux, guint fragment_id,
+    GstSample * first_sample, KmsAVMuxer * self)
+{
+  return kms_av_muxer_start_segment (self, fragment_id,
+      kms_av_muxer_get_sample_time (first_sample));
+}
+#else
+static gchar *
+kms_av_muxer_format_location (GstElement * splitmux, guint fragment_id,
+    KmsAVMuxer * self)
+{
+  /* Start of segments is unknown, they are listed without duration */
+  return kms_av_muxer_start_segment (self, fragment_id, GST_CLOCK_TIME_NONE);
+}
+#endif
+
+static GstPadProbeReturn
+kms_av_muxer_media_end_probe (GstPad * pad, GstPadProbeInfo * info,
+    KmsAVMuxer * self)
+{
+  GstBuffer *buffer;
+  GstClockTime end;
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+    GstBufferList *list = GST_PAD_PROBE_INFO_BUFFER_LIST (info);
+    guint len = gst_buffer_list_length (list);
+
+    if (len == 0) {
+      return GST_PAD_PROBE_OK;
+    }
+
+    buffer = gst_buffer_list_get (list, len - 1);
+  } else {
+    buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+  }
+
+  end = GST_BUFFER_PTS_OR_DTS (buffer);
+
+  if (!GST_CLOCK_TIME_IS_VALID (end)) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  if (GST_BUFFER_DURATION_IS_VALID (buffer)) {
+    end += GST_BUFFER_DURATION (buffer);
+  }
+
+  KMS_BASE_MEDIA_MUXER_LOCK (self);
+
+  if (!GST_CLOCK_TIME_IS_VALID (self->priv->media_end) ||
+      end > self->priv->media_end) {
+    self->priv->media_end = end;
+  }
+
+  KMS_BASE_MEDIA_MUXER_UNLOCK (self);
+
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+kms_av_muxer_track_media_end (KmsAVMuxer * self, GstElement * appsrc)
+{
+  GstPad *pad = gst_element_get_static_pad (appsrc, "src");
+
+  gst_pad_add_probe (pad,
+      GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+      (GstPadProbeCallback) kms_av_muxer_media_end_probe, self, NULL);
+
+  g_object_unref (pad);
+}
+
+static GstElement *
+kms_av_muxer_create_splitmux (KmsAVMuxer * self)
+{
+  GstElement *splitmux;
+  gchar *location, *basename, *dot, *path;
+
+  location = g_filename_from_uri (KMS_BASE_MEDIA_MUXER_GET_URI (self), NULL,
+      NULL);
+
+  if (location == NULL) {
+    GST_WARNING_OBJECT (self, "Only local files can be segmented, "
+        "recording %s as a single file", KMS_BASE_MEDIA_MUXER_GET_URI (self));
+    return NULL;
+  }
+
+  splitmux = gst_element_factory_make ("splitmuxsink", NULL);
+
+  if (splitmux == NULL) {
+    GST_WARNING_OBJECT (self, "splitmuxsink is not available, "
+        "recording %s as a single file", location);
+    g_free (location);
+    return NULL;
+  }
+
+  /* /rec/call.webm is recorded as /rec/call_00000.webm, /rec/call_00001.webm
+   * ... and listed in /rec/call.m3u8 */
+  basename = strrchr (location, G_DIR_SEPARATOR);
+  dot = strrchr (basename != NULL ? basename : location, '.');
+
+  if (dot != NULL) {
+    self->priv->segment_ext = g_strdup (dot);
+    *dot = '\0';
+  } else {
+    self->priv->segment_ext = g_strdup ("");
+  }
+
+  self->priv->segment_base = location;
+
+  path = g_strconcat (location, ".m3u8", NULL);
+  self->priv->playlist = kms_recording_playlist_new (path);
+  g_free (path);
+
+  g_object_set (splitmux, "muxer", self->priv->mux, "sink", self->priv->sink,
+      "max-size-time", (guint64) self->priv->segment_duration * GST_MSECOND,
+      "max-size-bytes", self->priv->max_segment_bytes, NULL);
+
+#if GST_CHECK_VERSION (1, 12, 0)
+  if (self->priv->max_segment_bytes == 0) {
+    /* Cut on time as precisely as possible instead of waiting for the
+     * next key frame the source sends by itself */
+    g_object_set (splitmux, "send-keyframe-requests", TRUE, NULL);
+  }
+
+  g_signal_connect (splitmux, "format-location-full",
+      G_CALLBACK (kms_av_muxer_format_location), self);
+#else
+  g_signal_connect (splitmux, "format-location",
+      G_CALLBACK (kms_av_muxer_format_location), self);
+#endif
+
+  return splitmux;
+}
+
+static void
+kms_av_muxer_prepare_pipeline (KmsAVMuxer * self)
+{
+  self->priv->videosrc = gst_element_factory_make ("appsrc", "videoSrc");
+  self->priv->audiosrc = gst_element_factory_make ("appsrc", "audioSrc");
+
+  self->priv->sink =
+      KMS_BASE_MEDIA_MUXER_GET_CLASS (self)->create_sink (KMS_BASE_MEDIA_MUXER
+      (self), KMS_BASE_MEDIA_MUXER_GET_URI (self));
+
+  kms_base_media_muxer_configure_appsrc (KMS_BASE_MEDIA_MUXER (self),
+      self->priv->videosrc);
+  kms_base_media_muxer_configure_appsrc (KMS_BASE_MEDIA_MUXER (self),
+      self->priv->audiosrc);
+
+  self->priv->mux = kms_av_muxer_create_muxer (self);
+
+  if (kms_av_muxer_is_segmented (self)) {
+    self->priv->splitmux = kms_av_muxer_create_splitmux (self);
+  }
+
+  if (self->priv->splitmux != NULL) {
+    gst_bin_add_many (GST_BIN (KMS_BASE_MEDIA_MUXER_GET_PIPELINE (self)),
+        self->priv->videosrc, self->priv->audiosrc, self->priv->splitmux,
+        NULL);
+    kms_av_muxer_track_media_end (self, self->priv->videosrc);
+    kms_av_muxer_track_media_end (self, self->priv->audiosrc);
+  } else {
+    gst_bin_add_many (GST_BIN (KMS_BASE_MEDIA_MUXER_GET_PIPELINE (self)),
+        self->priv->videosrc, self->priv->audiosrc, self->priv->mux,
+        self->priv->sink, NULL);
+  }
+
+  kms_av_muxer_link_muxer (self);
+}
+
+gboolean
+kms_av_muxer_set_profile (KmsAVMuxer * self, KmsRecordingProfile profile)
+{
+  KmsBaseMediaMuxer *base = KMS_BASE_MEDIA_MUXER (self);
+  GstElement *mux;
+
+  if (base->profile == profile) {
+    return TRUE;
+  }
+
+  if (kms_recording_profile_supports_type (base->profile,
+          KMS_ELEMENT_PAD_TYPE_AUDIO) !=
+      kms_recording_profile_supports_type (profile, KMS_ELEMENT_PAD_TYPE_AUDIO)
+      || kms_recording_profile_supports_type (base->profile,
+          KMS_ELEMENT_PAD_TYPE_VIDEO) !=
+      kms_recording_profile_supports_type (profile,
+          KMS_ELEMENT_PAD_TYPE_VIDEO)) {
+    GST_ERROR_OBJECT (self, "Profile %d does not record the same media as %d",
+        profile, base->profile);
+    return FALSE;
+  }
+
+  if (self->priv->splitmux != NULL) {
+    GST_WARNING_OBJECT (self, "The container of segmented recordings "
+        "can not be changed");
+    return FALSE;
+  }
+
+  GST_DEBUG_OBJECT (self, "Changing recording profile from %d to %d",
+      base->profile, profile);
+
+  /* Nothing has been pushed, so the old muxer has not produced any data */
+  mux = gst_object_ref (self->priv->mux);
+  gst_element_unlink (self->priv->videosrc, mux);
+  gst_element_unlink (self->priv->audiosrc, mux);
+  gst_element_unlink (mux, self->priv->sink);
+  gst_bin_remove (GST_BIN (KMS_BASE_MEDIA_MUXER_GET_PIPELINE (self)), mux);
+  gst_element_set_state (mux, GST_STATE_NULL);
+  gst_object_unref (mux);
+
+  base->profile = profile;
+  self->priv->mux = kms_av_muxer_create_muxer (self);
+  gst_bin_add (GST_BIN (KMS_BASE_MEDIA_MUXER_GET_PIPELINE (self)),
+      self->priv->mux);
+
+  kms_av_muxer_link_muxer (self);
+  gst_element_sync_state_with_parent (self->priv->mux);
+
+  return TRUE;
+}
+
 KmsAVMuxer *
 kms_av_muxer_new (const char *optname1, ...)
 {
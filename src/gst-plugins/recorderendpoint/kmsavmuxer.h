@@ -40,6 +40,9 @@ G_BEGIN_DECLS
   KMS_TYPE_AV_MUXER))
 
 #define KMS_AV_MUXER_PROFILE "profile"
+#define KMS_AV_MUXER_FRAGMENT_DURATION "fragment-duration"
+#define KMS_AV_MUXER_SEGMENT_DURATION "segment-duration"
+#define KMS_AV_MUXER_MAX_SEGMENT_BYTES "max-segment-bytes"
 
 typedef struct _KmsAVMuxer KmsAVMuxer;
 typedef struct _KmsAVMuxerClass KmsAVMuxerClass;
@@ -62,5 +65,9 @@ GType kms_av_muxer_get_type ();
 
 KmsAVMuxer * kms_av_muxer_new (const char *optname1, ...);
 
+/* Replaces the container muxer, before any data has been pushed to it */
+gboolean kms_av_muxer_set_profile (KmsAVMuxer * self,
+    KmsRecordingProfile profile);
+
 G_END_DECLS
 #endif
@@ -24,6 +24,8 @@
 #include <commons/kms-core-enumtypes.h>
 
 #include "kmsbasemediamuxer.h"
+#include "kmsspillqueue.h"
+#include "kmss3sink.h"
 
 #define OBJECT_NAME "basemediamuxer"
 
@@ -36,6 +38,7 @@ G_DEFINE_TYPE_WITH_CODE (KmsBaseMediaMuxer, kms_base_media_muxer, G_TYPE_OBJECT,
     GST_DEBUG_CATEGORY_INIT (kms_base_media_muxer_debug_category, OBJECT_NAME,
         0, "debug category for muxing pipeline object"));
 
+#define FILE_PROTO "file"
 #define HTTP_PROTO "http"
 #define HTTPS_PROTO "https"
 
@@ -46,11 +49,18 @@ enum
   PROP_0,
   PROP_URI,
   PROP_PROFILE,
+  PROP_MAX_QUEUE_BYTES,
+  PROP_MAX_SPILL_BYTES,
+  PROP_SPILL_DIR,
+  PROP_SINK_PROPERTIES,
   N_PROPERTIES
 };
 
 #define KMA_BASE_MEDIA_MUXER_DEFAULT_URI NULL
 #define KMA_BASE_MEDIA_MUXER_DEFAULT_RECORDING_PROFILE KMS_RECORDING_PROFILE_WEBM
+#define KMA_BASE_MEDIA_MUXER_DEFAULT_MAX_QUEUE_BYTES G_GUINT64_CONSTANT (2097152)
+#define KMA_BASE_MEDIA_MUXER_DEFAULT_MAX_SPILL_BYTES G_GUINT64_CONSTANT (1073741824)
+#define KMA_BASE_MEDIA_MUXER_DEFAULT_SPILL_DIR NULL
 
 static GParamSpec *obj_properties[N_PROPERTIES] = { NULL, };
 
@@ -63,6 +73,203 @@ enum
 
 static guint obj_signals[LAST_SIGNAL] = { 0 };
 
+/*
+ * Muxing bins are not run in a pipeline of their own. They are hosted by a
+ * process-wide set of pipelines (one per CPU core unless set otherwise with
+ * kms_base_media_muxer_set_n_pipelines ()) that stay in PLAYING for the
+ * whole life of the process; every muxer picks the least loaded one at
+ * creation. Bins handle their async state changes themselves, so starting
+ * or stopping a recording never makes the rest of the pipeline lose its
+ * state, and the messages of each bin are routed to the private bus of its
+ * muxer, so every recording still gets its own EOS, errors and state
+ * changes.
+ */
+typedef struct _KmsMuxingPipeline
+{
+  GstElement *pipeline;
+  guint users;
+} KmsMuxingPipeline;
+
+static GMutex muxing_pipelines_mutex;
+static KmsMuxingPipeline *muxing_pipelines = NULL;
+static guint n_muxing_pipelines = 0;    /* 0 = one per CPU core */
+
+static GQuark
+muxer_bus_quark (void)
+{
+  static GQuark quark = 0;
+
+  if (quark == 0) {
+    quark = g_quark_from_static_string ("kms-base-media-muxer-bus");
+  }
+
+  return quark;
+}
+
+/* Returns the child of @pipeline that contains @object, if any */
+static GstObject *
+kms_base_media_muxer_get_hosted_bin (GstObject * pipeline, GstObject * object)
+{
+  GstObject *parent;
+
+  gst_object_ref (object);
+
+  while ((parent = gst_object_get_parent (object)) != NULL) {
+    if (parent == pipeline) {
+      gst_object_unref (parent);
+      return object;
+    }
+
+    gst_object_unref (object);
+    object = parent;
+  }
+
+  gst_object_unref (object);
+
+  return NULL;
+}
+
+static GstBusSyncReply
+kms_base_media_muxer_route_message (GstBus * bus, GstMessage * msg,
+    gpointer pipeline)
+{
+  GstMessage *routed = NULL;
+  GstObject *bin;
+  GstBus *target;
+
+  if (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_ELEMENT &&
+      gst_message_has_name (msg, "GstBinForwarded")) {
+    /* EOS of hosted bins only reaches the bus through message-forward */
+    gst_structure_get (gst_message_get_structure (msg), "message",
+        GST_TYPE_MESSAGE, &routed, NULL);
+
+    if (routed == NULL || GST_MESSAGE_TYPE (routed) != GST_MESSAGE_EOS) {
+      goto drop;
+    }
+  } else {
+    routed = gst_message_ref (msg);
+  }
+
+  if (GST_MESSAGE_SRC (routed) == NULL) {
+    goto drop;
+  }
+
+  bin = kms_base_media_muxer_get_hosted_bin (GST_OBJECT (pipeline),
+      GST_MESSAGE_SRC (routed));
+
+  if (bin == NULL) {
+    goto drop;
+  }
+
+  target = g_object_get_qdata (G_OBJECT (bin), muxer_bus_quark ());
+
+  if (target != NULL) {
+    gst_bus_post (target, routed);
+    routed = NULL;
+  }
+
+  gst_object_unref (bin);
+
+drop:
+  if (routed != NULL) {
+    gst_message_unref (routed);
+  }
+
+  return GST_BUS_DROP;
+}
+
+static GstElement *
+kms_base_media_muxer_acquire_pipeline (guint * shard)
+{
+  GstElement *pipeline;
+  guint i, selected = 0;
+
+  g_mutex_lock (&muxing_pipelines_mutex);
+
+  if (muxing_pipelines == NULL) {
+    if (n_muxing_pipelines == 0) {
+      n_muxing_pipelines = g_get_num_processors ();
+    }
+
+    muxing_pipelines = g_new0 (KmsMuxingPipeline, n_muxing_pipelines);
+
+    for (i = 0; i < n_muxing_pipelines; i++) {
+      GstElement *p;
+      GstBus *bus;
+      gchar *name;
+
+      name = g_strdup_printf ("muxingpipeline%u", i);
+      p = gst_pipeline_new (name);
+      g_free (name);
+
+      g_object_set (p, "message-forward", TRUE, NULL);
+
+      bus = gst_pipeline_get_bus (GST_PIPELINE (p));
+      gst_bus_set_sync_handler (bus, kms_base_media_muxer_route_message, p,
+          NULL);
+      g_object_unref (bus);
+
+      gst_element_set_state (p, GST_STATE_PLAYING);
+      muxing_pipelines[i].pipeline = gst_object_ref_sink (p);
+    }
+  }
+
+  for (i = 1; i < n_muxing_pipelines; i++) {
+    if (muxing_pipelines[i].users < muxing_pipelines[selected].users) {
+      selected = i;
+    }
+  }
+
+  muxing_pipelines[selected].users++;
+  pipeline = muxing_pipelines[selected].pipeline;
+
+  g_mutex_unlock (&muxing_pipelines_mutex);
+
+  *shard = selected;
+
+  return pipeline;
+}
+
+gboolean
+kms_base_media_muxer_set_n_pipelines (guint n_pipelines)
+{
+  gboolean ret = TRUE;
+
+  g_mutex_lock (&muxing_pipelines_mutex);
+
+  if (muxing_pipelines == NULL) {
+    n_muxing_pipelines = n_pipelines;
+  } else if (n_pipelines != 0 && n_pipelines != n_muxing_pipelines) {
+    GST_WARNING ("%u muxing pipelines already running, can not use %u",
+        n_muxing_pipelines, n_pipelines);
+    ret = FALSE;
+  }
+
+  g_mutex_unlock (&muxing_pipelines_mutex);
+
+  return ret;
+}
+
+guint
+kms_base_media_muxer_get_n_pipelines (void)
+{
+  guint n_pipelines;
+
+  g_mutex_lock (&muxing_pipelines_mutex);
+  n_pipelines = n_muxing_pipelines;
+  g_mutex_unlock (&muxing_pipelines_mutex);
+
+  return n_pipelines;
+}
+
+static void
+kms_base_media_muxer_release_pipeline (guint shard)
+{
+  g_mutex_lock (&muxing_pipelines_mutex);
+  muxing_pipelines[shard].users--;
+  g_mutex_unlock (&muxing_pipelines_mutex);
+}
+
 static void
 kms_base_media_muxer_finalize (GObject * object)
 {
@@ -72,9 +279,17 @@ kms_base_media_muxer_finalize (GObject * object)
 
   gst_element_set_state (KMS_BASE_MEDIA_MUXER_GET_PIPELINE (self),
       GST_STATE_NULL);
+  gst_bin_remove (GST_BIN (muxing_pipelines[self->shard].pipeline),
+      KMS_BASE_MEDIA_MUXER_GET_PIPELINE (self));
+  kms_base_media_muxer_release_pipeline (self->shard);
   g_clear_object (&KMS_BASE_MEDIA_MUXER_GET_PIPELINE (self));
+  g_clear_object (&self->bus);
   g_rec_mutex_clear (&self->mutex);
   g_free (self->uri);
+  g_free (self->spill_dir);
+  if (self->sink_properties != NULL) {
+    gst_structure_free (self->sink_properties);
+  }
 
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
@@ -82,9 +297,22 @@ kms_base_media_muxer_finalize (GObject * object)
 GstStateChangeReturn
 kms_base_media_muxer_set_state_impl (KmsBaseMediaMuxer * obj, GstState state)
 {
+  GstStateChangeReturn ret;
+
   g_return_val_if_fail (obj != NULL, GST_STATE_CHANGE_FAILURE);
 
-  return gst_element_set_state (KMS_BASE_MEDIA_MUXER_GET_PIPELINE (obj), state);
+  /* Same as the auto-flush-bus behaviour of a pipeline */
+  if (state != GST_STATE_NULL) {
+    gst_bus_set_flushing (obj->bus, FALSE);
+  }
+
+  ret = gst_element_set_state (KMS_BASE_MEDIA_MUXER_GET_PIPELINE (obj), state);
+
+  if (state == GST_STATE_NULL) {
+    gst_bus_set_flushing (obj->bus, TRUE);
+  }
+
+  return ret;
 }
 
 GstState
@@ -98,7 +326,8 @@ kms_base_media_muxer_get_clock_impl (KmsBaseMediaMuxer * obj)
 {
   g_return_val_if_fail (obj != NULL, NULL);
 
-  return GST_ELEMENT (KMS_BASE_MEDIA_MUXER_GET_PIPELINE (obj))->clock;
+  /* The pipeline is shared, so its clock may change while it is in use */
+  return gst_element_get_clock (muxing_pipelines[obj->shard].pipeline);
 }
 
 GstBus *
@@ -106,9 +335,7 @@ kms_base_media_muxer_get_bus_impl (KmsBaseMediaMuxer * obj)
 {
   g_return_val_if_fail (obj != NULL, NULL);
 
-  return
-      gst_pipeline_get_bus (GST_PIPELINE (KMS_BASE_MEDIA_MUXER_GET_PIPELINE
-          (obj)));
+  return gst_object_ref (obj->bus);
 }
 
 void
@@ -146,6 +373,14 @@ kms_base_media_muxer_get_sink_fallback (KmsBaseMediaMuxer * self,
     } else {
       GST_ERROR_OBJECT (self, "URL not valid");
     }
+  } else if ((g_strcmp0 (prot, KMS_S3_SINK_PROTOCOL) == 0)
+      || (g_strcmp0 (prot, KMS_S3_SINK_PROTOCOL_HTTP) == 0)) {
+    /* Parts are uploaded in parallel, so a slow connection does not block
+     * the muxer */
+    sink = gst_element_factory_make ("kmss3sink", NULL);
+    if (sink == NULL) {
+      GST_ERROR_OBJECT (self, "S3 upload sink not available: kmss3sink");
+    }
   }
 
   g_free (prot);
@@ -161,6 +396,7 @@ kms_base_media_muxer_get_sink (KmsBaseMediaMuxer * self, const gchar * uri)
   GstElement *sink = NULL;
   GParamSpec *pspec;
   GError *err = NULL;
+  gchar *prot;
 
   if (uri == NULL) {
     goto no_uri;
@@ -170,7 +406,18 @@ kms_base_media_muxer_get_sink (KmsBaseMediaMuxer * self, const gchar * uri)
     goto invalid_uri;
   }
 
-  sink = gst_element_make_from_uri (GST_URI_SINK, uri, NULL, &err);
+  prot = gst_uri_get_protocol (uri);
+
+  if (g_strcmp0 (prot, FILE_PROTO) == 0) {
+    /* Batched, aligned writes instead of one write per muxer buffer */
+    sink = gst_element_factory_make ("kmsfilesink", NULL);
+  }
+
+  g_free (prot);
+
+  if (sink == NULL) {
+    sink = gst_element_make_from_uri (GST_URI_SINK, uri, NULL, &err);
+  }
 
   if (sink == NULL) {
     /* Some elements have no URI handling capabilities though they can */
@@ -189,8 +436,10 @@ kms_base_media_muxer_get_sink (KmsBaseMediaMuxer * self, const gchar * uri)
 
   pspec = g_object_class_find_property (sink_class, "location");
   if (pspec != NULL && G_PARAM_SPEC_VALUE_TYPE (pspec) == G_TYPE_STRING) {
-    if (g_strcmp0 (GST_OBJECT_NAME (gst_element_get_factory (sink)),
-            "filesink") == 0) {
+    const gchar *factory = GST_OBJECT_NAME (gst_element_get_factory (sink));
+
+    if (g_strcmp0 (factory, "filesink") == 0 ||
+        g_strcmp0 (factory, "kmsfilesink") == 0) {
       /* Work around for filesink elements */
       gchar *location = gst_uri_get_location (uri);
 
@@ -240,6 +489,29 @@ end:
   return sink;
 }
 
+static gboolean
+kms_base_media_muxer_set_sink_property (GQuark field_id, const GValue * value,
+    gpointer sink)
+{
+  const gchar *name = g_quark_to_string (field_id);
+  GParamSpec *pspec;
+
+  pspec = g_object_class_find_property (G_OBJECT_GET_CLASS (sink), name);
+
+  /* Options of other kinds of sink are ignored */
+  if (pspec == NULL) {
+    GST_DEBUG_OBJECT (sink, "No property %s", name);
+  } else if (G_VALUE_HOLDS_STRING (value) &&
+      G_PARAM_SPEC_VALUE_TYPE (pspec) != G_TYPE_STRING) {
+    gst_util_set_object_arg (G_OBJECT (sink), name,
+        g_value_get_string (value));
+  } else {
+    g_object_set_property (G_OBJECT (sink), name, value);
+  }
+
+  return TRUE;
+}
+
 static GstElement *
 kms_base_media_muxer_create_sink_impl (KmsBaseMediaMuxer * self,
     const gchar * uri)
@@ -251,6 +523,9 @@ kms_base_media_muxer_create_sink_impl (KmsBaseMediaMuxer * self,
   if (sink == NULL) {
     GST_ERROR_OBJECT (self, "No available sink for uri %s", uri);
     sink = gst_element_factory_make ("fakesink", NULL);
+  } else if (self->sink_properties != NULL) {
+    gst_structure_foreach (self->sink_properties,
+        kms_base_media_muxer_set_sink_property, sink);
   }
 
   return sink;
@@ -279,6 +554,22 @@ kms_base_media_muxer_set_property (GObject * object, guint property_id,
     case PROP_PROFILE:
       self->profile = g_value_get_enum (value);
       break;
+    case PROP_MAX_QUEUE_BYTES:
+      self->max_queue_bytes = g_value_get_uint64 (value);
+      break;
+    case PROP_MAX_SPILL_BYTES:
+      self->max_spill_bytes = g_value_get_uint64 (value);
+      break;
+    case PROP_SPILL_DIR:
+      g_free (self->spill_dir);
+      self->spill_dir = g_value_dup_string (value);
+      break;
+    case PROP_SINK_PROPERTIES:
+      if (self->sink_properties != NULL) {
+        gst_structure_free (self->sink_properties);
+      }
+      self->sink_properties = g_value_dup_boxed (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -302,6 +593,18 @@ kms_base_media_muxer_get_property (GObject * object, guint property_id,
     case PROP_PROFILE:
       g_value_set_enum (value, self->profile);
       break;
+    case PROP_MAX_QUEUE_BYTES:
+      g_value_set_uint64 (value, self->max_queue_bytes);
+      break;
+    case PROP_MAX_SPILL_BYTES:
+      g_value_set_uint64 (value, self->max_spill_bytes);
+      break;
+    case PROP_SPILL_DIR:
+      g_value_set_string (value, self->spill_dir);
+      break;
+    case PROP_SINK_PROPERTIES:
+      g_value_set_boxed (value, self->sink_properties);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -338,6 +641,36 @@ kms_base_media_muxer_class_init (KmsBaseMediaMuxerClass * klass)
       KMA_BASE_MEDIA_MUXER_DEFAULT_RECORDING_PROFILE,
       (G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE));
 
+  obj_properties[PROP_MAX_QUEUE_BYTES] =
+      g_param_spec_uint64 (KMS_BASE_MEDIA_MUXER_MAX_QUEUE_BYTES,
+      "Max queue bytes",
+      "Bytes each stream may keep in memory waiting for the muxer "
+      "(0 = unlimited). Overflow is spilled to disk, then dropped until the "
+      "next key frame with a warning for each gap", 0, G_MAXUINT64,
+      KMA_BASE_MEDIA_MUXER_DEFAULT_MAX_QUEUE_BYTES,
+      (G_PARAM_CONSTRUCT | G_PARAM_READWRITE));
+
+  obj_properties[PROP_MAX_SPILL_BYTES] =
+      g_param_spec_uint64 (KMS_BASE_MEDIA_MUXER_MAX_SPILL_BYTES,
+      "Max spill bytes",
+      "Bytes each stream may spill to disk once its memory queue is full "
+      "(0 = drop until the next key frame instead)", 0, G_MAXUINT64,
+      KMA_BASE_MEDIA_MUXER_DEFAULT_MAX_SPILL_BYTES,
+      (G_PARAM_CONSTRUCT | G_PARAM_READWRITE));
+
+  obj_properties[PROP_SPILL_DIR] =
+      g_param_spec_string (KMS_BASE_MEDIA_MUXER_SPILL_DIR,
+      "Spill directory",
+      "Directory for spill files (NULL = system temporary directory)",
+      KMA_BASE_MEDIA_MUXER_DEFAULT_SPILL_DIR,
+      (G_PARAM_CONSTRUCT | G_PARAM_READWRITE));
+
+  obj_properties[PROP_SINK_PROPERTIES] =
+      g_param_spec_boxed (KMS_BASE_MEDIA_MUXER_SINK_PROPERTIES,
+      "Sink properties",
+      "Properties set on the sink, when it has them (NULL = defaults)",
+      GST_TYPE_STRUCTURE, (G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE));
+
   g_object_class_install_properties (objclass, N_PROPERTIES, obj_properties);
 
   obj_signals[SIGNAL_ON_SINK_ADDED] =
@@ -351,8 +684,20 @@ kms_base_media_muxer_class_init (KmsBaseMediaMuxerClass * klass)
 static void
 kms_base_media_muxer_init (KmsBaseMediaMuxer * self)
 {
+  GstElement *bin, *pipeline;
+
   g_rec_mutex_init (&self->mutex);
-  KMS_BASE_MEDIA_MUXER_GET_PIPELINE (self) = gst_pipeline_new (NULL);
+
+  self->bus = gst_bus_new ();
+
+  bin = gst_bin_new (NULL);
+  g_object_set (bin, "async-handling", TRUE, NULL);
+  g_object_set_qdata_full (G_OBJECT (bin), muxer_bus_quark (),
+      gst_object_ref (self->bus), gst_object_unref);
+  KMS_BASE_MEDIA_MUXER_GET_PIPELINE (self) = gst_object_ref (bin);
+
+  pipeline = kms_base_media_muxer_acquire_pipeline (&self->shard);
+  gst_bin_add (GST_BIN (pipeline), bin);
 }
 
 GstStateChangeReturn
@@ -412,3 +757,18 @@ kms_base_media_muxer_remove_src (KmsBaseMediaMuxer * obj, const gchar * id)
 
   return KMS_BASE_MEDIA_MUXER_GET_CLASS (obj)->remove_src (obj, id);
 }
+
+void
+kms_base_media_muxer_configure_appsrc (KmsBaseMediaMuxer * obj,
+    GstElement * appsrc)
+{
+  g_return_if_fail (KMS_IS_BASE_MEDIA_MUXER (obj));
+
+  KMS_BASE_MEDIA_MUXER_LOCK (obj);
+
+  g_object_set (appsrc, "format", GST_FORMAT_TIME, NULL);
+  kms_spill_queue_attach (appsrc, obj->max_queue_bytes, obj->max_spill_bytes,
+      obj->spill_dir);
+
+  KMS_BASE_MEDIA_MUXER_UNLOCK (obj);
+}
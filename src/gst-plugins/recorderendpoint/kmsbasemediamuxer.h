@@ -51,6 +51,10 @@ G_BEGIN_DECLS
 #define KMS_BASE_MEDIA_MUXER_PROFILE "profile"
 #define KMS_BASE_MEDIA_MUXER_SINK "sink"
 #define KMS_BASE_MEDIA_MUXER_URI "uri"
+#define KMS_BASE_MEDIA_MUXER_MAX_QUEUE_BYTES "max-queue-bytes"
+#define KMS_BASE_MEDIA_MUXER_MAX_SPILL_BYTES "max-spill-bytes"
+#define KMS_BASE_MEDIA_MUXER_SPILL_DIR "spill-dir"
+#define KMS_BASE_MEDIA_MUXER_SINK_PROPERTIES "sink-properties"
 
 #define KMS_BASE_MEDIA_MUXER_LOCK(elem) \
   (g_rec_mutex_lock (&KMS_BASE_MEDIA_MUXER ((elem))->mutex))
@@ -75,6 +79,14 @@ struct _KmsBaseMediaMuxer
   GRecMutex mutex;
   gchar *uri;
   KmsRecordingProfile profile;
+  guint64 max_queue_bytes;
+  guint64 max_spill_bytes;
+  gchar *spill_dir;
+  GstStructure *sink_properties;
+
+  /*< private > */
+  GstBus *bus;
+  guint shard;
 };
 
 struct _KmsBaseMediaMuxerClass
@@ -105,12 +117,21 @@ GType kms_base_media_muxer_get_type ();
 GstStateChangeReturn kms_base_media_muxer_set_state (KmsBaseMediaMuxer *obj,
   GstState state);
 GstState kms_base_media_muxer_get_state (KmsBaseMediaMuxer *obj);
+/* transfer full, NULL while the muxer has no clock */
 GstClock * kms_base_media_muxer_get_clock (KmsBaseMediaMuxer *obj);
 GstBus * kms_base_media_muxer_get_bus (KmsBaseMediaMuxer *obj);
 void kms_base_media_muxer_dot_file (KmsBaseMediaMuxer *obj);
 GstElement * kms_base_media_muxer_add_src (KmsBaseMediaMuxer *obj, KmsMediaType type, const gchar *id);
 gboolean kms_base_media_muxer_remove_src (KmsBaseMediaMuxer *obj, const gchar *id);
 
+/* Pipelines hosting the muxers of the process (0 = one per CPU core). Can
+ * only be changed before the first muxer is created */
+gboolean kms_base_media_muxer_set_n_pipelines (guint n_pipelines);
+guint kms_base_media_muxer_get_n_pipelines (void);
+
+/* <protected> */
+void kms_base_media_muxer_configure_appsrc (KmsBaseMediaMuxer *obj, GstElement *appsrc);
+
 G_END_DECLS
 
 #endif
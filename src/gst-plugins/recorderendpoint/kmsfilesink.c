@@ -0,0 +1,710 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE             /* O_DIRECT, fallocate (), sync_file_range () */
+#endif
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <glib/gstdio.h>
+
+#include "kmsfilesink.h"
+#include "kms-recorder-enumtypes.h"
+
+#define PLUGIN_NAME "kmsfilesink"
+
+#define GST_CAT_DEFAULT kms_file_sink_debug_category
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+
+#define KMS_FILE_SINK_GET_PRIVATE(obj) (  \
+  G_TYPE_INSTANCE_GET_PRIVATE (           \
+    (obj),                                \
+    KMS_TYPE_FILE_SINK,                   \
+    KmsFileSinkPrivate                    \
+  )                                       \
+)
+
+/* Offsets and sizes of O_DIRECT writes must be multiples of this */
+#define BLOCK_ALIGN 4096
+
+#define DEFAULT_DIRECT_IO TRUE
+#define DEFAULT_WRITE_SIZE (256 * 1024)
+#define DEFAULT_EXPECTED_BITRATE 0
+#define DEFAULT_FLUSH_POLICY KMS_FILE_SINK_FLUSH_NONE
+
+/* Space is preallocated for this much media at the expected bitrate */
+#define PREALLOCATE_SECONDS 60
+
+enum
+{
+  PROP_0,
+  PROP_LOCATION,
+  PROP_DIRECT_IO,
+  PROP_WRITE_SIZE,
+  PROP_EXPECTED_BITRATE,
+  PROP_FLUSH_POLICY,
+  N_PROPERTIES
+};
+
+static GParamSpec *obj_properties[N_PROPERTIES] = { NULL, };
+
+struct _KmsFileSinkPrivate
+{
+  /* Properties, protected by the object lock */
+  gchar *location;
+  gboolean direct_io;
+  guint write_size;
+  guint expected_bitrate;
+  KmsFileSinkFlushPolicy flush_policy;
+
+  /* Used by the streaming thread only */
+  gint fd;
+  gint direct_fd;               /* -1 if O_DIRECT is not available */
+  guint8 *batch;                /* Aligned to BLOCK_ALIGN */
+  gsize batch_size;
+  gsize batch_len;
+  guint64 batch_offset;         /* File offset of the batch */
+  guint64 file_size;
+  guint64 preallocated;
+  gboolean preallocate;
+  guint64 written_back;         /* Offset already sent to the disk */
+
+  /* Kept across restarts, as segmented recordings reuse the sink */
+  GMutex stats_mutex;
+  guint64 bytes_written;
+  guint64 writes;
+  guint64 direct_writes;
+  GstClockTime write_time;
+  GstClockTime max_write_time;
+  guint64 preallocated_bytes;
+};
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS_ANY);
+
+G_DEFINE_TYPE_WITH_CODE (KmsFileSink, kms_file_sink, GST_TYPE_BASE_SINK,
+    GST_DEBUG_CATEGORY_INIT (kms_file_sink_debug_category, PLUGIN_NAME,
+        0, "debug category for recording file sink"));
+
+static gboolean
+kms_file_sink_pwrite (KmsFileSink * self, gint fd, const guint8 * data,
+    gsize len, guint64 offset)
+{
+  while (len > 0) {
+    gssize ret = pwrite (fd, data, len, offset);
+
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      GST_ELEMENT_ERROR (self, RESOURCE, WRITE,
+          ("Could not write to file \"%s\"", self->priv->location),
+          ("%s", g_strerror (errno)));
+      return FALSE;
+    }
+
+    data += ret;
+    len -= ret;
+    offset += ret;
+  }
+
+  return TRUE;
+}
+
+/* Reads back what is already in the file, zeros past its end */
+static gboolean
+kms_file_sink_pread (KmsFileSink * self, guint8 * data, gsize len,
+    guint64 offset)
+{
+  while (len > 0) {
+    gssize ret = pread (self->priv->fd, data, len, offset);
+
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      GST_WARNING_OBJECT (self, "Can not read back \"%s\": %s",
+          self->priv->location, g_strerror (errno));
+      return FALSE;
+    }
+
+    if (ret == 0) {
+      memset (data, 0, len);
+      break;
+    }
+
+    data += ret;
+    len -= ret;
+    offset += ret;
+  }
+
+  return TRUE;
+}
+
+static void
+kms_file_sink_preallocate (KmsFileSink * self, guint64 end)
+{
+#ifdef FALLOC_FL_KEEP_SIZE
+  guint64 chunk, length;
+
+  if (!self->priv->preallocate || end <= self->priv->preallocated) {
+    return;
+  }
+
+  chunk = (guint64) self->priv->expected_bitrate / 8 * PREALLOCATE_SECONDS;
+  chunk = MAX (GST_ROUND_UP_N (chunk, BLOCK_ALIGN), self->priv->batch_size);
+  length = GST_ROUND_UP_N (end - self->priv->preallocated, chunk);
+
+  /* The file size is not changed, so readers never see the free space */
+  if (fallocate (self->priv->fd, FALLOC_FL_KEEP_SIZE, self->priv->preallocated,
+          length) < 0) {
+    GST_WARNING_OBJECT (self, "Can not preallocate \"%s\": %s",
+        self->priv->location, g_strerror (errno));
+    self->priv->preallocate = FALSE;
+    return;
+  }
+
+  self->priv->preallocated += length;
+
+  g_mutex_lock (&self->priv->stats_mutex);
+  self->priv->preallocated_bytes += length;
+  g_mutex_unlock (&self->priv->stats_mutex);
+#endif
+}
+
+static void
+kms_file_sink_write_back (KmsFileSink * self, guint64 end)
+{
+#ifdef SYNC_FILE_RANGE_WRITE
+  if (end <= self->priv->written_back) {
+    return;
+  }
+
+  /* Starts the write back without waiting for it, so the disk is kept busy
+   * steadily instead of flushing everything when recordings stop */
+  if (sync_file_range (self->priv->fd, self->priv->written_back,
+          end - self->priv->written_back, SYNC_FILE_RANGE_WRITE) < 0) {
+    GST_DEBUG_OBJECT (self, "sync_file_range failed: %s", g_strerror (errno));
+  }
+
+  self->priv->written_back = end;
+#endif
+}
+
+/* Writes the batch, with O_DIRECT when it is aligned */
+static gboolean
+kms_file_sink_write_batch (KmsFileSink * self)
+{
+  guint64 end = self->priv->batch_offset + self->priv->batch_len;
+  gsize len = self->priv->batch_len;
+  gboolean direct, ret;
+  GstClockTime start, elapsed;
+
+  if (len == 0) {
+    return TRUE;
+  }
+
+  /* A patch inside the file is completed up to the end of its last block
+   * with what the file already has there */
+  if (self->priv->direct_fd >= 0 && len % BLOCK_ALIGN != 0 &&
+      GST_ROUND_UP_N (end, BLOCK_ALIGN) <= self->priv->file_size &&
+      kms_file_sink_pread (self, self->priv->batch + len,
+          GST_ROUND_UP_N (len, BLOCK_ALIGN) - len, end)) {
+    len = GST_ROUND_UP_N (len, BLOCK_ALIGN);
+  }
+
+  direct = self->priv->direct_fd >= 0 &&
+      self->priv->batch_offset % BLOCK_ALIGN == 0 && len % BLOCK_ALIGN == 0;
+
+  kms_file_sink_preallocate (self, end);
+
+  start = gst_util_get_timestamp ();
+  ret = kms_file_sink_pwrite (self,
+      direct ? self->priv->direct_fd : self->priv->fd, self->priv->batch,
+      len, self->priv->batch_offset);
+  elapsed = gst_util_get_timestamp () - start;
+
+  if (!ret) {
+    return FALSE;
+  }
+
+  self->priv->file_size = MAX (self->priv->file_size,
+      self->priv->batch_offset + len);
+
+  g_mutex_lock (&self->priv->stats_mutex);
+  self->priv->bytes_written += len;
+  self->priv->writes++;
+  if (direct) {
+    self->priv->direct_writes++;
+  }
+  self->priv->write_time += elapsed;
+  self->priv->max_write_time = MAX (self->priv->max_write_time, elapsed);
+  g_mutex_unlock (&self->priv->stats_mutex);
+
+  if (!direct && self->priv->flush_policy == KMS_FILE_SINK_FLUSH_STEADY) {
+    kms_file_sink_write_back (self, end);
+  }
+
+  self->priv->batch_offset = end;
+  self->priv->batch_len = 0;
+
+  return TRUE;
+}
+
+/* After an unaligned write the next batch is shortened so that the ones
+ * following it are aligned again */
+static gsize
+kms_file_sink_batch_limit (KmsFileSink * self)
+{
+  return self->priv->batch_size - self->priv->batch_offset % BLOCK_ALIGN;
+}
+
+static gboolean
+kms_file_sink_seek (KmsFileSink * self, guint64 offset)
+{
+  if (offset == self->priv->batch_offset + self->priv->batch_len) {
+    return TRUE;
+  }
+
+  GST_DEBUG_OBJECT (self, "Seeking to %" G_GUINT64_FORMAT, offset);
+
+  if (!kms_file_sink_write_batch (self)) {
+    return FALSE;
+  }
+
+  /* Muxers patch headers at any offset. Starting the batch at the block
+   * boundary, with the bytes the file has before the offset, keeps it
+   * aligned for O_DIRECT, and so are the batches after it */
+  self->priv->batch_offset = offset;
+
+  if (self->priv->direct_fd >= 0 && offset % BLOCK_ALIGN != 0) {
+    guint64 aligned = offset - offset % BLOCK_ALIGN;
+
+    if (kms_file_sink_pread (self, self->priv->batch, offset - aligned,
+            aligned)) {
+      self->priv->batch_offset = aligned;
+      self->priv->batch_len = offset - aligned;
+    }
+  }
+
+  return TRUE;
+}
+
+static void
+kms_file_sink_close (KmsFileSink * self)
+{
+  struct stat st;
+
+  if (self->priv->direct_fd >= 0) {
+    close (self->priv->direct_fd);
+    self->priv->direct_fd = -1;
+  }
+
+  if (self->priv->fd < 0) {
+    return;
+  }
+
+  /* Releases the space preallocated past the end of the recording */
+  if (self->priv->preallocated > 0 && fstat (self->priv->fd, &st) == 0 &&
+      self->priv->preallocated > (guint64) st.st_size &&
+      ftruncate (self->priv->fd, st.st_size) < 0) {
+    GST_WARNING_OBJECT (self, "Can not trim \"%s\": %s",
+        self->priv->location, g_strerror (errno));
+  }
+
+  close (self->priv->fd);
+  self->priv->fd = -1;
+}
+
+static gboolean
+kms_file_sink_start (GstBaseSink * sink)
+{
+  KmsFileSink *self = KMS_FILE_SINK (sink);
+  gboolean direct_io;
+
+  GST_OBJECT_LOCK (self);
+  direct_io = self->priv->direct_io;
+  self->priv->batch_size = GST_ROUND_UP_N (self->priv->write_size,
+      BLOCK_ALIGN);
+  self->priv->preallocate = self->priv->expected_bitrate > 0;
+  GST_OBJECT_UNLOCK (self);
+
+  if (self->priv->location == NULL) {
+    GST_ELEMENT_ERROR (self, RESOURCE, NOT_FOUND,
+        ("No file name specified for writing."), (NULL));
+    return FALSE;
+  }
+
+  self->priv->fd = g_open (self->priv->location,
+      O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (self->priv->fd < 0) {
+    GST_ELEMENT_ERROR (self, RESOURCE, OPEN_WRITE,
+        ("Could not open file \"%s\" for writing.", self->priv->location),
+        GST_ERROR_SYSTEM);
+    return FALSE;
+  }
+
+#ifdef O_DIRECT
+  if (direct_io) {
+    /* Not every file system supports it, tmpfs does not */
+    self->priv->direct_fd = g_open (self->priv->location,
+        O_WRONLY | O_DIRECT | O_CLOEXEC, 0);
+    if (self->priv->direct_fd < 0) {
+      GST_INFO_OBJECT (self, "No direct I/O for \"%s\": %s",
+          self->priv->location, g_strerror (errno));
+    }
+  }
+#endif
+
+  if (posix_memalign ((void **) &self->priv->batch, BLOCK_ALIGN,
+          self->priv->batch_size) != 0) {
+    GST_ELEMENT_ERROR (self, RESOURCE, NO_SPACE_LEFT,
+        ("Can not allocate the write buffer"), (NULL));
+    kms_file_sink_close (self);
+    return FALSE;
+  }
+
+  self->priv->batch_len = 0;
+  self->priv->batch_offset = 0;
+  self->priv->file_size = 0;
+  self->priv->preallocated = 0;
+  self->priv->written_back = 0;
+
+  GST_DEBUG_OBJECT (self, "Writing \"%s\" in blocks of %" G_GSIZE_FORMAT
+      " bytes, direct I/O: %d", self->priv->location, self->priv->batch_size,
+      self->priv->direct_fd >= 0);
+
+  return TRUE;
+}
+
+static gboolean
+kms_file_sink_stop (GstBaseSink * sink)
+{
+  KmsFileSink *self = KMS_FILE_SINK (sink);
+
+  if (self->priv->fd >= 0) {
+    kms_file_sink_write_batch (self);
+  }
+
+  kms_file_sink_close (self);
+
+  free (self->priv->batch);
+  self->priv->batch = NULL;
+
+  return TRUE;
+}
+
+static GstFlowReturn
+kms_file_sink_render (GstBaseSink * sink, GstBuffer * buffer)
+{
+  KmsFileSink *self = KMS_FILE_SINK (sink);
+  GstFlowReturn ret = GST_FLOW_OK;
+  const guint8 *data;
+  GstMapInfo info;
+  gsize size;
+
+  if (!gst_buffer_map (buffer, &info, GST_MAP_READ)) {
+    GST_ELEMENT_ERROR (self, RESOURCE, WRITE, ("Can not read buffer"), (NULL));
+    return GST_FLOW_ERROR;
+  }
+
+  data = info.data;
+  size = info.size;
+
+  /* Many small muxer buffers become a few large writes */
+  while (size > 0) {
+    gsize limit = kms_file_sink_batch_limit (self);
+    gsize len = MIN (size, limit - self->priv->batch_len);
+
+    memcpy (self->priv->batch + self->priv->batch_len, data, len);
+    self->priv->batch_len += len;
+    data += len;
+    size -= len;
+
+    if (self->priv->batch_len == limit && !kms_file_sink_write_batch (self)) {
+      ret = GST_FLOW_ERROR;
+      break;
+    }
+  }
+
+  gst_buffer_unmap (buffer, &info);
+
+  return ret;
+}
+
+static gboolean
+kms_file_sink_event (GstBaseSink * sink, GstEvent * event)
+{
+  KmsFileSink *self = KMS_FILE_SINK (sink);
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_SEGMENT:{
+      const GstSegment *segment;
+
+      gst_event_parse_segment (event, &segment);
+
+      /* Muxers seek back to rewrite headers and indexes */
+      if (segment->format == GST_FORMAT_BYTES &&
+          !kms_file_sink_seek (self, segment->start)) {
+        gst_event_unref (event);
+        return FALSE;
+      }
+      break;
+    }
+    case GST_EVENT_EOS:
+      if (!kms_file_sink_write_batch (self)) {
+        gst_event_unref (event);
+        return FALSE;
+      }
+
+      if (self->priv->flush_policy == KMS_FILE_SINK_FLUSH_EOS &&
+          fdatasync (self->priv->fd) < 0) {
+        GST_ELEMENT_ERROR (self, RESOURCE, WRITE,
+            ("Could not sync file \"%s\"", self->priv->location),
+            GST_ERROR_SYSTEM);
+      }
+      break;
+    default:
+      break;
+  }
+
+  return GST_BASE_SINK_CLASS (kms_file_sink_parent_class)->event (sink, event);
+}
+
+static gboolean
+kms_file_sink_query (GstBaseSink * sink, GstQuery * query)
+{
+  KmsFileSink *self = KMS_FILE_SINK (sink);
+  GstFormat format;
+
+  switch (GST_QUERY_TYPE (query)) {
+    case GST_QUERY_POSITION:
+      gst_query_parse_position (query, &format, NULL);
+      if (format != GST_FORMAT_BYTES && format != GST_FORMAT_DEFAULT) {
+        break;
+      }
+      gst_query_set_position (query, GST_FORMAT_BYTES,
+          self->priv->batch_offset + self->priv->batch_len);
+      return TRUE;
+    case GST_QUERY_FORMATS:
+      gst_query_set_formats (query, 2, GST_FORMAT_DEFAULT, GST_FORMAT_BYTES);
+      return TRUE;
+    case GST_QUERY_SEEKING:
+      /* Muxers only update headers and indexes in seekable sinks */
+      gst_query_parse_seeking (query, &format, NULL, NULL, NULL);
+      gst_query_set_seeking (query, format, format == GST_FORMAT_DEFAULT ||
+          format == GST_FORMAT_BYTES, 0, -1);
+      return TRUE;
+    default:
+      break;
+  }
+
+  return GST_BASE_SINK_CLASS (kms_file_sink_parent_class)->query (sink, query);
+}
+
+GstStructure *
+kms_file_sink_get_stats (KmsFileSink * self)
+{
+  GstStructure *stats;
+
+  g_return_val_if_fail (KMS_IS_FILE_SINK (self), NULL);
+
+  g_mutex_lock (&self->priv->stats_mutex);
+
+  stats = gst_structure_new ("recording-sink",
+      "bytes-written", G_TYPE_UINT64, self->priv->bytes_written,
+      "writes", G_TYPE_UINT64, self->priv->writes,
+      "direct-writes", G_TYPE_UINT64, self->priv->direct_writes,
+      "avg-write-latency", G_TYPE_UINT64, self->priv->writes > 0 ?
+      self->priv->write_time / self->priv->writes : 0,
+      "max-write-latency", G_TYPE_UINT64, self->priv->max_write_time,
+      "preallocated-bytes", G_TYPE_UINT64, self->priv->preallocated_bytes,
+      NULL);
+
+  g_mutex_unlock (&self->priv->stats_mutex);
+
+  return stats;
+}
+
+static void
+kms_file_sink_set_property (GObject * object, guint property_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  KmsFileSink *self = KMS_FILE_SINK (object);
+
+  GST_OBJECT_LOCK (self);
+
+  switch (property_id) {
+    case PROP_LOCATION:
+      g_free (self->priv->location);
+      self->priv->location = g_value_dup_string (value);
+      break;
+    case PROP_DIRECT_IO:
+      self->priv->direct_io = g_value_get_boolean (value);
+      break;
+    case PROP_WRITE_SIZE:
+      self->priv->write_size = g_value_get_uint (value);
+      break;
+    case PROP_EXPECTED_BITRATE:
+      self->priv->expected_bitrate = g_value_get_uint (value);
+      break;
+    case PROP_FLUSH_POLICY:
+      self->priv->flush_policy = g_value_get_enum (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+
+  GST_OBJECT_UNLOCK (self);
+}
+
+static void
+kms_file_sink_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  KmsFileSink *self = KMS_FILE_SINK (object);
+
+  GST_OBJECT_LOCK (self);
+
+  switch (property_id) {
+    case PROP_LOCATION:
+      g_value_set_string (value, self->priv->location);
+      break;
+    case PROP_DIRECT_IO:
+      g_value_set_boolean (value, self->priv->direct_io);
+      break;
+    case PROP_WRITE_SIZE:
+      g_value_set_uint (value, self->priv->write_size);
+      break;
+    case PROP_EXPECTED_BITRATE:
+      g_value_set_uint (value, self->priv->expected_bitrate);
+      break;
+    case PROP_FLUSH_POLICY:
+      g_value_set_enum (value, self->priv->flush_policy);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+
+  GST_OBJECT_UNLOCK (self);
+}
+
+static void
+kms_file_sink_finalize (GObject * object)
+{
+  KmsFileSink *self = KMS_FILE_SINK (object);
+
+  g_free (self->priv->location);
+  g_mutex_clear (&self->priv->stats_mutex);
+
+  G_OBJECT_CLASS (kms_file_sink_parent_class)->finalize (object);
+}
+
+static void
+kms_file_sink_class_init (KmsFileSinkClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+  GstBaseSinkClass *basesink_class = GST_BASE_SINK_CLASS (klass);
+
+  gst_element_class_set_static_metadata (element_class,
+      "Recording file sink", "Sink/File",
+      "Writes recordings to local files in large, aligned blocks",
+      "Kurento <kurento@googlegroups.com>");
+
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&sink_template));
+
+  gobject_class->set_property = kms_file_sink_set_property;
+  gobject_class->get_property = kms_file_sink_get_property;
+  gobject_class->finalize = kms_file_sink_finalize;
+
+  basesink_class->start = GST_DEBUG_FUNCPTR (kms_file_sink_start);
+  basesink_class->stop = GST_DEBUG_FUNCPTR (kms_file_sink_stop);
+  basesink_class->render = GST_DEBUG_FUNCPTR (kms_file_sink_render);
+  basesink_class->event = GST_DEBUG_FUNCPTR (kms_file_sink_event);
+  basesink_class->query = GST_DEBUG_FUNCPTR (kms_file_sink_query);
+
+  obj_properties[PROP_LOCATION] = g_param_spec_string ("location",
+      "File location", "Location of the file to write", NULL,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
+  obj_properties[PROP_DIRECT_IO] = g_param_spec_boolean ("direct-io",
+      "Direct I/O", "Write aligned blocks with O_DIRECT, bypassing the page "
+      "cache, when the file system supports it", DEFAULT_DIRECT_IO,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
+  obj_properties[PROP_WRITE_SIZE] = g_param_spec_uint ("write-size",
+      "Write size", "Bytes gathered before each write, rounded up to "
+      G_STRINGIFY (BLOCK_ALIGN), 1, G_MAXINT, DEFAULT_WRITE_SIZE,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
+  obj_properties[PROP_EXPECTED_BITRATE] =
+      g_param_spec_uint ("expected-bitrate", "Expected bitrate",
+      "Bits per second expected, used to preallocate disk space "
+      G_STRINGIFY (PREALLOCATE_SECONDS) " seconds ahead (0 = disabled)",
+      0, G_MAXUINT, DEFAULT_EXPECTED_BITRATE,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
+  obj_properties[PROP_FLUSH_POLICY] = g_param_spec_enum ("flush-policy",
+      "Flush policy", "When written data is sent to the disk",
+      KMS_TYPE_FILE_SINK_FLUSH_POLICY, DEFAULT_FLUSH_POLICY,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
+  g_object_class_install_properties (gobject_class, N_PROPERTIES,
+      obj_properties);
+
+  g_type_class_add_private (klass, sizeof (KmsFileSinkPrivate));
+}
+
+static void
+kms_file_sink_init (KmsFileSink * self)
+{
+  self->priv = KMS_FILE_SINK_GET_PRIVATE (self);
+
+  self->priv->direct_io = DEFAULT_DIRECT_IO;
+  self->priv->write_size = DEFAULT_WRITE_SIZE;
+  self->priv->expected_bitrate = DEFAULT_EXPECTED_BITRATE;
+  self->priv->flush_policy = DEFAULT_FLUSH_POLICY;
+  self->priv->fd = -1;
+  self->priv->direct_fd = -1;
+
+  g_mutex_init (&self->priv->stats_mutex);
+
+  gst_base_sink_set_sync (GST_BASE_SINK (self), FALSE);
+}
+
+gboolean
+kms_file_sink_plugin_init (GstPlugin * plugin)
+{
+  return gst_element_register (plugin, PLUGIN_NAME, GST_RANK_NONE,
+      KMS_TYPE_FILE_SINK);
+}
@@ -102,7 +102,7 @@ kms_ksr_muxer_add_src (KmsBaseMediaMuxer * obj, KmsMediaType type,
   }
 
   appsrc = gst_element_factory_make ("appsrc", NULL);
-  g_object_set (appsrc, "block", TRUE, "format", GST_FORMAT_TIME, NULL);
+  kms_base_media_muxer_configure_appsrc (KMS_BASE_MEDIA_MUXER (self), appsrc);
 
   gst_bin_add (GST_BIN (KMS_BASE_MEDIA_MUXER_GET_PIPELINE (self)), appsrc);
 
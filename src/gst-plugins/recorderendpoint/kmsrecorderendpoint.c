@@ -40,6 +40,9 @@
 #include "kmsbasemediamuxer.h"
 #include "kmsavmuxer.h"
 #include "kmsksrmuxer.h"
+#include "kmsspillqueue.h"
+#include "kmss3sink.h"
+#include "kmsfilesink.h"
 
 #include "kmsrecordergapsfixmethod.h"
 #include "kms-recorder-enumtypes.h"
@@ -50,6 +53,16 @@
 
 #define DEFAULT_RECORDING_PROFILE KMS_RECORDING_PROFILE_NONE
 #define DEFAULT_GAPS_FIX KMS_RECORDER_GAPS_FIX_NONE
+#define DEFAULT_MAX_QUEUE_BYTES G_GUINT64_CONSTANT (2097152)
+#define DEFAULT_MUXING_PIPELINES 0
+#define DEFAULT_MAX_SPILL_BYTES G_GUINT64_CONSTANT (1073741824)
+#define DEFAULT_SPILL_DIR NULL
+#define DEFAULT_PASSTHROUGH FALSE
+#define DEFAULT_MP4_FRAGMENT_DURATION 0
+#define DEFAULT_SEGMENT_DURATION 0
+#define DEFAULT_MAX_SEGMENT_BYTES 0
+
+#define CHOOSE_CONTAINER_TIMEOUT 3000   /* ms */
 
 #define KMS_BASE_TIME_KEY "base-time-key"
 G_DEFINE_QUARK (KMS_BASE_TIME_KEY, base_time_key);
@@ -60,6 +73,9 @@ G_DEFINE_QUARK (KMS_PAD_ID_KEY, kms_pad_id_key);
 #define KMS_APPSRC_ID_KEY "kms-appsrc-id-key"
 G_DEFINE_QUARK (KMS_APPSRC_ID_KEY, kms_appsrc_id_key);
 
+#define KMS_RECORDER_TRACK_KEY "kms-recorder-track-key"
+G_DEFINE_QUARK (KMS_RECORDER_TRACK_KEY, kms_recorder_track_key);
+
 GST_DEBUG_CATEGORY_STATIC (kms_recorder_endpoint_debug_category);
 #define GST_CAT_DEFAULT kms_recorder_endpoint_debug_category
 
@@ -90,6 +106,8 @@ GST_DEBUG_CATEGORY_STATIC (kms_recorder_endpoint_debug_category);
 static GstPadLinkReturn link_sinkpad_cb (GstPad * pad, GstObject * appsink,
     GstPad * peer);
 static void unlink_sinkpad_cb (GstPad * pad, GstObject * parent);
+static void kms_recorder_endpoint_choose_container (KmsRecorderEndpoint *
+    self, KmsRecorderTrack * track, GstCaps * caps);
 
 enum
 {
@@ -97,6 +115,15 @@ enum
   PROP_DVR,
   PROP_PROFILE,
   PROP_GAPS_FIX,
+  PROP_MAX_QUEUE_BYTES,
+  PROP_MAX_SPILL_BYTES,
+  PROP_SPILL_DIR,
+  PROP_PASSTHROUGH,
+  PROP_MP4_FRAGMENT_DURATION,
+  PROP_SEGMENT_DURATION,
+  PROP_MAX_SEGMENT_BYTES,
+  PROP_SINK_PROPERTIES,
+  PROP_MUXING_PIPELINES,
   N_PROPERTIES
 };
 
@@ -139,19 +166,34 @@ struct _KmsRecorderEndpointPrivate
 {
   KmsRecordingProfile profile;
   KmsRecorderGapsFixMethod gaps_fix;
+  guint64 max_queue_bytes;
+  guint64 max_spill_bytes;
+  gchar *spill_dir;
+  guint mp4_fragment_duration;
+  guint segment_duration;
+  guint64 max_segment_bytes;
+  GstStructure *sink_properties;
   GstClockTime paused_time;
   GstClockTime paused_start;
   gboolean use_dvr;
   GstTaskPool *pool;
   KmsBaseMediaMuxer *mux;
   GMutex base_time_lock;
+  gint timing_generation;
+  gint recording;
 
   GSList *sink_probes;
+  GstElement *file_sink;         /* Only for local recordings */
   GHashTable *srcs;
   GMutex srcs_mutex;
 
   KmsRecorderStats stats;
 
+  /* The profile only selects the media, the container follows the codecs */
+  gboolean passthrough;
+  gint container_fixed;
+  gint64 container_deadline;    /* Monotonic, 0 until a stream negotiates */
+
   gboolean sent_eos;
   gboolean playing;
   gboolean stopped;
@@ -162,6 +204,39 @@ struct _KmsRecorderEndpointPrivate
   gboolean generate_pads;
 };
 
+/*
+ * State of each appsink that is only used from its streaming thread, so
+ * recv_sample does not need any lock in the steady state. Timestamp offsets
+ * are recomputed under BASE_TIME_LOCK only when the timing generation of the
+ * recorder changes, or while the base times are not known yet.
+ */
+typedef struct _KmsRecorderTrack
+{
+  gint generation;
+  GstClockTime pts_offset;
+  GstClockTime dts_offset;
+  GstAppSrc *caps_appsrc;       /* Last appsrc whose caps were set */
+  /* Received while choosing the container, protected by KMS_ELEMENT_LOCK */
+  GstCaps *first_caps;
+  /* Codec quarks, also read by the stats */
+  gint first_codec;
+  gint codec;
+} KmsRecorderTrack;
+
+/* Containers a passthrough recorder may choose, by the media it records */
+static const KmsRecordingProfile passthrough_profiles[][3] = {
+  /* Audio and video, video only, audio only */
+  {KMS_RECORDING_PROFILE_WEBM, KMS_RECORDING_PROFILE_WEBM_VIDEO_ONLY,
+      KMS_RECORDING_PROFILE_WEBM_AUDIO_ONLY},
+  {KMS_RECORDING_PROFILE_MP4, KMS_RECORDING_PROFILE_MP4_VIDEO_ONLY,
+      KMS_RECORDING_PROFILE_MP4_AUDIO_ONLY},
+  {KMS_RECORDING_PROFILE_MKV, KMS_RECORDING_PROFILE_MKV_VIDEO_ONLY,
+      KMS_RECORDING_PROFILE_MKV_AUDIO_ONLY},
+};
+
+/* File extension of each row of passthrough_profiles */
+static const gchar *passthrough_extensions[] = { ".webm", ".mp4", ".mkv" };
+
 typedef struct _MarkBufferProbeData
 {
   gchar *id;
@@ -248,7 +323,7 @@ send_eos (GstElement * appsrc)
 
   GST_DEBUG ("Send EOS to %s", GST_ELEMENT_NAME (appsrc));
 
-  ret = gst_app_src_end_of_stream (GST_APP_SRC (appsrc));
+  ret = kms_spill_queue_end_of_stream (GST_APP_SRC (appsrc));
   if (ret != GST_FLOW_OK) {
     /* something wrong */
     GST_ERROR ("Could not send EOS to appsrc  %s. Ret code %d",
@@ -269,150 +344,183 @@ release_base_time_type (gpointer data)
   g_slice_free (BaseTimeType, data);
 }
 
-// Adjust timestamps to avoid gaps created by paused recordings.
-static GstFlowReturn
-recv_sample (GstAppSink * appsink, gpointer user_data)
+static KmsRecorderTrack *
+kms_recorder_track_new (void)
 {
-  KmsRecorderEndpoint *self =
-      KMS_RECORDER_ENDPOINT (GST_OBJECT_PARENT (appsink));
-  KmsUriEndpointState state = KMS_URI_ENDPOINT_STATE_STOP;
-  BaseTimeType *base_time = NULL;
-  GstCaps *caps = NULL;
+  KmsRecorderTrack *track;
 
-  gboolean unlock_element = FALSE;
-  GstSample *sample = NULL;
-  GstFlowReturn ret = GST_FLOW_OK;
+  track = g_slice_new0 (KmsRecorderTrack);
+  track->generation = -1;
+  track->pts_offset = GST_CLOCK_TIME_NONE;
+  track->dts_offset = GST_CLOCK_TIME_NONE;
 
-  GstAppSrc *appsrc =
-      g_object_get_qdata (G_OBJECT (appsink), kms_appsrc_id_key_quark ());
-  if (appsrc == NULL) {
-    GST_ERROR_OBJECT (appsink, "No appsrc attached");
-    ret = GST_FLOW_NOT_LINKED;
-    goto end;
-  }
+  return track;
+}
 
-  sample = gst_app_sink_pull_sample (appsink);
-  if (sample == NULL) {
-    ret = GST_FLOW_OK;
-    goto end;
+static void
+kms_recorder_track_destroy (KmsRecorderTrack * track)
+{
+  if (track->first_caps != NULL) {
+    gst_caps_unref (track->first_caps);
   }
 
-  GstBuffer *buffer = gst_sample_get_buffer (sample);
-  if (buffer == NULL) {
-    if (gst_sample_get_buffer_list (sample) != NULL) {
-      GST_ERROR_OBJECT (appsink,
-          "Discarding buffer list at the recorder endpoint");
-      g_warning ("Discarding buffer list at the recorder endpoint");
+  g_slice_free (KmsRecorderTrack, track);
+}
+
+/* Media column of @profile in passthrough_profiles, -1 if it is not there */
+static gint
+kms_recorder_endpoint_find_passthrough_profile (KmsRecordingProfile profile,
+    gint * row)
+{
+  gint i, j;
+
+  for (i = 0; i < G_N_ELEMENTS (passthrough_profiles); i++) {
+    for (j = 0; j < G_N_ELEMENTS (passthrough_profiles[i]); j++) {
+      if (passthrough_profiles[i][j] == profile) {
+        if (row != NULL) {
+          *row = i;
+        }
+        return j;
+      }
     }
-    ret = GST_FLOW_OK;
-    goto end;
   }
 
-  const GstSegment *segment = gst_sample_get_segment (sample);
+  return -1;
+}
 
-  unlock_element = TRUE;
-  KMS_ELEMENT_LOCK (self);
+static gboolean
+kms_recorder_endpoint_is_choosing_container (KmsRecorderEndpoint * self)
+{
+  return self->priv->passthrough &&
+      !g_atomic_int_get (&self->priv->container_fixed) &&
+      kms_recorder_endpoint_find_passthrough_profile (self->priv->profile,
+      NULL) >= 0;
+}
 
-  state = kms_uri_endpoint_get_state (KMS_URI_ENDPOINT (self));
+/*
+ * Must be called with BASE_TIME_LOCK held. Every change to the data used to
+ * compute the timestamp offsets must bump the generation, so appsinks
+ * recompute their cached offsets on their next buffer.
+ */
+static void
+kms_recorder_endpoint_invalidate_offsets (KmsRecorderEndpoint * self)
+{
+  g_atomic_int_inc (&self->priv->timing_generation);
+}
 
-  if (!((state == KMS_URI_ENDPOINT_STATE_START &&
-              self->priv->transition == KMS_RECORDER_ENDPOINT_COMPLETED) ||
-          self->priv->transition == KMS_RECORDER_ENDPOINT_STARTING)) {
-    GST_LOG_OBJECT (appsink,
-        "Not recording, drop buffer %" GST_PTR_FORMAT, buffer);
-    ret = GST_FLOW_OK;
-    goto end;
-  }
+static void
+kms_recorder_endpoint_update_offsets (KmsRecorderEndpoint * self,
+    KmsRecorderTrack * track, GstClockTime pts, GstClockTime dts)
+{
+  BaseTimeType *base_time;
+  GstClockTime common_offset;
 
-  gst_buffer_ref (buffer);
-  buffer = gst_buffer_make_writable (buffer);
+  BASE_TIME_LOCK (self);
 
-  // Ensure that PTS/DTS are measured from 00:00:00. Do this by replacing each
-  // one by their GStreamer running time, which always starts from 0 wrt. its
-  // containing segment.
-  {
-    if (GST_BUFFER_PTS_IS_VALID (buffer)) {
-      GST_BUFFER_PTS (buffer) = gst_segment_to_running_time (
-          segment, GST_FORMAT_TIME, GST_BUFFER_PTS (buffer));
-    }
+  // First time this runs, create a new BaseTime storage.
+  base_time = g_object_get_qdata (G_OBJECT (self), base_time_key_quark ());
+  if (base_time == NULL) {
+    base_time = g_slice_new0 (BaseTimeType);
+    base_time->pts = GST_CLOCK_TIME_NONE;
+    base_time->dts = GST_CLOCK_TIME_NONE;
+    base_time->audio_gaps = 0;
 
-    if (GST_BUFFER_DTS_IS_VALID (buffer)) {
-      GST_BUFFER_DTS (buffer) = gst_segment_to_running_time (
-          segment, GST_FORMAT_TIME, GST_BUFFER_DTS (buffer));
-    }
+    g_object_set_qdata_full (G_OBJECT (self), base_time_key_quark (),
+        base_time, release_base_time_type);
   }
 
-  BASE_TIME_LOCK (self);
+  if (!GST_CLOCK_TIME_IS_VALID (base_time->pts)
+      && GST_CLOCK_TIME_IS_VALID (pts)) {
+    base_time->pts = pts;
+    GST_DEBUG_OBJECT (self, "Setting PTS base time to %" GST_TIME_FORMAT,
+        GST_TIME_ARGS (base_time->pts));
+  }
 
-  // First time this runs, create a new BaseTime storage.
-  {
-    base_time = g_object_get_qdata (G_OBJECT (self), base_time_key_quark ());
-    if (base_time == NULL) {
-      base_time = g_slice_new0 (BaseTimeType);
-      base_time->pts = GST_CLOCK_TIME_NONE;
-      base_time->dts = GST_CLOCK_TIME_NONE;
-      base_time->audio_gaps = 0;
-
-      g_object_set_qdata_full (G_OBJECT (self), base_time_key_quark (),
-          base_time, release_base_time_type);
-    }
+  if (!GST_CLOCK_TIME_IS_VALID (base_time->dts)
+      && GST_CLOCK_TIME_IS_VALID (dts)) {
+    base_time->dts = dts;
+    GST_DEBUG_OBJECT (self, "Setting DTS base time to %" GST_TIME_FORMAT,
+        GST_TIME_ARGS (base_time->dts));
+  }
 
-    if (!GST_CLOCK_TIME_IS_VALID (base_time->pts)
-        && GST_BUFFER_PTS_IS_VALID (buffer)) {
-      base_time->pts = GST_BUFFER_PTS (buffer);
-      GST_DEBUG_OBJECT (self, "Setting PTS base time to %" GST_TIME_FORMAT,
-          GST_TIME_ARGS (base_time->pts));
-    }
+  // FIXME: There is some skew introduced each time the recording is paused.
+  // The 'paused_time' doesn't account exactly for all the time, it is missing
+  // some milliseconds. Maybe due to latency in upstream elements?
 
-    if (!GST_CLOCK_TIME_IS_VALID (base_time->dts)
-        && GST_BUFFER_DTS_IS_VALID (buffer)) {
-      base_time->dts = GST_BUFFER_DTS (buffer);
-      GST_DEBUG_OBJECT (self, "Setting DTS base time to %" GST_TIME_FORMAT,
-          GST_TIME_ARGS (base_time->dts));
-    }
+  common_offset = self->priv->paused_time;
+
+  if (self->priv->gaps_fix == KMS_RECORDER_GAPS_FIX_GENPTS) {
+    // In GenPTS mode, add the total time that has been lost in the form
+    // of gaps, typically caused by packet loss from an RTP source.
+    common_offset += base_time->audio_gaps;
   }
 
-  // Adjust PTS/DTS of all buffers, so recordings are always created with an
-  // initial timestamp of 0 (0:00:00.000).
-  {
-    // FIXME: There is some skew introduced each time the recording is paused.
-    // The 'paused_time' doesn't account exactly for all the time, it is missing
-    // some milliseconds. Maybe due to latency in upstream elements?
+  track->pts_offset = GST_CLOCK_TIME_IS_VALID (base_time->pts) ?
+      common_offset + base_time->pts : GST_CLOCK_TIME_NONE;
+  track->dts_offset = GST_CLOCK_TIME_IS_VALID (base_time->dts) ?
+      common_offset + base_time->dts : GST_CLOCK_TIME_NONE;
+  track->generation = self->priv->timing_generation;
 
-    GstClockTime common_offset = self->priv->paused_time;
+  BASE_TIME_UNLOCK (self);
+}
 
-    if (self->priv->gaps_fix == KMS_RECORDER_GAPS_FIX_GENPTS) {
-      // In GenPTS mode, add the total time that has been lost in the form
-      // of gaps, typically caused by packet loss from an RTP source.
-      common_offset += base_time->audio_gaps;
-    }
+/* Subtracts the offset, but preventing underflows */
+static inline GstClockTime
+kms_recorder_endpoint_apply_offset (GstClockTime ts, GstClockTime offset)
+{
+  if (!GST_CLOCK_TIME_IS_VALID (ts) || !GST_CLOCK_TIME_IS_VALID (offset)) {
+    return ts;
+  }
 
-    if (GST_CLOCK_TIME_IS_VALID (base_time->pts)
-        && GST_BUFFER_PTS_IS_VALID (buffer)) {
-      const GstClockTime offset = common_offset + base_time->pts;
+  return ts > offset ? ts - offset : 0;
+}
 
-      // PTS -= offset, but preventing underflows.
-      if (GST_BUFFER_PTS (buffer) > offset) {
-        GST_BUFFER_PTS (buffer) -= offset;
-      } else {
-        GST_BUFFER_PTS (buffer) = 0;
-      }
-    }
+typedef struct _KmsAdjustData
+{
+  KmsRecorderEndpoint *self;
+  KmsRecorderTrack *track;
+  GstSegment segment;
+} KmsAdjustData;
 
-    if (GST_CLOCK_TIME_IS_VALID (base_time->dts)
-        && GST_BUFFER_DTS_IS_VALID (buffer)) {
-      const GstClockTime offset = common_offset + base_time->dts;
+// Adjust timestamps to avoid gaps created by paused recordings. Takes
+// ownership of the buffer and returns a writable one.
+static GstBuffer *
+kms_recorder_endpoint_adjust_buffer (KmsAdjustData * data, GstBuffer * buffer)
+{
+  KmsRecorderTrack *track = data->track;
+  GstClockTime pts, dts;
 
-      // DTS -= offset, but preventing underflows.
-      if (GST_BUFFER_DTS (buffer) > offset) {
-        GST_BUFFER_DTS (buffer) -= offset;
-      } else {
-        GST_BUFFER_DTS (buffer) = 0;
-      }
-    }
+  // Ensure that PTS/DTS are measured from 00:00:00. Do this by replacing each
+  // one by their GStreamer running time, which always starts from 0 wrt. its
+  // containing segment.
+  pts = GST_BUFFER_PTS (buffer);
+  if (GST_CLOCK_TIME_IS_VALID (pts)) {
+    pts = gst_segment_to_running_time (&data->segment, GST_FORMAT_TIME, pts);
   }
 
-  BASE_TIME_UNLOCK (self);
+  dts = GST_BUFFER_DTS (buffer);
+  if (GST_CLOCK_TIME_IS_VALID (dts)) {
+    dts = gst_segment_to_running_time (&data->segment, GST_FORMAT_TIME, dts);
+  }
+
+  // Adjust PTS/DTS of all buffers, so recordings are always created with an
+  // initial timestamp of 0 (0:00:00.000).
+  if (track->generation !=
+      g_atomic_int_get (&data->self->priv->timing_generation)
+      || (!GST_CLOCK_TIME_IS_VALID (track->pts_offset)
+          && GST_CLOCK_TIME_IS_VALID (pts))
+      || (!GST_CLOCK_TIME_IS_VALID (track->dts_offset)
+          && GST_CLOCK_TIME_IS_VALID (dts))) {
+    kms_recorder_endpoint_update_offsets (data->self, track, pts, dts);
+  }
+
+  // The buffer is only copied when it is really shared with another branch,
+  // and even then the copy keeps referencing the same memory.
+  buffer = gst_buffer_make_writable (buffer);
+  GST_BUFFER_PTS (buffer) =
+      kms_recorder_endpoint_apply_offset (pts, track->pts_offset);
+  GST_BUFFER_DTS (buffer) =
+      kms_recorder_endpoint_apply_offset (dts, track->dts_offset);
 
   // Set some flags to make sure the buffer is appropriately handled downstream.
   GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_LIVE);
@@ -420,16 +528,97 @@ recv_sample (GstAppSink * appsink, gpointer user_data)
     GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_DISCONT);
   }
 
-  KMS_ELEMENT_UNLOCK (self);
-  unlock_element = FALSE;
+  return buffer;
+}
 
-  caps = gst_app_src_get_caps (appsrc);
-  if (caps == NULL) {
+static gboolean
+adjust_list_buffer (GstBuffer ** buffer, guint idx, gpointer data)
+{
+  *buffer = kms_recorder_endpoint_adjust_buffer (data, *buffer);
+
+  return TRUE;
+}
+
+static GstFlowReturn
+recv_sample (GstAppSink * appsink, gpointer user_data)
+{
+  KmsRecorderEndpoint *self =
+      KMS_RECORDER_ENDPOINT (GST_OBJECT_PARENT (appsink));
+  GstBufferList *list = NULL;
+  GstBuffer *buffer = NULL;
+  GstSample *sample = NULL;
+  GstFlowReturn ret = GST_FLOW_OK;
+  KmsAdjustData data;
+
+  GstAppSrc *appsrc =
+      g_object_get_qdata (G_OBJECT (appsink), kms_appsrc_id_key_quark ());
+  if (appsrc == NULL) {
+    GST_ERROR_OBJECT (appsink, "No appsrc attached");
+    ret = GST_FLOW_NOT_LINKED;
+    goto end;
+  }
+
+  sample = gst_app_sink_pull_sample (appsink);
+  if (sample == NULL) {
+    ret = GST_FLOW_OK;
+    goto end;
+  }
+
+  buffer = gst_sample_get_buffer (sample);
+#if GST_CHECK_VERSION (1, 16, 0)
+  if (buffer == NULL) {
+    list = gst_sample_get_buffer_list (sample);
+  }
+#endif
+
+  if (buffer == NULL && list == NULL) {
+    ret = GST_FLOW_OK;
+    goto end;
+  }
+
+  if (kms_recorder_endpoint_is_choosing_container (self)) {
+    /* Gives up waiting for streams that never negotiate */
+    kms_recorder_endpoint_choose_container (self, NULL, NULL);
+  }
+
+  if (!g_atomic_int_get (&self->priv->recording) ||
+      kms_recorder_endpoint_is_choosing_container (self)) {
+    GST_LOG_OBJECT (appsink, "Not recording, drop %" GST_PTR_FORMAT,
+        buffer != NULL ? (gpointer) buffer : (gpointer) list);
+    ret = GST_FLOW_OK;
+    goto end;
+  }
+
+  data.self = self;
+  data.track = g_object_get_qdata (G_OBJECT (appsink),
+      kms_recorder_track_key_quark ());
+  gst_segment_copy_into (gst_sample_get_segment (sample), &data.segment);
+
+  if (G_UNLIKELY (data.track->caps_appsrc != appsrc)) {
     GST_ERROR_OBJECT (appsrc, "Trying to push buffer without setting caps");
+  }
+
+  // Release the sample before writing, so its buffer or list is only copied
+  // when some other branch really shares it.
+  if (buffer != NULL) {
+    gst_buffer_ref (buffer);
   } else {
-    gst_caps_unref (caps);
+    gst_buffer_list_ref (list);
+  }
+
+  gst_sample_unref (sample);
+  sample = NULL;
+
+  if (buffer != NULL) {
+    buffer = kms_recorder_endpoint_adjust_buffer (&data, buffer);
+    ret = kms_spill_queue_push_buffer (appsrc, buffer);
+  } else {
+    // Timestamps of the whole list are fixed in a single pass, and the list
+    // is handed to the appsrc as is.
+    list = gst_buffer_list_make_writable (list);
+    gst_buffer_list_foreach (list, adjust_list_buffer, &data);
+    ret = kms_spill_queue_push_buffer_list (appsrc, list);
   }
-  ret = gst_app_src_push_buffer (appsrc, buffer);
 
   if (ret != GST_FLOW_OK) {
     GST_ERROR_OBJECT (self, "Could not send buffer to appsrc %s. Cause: %s",
@@ -438,10 +627,6 @@ recv_sample (GstAppSink * appsink, gpointer user_data)
   }
 
 end:
-  if (unlock_element) {
-    KMS_ELEMENT_UNLOCK (self);
-  }
-
   if (sample != NULL) {
     gst_sample_unref (sample);
   }
@@ -463,6 +648,24 @@ recv_eos (GstAppSink * appsink, gpointer user_data)
   }
 }
 
+/*
+ * Caches whether incoming buffers must be recorded, so recv_sample can
+ * check it without taking the element lock. It must be called with the
+ * element lock held after any change of state or transition.
+ */
+static void
+kms_recorder_endpoint_update_recording (KmsRecorderEndpoint * self)
+{
+  KmsUriEndpointState state;
+
+  state = kms_uri_endpoint_get_state (KMS_URI_ENDPOINT (self));
+
+  g_atomic_int_set (&self->priv->recording,
+      (state == KMS_URI_ENDPOINT_STATE_START &&
+          self->priv->transition == KMS_RECORDER_ENDPOINT_COMPLETED) ||
+      self->priv->transition == KMS_RECORDER_ENDPOINT_STARTING);
+}
+
 static void
 kms_recorder_endpoint_change_state (KmsRecorderEndpoint * self,
     KmsRecorderEndpointTransition transition)
@@ -473,6 +676,7 @@ kms_recorder_endpoint_change_state (KmsRecorderEndpoint * self,
   }
 
   self->priv->transition = transition;
+  kms_recorder_endpoint_update_recording (self);
 }
 
 static void
@@ -498,6 +702,7 @@ kms_recorder_endpoint_sync_state_changed (KmsRecorderEndpoint * self,
 
   KMS_URI_ENDPOINT_GET_CLASS (self)->change_state (KMS_URI_ENDPOINT (self),
       state);
+  kms_recorder_endpoint_update_recording (self);
 
   KMS_ELEMENT_UNLOCK (KMS_ELEMENT (self));
 }
@@ -525,6 +730,7 @@ kms_recorder_endpoint_async_state_changed (KmsRecorderEndpoint * self,
 
     KMS_URI_ENDPOINT_GET_CLASS (self)->change_state (KMS_URI_ENDPOINT (self),
         state);
+    kms_recorder_endpoint_update_recording (self);
   } else {
     KmsUriEndpointState current;
 
@@ -636,12 +842,17 @@ kms_recorder_endpoint_finalize (GObject * object)
   kms_recorder_endpoint_release_pending_requests (self);
   g_slist_free_full (self->priv->sink_probes,
       (GDestroyNotify) kms_stats_probe_destroy);
+  g_clear_object (&self->priv->file_sink);
+  if (self->priv->sink_properties != NULL) {
+    gst_structure_free (self->priv->sink_properties);
+  }
   g_hash_table_unref (self->priv->srcs);
   g_mutex_clear (&self->priv->srcs_mutex);
 
   g_hash_table_unref (self->priv->sink_pad_data);
   g_slist_free_full (self->priv->pending_srcs, g_free);
   g_hash_table_unref (self->priv->stats.avg_e2e);
+  g_free (self->priv->spill_dir);
 
   g_mutex_clear (&self->priv->base_time_lock);
 
@@ -822,6 +1033,7 @@ kms_recorder_endpoint_stopped (KmsUriEndpoint * obj, GError ** error)
 
   self->priv->paused_time = G_GUINT64_CONSTANT (0);
   self->priv->paused_start = GST_CLOCK_TIME_NONE;
+  kms_recorder_endpoint_invalidate_offsets (self);
 
   BASE_TIME_UNLOCK (self);
 
@@ -895,10 +1107,15 @@ kms_recorder_endpoint_started (KmsUriEndpoint * obj, GError ** error)
   BASE_TIME_LOCK (self);
 
   if (GST_CLOCK_TIME_IS_VALID (self->priv->paused_start)) {
-    self->priv->paused_time +=
-        gst_clock_get_time (kms_base_media_muxer_get_clock (self->priv->mux)) -
-        self->priv->paused_start;
+    GstClock *clk = kms_base_media_muxer_get_clock (self->priv->mux);
+
+    if (clk != NULL) {
+      self->priv->paused_time += gst_clock_get_time (clk) -
+          self->priv->paused_start;
+      gst_object_unref (clk);
+    }
     self->priv->paused_start = GST_CLOCK_TIME_NONE;
+    kms_recorder_endpoint_invalidate_offsets (self);
   }
 
   BASE_TIME_UNLOCK (self);
@@ -947,6 +1164,7 @@ kms_recorder_endpoint_paused (KmsUriEndpoint * obj, GError ** error)
 
   if (clk) {
     self->priv->paused_start = gst_clock_get_time (clk);
+    gst_object_unref (clk);
   }
 
   kms_recorder_endpoint_sync_state_changed (self, KMS_URI_ENDPOINT_STATE_PAUSE);
@@ -979,7 +1197,7 @@ set_appsrc_caps (GstElement * appsrc, const GstCaps * caps)
   g_value_reset (&framerate);
 
   GST_DEBUG_OBJECT (appsrc, "Setting source caps %" GST_PTR_FORMAT, srccaps);
-  g_object_set (appsrc, "caps", srccaps, NULL);
+  kms_spill_queue_set_caps (GST_APP_SRC (appsrc), srccaps);
 
 end:
 
@@ -1055,10 +1273,22 @@ appsink_event_probe (GstPad * pad, GstPadProbeInfo * info,
     GST_DEBUG_OBJECT (appsink, "Setting caps: %" GST_PTR_FORMAT, caps);
     set_appsink_caps (appsink, caps, self->priv->profile);
 
+    KmsRecorderTrack *track = g_object_get_qdata (G_OBJECT (appsink),
+        kms_recorder_track_key_quark ());
+    GQuark codec = g_quark_from_string (gst_structure_get_name
+        (gst_caps_get_structure (caps, 0)));
+
+    g_atomic_int_set (&track->codec, codec);
+
+    if (kms_recorder_endpoint_is_choosing_container (self)) {
+      kms_recorder_endpoint_choose_container (self, track, caps);
+    }
+
     GstElement *appsrc =
         g_object_get_qdata (G_OBJECT (appsink), kms_appsrc_id_key_quark ());
     if (appsrc != NULL) {
       set_appsrc_caps (appsrc, caps);
+      track->caps_appsrc = GST_APP_SRC (appsrc);
     } else {
       GST_ERROR_OBJECT (pad, "No appsrc attached");
     }
@@ -1077,14 +1307,16 @@ appsink_event_probe (GstPad * pad, GstPadProbeInfo * info,
     isn't, so it will reach downstream elements such as this one.
     */
 
-    // Get the RecorderEndpoint base timings, if any yet.
-    BaseTimeType *base_time =
-        g_object_get_qdata (G_OBJECT (self), base_time_key_quark ());
-
     // Get the current appsink caps to see if this is applies to the audio.
     GstAppSink *appsink = GST_APP_SINK (gst_pad_get_parent_element (pad));
     caps = gst_app_sink_get_caps (appsink);
 
+    BASE_TIME_LOCK (self);
+
+    // Get the RecorderEndpoint base timings, if any yet.
+    BaseTimeType *base_time =
+        g_object_get_qdata (G_OBJECT (self), base_time_key_quark ());
+
     if (base_time != NULL && kms_utils_caps_is_audio (caps)) {
       GstClockTime gap_pts;
       GstClockTime gap_duration;
@@ -1092,11 +1324,14 @@ appsink_event_probe (GstPad * pad, GstPadProbeInfo * info,
 
       // This will later be used to adjust timestamp of audio buffers.
       base_time->audio_gaps += gap_duration;
+      kms_recorder_endpoint_invalidate_offsets (self);
 
       // The GAP event has been handled here, so no need to pass it downstream.
       ret = GST_PAD_PROBE_DROP;
     }
 
+    BASE_TIME_UNLOCK (self);
+
     gst_caps_unref (caps);
     g_object_unref (appsink);
   }
@@ -1253,6 +1488,17 @@ kms_recorder_endpoint_add_appsink (KmsRecorderEndpoint * self,
   g_object_set (appsink, "emit-signals", FALSE, "async", FALSE,
       "sync", FALSE, "qos", FALSE, NULL);
 
+#if GST_CHECK_VERSION (1, 16, 0)
+  /* Before that every buffer comes in its own sample */
+  if (g_object_class_find_property (G_OBJECT_GET_CLASS (appsink),
+          "buffer-list") != NULL) {
+    g_object_set (appsink, "buffer-list", TRUE, NULL);
+  }
+#endif
+
+  g_object_set_qdata_full (G_OBJECT (appsink), kms_recorder_track_key_quark (),
+      kms_recorder_track_new (), (GDestroyNotify) kms_recorder_track_destroy);
+
   gst_bin_add (GST_BIN (self), appsink);
 
   sinkpad = gst_element_get_static_pad (appsink, "sink");
@@ -1375,6 +1621,11 @@ kms_recorder_endpoint_on_sink_added (KmsBaseMediaMuxer * obj,
 
   self->priv->sink_probes = g_slist_append (self->priv->sink_probes, sprobe);
 
+  if (KMS_IS_FILE_SINK (sink)) {
+    g_clear_object (&self->priv->file_sink);
+    self->priv->file_sink = g_object_ref (sink);
+  }
+
   if (self->priv->stats.enabled) {
     kms_stats_probe_add_latency (sprobe, kms_recorder_endpoint_latency_cb,
         TRUE /* Lock the data */ , self, NULL);
@@ -1391,11 +1642,24 @@ kms_recorder_endpoint_create_base_media_muxer (KmsRecorderEndpoint * self)
   if (self->priv->profile == KMS_RECORDING_PROFILE_KSR) {
     mux = KMS_BASE_MEDIA_MUXER (kms_ksr_muxer_new
         (KMS_BASE_MEDIA_MUXER_PROFILE, self->priv->profile,
-            KMS_BASE_MEDIA_MUXER_URI, KMS_URI_ENDPOINT (self)->uri, NULL));
+            KMS_BASE_MEDIA_MUXER_URI, KMS_URI_ENDPOINT (self)->uri,
+            KMS_BASE_MEDIA_MUXER_MAX_QUEUE_BYTES, self->priv->max_queue_bytes,
+            KMS_BASE_MEDIA_MUXER_MAX_SPILL_BYTES, self->priv->max_spill_bytes,
+            KMS_BASE_MEDIA_MUXER_SPILL_DIR, self->priv->spill_dir,
+            KMS_BASE_MEDIA_MUXER_SINK_PROPERTIES, self->priv->sink_properties,
+            NULL));
   } else {
     mux = KMS_BASE_MEDIA_MUXER (kms_av_muxer_new
         (KMS_BASE_MEDIA_MUXER_PROFILE, self->priv->profile,
-            KMS_BASE_MEDIA_MUXER_URI, KMS_URI_ENDPOINT (self)->uri, NULL));
+            KMS_BASE_MEDIA_MUXER_URI, KMS_URI_ENDPOINT (self)->uri,
+            KMS_BASE_MEDIA_MUXER_MAX_QUEUE_BYTES, self->priv->max_queue_bytes,
+            KMS_BASE_MEDIA_MUXER_MAX_SPILL_BYTES, self->priv->max_spill_bytes,
+            KMS_BASE_MEDIA_MUXER_SPILL_DIR, self->priv->spill_dir,
+            KMS_BASE_MEDIA_MUXER_SINK_PROPERTIES, self->priv->sink_properties,
+            KMS_AV_MUXER_FRAGMENT_DURATION, self->priv->mp4_fragment_duration,
+            KMS_AV_MUXER_SEGMENT_DURATION, self->priv->segment_duration,
+            KMS_AV_MUXER_MAX_SEGMENT_BYTES, self->priv->max_segment_bytes,
+            NULL));
   }
 
   self->priv->mux = mux;
@@ -1454,7 +1718,47 @@ kms_recorder_endpoint_set_property (GObject * object, guint property_id,
       break;
     }
     case PROP_GAPS_FIX:
+      BASE_TIME_LOCK (self);
       self->priv->gaps_fix = g_value_get_enum (value);
+      kms_recorder_endpoint_invalidate_offsets (self);
+      BASE_TIME_UNLOCK (self);
+      break;
+    case PROP_MAX_QUEUE_BYTES:
+      self->priv->max_queue_bytes = g_value_get_uint64 (value);
+      break;
+    case PROP_MAX_SPILL_BYTES:
+      self->priv->max_spill_bytes = g_value_get_uint64 (value);
+      break;
+    case PROP_SPILL_DIR:
+      g_free (self->priv->spill_dir);
+      self->priv->spill_dir = g_value_dup_string (value);
+      break;
+    case PROP_MP4_FRAGMENT_DURATION:
+      self->priv->mp4_fragment_duration = g_value_get_uint (value);
+      break;
+    case PROP_SEGMENT_DURATION:
+      self->priv->segment_duration = g_value_get_uint (value);
+      break;
+    case PROP_MAX_SEGMENT_BYTES:
+      self->priv->max_segment_bytes = g_value_get_uint64 (value);
+      break;
+    case PROP_SINK_PROPERTIES:
+      if (self->priv->sink_properties != NULL) {
+        gst_structure_free (self->priv->sink_properties);
+      }
+      self->priv->sink_properties = g_value_dup_boxed (value);
+      break;
+    case PROP_MUXING_PIPELINES:
+      if (!kms_base_media_muxer_set_n_pipelines (g_value_get_uint (value))) {
+        GST_WARNING_OBJECT (self, "Muxing pipelines already created");
+      }
+      break;
+    case PROP_PASSTHROUGH:
+      if (g_atomic_int_get (&self->priv->container_fixed)) {
+        GST_ERROR_OBJECT (self, "Container already chosen");
+      } else {
+        self->priv->passthrough = g_value_get_boolean (value);
+      }
       break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -1482,6 +1786,33 @@ kms_recorder_endpoint_get_property (GObject * object, guint property_id,
       g_value_set_enum (value, self->priv->gaps_fix);
       break;
     }
+    case PROP_MAX_QUEUE_BYTES:
+      g_value_set_uint64 (value, self->priv->max_queue_bytes);
+      break;
+    case PROP_MAX_SPILL_BYTES:
+      g_value_set_uint64 (value, self->priv->max_spill_bytes);
+      break;
+    case PROP_SPILL_DIR:
+      g_value_set_string (value, self->priv->spill_dir);
+      break;
+    case PROP_PASSTHROUGH:
+      g_value_set_boolean (value, self->priv->passthrough);
+      break;
+    case PROP_MP4_FRAGMENT_DURATION:
+      g_value_set_uint (value, self->priv->mp4_fragment_duration);
+      break;
+    case PROP_SEGMENT_DURATION:
+      g_value_set_uint (value, self->priv->segment_duration);
+      break;
+    case PROP_MAX_SEGMENT_BYTES:
+      g_value_set_uint64 (value, self->priv->max_segment_bytes);
+      break;
+    case PROP_SINK_PROPERTIES:
+      g_value_set_boxed (value, self->priv->sink_properties);
+      break;
+    case PROP_MUXING_PIPELINES:
+      g_value_set_uint (value, kms_base_media_muxer_get_n_pipelines ());
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -1490,7 +1821,7 @@ kms_recorder_endpoint_get_property (GObject * object, guint property_id,
 }
 
 static GstCaps *
-kms_recorder_endpoint_get_caps_from_profile (KmsRecorderEndpoint * self,
+kms_recorder_endpoint_get_profile_caps (KmsRecordingProfile profile,
     KmsElementPadType type)
 {
   GstEncodingContainerProfile *cprof;
@@ -1499,14 +1830,10 @@ kms_recorder_endpoint_get_caps_from_profile (KmsRecorderEndpoint * self,
 
   switch (type) {
     case KMS_ELEMENT_PAD_TYPE_VIDEO:
-      cprof =
-          kms_recording_profile_create_profile (self->priv->profile, FALSE,
-          TRUE);
+      cprof = kms_recording_profile_create_profile (profile, FALSE, TRUE);
       break;
     case KMS_ELEMENT_PAD_TYPE_AUDIO:
-      cprof =
-          kms_recording_profile_create_profile (self->priv->profile, TRUE,
-          FALSE);
+      cprof = kms_recording_profile_create_profile (profile, TRUE, FALSE);
       break;
     default:
       return NULL;
@@ -1530,6 +1857,267 @@ kms_recorder_endpoint_get_caps_from_profile (KmsRecorderEndpoint * self,
   return caps;
 }
 
+/*
+ * A URI whose extension names one of the containers only takes that one, so
+ * the location never ends up holding a different format than it claims.
+ */
+static gboolean
+kms_recorder_endpoint_uri_takes (KmsRecorderEndpoint * self, gint row)
+{
+  const gchar *uri = KMS_URI_ENDPOINT (self)->uri;
+  gchar *path;
+  gboolean ret = TRUE;
+  gint i;
+
+  if (uri == NULL) {
+    return TRUE;
+  }
+
+  path = g_ascii_strdown (uri, strcspn (uri, "?#"));
+
+  for (i = 0; i < G_N_ELEMENTS (passthrough_extensions); i++) {
+    if (g_str_has_suffix (path, passthrough_extensions[i])) {
+      ret = i == row;
+      break;
+    }
+  }
+
+  g_free (path);
+
+  return ret;
+}
+
+static GstCaps *
+kms_recorder_endpoint_get_caps_from_profile (KmsRecorderEndpoint * self,
+    KmsElementPadType type)
+{
+  GstCaps *caps = NULL;
+  gint i, row, media;
+
+  if (!kms_recorder_endpoint_is_choosing_container (self)) {
+    return kms_recorder_endpoint_get_profile_caps (self->priv->profile, type);
+  }
+
+  /* Codecs of any container the URI allows, so upstream elements send */
+  /* what they receive */
+  media = kms_recorder_endpoint_find_passthrough_profile (self->priv->profile,
+      &row);
+
+  for (i = 0; i < G_N_ELEMENTS (passthrough_profiles); i++) {
+    GstCaps *pcaps;
+
+    if (i != row && !kms_recorder_endpoint_uri_takes (self, i)) {
+      continue;
+    }
+
+    pcaps = kms_recorder_endpoint_get_profile_caps (passthrough_profiles[i]
+        [media], type);
+
+    if (pcaps == NULL) {
+      continue;
+    }
+
+    caps = (caps == NULL) ? pcaps : gst_caps_merge (caps, pcaps);
+  }
+
+  return caps;
+}
+
+static gboolean
+kms_recorder_endpoint_profile_accepts (KmsRecordingProfile profile,
+    KmsElementPadType type, GstCaps * caps)
+{
+  GstCaps *pcaps;
+  gboolean ret;
+
+  if (caps == NULL) {
+    /* Not negotiated yet, it will be negotiated for this profile */
+    return TRUE;
+  }
+
+  pcaps = kms_recorder_endpoint_get_profile_caps (profile, type);
+  ret = pcaps != NULL && gst_caps_can_intersect (caps, pcaps);
+
+  if (pcaps != NULL) {
+    gst_caps_unref (pcaps);
+  }
+
+  return ret;
+}
+
+typedef struct _KmsContainerPad
+{
+  GstPad *pad;
+  gboolean reconfigure;
+  gboolean video;
+} KmsContainerPad;
+
+static void
+kms_container_pad_free (KmsContainerPad * cpad)
+{
+  g_object_unref (cpad->pad);
+  g_slice_free (KmsContainerPad, cpad);
+}
+
+/*
+ * Called from the CAPS events of a passthrough recorder, with NULL caps from
+ * the media it drops. Media is dropped until every linked stream is
+ * negotiated; then the container is fixed: the configured one if it takes
+ * those codecs, else the first one that does and matches the URI extension.
+ * If some stream is still not negotiated CHOOSE_CONTAINER_TIMEOUT ms after
+ * the first one, the configured container is used. Streams it does not
+ * take are renegotiated, so upstream elements transcode them. No data has
+ * reached the muxer yet, so it can be replaced.
+ */
+static void
+kms_recorder_endpoint_choose_container (KmsRecorderEndpoint * self,
+    KmsRecorderTrack * track, GstCaps * caps)
+{
+  GstCaps *audio = NULL, *video = NULL;
+  KmsRecordingProfile profile;
+  GSList *pads = NULL, *l;
+  GHashTableIter iter;
+  gpointer value;
+  gint i, row, media;
+  gboolean timeout = FALSE;
+
+  KMS_ELEMENT_LOCK (self);
+
+  if (!kms_recorder_endpoint_is_choosing_container (self)) {
+    goto end;
+  }
+
+  if (track != NULL) {
+    if (track->first_caps != NULL) {
+      gst_caps_unref (track->first_caps);
+    }
+    track->first_caps = gst_caps_ref (caps);
+    g_atomic_int_set (&track->first_codec, g_atomic_int_get (&track->codec));
+
+    if (self->priv->container_deadline == 0) {
+      self->priv->container_deadline = g_get_monotonic_time () +
+          CHOOSE_CONTAINER_TIMEOUT * G_TIME_SPAN_MILLISECOND;
+    }
+  } else if (self->priv->container_deadline == 0) {
+    /* Nothing negotiated yet */
+    goto end;
+  }
+
+  g_hash_table_iter_init (&iter, self->priv->sink_pad_data);
+
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    KmsSinkPadData *data = value;
+    KmsRecorderTrack *t;
+    GstElement *appsink;
+    gboolean linked;
+
+    appsink = gst_pad_get_parent_element (data->sink_target);
+    t = g_object_get_qdata (G_OBJECT (appsink),
+        kms_recorder_track_key_quark ());
+    linked = g_object_get_qdata (G_OBJECT (appsink),
+        kms_appsrc_id_key_quark ()) != NULL;
+    g_object_unref (appsink);
+
+    if (t->first_caps == NULL) {
+      if (!linked) {
+        continue;
+      }
+
+      if (g_get_monotonic_time () < self->priv->container_deadline) {
+        GST_DEBUG_OBJECT (self, "Waiting for %s to choose the container",
+            data->name);
+        goto end;
+      }
+
+      GST_WARNING_OBJECT (self, "%s not negotiated after %d ms, keeping the "
+          "configured container", data->name, CHOOSE_CONTAINER_TIMEOUT);
+      timeout = TRUE;
+    } else if (data->type == KMS_ELEMENT_PAD_TYPE_AUDIO) {
+      audio = t->first_caps;
+    } else {
+      video = t->first_caps;
+    }
+  }
+
+  media = kms_recorder_endpoint_find_passthrough_profile (self->priv->profile,
+      &row);
+  profile = self->priv->profile;
+
+  for (i = -1; i < (gint) G_N_ELEMENTS (passthrough_profiles) && !timeout;
+      i++) {
+    KmsRecordingProfile candidate =
+        passthrough_profiles[i < 0 ? row : i][media];
+
+    if (i >= 0 && !kms_recorder_endpoint_uri_takes (self, i)) {
+      continue;
+    }
+
+    if (kms_recorder_endpoint_profile_accepts (candidate,
+            KMS_ELEMENT_PAD_TYPE_AUDIO, audio) &&
+        kms_recorder_endpoint_profile_accepts (candidate,
+            KMS_ELEMENT_PAD_TYPE_VIDEO, video)) {
+      profile = candidate;
+      break;
+    }
+  }
+
+  if (kms_av_muxer_set_profile (KMS_AV_MUXER (self->priv->mux), profile)) {
+    self->priv->profile = profile;
+  }
+
+  GST_INFO_OBJECT (self, "Recording %" GST_PTR_FORMAT " and %" GST_PTR_FORMAT
+      " with profile %d", audio, video, self->priv->profile);
+
+  g_atomic_int_set (&self->priv->container_fixed, TRUE);
+
+  g_hash_table_iter_init (&iter, self->priv->sink_pad_data);
+
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    KmsSinkPadData *data = value;
+    KmsContainerPad *cpad;
+    KmsRecorderTrack *t;
+    GstElement *appsink;
+
+    appsink = gst_pad_get_parent_element (data->sink_target);
+    t = g_object_get_qdata (G_OBJECT (appsink),
+        kms_recorder_track_key_quark ());
+    g_object_unref (appsink);
+
+    cpad = g_slice_new0 (KmsContainerPad);
+    cpad->pad = g_object_ref (data->sink_target);
+    cpad->video = data->type == KMS_ELEMENT_PAD_TYPE_VIDEO;
+    cpad->reconfigure =
+        !kms_recorder_endpoint_profile_accepts (self->priv->profile,
+        data->type, t->first_caps);
+
+    if (cpad->reconfigure) {
+      GST_WARNING_OBJECT (self, "Container does not take %" GST_PTR_FORMAT
+          ", %s will be transcoded", t->first_caps, data->name);
+    }
+
+    pads = g_slist_prepend (pads, cpad);
+  }
+
+end:
+  KMS_ELEMENT_UNLOCK (self);
+
+  /* Pads are only touched once the lock is released */
+  for (l = pads; l != NULL; l = l->next) {
+    KmsContainerPad *cpad = l->data;
+
+    if (cpad->reconfigure) {
+      gst_pad_push_event (cpad->pad, gst_event_new_reconfigure ());
+    }
+
+    if (cpad->video) {
+      /* Its first key frame may have been dropped */
+      kms_utils_drop_until_keyframe (cpad->pad, TRUE);
+    }
+  }
+
+  g_slist_free_full (pads, (GDestroyNotify) kms_container_pad_free);
+}
+
 static gboolean
 kms_recorder_endpoint_query_caps (KmsElement * element, GstPad * pad,
     GstQuery * query)
@@ -1594,7 +2182,8 @@ kms_recorder_endpoint_query_caps (KmsElement * element, GstPad * pad,
     GST_OBJECT_LOCK (pad);
     appsrc = gst_pad_get_element_private (pad);
 
-    if (appsrc == NULL) {
+    /* The muxer of a passthrough recorder may still be replaced */
+    if (appsrc == NULL || kms_recorder_endpoint_is_choosing_container (self)) {
       GstCaps *aux;
 
       GST_OBJECT_UNLOCK (pad);
@@ -1703,9 +2292,9 @@ kms_recorder_endpoint_query_accept_caps (KmsElement * element, GstPad * pad,
     appsrc = g_hash_table_lookup (self->priv->srcs, id);
     g_free (id);
 
-    if (appsrc == NULL) {
+    if (appsrc == NULL || kms_recorder_endpoint_is_choosing_container (self)) {
       SRCS_UNLOCK (self);
-      GST_DEBUG_OBJECT (self, "No appsrc attached to pad %" GST_PTR_FORMAT,
+      GST_DEBUG_OBJECT (self, "No muxer to ask for pad %" GST_PTR_FORMAT,
           pad);
       goto end;
     }
@@ -1820,17 +2409,125 @@ kms_element_get_e2e_latency_stats (KmsRecorderEndpoint * self, gchar * selector)
   return stats;
 }
 
+static GstStructure *
+kms_recorder_endpoint_get_queue_stats (KmsRecorderEndpoint * self)
+{
+  GstStructure *q_stats;
+  GHashTableIter iter;
+  gpointer key, value;
+
+  q_stats = gst_structure_new_empty ("recording-queues");
+
+  SRCS_LOCK (self);
+
+  g_hash_table_iter_init (&iter, self->priv->srcs);
+  while (g_hash_table_iter_next (&iter, &key, &value)) {
+    GstStructure *appsrc_stats;
+
+    appsrc_stats = kms_spill_queue_get_stats (GST_APP_SRC (value));
+
+    if (appsrc_stats != NULL) {
+      gst_structure_set (q_stats, key, GST_TYPE_STRUCTURE, appsrc_stats, NULL);
+      gst_structure_free (appsrc_stats);
+    }
+  }
+
+  SRCS_UNLOCK (self);
+
+  return q_stats;
+}
+
+static GstStructure *
+kms_recorder_endpoint_get_codec_stats (KmsRecorderEndpoint * self)
+{
+  GstStructure *c_stats;
+  GHashTableIter iter;
+  gpointer key, value;
+
+  c_stats = gst_structure_new ("recording-codecs",
+      "profile", KMS_TYPE_RECORDING_PROFILE, self->priv->profile,
+      "passthrough", G_TYPE_BOOLEAN, self->priv->passthrough, NULL);
+
+  KMS_ELEMENT_LOCK (self);
+
+  g_hash_table_iter_init (&iter, self->priv->sink_pad_data);
+
+  while (g_hash_table_iter_next (&iter, &key, &value)) {
+    KmsSinkPadData *data = value;
+    KmsRecorderTrack *track;
+    GstStructure *t_stats;
+    GstElement *appsink;
+    GQuark codec, first_codec;
+
+    appsink = gst_pad_get_parent_element (data->sink_target);
+
+    if (appsink == NULL) {
+      continue;
+    }
+
+    track = g_object_get_qdata (G_OBJECT (appsink),
+        kms_recorder_track_key_quark ());
+    codec = g_atomic_int_get (&track->codec);
+    first_codec = g_atomic_int_get (&track->first_codec);
+    g_object_unref (appsink);
+
+    if (codec == 0) {
+      continue;
+    }
+
+    t_stats = gst_structure_new (key, "codec", G_TYPE_STRING,
+        g_quark_to_string (codec), NULL);
+
+    /* Only passthrough recorders know what upstream elements received */
+    if (self->priv->passthrough) {
+      gst_structure_set (t_stats, "transcoding", G_TYPE_BOOLEAN,
+          first_codec != 0 && first_codec != codec, NULL);
+    }
+
+    gst_structure_set (c_stats, key, GST_TYPE_STRUCTURE, t_stats, NULL);
+    gst_structure_free (t_stats);
+  }
+
+  KMS_ELEMENT_UNLOCK (self);
+
+  return c_stats;
+}
+
 static GstStructure *
 kms_recorder_endpoint_stats (KmsElement * obj, gchar * selector)
 {
   KmsRecorderEndpoint *self = KMS_RECORDER_ENDPOINT (obj);
-  GstStructure *stats, *e_stats, *l_stats;
+  GstStructure *stats, *e_stats, *l_stats, *q_stats, *c_stats, *s_stats;
 
   /* chain up */
   stats =
       KMS_ELEMENT_CLASS (kms_recorder_endpoint_parent_class)->stats (obj,
       selector);
 
+  /* Bytes and time waiting for the muxer, in memory and spilled to disk */
+  q_stats = kms_recorder_endpoint_get_queue_stats (self);
+  gst_structure_set (stats, "recording-queues", GST_TYPE_STRUCTURE, q_stats,
+      NULL);
+  gst_structure_free (q_stats);
+
+  /* Codecs recorded, and whether they had to be transcoded */
+  c_stats = kms_recorder_endpoint_get_codec_stats (self);
+  gst_structure_set (stats, "recording-codecs", GST_TYPE_STRUCTURE, c_stats,
+      NULL);
+  gst_structure_free (c_stats);
+
+  /* Bytes written to local files, and how long the writes took */
+  KMS_ELEMENT_LOCK (self);
+  s_stats = self->priv->file_sink != NULL ?
+      kms_file_sink_get_stats (KMS_FILE_SINK (self->priv->file_sink)) : NULL;
+  KMS_ELEMENT_UNLOCK (self);
+
+  if (s_stats != NULL) {
+    gst_structure_set (stats, "recording-sink", GST_TYPE_STRUCTURE, s_stats,
+        NULL);
+    gst_structure_free (s_stats);
+  }
+
   if (!self->priv->stats.enabled) {
     return stats;
   }
@@ -1982,6 +2679,65 @@ kms_recorder_endpoint_class_init (KmsRecorderEndpointClass * klass)
       "Gaps fix method", "The method used to fix gaps in the stream",
       KMS_TYPE_RECORDER_GAPS_FIX_METHOD, DEFAULT_GAPS_FIX, G_PARAM_READWRITE);
 
+  obj_properties[PROP_MAX_QUEUE_BYTES] = g_param_spec_uint64 ("max-queue-bytes",
+      "Max queue bytes",
+      "Bytes each stream may keep in memory while the storage is slow "
+      "(0 = unlimited). Then media goes to the spill file, and once that is "
+      "full too, to nowhere until the next key frame: each such gap posts a "
+      "warning and is counted in the \"recording-queues\" stats. "
+      "Must be set before the profile", 0, G_MAXUINT64,
+      DEFAULT_MAX_QUEUE_BYTES, G_PARAM_READWRITE);
+
+  obj_properties[PROP_MAX_SPILL_BYTES] = g_param_spec_uint64 ("max-spill-bytes",
+      "Max spill bytes",
+      "Bytes each stream may spill to disk once its memory queue is full "
+      "(0 = drop until the next key frame instead, see max-queue-bytes). "
+      "Must be set before the profile", 0, G_MAXUINT64,
+      DEFAULT_MAX_SPILL_BYTES, G_PARAM_READWRITE);
+
+  obj_properties[PROP_SPILL_DIR] = g_param_spec_string ("spill-dir",
+      "Spill directory",
+      "Directory for spill files (NULL = system temporary directory). "
+      "Must be set before the profile", DEFAULT_SPILL_DIR, G_PARAM_READWRITE);
+
+  obj_properties[PROP_PASSTHROUGH] = g_param_spec_boolean ("passthrough",
+      "Passthrough",
+      "Choose the WEBM, MP4 or MKV container from the codecs received, so "
+      "they are not transcoded. The profile only selects the media recorded",
+      DEFAULT_PASSTHROUGH, G_PARAM_READWRITE);
+
+  obj_properties[PROP_MP4_FRAGMENT_DURATION] =
+      g_param_spec_uint ("mp4-fragment-duration", "MP4 fragment duration",
+      "Milliseconds of media in each fragment of MP4 recordings "
+      "(0 = not fragmented). Must be set before the profile", 0, G_MAXUINT,
+      DEFAULT_MP4_FRAGMENT_DURATION, G_PARAM_READWRITE);
+
+  obj_properties[PROP_SEGMENT_DURATION] =
+      g_param_spec_uint ("segment-duration", "Segment duration",
+      "Milliseconds after which a local recording goes on in a new file, "
+      "listed in a .m3u8 playlist next to it (0 = no limit). "
+      "Must be set before the profile", 0, G_MAXUINT,
+      DEFAULT_SEGMENT_DURATION, G_PARAM_READWRITE);
+
+  obj_properties[PROP_MAX_SEGMENT_BYTES] =
+      g_param_spec_uint64 ("max-segment-bytes", "Max segment bytes",
+      "Bytes after which a local recording goes on in a new file, "
+      "listed in a .m3u8 playlist next to it (0 = no limit). "
+      "Must be set before the profile", 0, G_MAXUINT64,
+      DEFAULT_MAX_SEGMENT_BYTES, G_PARAM_READWRITE);
+
+  obj_properties[PROP_SINK_PROPERTIES] =
+      g_param_spec_boxed ("sink-properties", "Sink properties",
+      "Properties of the element writing the recording, such as "
+      "\"flush-policy\" for local files. Those it does not have are ignored. "
+      "Must be set before the profile", GST_TYPE_STRUCTURE, G_PARAM_READWRITE);
+
+  obj_properties[PROP_MUXING_PIPELINES] =
+      g_param_spec_uint ("muxing-pipelines", "Muxing pipelines",
+      "Pipelines that host the muxers of all the recorders of the process "
+      "(0 = one per CPU core). Only taken before the first profile is set",
+      0, G_MAXUINT, DEFAULT_MUXING_PIPELINES, G_PARAM_READWRITE);
+
   g_object_class_install_properties (gobject_class,
       N_PROPERTIES, obj_properties);
 
@@ -2115,6 +2871,12 @@ kms_recorder_endpoint_init (KmsRecorderEndpoint * self)
 
   self->priv->profile = DEFAULT_RECORDING_PROFILE;
   self->priv->gaps_fix = DEFAULT_GAPS_FIX;
+  self->priv->max_queue_bytes = DEFAULT_MAX_QUEUE_BYTES;
+  self->priv->max_spill_bytes = DEFAULT_MAX_SPILL_BYTES;
+  self->priv->passthrough = DEFAULT_PASSTHROUGH;
+  self->priv->mp4_fragment_duration = DEFAULT_MP4_FRAGMENT_DURATION;
+  self->priv->segment_duration = DEFAULT_SEGMENT_DURATION;
+  self->priv->max_segment_bytes = DEFAULT_MAX_SEGMENT_BYTES;
 
   self->priv->paused_time = G_GUINT64_CONSTANT (0);
   self->priv->paused_start = GST_CLOCK_TIME_NONE;
@@ -2137,6 +2899,11 @@ kms_recorder_endpoint_init (KmsRecorderEndpoint * self)
 gboolean
 kms_recorder_endpoint_plugin_init (GstPlugin * plugin)
 {
+  if (!kms_s3_sink_plugin_init (plugin) ||
+      !kms_file_sink_plugin_init (plugin)) {
+    return FALSE;
+  }
+
   return gst_element_register (plugin, PLUGIN_NAME, GST_RANK_NONE,
       KMS_TYPE_RECORDER_ENDPOINT);
 }
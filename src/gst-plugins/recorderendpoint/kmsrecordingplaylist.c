@@ -0,0 +1,122 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "kmsrecordingplaylist.h"
+
+#define GST_DEFAULT_NAME "recordingplaylist"
+#define GST_CAT_DEFAULT kms_recording_playlist_debug_category
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+
+struct _KmsRecordingPlaylist
+{
+  GMutex mutex;
+  gchar *path;
+  GString *contents;
+  gboolean ended;
+};
+
+/* Must be called with the playlist mutex held */
+static void
+kms_recording_playlist_write (KmsRecordingPlaylist * playlist)
+{
+  GError *err = NULL;
+
+  /* Written to a temporary file and renamed, readers never see it partial */
+  if (!g_file_set_contents (playlist->path, playlist->contents->str,
+          playlist->contents->len, &err)) {
+    GST_ERROR ("Can not write playlist %s: %s", playlist->path, err->message);
+    g_error_free (err);
+  }
+}
+
+KmsRecordingPlaylist *
+kms_recording_playlist_new (const gchar * path)
+{
+  static gsize debug_init = 0;
+  KmsRecordingPlaylist *playlist;
+
+  g_return_val_if_fail (path != NULL, NULL);
+
+  if (g_once_init_enter (&debug_init)) {
+    GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+        GST_DEFAULT_NAME);
+    g_once_init_leave (&debug_init, 1);
+  }
+
+  playlist = g_slice_new0 (KmsRecordingPlaylist);
+  g_mutex_init (&playlist->mutex);
+  playlist->path = g_strdup (path);
+  playlist->contents = g_string_new ("#EXTM3U\n");
+
+  return playlist;
+}
+
+void
+kms_recording_playlist_free (KmsRecordingPlaylist * playlist)
+{
+  g_mutex_clear (&playlist->mutex);
+  g_free (playlist->path);
+  g_string_free (playlist->contents, TRUE);
+
+  g_slice_free (KmsRecordingPlaylist, playlist);
+}
+
+void
+kms_recording_playlist_add_segment (KmsRecordingPlaylist * playlist,
+    const gchar * location, GstClockTime duration)
+{
+  gchar *name, secs[G_ASCII_DTOSTR_BUF_SIZE];
+
+  name = g_path_get_basename (location);
+
+  if (GST_CLOCK_TIME_IS_VALID (duration)) {
+    /* Locale independent, players expect a dot as decimal separator */
+    g_ascii_formatd (secs, sizeof (secs), "%.3f",
+        (gdouble) duration / GST_SECOND);
+  } else {
+    g_strlcpy (secs, "-1", sizeof (secs));
+  }
+
+  g_mutex_lock (&playlist->mutex);
+
+  if (playlist->ended) {
+    GST_WARNING ("Segment %s added to ended playlist %s", location,
+        playlist->path);
+  } else {
+    g_string_append_printf (playlist->contents, "#EXTINF:%s,\n%s\n", secs,
+        name);
+    kms_recording_playlist_write (playlist);
+  }
+
+  g_mutex_unlock (&playlist->mutex);
+
+  GST_DEBUG ("Segment %s of %" GST_TIME_FORMAT " added to %s", location,
+      GST_TIME_ARGS (duration), playlist->path);
+
+  g_free (name);
+}
+
+void
+kms_recording_playlist_end (KmsRecordingPlaylist * playlist)
+{
+  g_mutex_lock (&playlist->mutex);
+  playlist->ended = TRUE;
+  g_mutex_unlock (&playlist->mutex);
+}
@@ -0,0 +1,46 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef _KMS_RECORDING_PLAYLIST_H_
+#define _KMS_RECORDING_PLAYLIST_H_
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Extended M3U playlist (UTF-8, hence .m3u8) of the segments of a
+ * recording. It is not an HLS playlist: segments are complete files of the
+ * recording profile, WebM and MP4 included, which HLS clients do not take.
+ * The file is replaced atomically every time a segment is closed, so it
+ * always lists complete segments only. Segments are listed relative to the
+ * playlist, which must be in the same directory, with a duration of -1 when
+ * it is unknown.
+ *
+ * Functions can be called from any thread. The file is written under a
+ * lock of the playlist only, so callers should not hold their own locks.
+ */
+typedef struct _KmsRecordingPlaylist KmsRecordingPlaylist;
+
+KmsRecordingPlaylist * kms_recording_playlist_new (const gchar * path);
+void kms_recording_playlist_free (KmsRecordingPlaylist * playlist);
+
+void kms_recording_playlist_add_segment (KmsRecordingPlaylist * playlist,
+    const gchar * location, GstClockTime duration);
+void kms_recording_playlist_end (KmsRecordingPlaylist * playlist);
+
+G_END_DECLS
+#endif /* _KMS_RECORDING_PLAYLIST_H_ */
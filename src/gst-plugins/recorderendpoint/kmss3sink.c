@@ -0,0 +1,1038 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <libsoup/soup.h>
+
+#include "kmss3sink.h"
+
+#define PLUGIN_NAME "kmss3sink"
+
+#define GST_CAT_DEFAULT kms_s3_sink_debug_category
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+
+#define KMS_S3_SINK_GET_PRIVATE(obj) (  \
+  G_TYPE_INSTANCE_GET_PRIVATE (         \
+    (obj),                              \
+    KMS_TYPE_S3_SINK,                   \
+    KmsS3SinkPrivate                    \
+  )                                     \
+)
+
+#define MEGA_BYTES(n) ((n) * 1024 * 1024)
+
+/* S3 rejects parts under 5 MiB, except the last one, and more than 10000 */
+#define DEFAULT_PART_SIZE MEGA_BYTES (5)
+#define S3_MIN_PART_SIZE MEGA_BYTES (5)
+#define MAX_PARTS 10000
+/* Other stores, such as test servers, may take smaller parts */
+#define MIN_PART_SIZE 1024
+#define AWS_DOMAIN ".amazonaws.com"
+
+#define DEFAULT_MAX_UPLOADS 4
+#define DEFAULT_MAX_PENDING_PARTS 8
+#define DEFAULT_MAX_RETRIES 3
+#define DEFAULT_REGION "us-east-1"
+
+#define REQUEST_TIMEOUT 30      /* seconds */
+#define RETRY_DELAY (200 * G_TIME_SPAN_MILLISECOND)
+
+#define SIGNED_HEADERS "host;x-amz-content-sha256;x-amz-date"
+#define SHA256_LEN 32
+
+enum
+{
+  PROP_0,
+  PROP_LOCATION,
+  PROP_ACCESS_KEY,
+  PROP_SECRET_KEY,
+  PROP_REGION,
+  PROP_PART_SIZE,
+  PROP_MAX_UPLOADS,
+  PROP_MAX_PENDING_PARTS,
+  PROP_MAX_RETRIES,
+  N_PROPERTIES
+};
+
+static GParamSpec *obj_properties[N_PROPERTIES] = { NULL, };
+
+typedef struct _KmsS3Part
+{
+  guint number;
+  GBytes *data;
+} KmsS3Part;
+
+struct _KmsS3SinkPrivate
+{
+  /* Properties, protected by the object lock */
+  gchar *location;
+  gchar *access_key;
+  gchar *secret_key;
+  gchar *region;
+  guint part_size;
+  guint max_uploads;
+  guint max_pending_parts;
+  guint max_retries;
+
+  /* Taken from the location when the upload starts */
+  gchar *endpoint;              /* "https://host:port" */
+  gchar *host;                  /* Host header, as signed */
+  gchar *path;                  /* "/bucket/key", escaped */
+  gchar *key_id;
+  gchar *secret;
+  guint upload_part_size;
+
+  /* Used by the streaming thread only */
+  SoupSession *session;
+  gchar *upload_id;
+  GByteArray *part;
+  GThread **workers;
+  guint n_workers;
+
+  /* Shared with the upload workers */
+  GMutex mutex;
+  GCond cond;
+  GQueue parts;                 /* KmsS3Part waiting for a worker */
+  guint in_flight;
+  guint queued_parts;           /* Number of the last part queued */
+  GPtrArray *etags;             /* Indexed by part number - 1 */
+  gboolean failed;
+  gboolean flushing;
+  gboolean stopping;
+};
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS_ANY);
+
+G_DEFINE_TYPE_WITH_CODE (KmsS3Sink, kms_s3_sink, GST_TYPE_BASE_SINK,
+    GST_DEBUG_CATEGORY_INIT (kms_s3_sink_debug_category, PLUGIN_NAME,
+        0, "debug category for S3 multipart upload sink"));
+
+static void
+kms_s3_sink_part_destroy (KmsS3Part * part)
+{
+  g_bytes_unref (part->data);
+  g_slice_free (KmsS3Part, part);
+}
+
+static SoupSession *
+kms_s3_sink_new_session (void)
+{
+  return soup_session_new_with_options (SOUP_SESSION_TIMEOUT, REQUEST_TIMEOUT,
+      NULL);
+}
+
+static void
+kms_s3_sink_hmac (const guint8 * key, gsize key_len, const gchar * data,
+    guint8 * digest)
+{
+  GHmac *hmac = g_hmac_new (G_CHECKSUM_SHA256, key, key_len);
+  gsize len = SHA256_LEN;
+
+  g_hmac_update (hmac, (const guchar *) data, -1);
+  g_hmac_get_digest (hmac, digest, &len);
+  g_hmac_unref (hmac);
+}
+
+/* AWS Signature Version 4, with the payload hash in x-amz-content-sha256 */
+static void
+kms_s3_sink_sign (KmsS3Sink * self, SoupMessage * msg, const gchar * method,
+    const gchar * query, const gchar * payload_hash)
+{
+  gchar *date, *day, *canonical, *canonical_hash, *scope, *string_to_sign;
+  gchar *key, *signature, *authorization;
+  guint8 k_date[SHA256_LEN], k_region[SHA256_LEN], k_service[SHA256_LEN];
+  guint8 k_signing[SHA256_LEN];
+  GDateTime *now;
+
+  now = g_date_time_new_now_utc ();
+  date = g_date_time_format (now, "%Y%m%dT%H%M%SZ");
+  day = g_date_time_format (now, "%Y%m%d");
+  g_date_time_unref (now);
+
+  soup_message_headers_replace (msg->request_headers, "x-amz-date", date);
+  soup_message_headers_replace (msg->request_headers, "x-amz-content-sha256",
+      payload_hash);
+
+  if (self->priv->key_id == NULL) {
+    /* Anonymous request, for buckets that allow them */
+    goto end;
+  }
+
+  canonical = g_strdup_printf ("%s\n%s\n%s\nhost:%s\nx-amz-content-sha256:%s\n"
+      "x-amz-date:%s\n\n" SIGNED_HEADERS "\n%s", method, self->priv->path,
+      query, self->priv->host, payload_hash, date, payload_hash);
+  canonical_hash = g_compute_checksum_for_string (G_CHECKSUM_SHA256, canonical,
+      -1);
+
+  scope = g_strdup_printf ("%s/%s/s3/aws4_request", day, self->priv->region);
+  string_to_sign = g_strdup_printf ("AWS4-HMAC-SHA256\n%s\n%s\n%s", date,
+      scope, canonical_hash);
+
+  key = g_strconcat ("AWS4", self->priv->secret, NULL);
+  kms_s3_sink_hmac ((const guint8 *) key, strlen (key), day, k_date);
+  kms_s3_sink_hmac (k_date, SHA256_LEN, self->priv->region, k_region);
+  kms_s3_sink_hmac (k_region, SHA256_LEN, "s3", k_service);
+  kms_s3_sink_hmac (k_service, SHA256_LEN, "aws4_request", k_signing);
+  signature = g_compute_hmac_for_string (G_CHECKSUM_SHA256, k_signing,
+      SHA256_LEN, string_to_sign, -1);
+
+  authorization = g_strdup_printf ("AWS4-HMAC-SHA256 Credential=%s/%s, "
+      "SignedHeaders=" SIGNED_HEADERS ", Signature=%s", self->priv->key_id,
+      scope, signature);
+  soup_message_headers_replace (msg->request_headers, "Authorization",
+      authorization);
+
+  g_free (authorization);
+  g_free (signature);
+  g_free (key);
+  g_free (string_to_sign);
+  g_free (scope);
+  g_free (canonical_hash);
+  g_free (canonical);
+
+end:
+  g_free (day);
+  g_free (date);
+}
+
+static gboolean
+kms_s3_sink_should_retry (guint status)
+{
+  return SOUP_STATUS_IS_TRANSPORT_ERROR (status) ||
+      SOUP_STATUS_IS_SERVER_ERROR (status) ||
+      status == SOUP_STATUS_REQUEST_TIMEOUT || status == 429;
+}
+
+/* Waits before a retry. Returns FALSE if the sink is being stopped */
+static gboolean
+kms_s3_sink_backoff (KmsS3Sink * self, guint attempt)
+{
+  gint64 end_time;
+  gboolean stopping;
+
+  end_time = g_get_monotonic_time () + (RETRY_DELAY << attempt);
+
+  g_mutex_lock (&self->priv->mutex);
+  while (!self->priv->stopping &&
+      g_cond_wait_until (&self->priv->cond, &self->priv->mutex, end_time));
+  stopping = self->priv->stopping;
+  g_mutex_unlock (&self->priv->mutex);
+
+  return !stopping;
+}
+
+/* Sends a request, retrying transient failures. Returns the successful
+ * message, or NULL */
+static SoupMessage *
+kms_s3_sink_request (KmsS3Sink * self, SoupSession * session,
+    const gchar * method, const gchar * query, GBytes * body)
+{
+  SoupMessage *msg = NULL;
+  gchar *url, *payload_hash;
+  guint attempt, status = SOUP_STATUS_NONE;
+  gsize size = 0;
+  gconstpointer data = NULL;
+
+  if (body != NULL) {
+    data = g_bytes_get_data (body, &size);
+  }
+
+  url = g_strconcat (self->priv->endpoint, self->priv->path, "?", query, NULL);
+  payload_hash = g_compute_checksum_for_data (G_CHECKSUM_SHA256, data, size);
+
+  for (attempt = 0; attempt <= self->priv->max_retries; attempt++) {
+    if (attempt > 0 && !kms_s3_sink_backoff (self, attempt - 1)) {
+      break;
+    }
+
+    msg = soup_message_new (method, url);
+    if (msg == NULL) {
+      GST_ERROR_OBJECT (self, "Invalid request URL %s", url);
+      break;
+    }
+
+    if (data != NULL) {
+      /* The request is synchronous, so the part outlives it */
+      soup_message_set_request (msg, "application/octet-stream",
+          SOUP_MEMORY_STATIC, data, size);
+    }
+
+    kms_s3_sink_sign (self, msg, method, query, payload_hash);
+    status = soup_session_send_message (session, msg);
+
+    if (SOUP_STATUS_IS_SUCCESSFUL (status)) {
+      break;
+    }
+
+    GST_WARNING_OBJECT (self, "%s %s failed (attempt %u): %u %s", method,
+        query, attempt + 1, status, msg->reason_phrase);
+    g_clear_object (&msg);
+
+    if (!kms_s3_sink_should_retry (status)) {
+      break;
+    }
+  }
+
+  g_free (payload_hash);
+  g_free (url);
+
+  return msg;
+}
+
+static gchar *
+kms_s3_sink_get_xml_value (SoupMessage * msg, const gchar * tag)
+{
+  SoupBuffer *buffer;
+  gchar *open_tag, *close_tag, *value = NULL;
+  const gchar *start, *end;
+
+  buffer = soup_message_body_flatten (msg->response_body);
+  open_tag = g_strdup_printf ("<%s>", tag);
+  close_tag = g_strdup_printf ("</%s>", tag);
+
+  start = g_strstr_len (buffer->data, buffer->length, open_tag);
+  if (start != NULL) {
+    start += strlen (open_tag);
+    end = g_strstr_len (start, buffer->data + buffer->length - start,
+        close_tag);
+    if (end != NULL) {
+      value = g_strndup (start, end - start);
+    }
+  }
+
+  g_free (close_tag);
+  g_free (open_tag);
+  soup_buffer_free (buffer);
+
+  return value;
+}
+
+static gchar *
+kms_s3_sink_upload_query (KmsS3Sink * self, guint part_number)
+{
+  gchar *upload_id, *query;
+
+  upload_id = g_uri_escape_string (self->priv->upload_id, NULL, FALSE);
+
+  /* Parameters are sorted, as the signature requires */
+  if (part_number > 0) {
+    query = g_strdup_printf ("partNumber=%u&uploadId=%s", part_number,
+        upload_id);
+  } else {
+    query = g_strdup_printf ("uploadId=%s", upload_id);
+  }
+
+  g_free (upload_id);
+
+  return query;
+}
+
+static gpointer
+kms_s3_sink_upload_parts (KmsS3Sink * self)
+{
+  SoupSession *session = kms_s3_sink_new_session ();
+
+  while (TRUE) {
+    SoupMessage *msg = NULL;
+    gchar *etag = NULL;
+    KmsS3Part *part;
+
+    g_mutex_lock (&self->priv->mutex);
+
+    while (g_queue_is_empty (&self->priv->parts) && !self->priv->stopping) {
+      g_cond_wait (&self->priv->cond, &self->priv->mutex);
+    }
+
+    part = g_queue_pop_head (&self->priv->parts);
+    if (part == NULL) {
+      g_mutex_unlock (&self->priv->mutex);
+      break;
+    }
+
+    self->priv->in_flight++;
+    /* Room in the queue for the streaming thread */
+    g_cond_broadcast (&self->priv->cond);
+
+    if (!self->priv->failed && !self->priv->stopping) {
+      gchar *query;
+
+      g_mutex_unlock (&self->priv->mutex);
+
+      query = kms_s3_sink_upload_query (self, part->number);
+      msg = kms_s3_sink_request (self, session, SOUP_METHOD_PUT, query,
+          part->data);
+      g_free (query);
+
+      if (msg != NULL) {
+        etag = g_strdup (soup_message_headers_get_one (msg->response_headers,
+                "ETag"));
+        g_object_unref (msg);
+      }
+
+      g_mutex_lock (&self->priv->mutex);
+    }
+
+    if (etag != NULL) {
+      GST_LOG_OBJECT (self, "Uploaded part %u (%" G_GSIZE_FORMAT " bytes)",
+          part->number, g_bytes_get_size (part->data));
+      g_ptr_array_index (self->priv->etags, part->number - 1) = etag;
+    } else if (!self->priv->stopping) {
+      GST_ERROR_OBJECT (self, "Could not upload part %u", part->number);
+      self->priv->failed = TRUE;
+    }
+
+    self->priv->in_flight--;
+    g_cond_broadcast (&self->priv->cond);
+    g_mutex_unlock (&self->priv->mutex);
+
+    kms_s3_sink_part_destroy (part);
+  }
+
+  g_object_unref (session);
+
+  return NULL;
+}
+
+/* Parts under S3_MIN_PART_SIZE are only allowed with other endpoints */
+static gboolean
+kms_s3_sink_is_aws (const gchar * host)
+{
+  gchar *name = g_ascii_strdown (host, -1);
+  gboolean ret;
+
+  ret = g_str_has_suffix (name, AWS_DOMAIN) ||
+      g_strcmp0 (name, AWS_DOMAIN + 1) == 0;
+  g_free (name);
+
+  return ret;
+}
+
+static gboolean
+kms_s3_sink_parse_location (KmsS3Sink * self)
+{
+  SoupURI *uri;
+  const gchar *scheme, *path;
+  gchar *decoded;
+  gboolean ret = FALSE;
+
+  uri = soup_uri_new (self->priv->location);
+  if (uri == NULL || soup_uri_get_host (uri) == NULL) {
+    goto end;
+  }
+
+  scheme = soup_uri_get_scheme (uri);
+  if (g_strcmp0 (scheme, KMS_S3_SINK_PROTOCOL) == 0) {
+    scheme = "https";
+  } else if (g_strcmp0 (scheme, KMS_S3_SINK_PROTOCOL_HTTP) == 0) {
+    scheme = "http";
+  } else {
+    goto end;
+  }
+
+  /* Path style addressing: "/bucket/key" */
+  path = soup_uri_get_path (uri);
+  if (path == NULL || strchr (path + 1, '/') == NULL ||
+      g_str_has_suffix (path, "/")) {
+    goto end;
+  }
+
+  /* Escaped the way the signature expects it */
+  decoded = soup_uri_decode (path);
+  self->priv->path = g_uri_escape_string (decoded, "/", FALSE);
+  g_free (decoded);
+
+  if (soup_uri_get_port (uri) != 0) {
+    self->priv->host = g_strdup_printf ("%s:%u", soup_uri_get_host (uri),
+        soup_uri_get_port (uri));
+  } else {
+    self->priv->host = g_strdup (soup_uri_get_host (uri));
+  }
+
+  self->priv->endpoint = g_strdup_printf ("%s://%s", scheme, self->priv->host);
+
+  /* Credentials in the URI take precedence */
+  if (soup_uri_get_user (uri) != NULL) {
+    self->priv->key_id = g_strdup (soup_uri_get_user (uri));
+    self->priv->secret = g_strdup (soup_uri_get_password (uri));
+  } else if (self->priv->access_key != NULL) {
+    self->priv->key_id = g_strdup (self->priv->access_key);
+    self->priv->secret = g_strdup (self->priv->secret_key);
+  }
+
+  if (self->priv->key_id != NULL && self->priv->secret == NULL) {
+    self->priv->secret = g_strdup ("");
+  }
+
+  self->priv->upload_part_size = self->priv->part_size;
+
+  if (self->priv->upload_part_size < S3_MIN_PART_SIZE &&
+      kms_s3_sink_is_aws (soup_uri_get_host (uri))) {
+    GST_WARNING_OBJECT (self, "Part size %u is too small for S3, using %u",
+        self->priv->upload_part_size, S3_MIN_PART_SIZE);
+    self->priv->upload_part_size = S3_MIN_PART_SIZE;
+  }
+
+  ret = TRUE;
+
+end:
+  if (uri != NULL) {
+    soup_uri_free (uri);
+  }
+
+  return ret;
+}
+
+static void
+kms_s3_sink_clear_location (KmsS3Sink * self)
+{
+  g_clear_pointer (&self->priv->endpoint, g_free);
+  g_clear_pointer (&self->priv->host, g_free);
+  g_clear_pointer (&self->priv->path, g_free);
+  g_clear_pointer (&self->priv->key_id, g_free);
+  g_clear_pointer (&self->priv->secret, g_free);
+}
+
+static void
+kms_s3_sink_abort_upload (KmsS3Sink * self)
+{
+  SoupMessage *msg;
+  gchar *query;
+
+  if (self->priv->upload_id == NULL) {
+    return;
+  }
+
+  /* Otherwise the storage keeps the uploaded parts */
+  query = kms_s3_sink_upload_query (self, 0);
+  msg = kms_s3_sink_request (self, self->priv->session, SOUP_METHOD_DELETE,
+      query, NULL);
+  g_free (query);
+
+  if (msg != NULL) {
+    GST_DEBUG_OBJECT (self, "Aborted upload %s", self->priv->upload_id);
+    g_object_unref (msg);
+  } else {
+    GST_WARNING_OBJECT (self, "Could not abort upload %s",
+        self->priv->upload_id);
+  }
+
+  g_clear_pointer (&self->priv->upload_id, g_free);
+}
+
+static void
+kms_s3_sink_stop_workers (KmsS3Sink * self)
+{
+  guint i;
+
+  g_mutex_lock (&self->priv->mutex);
+  self->priv->stopping = TRUE;
+  g_cond_broadcast (&self->priv->cond);
+  g_mutex_unlock (&self->priv->mutex);
+
+  for (i = 0; i < self->priv->n_workers; i++) {
+    g_thread_join (self->priv->workers[i]);
+  }
+
+  g_clear_pointer (&self->priv->workers, g_free);
+  self->priv->n_workers = 0;
+}
+
+static gboolean kms_s3_sink_stop (GstBaseSink * sink);
+
+static gboolean
+kms_s3_sink_start (GstBaseSink * sink)
+{
+  KmsS3Sink *self = KMS_S3_SINK (sink);
+  SoupMessage *msg;
+  gboolean ret;
+  guint i;
+
+  GST_OBJECT_LOCK (self);
+  ret = self->priv->location != NULL && kms_s3_sink_parse_location (self);
+  GST_OBJECT_UNLOCK (self);
+
+  if (!ret) {
+    GST_ELEMENT_ERROR (self, RESOURCE, NOT_FOUND,
+        ("Invalid S3 location: %s", GST_STR_NULL (self->priv->location)),
+        ("Expected " KMS_S3_SINK_PROTOCOL "://host[:port]/bucket/key"));
+    kms_s3_sink_clear_location (self);
+    return FALSE;
+  }
+
+  self->priv->failed = FALSE;
+  self->priv->flushing = FALSE;
+  self->priv->stopping = FALSE;
+  self->priv->queued_parts = 0;
+  self->priv->etags = g_ptr_array_new_with_free_func (g_free);
+  self->priv->part = g_byte_array_sized_new (self->priv->upload_part_size);
+  self->priv->session = kms_s3_sink_new_session ();
+
+  msg = kms_s3_sink_request (self, self->priv->session, SOUP_METHOD_POST,
+      "uploads=", NULL);
+  if (msg != NULL) {
+    self->priv->upload_id = kms_s3_sink_get_xml_value (msg, "UploadId");
+    g_object_unref (msg);
+  }
+
+  if (self->priv->upload_id == NULL) {
+    GST_ELEMENT_ERROR (self, RESOURCE, OPEN_WRITE,
+        ("Could not start the upload to %s", self->priv->location), (NULL));
+    kms_s3_sink_stop (sink);
+    return FALSE;
+  }
+
+  GST_DEBUG_OBJECT (self, "Started upload %s to %s%s", self->priv->upload_id,
+      self->priv->endpoint, self->priv->path);
+
+  self->priv->n_workers = self->priv->max_uploads;
+  self->priv->workers = g_new0 (GThread *, self->priv->n_workers);
+
+  for (i = 0; i < self->priv->n_workers; i++) {
+    self->priv->workers[i] = g_thread_new (PLUGIN_NAME,
+        (GThreadFunc) kms_s3_sink_upload_parts, self);
+  }
+
+  return TRUE;
+}
+
+static gboolean
+kms_s3_sink_stop (GstBaseSink * sink)
+{
+  KmsS3Sink *self = KMS_S3_SINK (sink);
+  KmsS3Part *part;
+
+  kms_s3_sink_stop_workers (self);
+
+  /* The workers are gone, let the abort be retried like any request */
+  g_mutex_lock (&self->priv->mutex);
+  self->priv->stopping = FALSE;
+  g_mutex_unlock (&self->priv->mutex);
+
+  /* Still set if the upload was not completed by an EOS */
+  kms_s3_sink_abort_upload (self);
+
+  while ((part = g_queue_pop_head (&self->priv->parts)) != NULL) {
+    kms_s3_sink_part_destroy (part);
+  }
+
+  g_clear_pointer (&self->priv->etags, g_ptr_array_unref);
+  if (self->priv->part != NULL) {
+    g_byte_array_unref (self->priv->part);
+    self->priv->part = NULL;
+  }
+  g_clear_object (&self->priv->session);
+  kms_s3_sink_clear_location (self);
+
+  return TRUE;
+}
+
+static GstFlowReturn
+kms_s3_sink_queue_part (KmsS3Sink * self)
+{
+  KmsS3Part *part;
+  GstFlowReturn ret = GST_FLOW_OK;
+
+  g_mutex_lock (&self->priv->mutex);
+
+  /* Only blocks the pipeline if the storage falls far behind */
+  while (!self->priv->failed && !self->priv->flushing &&
+      g_queue_get_length (&self->priv->parts) >=
+      self->priv->max_pending_parts) {
+    g_cond_wait (&self->priv->cond, &self->priv->mutex);
+  }
+
+  if (self->priv->failed) {
+    ret = GST_FLOW_ERROR;
+    goto end;
+  } else if (self->priv->flushing) {
+    ret = GST_FLOW_FLUSHING;
+    goto end;
+  } else if (self->priv->queued_parts == MAX_PARTS) {
+    GST_ERROR_OBJECT (self, "Upload exceeds %d parts, increase part-size",
+        MAX_PARTS);
+    self->priv->failed = TRUE;
+    ret = GST_FLOW_ERROR;
+    goto end;
+  }
+
+  part = g_slice_new (KmsS3Part);
+  part->number = ++self->priv->queued_parts;
+  part->data = g_byte_array_free_to_bytes (self->priv->part);
+  self->priv->part = g_byte_array_sized_new (self->priv->upload_part_size);
+
+  g_ptr_array_set_size (self->priv->etags, part->number);
+  g_queue_push_tail (&self->priv->parts, part);
+  g_cond_broadcast (&self->priv->cond);
+
+end:
+  g_mutex_unlock (&self->priv->mutex);
+
+  return ret;
+}
+
+static GstFlowReturn
+kms_s3_sink_render (GstBaseSink * sink, GstBuffer * buffer)
+{
+  KmsS3Sink *self = KMS_S3_SINK (sink);
+  GstFlowReturn ret;
+  GstMapInfo info;
+
+  if (!gst_buffer_map (buffer, &info, GST_MAP_READ)) {
+    GST_ELEMENT_ERROR (self, RESOURCE, WRITE, ("Can not read buffer"), (NULL));
+    return GST_FLOW_ERROR;
+  }
+
+  g_byte_array_append (self->priv->part, info.data, info.size);
+  gst_buffer_unmap (buffer, &info);
+
+  if (self->priv->part->len < self->priv->upload_part_size) {
+    return GST_FLOW_OK;
+  }
+
+  ret = kms_s3_sink_queue_part (self);
+
+  if (ret == GST_FLOW_ERROR) {
+    GST_ELEMENT_ERROR (self, RESOURCE, WRITE,
+        ("Could not upload to %s", self->priv->location), (NULL));
+  }
+
+  return ret;
+}
+
+static gboolean
+kms_s3_sink_complete_upload (KmsS3Sink * self)
+{
+  SoupMessage *msg;
+  GString *xml;
+  GBytes *body;
+  gchar *query, *error;
+  gboolean failed;
+  guint i;
+
+  /* The last part may be shorter, or even empty for an empty recording */
+  if ((self->priv->part->len > 0 || self->priv->queued_parts == 0) &&
+      kms_s3_sink_queue_part (self) != GST_FLOW_OK) {
+    return FALSE;
+  }
+
+  g_mutex_lock (&self->priv->mutex);
+  while (!self->priv->failed && (!g_queue_is_empty (&self->priv->parts) ||
+          self->priv->in_flight > 0)) {
+    g_cond_wait (&self->priv->cond, &self->priv->mutex);
+  }
+  failed = self->priv->failed;
+  g_mutex_unlock (&self->priv->mutex);
+
+  if (failed) {
+    return FALSE;
+  }
+
+  xml = g_string_new ("<CompleteMultipartUpload>");
+  for (i = 0; i < self->priv->etags->len; i++) {
+    gchar *etag = g_markup_escape_text (g_ptr_array_index (self->priv->etags,
+            i), -1);
+
+    g_string_append_printf (xml, "<Part><PartNumber>%u</PartNumber>"
+        "<ETag>%s</ETag></Part>", i + 1, etag);
+    g_free (etag);
+  }
+  g_string_append (xml, "</CompleteMultipartUpload>");
+  body = g_string_free_to_bytes (xml);
+
+  query = kms_s3_sink_upload_query (self, 0);
+  msg = kms_s3_sink_request (self, self->priv->session, SOUP_METHOD_POST,
+      query, body);
+  g_free (query);
+  g_bytes_unref (body);
+
+  if (msg == NULL) {
+    return FALSE;
+  }
+
+  /* Errors can also come with a 200 status once the response has started */
+  error = kms_s3_sink_get_xml_value (msg, "Code");
+  g_object_unref (msg);
+
+  if (error != NULL) {
+    GST_ERROR_OBJECT (self, "Could not complete upload: %s", error);
+    g_free (error);
+    return FALSE;
+  }
+
+  GST_DEBUG_OBJECT (self, "Completed upload of %u parts to %s%s",
+      self->priv->etags->len, self->priv->endpoint, self->priv->path);
+  g_clear_pointer (&self->priv->upload_id, g_free);
+
+  return TRUE;
+}
+
+static gboolean
+kms_s3_sink_event (GstBaseSink * sink, GstEvent * event)
+{
+  KmsS3Sink *self = KMS_S3_SINK (sink);
+
+  if (GST_EVENT_TYPE (event) == GST_EVENT_EOS &&
+      self->priv->upload_id != NULL && !kms_s3_sink_complete_upload (self)) {
+    GST_ELEMENT_ERROR (self, RESOURCE, WRITE,
+        ("Could not complete the upload to %s", self->priv->location),
+        (NULL));
+  }
+
+  return GST_BASE_SINK_CLASS (kms_s3_sink_parent_class)->event (sink, event);
+}
+
+static gboolean
+kms_s3_sink_unlock (GstBaseSink * sink)
+{
+  KmsS3Sink *self = KMS_S3_SINK (sink);
+
+  g_mutex_lock (&self->priv->mutex);
+  self->priv->flushing = TRUE;
+  g_cond_broadcast (&self->priv->cond);
+  g_mutex_unlock (&self->priv->mutex);
+
+  return TRUE;
+}
+
+static gboolean
+kms_s3_sink_unlock_stop (GstBaseSink * sink)
+{
+  KmsS3Sink *self = KMS_S3_SINK (sink);
+
+  g_mutex_lock (&self->priv->mutex);
+  self->priv->flushing = FALSE;
+  g_mutex_unlock (&self->priv->mutex);
+
+  return TRUE;
+}
+
+static void
+kms_s3_sink_set_property (GObject * object, guint property_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  KmsS3Sink *self = KMS_S3_SINK (object);
+
+  GST_OBJECT_LOCK (self);
+
+  switch (property_id) {
+    case PROP_LOCATION:
+      g_free (self->priv->location);
+      self->priv->location = g_value_dup_string (value);
+      break;
+    case PROP_ACCESS_KEY:
+      g_free (self->priv->access_key);
+      self->priv->access_key = g_value_dup_string (value);
+      break;
+    case PROP_SECRET_KEY:
+      g_free (self->priv->secret_key);
+      self->priv->secret_key = g_value_dup_string (value);
+      break;
+    case PROP_REGION:
+      g_free (self->priv->region);
+      self->priv->region = g_value_dup_string (value);
+      break;
+    case PROP_PART_SIZE:
+      self->priv->part_size = g_value_get_uint (value);
+      break;
+    case PROP_MAX_UPLOADS:
+      self->priv->max_uploads = g_value_get_uint (value);
+      break;
+    case PROP_MAX_PENDING_PARTS:
+      self->priv->max_pending_parts = g_value_get_uint (value);
+      break;
+    case PROP_MAX_RETRIES:
+      self->priv->max_retries = g_value_get_uint (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+
+  GST_OBJECT_UNLOCK (self);
+}
+
+static void
+kms_s3_sink_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  KmsS3Sink *self = KMS_S3_SINK (object);
+
+  GST_OBJECT_LOCK (self);
+
+  switch (property_id) {
+    case PROP_LOCATION:
+      g_value_set_string (value, self->priv->location);
+      break;
+    case PROP_ACCESS_KEY:
+      g_value_set_string (value, self->priv->access_key);
+      break;
+    case PROP_SECRET_KEY:
+      g_value_set_string (value, self->priv->secret_key);
+      break;
+    case PROP_REGION:
+      g_value_set_string (value, self->priv->region);
+      break;
+    case PROP_PART_SIZE:
+      g_value_set_uint (value, self->priv->part_size);
+      break;
+    case PROP_MAX_UPLOADS:
+      g_value_set_uint (value, self->priv->max_uploads);
+      break;
+    case PROP_MAX_PENDING_PARTS:
+      g_value_set_uint (value, self->priv->max_pending_parts);
+      break;
+    case PROP_MAX_RETRIES:
+      g_value_set_uint (value, self->priv->max_retries);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+
+  GST_OBJECT_UNLOCK (self);
+}
+
+static void
+kms_s3_sink_finalize (GObject * object)
+{
+  KmsS3Sink *self = KMS_S3_SINK (object);
+
+  g_free (self->priv->location);
+  g_free (self->priv->access_key);
+  g_free (self->priv->secret_key);
+  g_free (self->priv->region);
+
+  g_mutex_clear (&self->priv->mutex);
+  g_cond_clear (&self->priv->cond);
+
+  G_OBJECT_CLASS (kms_s3_sink_parent_class)->finalize (object);
+}
+
+static void
+kms_s3_sink_class_init (KmsS3SinkClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+  GstBaseSinkClass *basesink_class = GST_BASE_SINK_CLASS (klass);
+
+  gst_element_class_set_static_metadata (element_class,
+      "S3 multipart upload sink", "Sink/Network",
+      "Uploads the stream to S3 compatible storage, several parts at a time",
+      "Kurento <kurento@googlegroups.com>");
+
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&sink_template));
+
+  gobject_class->set_property = kms_s3_sink_set_property;
+  gobject_class->get_property = kms_s3_sink_get_property;
+  gobject_class->finalize = kms_s3_sink_finalize;
+
+  basesink_class->start = GST_DEBUG_FUNCPTR (kms_s3_sink_start);
+  basesink_class->stop = GST_DEBUG_FUNCPTR (kms_s3_sink_stop);
+  basesink_class->render = GST_DEBUG_FUNCPTR (kms_s3_sink_render);
+  basesink_class->event = GST_DEBUG_FUNCPTR (kms_s3_sink_event);
+  basesink_class->unlock = GST_DEBUG_FUNCPTR (kms_s3_sink_unlock);
+  basesink_class->unlock_stop = GST_DEBUG_FUNCPTR (kms_s3_sink_unlock_stop);
+
+  obj_properties[PROP_LOCATION] = g_param_spec_string ("location",
+      "Location",
+      "Object to upload, as " KMS_S3_SINK_PROTOCOL
+      "://[access-key:secret-key@]host[:port]/bucket/key, or "
+      KMS_S3_SINK_PROTOCOL_HTTP "://... for plain HTTP", NULL,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
+  obj_properties[PROP_ACCESS_KEY] = g_param_spec_string ("access-key",
+      "Access key", "Used when the location has no credentials "
+      "(default: $AWS_ACCESS_KEY_ID)", NULL,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
+  obj_properties[PROP_SECRET_KEY] = g_param_spec_string ("secret-key",
+      "Secret key", "Used when the location has no credentials "
+      "(default: $AWS_SECRET_ACCESS_KEY)", NULL,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
+  obj_properties[PROP_REGION] = g_param_spec_string ("region",
+      "Region", "Region the requests are signed for "
+      "(default: $AWS_REGION, or " DEFAULT_REGION ")", NULL,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
+  obj_properties[PROP_PART_SIZE] = g_param_spec_uint ("part-size",
+      "Part size", "Bytes uploaded in each part. Up to max-uploads + "
+      "max-pending-parts + 1 parts are kept in memory. Raised to 5 MiB, the "
+      "minimum of S3 for all parts but the last, on amazonaws.com hosts; "
+      "smaller parts are only used with other endpoints",
+      MIN_PART_SIZE, G_MAXUINT,
+      DEFAULT_PART_SIZE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
+  obj_properties[PROP_MAX_UPLOADS] = g_param_spec_uint ("max-uploads",
+      "Max uploads", "Parts uploaded at the same time", 1, 64,
+      DEFAULT_MAX_UPLOADS, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
+  obj_properties[PROP_MAX_PENDING_PARTS] =
+      g_param_spec_uint ("max-pending-parts", "Max pending parts",
+      "Parts kept in memory waiting for an upload before the pipeline is "
+      "blocked", 1, G_MAXUINT, DEFAULT_MAX_PENDING_PARTS,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
+  obj_properties[PROP_MAX_RETRIES] = g_param_spec_uint ("max-retries",
+      "Max retries", "Times a failed request is retried, waiting longer "
+      "each time", 0, 16, DEFAULT_MAX_RETRIES,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
+  g_object_class_install_properties (gobject_class, N_PROPERTIES,
+      obj_properties);
+
+  g_type_class_add_private (klass, sizeof (KmsS3SinkPrivate));
+}
+
+static void
+kms_s3_sink_init (KmsS3Sink * self)
+{
+  const gchar *region;
+
+  self->priv = KMS_S3_SINK_GET_PRIVATE (self);
+
+  self->priv->access_key = g_strdup (g_getenv ("AWS_ACCESS_KEY_ID"));
+  self->priv->secret_key = g_strdup (g_getenv ("AWS_SECRET_ACCESS_KEY"));
+
+  region = g_getenv ("AWS_REGION");
+  self->priv->region = g_strdup (region != NULL ? region : DEFAULT_REGION);
+
+  self->priv->part_size = DEFAULT_PART_SIZE;
+  self->priv->max_uploads = DEFAULT_MAX_UPLOADS;
+  self->priv->max_pending_parts = DEFAULT_MAX_PENDING_PARTS;
+  self->priv->max_retries = DEFAULT_MAX_RETRIES;
+
+  g_mutex_init (&self->priv->mutex);
+  g_cond_init (&self->priv->cond);
+  g_queue_init (&self->priv->parts);
+
+  gst_base_sink_set_sync (GST_BASE_SINK (self), FALSE);
+}
+
+gboolean
+kms_s3_sink_plugin_init (GstPlugin * plugin)
+{
+  return gst_element_register (plugin, PLUGIN_NAME, GST_RANK_NONE,
+      KMS_TYPE_S3_SINK);
+}
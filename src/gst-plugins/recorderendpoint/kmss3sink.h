@@ -0,0 +1,76 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef _KMS_S3_SINK_H_
+#define _KMS_S3_SINK_H_
+
+#include <gst/gst.h>
+#include <gst/base/gstbasesink.h>
+
+G_BEGIN_DECLS
+#define KMS_TYPE_S3_SINK \
+  (kms_s3_sink_get_type())
+#define KMS_S3_SINK(obj) (                     \
+  G_TYPE_CHECK_INSTANCE_CAST(                  \
+    (obj),                                     \
+    KMS_TYPE_S3_SINK,                          \
+    KmsS3Sink                                  \
+  )                                            \
+)
+#define KMS_S3_SINK_CLASS(klass) (             \
+  G_TYPE_CHECK_CLASS_CAST (                    \
+    (klass),                                   \
+    KMS_TYPE_S3_SINK,                          \
+    KmsS3SinkClass                             \
+  )                                            \
+)
+#define KMS_IS_S3_SINK(obj) (                  \
+  G_TYPE_CHECK_INSTANCE_TYPE (                 \
+    (obj),                                     \
+    KMS_TYPE_S3_SINK                           \
+  )                                            \
+)
+#define KMS_IS_S3_SINK_CLASS(klass) (                   \
+  G_TYPE_CHECK_CLASS_TYPE((klass),                      \
+  KMS_TYPE_S3_SINK)                                     \
+)
+typedef struct _KmsS3Sink KmsS3Sink;
+typedef struct _KmsS3SinkClass KmsS3SinkClass;
+typedef struct _KmsS3SinkPrivate KmsS3SinkPrivate;
+
+/* URI schemes uploaded with S3 multipart uploads, over HTTPS and HTTP */
+#define KMS_S3_SINK_PROTOCOL "s3"
+#define KMS_S3_SINK_PROTOCOL_HTTP "s3+http"
+
+struct _KmsS3Sink
+{
+  GstBaseSink parent;
+
+  /*< private > */
+  KmsS3SinkPrivate *priv;
+};
+
+struct _KmsS3SinkClass
+{
+  GstBaseSinkClass parent_class;
+};
+
+GType kms_s3_sink_get_type (void);
+
+gboolean kms_s3_sink_plugin_init (GstPlugin * plugin);
+
+G_END_DECLS
+#endif
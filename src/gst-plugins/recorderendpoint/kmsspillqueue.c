@@ -0,0 +1,681 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+
+#include "kmsspillqueue.h"
+
+#define OBJECT_NAME "spillqueue"
+
+GST_DEBUG_CATEGORY_STATIC (kms_spill_queue_debug_category);
+#define GST_CAT_DEFAULT kms_spill_queue_debug_category
+
+#define KMS_SPILL_QUEUE_KEY "kms-spill-queue-key"
+G_DEFINE_QUARK (KMS_SPILL_QUEUE_KEY, kms_spill_queue_key);
+
+#define SPILL_FILE_TEMPLATE "kms-recorder-XXXXXX"
+#define REFILL_PERCENT 50
+#define NO_WRAP G_MAXUINT64
+
+typedef enum
+{
+  KMS_SPILL_RECORD_BUFFER,
+  KMS_SPILL_RECORD_CAPS
+} KmsSpillRecordType;
+
+/* Header written in front of every record of the spill file */
+typedef struct _KmsSpillRecord
+{
+  guint32 type;
+  guint32 size;
+  guint32 flags;
+  guint32 reserved;
+  guint64 pts;
+  guint64 dts;
+  guint64 duration;
+  guint64 offset;
+  guint64 offset_end;
+} KmsSpillRecord;
+
+typedef struct _KmsSpillQueue
+{
+  GMutex mutex;
+  GstAppSrc *appsrc;            /* Not owned, the queue lives in its qdata */
+  guint64 max_bytes;
+  guint64 max_spill_bytes;
+  gchar *spill_dir;
+
+  /* Ring file. Valid data is [read_off, write_off), or */
+  /* [read_off, wrap_off) + [0, write_off) once the writer has wrapped */
+  gint fd;
+  guint64 read_off;
+  guint64 write_off;
+  guint64 wrap_off;
+  guint64 spilled_bytes;
+  guint spilled_records;
+
+  gboolean eos_pending;
+  gboolean wait_keyframe;
+  gboolean discont;
+
+  GstClockTime in_ts;
+  GstClockTime out_ts;
+
+  guint64 total_spilled_bytes;
+  guint64 dropped_bytes;
+  guint dropped_buffers;
+} KmsSpillQueue;
+
+static KmsSpillQueue *
+kms_spill_queue_get (GstAppSrc * appsrc)
+{
+  return g_object_get_qdata (G_OBJECT (appsrc), kms_spill_queue_key_quark ());
+}
+
+static void
+kms_spill_queue_reset_file (KmsSpillQueue * queue)
+{
+  queue->read_off = queue->write_off = 0;
+  queue->wrap_off = NO_WRAP;
+  queue->spilled_bytes = 0;
+  queue->spilled_records = 0;
+}
+
+static gboolean
+kms_spill_queue_open_file (KmsSpillQueue * queue)
+{
+  gchar *path;
+
+  if (queue->fd >= 0) {
+    return TRUE;
+  }
+
+  path = g_build_filename (queue->spill_dir != NULL ? queue->spill_dir :
+      g_get_tmp_dir (), SPILL_FILE_TEMPLATE, NULL);
+  queue->fd = g_mkstemp (path);
+
+  if (queue->fd < 0) {
+    GST_WARNING_OBJECT (queue->appsrc, "Can not create spill file %s", path);
+  } else {
+    /* The file is only reachable through its descriptor from now on */
+    GST_INFO_OBJECT (queue->appsrc, "Spilling to %s", path);
+    g_unlink (path);
+  }
+
+  g_free (path);
+
+  return queue->fd >= 0;
+}
+
+/* Finds room for a record of size bytes without modifying the ring */
+static gboolean
+kms_spill_queue_reserve (KmsSpillQueue * queue, guint64 size, guint64 * offset,
+    gboolean * wrap)
+{
+  *wrap = FALSE;
+
+  if (queue->wrap_off != NO_WRAP) {
+    *offset = queue->write_off;
+    return queue->write_off + size < queue->read_off;
+  }
+
+  if (queue->write_off + size <= queue->max_spill_bytes) {
+    *offset = queue->write_off;
+    return TRUE;
+  }
+
+  if (size < queue->read_off) {
+    *offset = 0;
+    *wrap = TRUE;
+    return TRUE;
+  }
+
+  return FALSE;
+}
+
+static gboolean
+kms_spill_queue_write_record (KmsSpillQueue * queue, KmsSpillRecord * record,
+    gconstpointer data)
+{
+  struct iovec iov[2];
+  guint64 size, offset;
+  gboolean wrap;
+
+  size = sizeof (KmsSpillRecord) + record->size;
+
+  if (!kms_spill_queue_reserve (queue, size, &offset, &wrap)) {
+    return FALSE;
+  }
+
+  if (!kms_spill_queue_open_file (queue)) {
+    return FALSE;
+  }
+
+  iov[0].iov_base = record;
+  iov[0].iov_len = sizeof (KmsSpillRecord);
+  iov[1].iov_base = (gpointer) data;
+  iov[1].iov_len = record->size;
+
+  if (pwritev (queue->fd, iov, 2, offset) != (gssize) size) {
+    GST_WARNING_OBJECT (queue->appsrc, "Can not write to spill file");
+    return FALSE;
+  }
+
+  if (wrap) {
+    queue->wrap_off = queue->write_off;
+  }
+
+  queue->write_off = offset + size;
+  queue->spilled_bytes += size;
+  queue->spilled_records++;
+  queue->total_spilled_bytes += size;
+
+  return TRUE;
+}
+
+static gboolean
+kms_spill_queue_spill_buffer (KmsSpillQueue * queue, GstBuffer * buffer)
+{
+  KmsSpillRecord record = { 0, };
+  GstMapInfo info;
+  gboolean ret;
+
+  if (queue->max_spill_bytes == 0) {
+    return FALSE;
+  }
+
+  if (!gst_buffer_map (buffer, &info, GST_MAP_READ)) {
+    return FALSE;
+  }
+
+  record.type = KMS_SPILL_RECORD_BUFFER;
+  record.size = info.size;
+  record.flags = GST_BUFFER_FLAGS (buffer);
+  record.pts = GST_BUFFER_PTS (buffer);
+  record.dts = GST_BUFFER_DTS (buffer);
+  record.duration = GST_BUFFER_DURATION (buffer);
+  record.offset = GST_BUFFER_OFFSET (buffer);
+  record.offset_end = GST_BUFFER_OFFSET_END (buffer);
+
+  ret = kms_spill_queue_write_record (queue, &record, info.data);
+
+  gst_buffer_unmap (buffer, &info);
+
+  return ret;
+}
+
+static gboolean
+kms_spill_queue_spill_caps (KmsSpillQueue * queue, GstCaps * caps)
+{
+  KmsSpillRecord record = { 0, };
+  gchar *str;
+  gboolean ret;
+
+  str = gst_caps_to_string (caps);
+
+  record.type = KMS_SPILL_RECORD_CAPS;
+  record.size = strlen (str) + 1;
+
+  ret = kms_spill_queue_write_record (queue, &record, str);
+
+  g_free (str);
+
+  return ret;
+}
+
+/* Reads the oldest record back. Returns either a buffer or caps */
+static gboolean
+kms_spill_queue_read_record (KmsSpillQueue * queue, GstBuffer ** buffer,
+    GstCaps ** caps)
+{
+  KmsSpillRecord record;
+  GstMapInfo info;
+  GstBuffer *data;
+
+  if (queue->wrap_off != NO_WRAP && queue->read_off == queue->wrap_off) {
+    queue->read_off = 0;
+    queue->wrap_off = NO_WRAP;
+  }
+
+  if (pread (queue->fd, &record, sizeof (record),
+          queue->read_off) != (gssize) sizeof (record)) {
+    goto error;
+  }
+
+  data = gst_buffer_new_allocate (NULL, record.size, NULL);
+  gst_buffer_map (data, &info, GST_MAP_WRITE);
+
+  if (pread (queue->fd, info.data, record.size,
+          queue->read_off + sizeof (record)) != (gssize) record.size) {
+    gst_buffer_unmap (data, &info);
+    gst_buffer_unref (data);
+    goto error;
+  }
+
+  if (record.type == KMS_SPILL_RECORD_CAPS) {
+    *caps = gst_caps_from_string ((const gchar *) info.data);
+    gst_buffer_unmap (data, &info);
+    gst_buffer_unref (data);
+  } else {
+    gst_buffer_unmap (data, &info);
+    GST_BUFFER_FLAGS (data) = record.flags;
+    GST_BUFFER_PTS (data) = record.pts;
+    GST_BUFFER_DTS (data) = record.dts;
+    GST_BUFFER_DURATION (data) = record.duration;
+    GST_BUFFER_OFFSET (data) = record.offset;
+    GST_BUFFER_OFFSET_END (data) = record.offset_end;
+    *buffer = data;
+  }
+
+  queue->read_off += sizeof (record) + record.size;
+  queue->spilled_bytes -= sizeof (record) + record.size;
+  queue->spilled_records--;
+
+  if (queue->spilled_records == 0) {
+    kms_spill_queue_reset_file (queue);
+  }
+
+  return TRUE;
+
+error:
+  GST_ELEMENT_WARNING (queue->appsrc, RESOURCE, READ,
+      ("Can not read the recording spill file, dropping its media"),
+      ("%" G_GUINT64_FORMAT " bytes in %u buffers", queue->spilled_bytes,
+          queue->spilled_records));
+
+  queue->dropped_bytes += queue->spilled_bytes;
+  queue->dropped_buffers += queue->spilled_records;
+  queue->wait_keyframe = TRUE;
+  kms_spill_queue_reset_file (queue);
+
+  return FALSE;
+}
+
+static gboolean
+kms_spill_queue_has_room (KmsSpillQueue * queue)
+{
+  return queue->max_bytes == 0 ||
+      gst_app_src_get_current_level_bytes (queue->appsrc) < queue->max_bytes;
+}
+
+static GstFlowReturn
+kms_spill_queue_push_to_appsrc (KmsSpillQueue * queue, GstBuffer * buffer)
+{
+  if (queue->discont) {
+    buffer = gst_buffer_make_writable (buffer);
+    GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_DISCONT);
+    queue->discont = FALSE;
+  }
+
+  return gst_app_src_push_buffer (queue->appsrc, buffer);
+}
+
+/* Replays spilled records while the appsrc has room. Lock must be held */
+static void
+kms_spill_queue_drain (KmsSpillQueue * queue)
+{
+  while (queue->spilled_records > 0 && kms_spill_queue_has_room (queue)) {
+    GstBuffer *buffer = NULL;
+    GstCaps *caps = NULL;
+
+    if (!kms_spill_queue_read_record (queue, &buffer, &caps)) {
+      break;
+    }
+
+    if (caps != NULL) {
+      g_object_set (queue->appsrc, "caps", caps, NULL);
+      gst_caps_unref (caps);
+    } else if (buffer != NULL) {
+      kms_spill_queue_push_to_appsrc (queue, buffer);
+    }
+  }
+
+  if (queue->spilled_records == 0 && queue->eos_pending) {
+    GST_DEBUG_OBJECT (queue->appsrc, "Spill file drained, sending EOS");
+    queue->eos_pending = FALSE;
+    gst_app_src_end_of_stream (queue->appsrc);
+  }
+}
+
+static void
+kms_spill_queue_need_data (GstAppSrc * appsrc, guint length, gpointer data)
+{
+  KmsSpillQueue *queue = data;
+
+  g_mutex_lock (&queue->mutex);
+  kms_spill_queue_drain (queue);
+  g_mutex_unlock (&queue->mutex);
+}
+
+static GstPadProbeReturn
+kms_spill_queue_output_probe (GstPad * pad, GstPadProbeInfo * info,
+    gpointer data)
+{
+  KmsSpillQueue *queue = data;
+  GstBuffer *buffer;
+  GstClockTime ts;
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+    GstBufferList *list = GST_PAD_PROBE_INFO_BUFFER_LIST (info);
+    guint len = gst_buffer_list_length (list);
+
+    if (len == 0) {
+      return GST_PAD_PROBE_OK;
+    }
+
+    buffer = gst_buffer_list_get (list, len - 1);
+  } else {
+    buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+  }
+
+  ts = GST_BUFFER_DTS_OR_PTS (buffer);
+
+  if (GST_CLOCK_TIME_IS_VALID (ts)) {
+    g_mutex_lock (&queue->mutex);
+    queue->out_ts = ts;
+    g_mutex_unlock (&queue->mutex);
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+kms_spill_queue_destroy (KmsSpillQueue * queue)
+{
+  if (queue->fd >= 0) {
+    close (queue->fd);
+  }
+
+  g_free (queue->spill_dir);
+  g_mutex_clear (&queue->mutex);
+
+  g_slice_free (KmsSpillQueue, queue);
+}
+
+static GstAppSrcCallbacks spill_queue_callbacks = {
+  kms_spill_queue_need_data,
+  NULL,
+  NULL
+};
+
+void
+kms_spill_queue_attach (GstElement * appsrc, guint64 max_bytes,
+    guint64 max_spill_bytes, const gchar * spill_dir)
+{
+  static gsize debug_init = 0;
+  KmsSpillQueue *queue;
+  GstPad *srcpad;
+
+  if (g_once_init_enter (&debug_init)) {
+    GST_DEBUG_CATEGORY_INIT (kms_spill_queue_debug_category, OBJECT_NAME,
+        0, "debug category for recorder spill queues");
+    g_once_init_leave (&debug_init, 1);
+  }
+
+  queue = g_slice_new0 (KmsSpillQueue);
+  g_mutex_init (&queue->mutex);
+  queue->appsrc = GST_APP_SRC (appsrc);
+  queue->max_bytes = max_bytes;
+  queue->max_spill_bytes = max_spill_bytes;
+  queue->spill_dir = g_strdup (spill_dir);
+  queue->fd = -1;
+  queue->in_ts = GST_CLOCK_TIME_NONE;
+  queue->out_ts = GST_CLOCK_TIME_NONE;
+  kms_spill_queue_reset_file (queue);
+
+  /* The queue enforces the limit itself, pushing must never block */
+  g_object_set (appsrc, "block", FALSE, "max-bytes", max_bytes,
+      "min-percent", REFILL_PERCENT, NULL);
+  gst_app_src_set_callbacks (GST_APP_SRC (appsrc), &spill_queue_callbacks,
+      queue, NULL);
+
+  srcpad = gst_element_get_static_pad (appsrc, "src");
+  gst_pad_add_probe (srcpad,
+      GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+      kms_spill_queue_output_probe, queue, NULL);
+  g_object_unref (srcpad);
+
+  g_object_set_qdata_full (G_OBJECT (appsrc), kms_spill_queue_key_quark (),
+      queue, (GDestroyNotify) kms_spill_queue_destroy);
+
+  GST_DEBUG_OBJECT (appsrc, "Queue limits: %" G_GUINT64_FORMAT " bytes in "
+      "memory, %" G_GUINT64_FORMAT " bytes on disk", max_bytes,
+      max_spill_bytes);
+}
+
+GstFlowReturn
+kms_spill_queue_push_buffer (GstAppSrc * appsrc, GstBuffer * buffer)
+{
+  KmsSpillQueue *queue = kms_spill_queue_get (appsrc);
+  GstFlowReturn ret = GST_FLOW_OK;
+  GstClockTime ts;
+
+  if (queue == NULL) {
+    return gst_app_src_push_buffer (appsrc, buffer);
+  }
+
+  g_mutex_lock (&queue->mutex);
+
+  if (queue->eos_pending) {
+    gst_buffer_unref (buffer);
+    ret = GST_FLOW_EOS;
+    goto end;
+  }
+
+  ts = GST_BUFFER_DTS_OR_PTS (buffer);
+  if (GST_CLOCK_TIME_IS_VALID (ts)) {
+    queue->in_ts = ts;
+  }
+
+  if (queue->wait_keyframe) {
+    if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT)) {
+      goto drop;
+    }
+
+    GST_INFO_OBJECT (appsrc, "Resuming after dropping %u buffers",
+        queue->dropped_buffers);
+    queue->wait_keyframe = FALSE;
+    queue->discont = TRUE;
+  }
+
+  kms_spill_queue_drain (queue);
+
+  if (queue->spilled_records == 0 && kms_spill_queue_has_room (queue)) {
+    ret = kms_spill_queue_push_to_appsrc (queue, buffer);
+    goto end;
+  }
+
+  if (kms_spill_queue_spill_buffer (queue, buffer)) {
+    gst_buffer_unref (buffer);
+    goto end;
+  }
+
+  /* Reaches the application as a warning of the recorder, once for each
+   * gap. The total is kept in the stats */
+  GST_ELEMENT_WARNING (appsrc, RESOURCE, NO_SPACE_LEFT,
+      ("Recording queue full, dropping media until the next key frame"),
+      ("%" G_GUINT64_FORMAT " bytes in memory, %" G_GUINT64_FORMAT
+          " spilled, %u buffers dropped so far",
+          gst_app_src_get_current_level_bytes (appsrc), queue->spilled_bytes,
+          queue->dropped_buffers + 1));
+  queue->wait_keyframe = TRUE;
+
+drop:
+  queue->dropped_bytes += gst_buffer_get_size (buffer);
+  queue->dropped_buffers++;
+  gst_buffer_unref (buffer);
+
+end:
+  g_mutex_unlock (&queue->mutex);
+
+  return ret;
+}
+
+GstFlowReturn
+kms_spill_queue_push_buffer_list (GstAppSrc * appsrc, GstBufferList * list)
+{
+  KmsSpillQueue *queue = kms_spill_queue_get (appsrc);
+  GstFlowReturn ret = GST_FLOW_OK;
+  guint i, len;
+
+  len = gst_buffer_list_length (list);
+
+  if (queue == NULL) {
+#if GST_CHECK_VERSION (1, 14, 0)
+    return gst_app_src_push_buffer_list (appsrc, list);
+#else
+    for (i = 0; i < len && ret == GST_FLOW_OK; i++) {
+      ret = gst_app_src_push_buffer (appsrc,
+          gst_buffer_ref (gst_buffer_list_get (list, i)));
+    }
+
+    gst_buffer_list_unref (list);
+
+    return ret;
+#endif
+  }
+
+  if (len == 0) {
+    gst_buffer_list_unref (list);
+    return GST_FLOW_OK;
+  }
+
+#if GST_CHECK_VERSION (1, 14, 0)
+  g_mutex_lock (&queue->mutex);
+
+  kms_spill_queue_drain (queue);
+
+  /* Whole list goes to the appsrc while nothing is waiting on disk */
+  if (!queue->eos_pending && !queue->wait_keyframe && !queue->discont &&
+      queue->spilled_records == 0 && kms_spill_queue_has_room (queue)) {
+    GstClockTime ts;
+
+    ts = GST_BUFFER_DTS_OR_PTS (gst_buffer_list_get (list, len - 1));
+    if (GST_CLOCK_TIME_IS_VALID (ts)) {
+      queue->in_ts = ts;
+    }
+
+    ret = gst_app_src_push_buffer_list (appsrc, list);
+    g_mutex_unlock (&queue->mutex);
+
+    return ret;
+  }
+
+  g_mutex_unlock (&queue->mutex);
+#endif
+
+  /* Otherwise each buffer may be spilled or dropped on its own */
+  for (i = 0; i < len && ret == GST_FLOW_OK; i++) {
+    ret = kms_spill_queue_push_buffer (appsrc,
+        gst_buffer_ref (gst_buffer_list_get (list, i)));
+  }
+
+  gst_buffer_list_unref (list);
+
+  return ret;
+}
+
+void
+kms_spill_queue_set_caps (GstAppSrc * appsrc, GstCaps * caps)
+{
+  KmsSpillQueue *queue = kms_spill_queue_get (appsrc);
+
+  if (queue == NULL) {
+    g_object_set (appsrc, "caps", caps, NULL);
+    return;
+  }
+
+  g_mutex_lock (&queue->mutex);
+
+  kms_spill_queue_drain (queue);
+
+  /* Caps must not overtake the buffers still waiting on disk */
+  if (queue->spilled_records == 0 || !kms_spill_queue_spill_caps (queue, caps)) {
+    g_object_set (appsrc, "caps", caps, NULL);
+  }
+
+  g_mutex_unlock (&queue->mutex);
+}
+
+GstFlowReturn
+kms_spill_queue_end_of_stream (GstAppSrc * appsrc)
+{
+  KmsSpillQueue *queue = kms_spill_queue_get (appsrc);
+  GstFlowReturn ret = GST_FLOW_OK;
+
+  if (queue == NULL) {
+    return gst_app_src_end_of_stream (appsrc);
+  }
+
+  g_mutex_lock (&queue->mutex);
+
+  kms_spill_queue_drain (queue);
+
+  if (queue->spilled_records == 0) {
+    ret = gst_app_src_end_of_stream (appsrc);
+  } else {
+    GST_DEBUG_OBJECT (appsrc, "Delaying EOS until %" G_GUINT64_FORMAT
+        " spilled bytes are replayed", queue->spilled_bytes);
+    queue->eos_pending = TRUE;
+  }
+
+  g_mutex_unlock (&queue->mutex);
+
+  return ret;
+}
+
+GstStructure *
+kms_spill_queue_get_stats (GstAppSrc * appsrc)
+{
+  KmsSpillQueue *queue = kms_spill_queue_get (appsrc);
+  GstClockTime queued_time = 0;
+  GstStructure *stats;
+  guint64 level;
+
+  if (queue == NULL) {
+    return NULL;
+  }
+
+  level = gst_app_src_get_current_level_bytes (appsrc);
+
+  g_mutex_lock (&queue->mutex);
+
+  if (GST_CLOCK_TIME_IS_VALID (queue->in_ts) &&
+      GST_CLOCK_TIME_IS_VALID (queue->out_ts) &&
+      queue->in_ts > queue->out_ts) {
+    queued_time = queue->in_ts - queue->out_ts;
+  }
+
+  stats = gst_structure_new (GST_OBJECT_NAME (appsrc),
+      "queued-bytes", G_TYPE_UINT64, level + queue->spilled_bytes,
+      "queued-time", G_TYPE_UINT64, queued_time,
+      "memory-bytes", G_TYPE_UINT64, level,
+      "spilled-bytes", G_TYPE_UINT64, queue->spilled_bytes,
+      "total-spilled-bytes", G_TYPE_UINT64, queue->total_spilled_bytes,
+      "dropped-bytes", G_TYPE_UINT64, queue->dropped_bytes,
+      "dropped-buffers", G_TYPE_UINT, queue->dropped_buffers, NULL);
+
+  g_mutex_unlock (&queue->mutex);
+
+  return stats;
+}
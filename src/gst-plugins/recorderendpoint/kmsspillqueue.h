@@ -0,0 +1,50 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef _KMS_SPILL_QUEUE_H_
+#define _KMS_SPILL_QUEUE_H_
+
+#include <gst/gst.h>
+#include <gst/app/gstappsrc.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Bounded queue in front of a muxing appsrc. Up to max_bytes are kept in
+ * memory by the appsrc itself; when the muxer or its sink can not keep up,
+ * the overflow is written to a temporary ring file of at most
+ * max_spill_bytes and replayed in order as soon as the appsrc drains.
+ * When that is full too, buffers are dropped until the next key frame;
+ * the appsrc posts a warning for each such gap, and the drops are counted
+ * in the stats. A max_bytes of 0 leaves the appsrc unbounded.
+ *
+ * Appsrcs without a queue attached are handled directly, so the push,
+ * caps and EOS helpers can be used on any appsrc.
+ */
+void kms_spill_queue_attach (GstElement * appsrc, guint64 max_bytes,
+    guint64 max_spill_bytes, const gchar * spill_dir);
+
+GstFlowReturn kms_spill_queue_push_buffer (GstAppSrc * appsrc,
+    GstBuffer * buffer);
+GstFlowReturn kms_spill_queue_push_buffer_list (GstAppSrc * appsrc,
+    GstBufferList * list);
+void kms_spill_queue_set_caps (GstAppSrc * appsrc, GstCaps * caps);
+GstFlowReturn kms_spill_queue_end_of_stream (GstAppSrc * appsrc);
+
+GstStructure * kms_spill_queue_get_stats (GstAppSrc * appsrc);
+
+G_END_DECLS
+#endif /* _KMS_SPILL_QUEUE_H_ */
@@ -313,11 +313,12 @@ kms_rtp_connection_finalize (GObject * object)
 
   g_clear_object (&self->rtp_udpsink);
   g_clear_object (&self->rtp_udpsrc);
-  kms_socket_finalize (&self->rtp_socket);
 
   g_clear_object (&self->rtcp_udpsink);
   g_clear_object (&self->rtcp_udpsrc);
-  kms_socket_finalize (&self->rtcp_socket);
+
+  kms_rtp_connection_release_rtp_rtcp_sockets (&self->rtp_socket,
+      &self->rtcp_socket);
 
   /* chain up */
   G_OBJECT_CLASS (kms_rtp_connection_parent_class)->finalize (object);
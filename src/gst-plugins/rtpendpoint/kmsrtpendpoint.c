@@ -34,6 +34,7 @@
 #include "kms-rtp-enumtypes.h"
 #include "kmsrtpsdescryptosuite.h"
 #include "kmsrandom.h"
+#include "kmssocketutils.h"
 
 #include <stdlib.h> // atoi()
 
@@ -1089,10 +1090,27 @@ kms_rtp_endpoint_finalize (GObject * object)
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
+static GstStructure *
+kms_rtp_endpoint_stats (KmsElement * obj, gchar * selector)
+{
+  GstStructure *stats, *pool_stats;
+
+  /* chain up */
+  stats =
+      KMS_ELEMENT_CLASS (kms_rtp_endpoint_parent_class)->stats (obj, selector);
+
+  pool_stats = kms_socket_port_pool_get_stats ();
+  gst_structure_set (stats, "port-pool", GST_TYPE_STRUCTURE, pool_stats, NULL);
+  gst_structure_free (pool_stats);
+
+  return stats;
+}
+
 static void
 kms_rtp_endpoint_class_init (KmsRtpEndpointClass * klass)
 {
   GObjectClass *gobject_class;
+  KmsElementClass *kmselement_class;
   KmsBaseSdpEndpointClass *base_sdp_endpoint_class;
   GstElementClass *gstelement_class;
 
@@ -1109,6 +1127,9 @@ kms_rtp_endpoint_class_init (KmsRtpEndpointClass * klass)
       "José Antonio Santos Cadenas <santoscadenas@kurento.com>");
   GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, PLUGIN_NAME, 0, PLUGIN_NAME);
 
+  kmselement_class = KMS_ELEMENT_CLASS (klass);
+  kmselement_class->stats = GST_DEBUG_FUNCPTR (kms_rtp_endpoint_stats);
+
   base_sdp_endpoint_class = KMS_BASE_SDP_ENDPOINT_CLASS (klass);
   base_sdp_endpoint_class->create_session_internal =
       kms_rtp_endpoint_create_session_internal;
@@ -71,85 +71,319 @@ kms_socket_get_port (GSocket * socket)
   return port;
 }
 
-static inline guint16
-inc_port (guint16 current, guint16 min, guint16 max, guint16 start,
-    gboolean * max_reached, gboolean * all_checked)
+/*
+ * Process-wide pool of RTP/RTCP port pairs.
+ *
+ * Each pair (even RTP port, odd RTCP port) is one bit in a bitmap, set while
+ * the pair is in use by a connection of this process, in quarantine after
+ * being released, or found busy by some other process. Allocation walks the
+ * bitmap from a moving cursor one 64-bit word at a time, so no bind() is
+ * wasted on ports we already know are taken.
+ *
+ * Quarantined and busy pairs are kept in queues sorted by expiration time,
+ * so expiration only needs to look at the head. The quarantine is a single
+ * pool-wide setting, but it may still change while pairs are waiting.
+ */
+
+#define PORT_PAIRS (G_MAXUINT16 / 2 + 1)
+#define PAIR_WORDS (PORT_PAIRS / 64)
+#define BUSY_RETRY_DELAY (30 * G_USEC_PER_SEC)
+#define UNPRIVILEGED_PORT_MIN 1024
+
+typedef struct _KmsPortPairTimeout
 {
-  guint16 next = current + 2;
+  guint pair;
+  gint64 expiration;
+} KmsPortPairTimeout;
 
-  if (next > max) {
-    *max_reached = TRUE;
-    next = min;
+typedef struct _KmsPortPool
+{
+  GMutex mutex;
+  guint64 taken[PAIR_WORDS];
+  guint cursor;
+  gint64 quarantine;            /* usec */
+  GQueue quarantined;
+  GQueue busy;
+
+  /* Metrics */
+  guint allocated;
+  guint64 allocations;
+  guint64 failed_allocations;
+  guint64 bind_failures;
+  gint64 last_latency;
+  gint64 total_latency;
+  gint64 max_latency;
+} KmsPortPool;
+
+static KmsPortPool port_pool = {
+  .cursor = G_MAXUINT,
+  .quarantined = G_QUEUE_INIT,
+  .busy = G_QUEUE_INIT,
+};
+
+static inline void
+port_pool_set (guint pair)
+{
+  port_pool.taken[pair / 64] |= G_GUINT64_CONSTANT (1) << (pair % 64);
+}
+
+static inline void
+port_pool_clear (guint pair)
+{
+  port_pool.taken[pair / 64] &= ~(G_GUINT64_CONSTANT (1) << (pair % 64));
+}
+
+static inline gboolean
+port_pool_is_set (guint pair)
+{
+  return (port_pool.taken[pair / 64] >> (pair % 64)) & 1;
+}
+
+/* Must be called with the pool mutex held */
+static void
+port_pool_expire (GQueue * queue, gint64 now)
+{
+  KmsPortPairTimeout *timeout;
+
+  while ((timeout = g_queue_peek_head (queue)) != NULL &&
+      timeout->expiration <= now) {
+    g_queue_pop_head (queue);
+    port_pool_clear (timeout->pair);
+    g_slice_free (KmsPortPairTimeout, timeout);
   }
+}
 
-  if (*max_reached && (next + 1 >= start)) {
-    *all_checked = TRUE;
+/* Entries nearly always go at the tail, so look for their place from there.
+ * Must be called with the pool mutex held */
+static void
+port_pool_delay (GQueue * queue, guint pair, gint64 expiration)
+{
+  KmsPortPairTimeout *timeout;
+  GList *l;
+
+  timeout = g_slice_new (KmsPortPairTimeout);
+  timeout->pair = pair;
+  timeout->expiration = expiration;
+
+  for (l = queue->tail; l != NULL; l = l->prev) {
+    if (((KmsPortPairTimeout *) l->data)->expiration <= expiration) {
+      break;
+    }
   }
 
-  return next;
+  if (l != NULL) {
+    g_queue_insert_after (queue, l, timeout);
+  } else {
+    g_queue_push_head (queue, timeout);
+  }
 }
 
-static inline gboolean
-in_range (guint16 current, guint16 min, guint16 max)
+/* Returns the index of the first free pair in [first, last] starting at
+ * @from and wrapping around, or G_MAXUINT if every pair is taken.
+ * Must be called with the pool mutex held */
+static guint
+port_pool_find_free (guint first, guint last, guint from)
+{
+  guint pair = from;
+  guint checked = 0, total = last - first + 1;
+
+  while (checked < total) {
+    guint64 word = ~port_pool.taken[pair / 64] >> (pair % 64);
+    guint span = MIN (64 - pair % 64, last - pair + 1);
+
+    if (span < 64) {
+      word &= (G_GUINT64_CONSTANT (1) << span) - 1;
+    }
+
+    if (word != 0) {
+      guint found = pair + __builtin_ctzll (word);
+
+      if (checked + (found - pair) < total) {
+        return found;
+      }
+
+      return G_MAXUINT;
+    }
+
+    checked += span;
+    pair += span;
+    if (pair > last) {
+      pair = first;
+    }
+  }
+
+  return G_MAXUINT;
+}
+
+void
+kms_socket_port_pool_set_quarantine (guint msecs)
+{
+  g_mutex_lock (&port_pool.mutex);
+  port_pool.quarantine = (gint64) msecs * 1000;
+  g_mutex_unlock (&port_pool.mutex);
+}
+
+static void
+kms_socket_port_pool_release (guint16 port)
 {
-  return current >= min && current <= max;
+  guint pair = port / 2;
+  gint64 now;
+
+  g_mutex_lock (&port_pool.mutex);
+
+  if (!port_pool_is_set (pair)) {
+    g_mutex_unlock (&port_pool.mutex);
+    return;
+  }
+
+  port_pool.allocated--;
+
+  if (port_pool.quarantine > 0) {
+    now = g_get_monotonic_time ();
+    port_pool_delay (&port_pool.quarantined, pair, now + port_pool.quarantine);
+  } else {
+    port_pool_clear (pair);
+  }
+
+  g_mutex_unlock (&port_pool.mutex);
+}
+
+GstStructure *
+kms_socket_port_pool_get_stats (void)
+{
+  GstStructure *stats;
+
+  g_mutex_lock (&port_pool.mutex);
+
+  stats = gst_structure_new ("port-pool",
+      "allocated-pairs", G_TYPE_UINT, port_pool.allocated,
+      "quarantined-pairs", G_TYPE_UINT,
+      g_queue_get_length (&port_pool.quarantined),
+      "busy-pairs", G_TYPE_UINT, g_queue_get_length (&port_pool.busy),
+      "allocations", G_TYPE_UINT64, port_pool.allocations,
+      "failed-allocations", G_TYPE_UINT64, port_pool.failed_allocations,
+      "bind-failures", G_TYPE_UINT64, port_pool.bind_failures,
+      "last-allocation-latency", G_TYPE_INT64,
+      port_pool.last_latency * GST_USECOND,
+      "avg-allocation-latency", G_TYPE_INT64, port_pool.allocations > 0 ?
+      (gint64) (port_pool.total_latency / port_pool.allocations) *
+      GST_USECOND : 0,
+      "max-allocation-latency", G_TYPE_INT64,
+      port_pool.max_latency * GST_USECOND, NULL);
+
+  g_mutex_unlock (&port_pool.mutex);
+
+  return stats;
+}
+
+/* Reserves a free pair in [first, last], or returns G_MAXUINT if there is
+ * none. Must be called with the pool mutex held */
+static guint
+port_pool_reserve (guint first, guint last)
+{
+  guint pair = port_pool.cursor;
+
+  if (pair < first || pair > last) {
+    pair = g_random_int_range (first, last + 1);
+  }
+
+  pair = port_pool_find_free (first, last, pair);
+  if (pair == G_MAXUINT) {
+    return G_MAXUINT;
+  }
+
+  /* Set before binding, so that no other thread is handed the same pair */
+  port_pool_set (pair);
+  port_pool.cursor = (pair == last) ? first : pair + 1;
+
+  return pair;
 }
 
 gboolean
 kms_rtp_connection_get_rtp_rtcp_sockets (GSocket ** rtp, GSocket ** rtcp,
     guint16 min_port, guint16 max_port, GSocketFamily socket_family)
 {
-  guint16 port1, port2;
-  guint16 start_port;
-  gboolean all_checked = FALSE, max_reached = FALSE;
+  guint first, last, pair;
+  gint64 start, now;
+  gboolean ret = FALSE;
 
   if (rtp == NULL || rtcp == NULL) {
     return FALSE;
   }
 
-  start_port = (guint16) g_random_int_range (min_port, max_port + 1);
+  /* Neither port 0 ("any port" for bind()) nor privileged ports */
+  first = (MAX (min_port, UNPRIVILEGED_PORT_MIN) + 1) / 2;
+  last = (max_port - 1) / 2;
 
-  for (port1 = start_port; !all_checked;
-       port1 = inc_port (
-           port1, min_port, max_port, start_port, &max_reached, &all_checked)) {
-    GSocket *s1, *s2;
+  if (max_port == 0 || first > last) {
+    return FALSE;
+  }
 
-    s1 = kms_socket_open (port1, socket_family);
+  start = g_get_monotonic_time ();
 
-    if (s1 == NULL) {
-      continue;
-    }
+  g_mutex_lock (&port_pool.mutex);
+  port_pool_expire (&port_pool.quarantined, start);
+  port_pool_expire (&port_pool.busy, start);
+  pair = port_pool_reserve (first, last);
+  g_mutex_unlock (&port_pool.mutex);
 
-    port1 = kms_socket_get_port (s1);
+  while (pair != G_MAXUINT) {
+    GSocket *s1, *s2 = NULL;
 
-    if (port1 & 0x01) {
-      port2 = port1 - 1;
-    } else {
-      port2 = port1 + 1;
+    /* bind() may be slow, other threads keep allocating meanwhile */
+    s1 = kms_socket_open (pair * 2, socket_family);
+    if (s1 != NULL) {
+      s2 = kms_socket_open (pair * 2 + 1, socket_family);
     }
 
-    if (!in_range (port2, min_port, max_port)) {
-      kms_socket_finalize (&s1);
-      continue;
+    if (s2 != NULL) {
+      *rtp = s1;
+      *rtcp = s2;
+      ret = TRUE;
+      break;
     }
 
-    s2 = kms_socket_open (port2, socket_family);
+    kms_socket_finalize (&s1);
 
-    if (s2 == NULL) {
-      kms_socket_finalize (&s1);
-      continue;
-    }
+    g_mutex_lock (&port_pool.mutex);
+    /* Taken by another process; do not probe it again for a while */
+    port_pool.bind_failures++;
+    port_pool_delay (&port_pool.busy, pair,
+        g_get_monotonic_time () + BUSY_RETRY_DELAY);
+    pair = port_pool_reserve (first, last);
+    g_mutex_unlock (&port_pool.mutex);
+  }
 
-    if (port1 < port2) {
-      *rtp = s1;
-      *rtcp = s2;
-    } else {
-      *rtp = s2;
-      *rtcp = s1;
-    }
+  now = g_get_monotonic_time ();
 
-    return TRUE;
+  g_mutex_lock (&port_pool.mutex);
+  if (ret) {
+    port_pool.allocated++;
+    port_pool.allocations++;
+    port_pool.last_latency = now - start;
+    port_pool.total_latency += now - start;
+    port_pool.max_latency = MAX (port_pool.max_latency, now - start);
+  } else {
+    port_pool.failed_allocations++;
   }
+  g_mutex_unlock (&port_pool.mutex);
+
+  return ret;
+}
 
-  return FALSE;
+void
+kms_rtp_connection_release_rtp_rtcp_sockets (GSocket ** rtp, GSocket ** rtcp)
+{
+  guint16 port = 0;
+
+  if (rtp != NULL && *rtp != NULL) {
+    port = kms_socket_get_port (*rtp);
+  }
+
+  kms_socket_finalize (rtp);
+  kms_socket_finalize (rtcp);
+
+  if (port != 0) {
+    kms_socket_port_pool_release (port);
+  }
 }
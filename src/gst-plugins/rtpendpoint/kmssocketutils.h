@@ -19,10 +19,21 @@
 #define __KMS_SOCKETUTILS_H__
 
 #include <gio/gio.h>
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
 
 void kms_socket_finalize (GSocket ** socket);
 guint16 kms_socket_get_port (GSocket * socket);
 gboolean kms_rtp_connection_get_rtp_rtcp_sockets (GSocket ** rtp,
     GSocket ** rtcp, guint16 min_port, guint16 max_port, GSocketFamily socket_family);
+void kms_rtp_connection_release_rtp_rtcp_sockets (GSocket ** rtp,
+    GSocket ** rtcp);
+
+/* Applies to every endpoint of the process, set it once at startup */
+void kms_socket_port_pool_set_quarantine (guint msecs);
+GstStructure * kms_socket_port_pool_get_stats (void);
+
+G_END_DECLS
 
 #endif /* __KMS_SOCKETUTILS_H__ */
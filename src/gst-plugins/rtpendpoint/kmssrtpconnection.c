@@ -483,8 +483,8 @@ kms_srtp_connection_finalize (GObject * object)
   g_clear_object (&self->srtpenc);
   g_clear_object (&self->srtpdec);
 
-  kms_socket_finalize (&self->rtp_socket);
-  kms_socket_finalize (&self->rtcp_socket);
+  kms_rtp_connection_release_rtp_rtcp_sockets (&self->rtp_socket,
+      &self->rtcp_socket);
 
   g_free (self->r_key);
 
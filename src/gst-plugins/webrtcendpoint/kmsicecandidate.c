@@ -19,6 +19,7 @@
 #include <gio/gio.h>
 #include <gst/gst.h>
 #include <stdlib.h>
+#include <string.h>
 
 #define GST_CAT_DEFAULT kmsicecandidate
 GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
@@ -93,102 +94,152 @@ struct _KmsIceCandidatePrivate
   gboolean is_valid;
 };
 
+/*
+ * The expression is compiled once and shared by all candidates; a GRegex is
+ * immutable so it can be matched from any thread. Fields are then read from
+ * their match offsets, so only the strings kept by the candidate are copied.
+ */
+static GRegex *
+kms_ice_candidate_get_regex (void)
+{
+  static gsize regex = 0;
+
+  if (g_once_init_enter (&regex)) {
+    GRegex *r = g_regex_new (CANDIDATE_EXPR, G_REGEX_OPTIMIZE, 0, NULL);
+
+    g_once_init_leave (&regex, (gsize) r);
+  }
+
+  return (GRegex *) regex;
+}
+
+typedef struct _KmsCandidateField
+{
+  const gchar *str;
+  gint len;                     /* -1 if the field was not matched */
+} KmsCandidateField;
+
+static KmsCandidateField
+kms_ice_candidate_fetch_field (const GMatchInfo * match_info,
+    const gchar * candidate, const gchar * name)
+{
+  KmsCandidateField field = { NULL, -1 };
+  gint start, end;
+
+  if (g_match_info_fetch_named_pos (match_info, name, &start, &end)
+      && start >= 0) {
+    field.str = candidate + start;
+    field.len = end - start;
+  }
+
+  return field;
+}
+
+static gboolean
+kms_ice_candidate_field_equals (KmsCandidateField field, const gchar * value)
+{
+  return field.len >= 0 && (gsize) field.len == strlen (value) &&
+      strncmp (field.str, value, field.len) == 0;
+}
+
+/* Numeric fields are always followed by a separator or the end of string */
+static guint64
+kms_ice_candidate_field_to_uint (KmsCandidateField field)
+{
+  return g_ascii_strtoull (field.str, NULL, 10);
+}
+
 static gboolean
 kms_ice_candidate_update_values (KmsIceCandidate * self)
 {
-  GRegex *regex;
+  const gchar *candidate = self->priv->candidate;
   GMatchInfo *match_info;
-  gchar *tmp = NULL;
+  KmsCandidateField field;
   gboolean ret = FALSE;
 
-  regex = g_regex_new (CANDIDATE_EXPR, 0, 0, NULL);
-  g_regex_match (regex, self->priv->candidate, 0, &match_info);
+  /* Candidates come from the remote peer, and GRegex requires UTF-8 */
+  if (!g_utf8_validate (candidate, -1, NULL)) {
+    GST_WARNING_OBJECT (self, "Cannot parse from non UTF-8 candidate");
+    return FALSE;
+  }
+
+  g_regex_match (kms_ice_candidate_get_regex (), candidate, 0, &match_info);
 
   if (!g_match_info_matches (match_info)) {
-    GST_WARNING_OBJECT (self, "Cannot parse from '%s'", self->priv->candidate);
+    GST_WARNING_OBJECT (self, "Cannot parse from '%s'", candidate);
     goto end;
   }
 
   g_free (self->priv->foundation);
   g_free (self->priv->ip);
   g_free (self->priv->related_addr);
+  self->priv->related_addr = NULL;
+
+  field = kms_ice_candidate_fetch_field (match_info, candidate, "port");
+  self->priv->port = kms_ice_candidate_field_to_uint (field);
 
-  tmp = g_match_info_fetch_named (match_info, "port");
-  self->priv->port = atoi (tmp);
-  g_free (tmp);
+  field = kms_ice_candidate_fetch_field (match_info, candidate, "foundation");
+  self->priv->foundation = g_strndup (field.str, field.len);
 
-  self->priv->foundation = g_match_info_fetch_named (match_info, "foundation");
+  field = kms_ice_candidate_fetch_field (match_info, candidate, "priority");
+  self->priv->priority = kms_ice_candidate_field_to_uint (field);
 
-  tmp = g_match_info_fetch_named (match_info, "priority");
-  self->priv->priority = atoi (tmp);
-  g_free (tmp);
+  field = kms_ice_candidate_fetch_field (match_info, candidate, "addr");
+  self->priv->ip = g_strndup (field.str, field.len);
 
-  tmp = g_match_info_fetch_named (match_info, "componentid");
-  if (g_strcmp0 (tmp, "1") == 0) {
+  field = kms_ice_candidate_fetch_field (match_info, candidate, "componentid");
+  if (kms_ice_candidate_field_equals (field, "1")) {
     self->priv->component = KMS_ICE_COMPONENT_RTP;
-  } else if (g_strcmp0 (tmp, "2") == 0) {
+  } else if (kms_ice_candidate_field_equals (field, "2")) {
     self->priv->component = KMS_ICE_COMPONENT_RTCP;
   } else {
-    GST_ERROR_OBJECT (self, "Unsupported ICE candidate component %s", tmp);
+    GST_ERROR_OBJECT (self, "Unsupported ICE candidate component %.*s",
+        field.len, field.str);
     goto end;
   }
-  g_free (tmp);
 
-  tmp = g_match_info_fetch_named (match_info, "transport");
-  if (g_strcmp0 (tmp, "TCP") == 0 || g_strcmp0 (tmp, "tcp") == 0) {
+  /* The expression only accepts udp, UDP, tcp or TCP */
+  field = kms_ice_candidate_fetch_field (match_info, candidate, "transport");
+  if (g_ascii_tolower (field.str[0]) == 't') {
     self->priv->protocol = KMS_ICE_PROTOCOL_TCP;
-  } else if (g_strcmp0 (tmp, "UDP") == 0 || g_strcmp0 (tmp, "udp") == 0) {
-    self->priv->protocol = KMS_ICE_PROTOCOL_UDP;
   } else {
-    GST_ERROR_OBJECT (self, "Unsupported protocol %s", tmp);
-    goto end;
+    self->priv->protocol = KMS_ICE_PROTOCOL_UDP;
   }
-  g_free (tmp);
 
-  tmp = g_match_info_fetch_named (match_info, "type");
-  if (g_strcmp0 (tmp, "host") == 0) {
+  field = kms_ice_candidate_fetch_field (match_info, candidate, "type");
+  if (kms_ice_candidate_field_equals (field, "host")) {
     self->priv->type = KMS_ICE_CANDIDATE_TYPE_HOST;
-  } else if (g_strcmp0 (tmp, "srflx") == 0) {
+  } else if (kms_ice_candidate_field_equals (field, "srflx")) {
     self->priv->type = KMS_ICE_CANDIDATE_TYPE_SRFLX;
-  } else if (g_strcmp0 (tmp, "prflx") == 0) {
+  } else if (kms_ice_candidate_field_equals (field, "prflx")) {
     self->priv->type = KMS_ICE_CANDIDATE_TYPE_PRFLX;
-  } else if (g_strcmp0 (tmp, "relay") == 0) {
-    self->priv->type = KMS_ICE_CANDIDATE_TYPE_RELAY;
   } else {
-    GST_ERROR_OBJECT (self, "Unsupported ICE candidate type %s", tmp);
-    goto end;
+    self->priv->type = KMS_ICE_CANDIDATE_TYPE_RELAY;
   }
-  g_free (tmp);
 
-  tmp = g_match_info_fetch_named (match_info, "tcptype");
-  if (g_strcmp0 (tmp, "active") == 0) {
+  field = kms_ice_candidate_fetch_field (match_info, candidate, "tcptype");
+  if (kms_ice_candidate_field_equals (field, "active")) {
     self->priv->tcp_type = KMS_ICE_TCP_CANDIDATE_TYPE_ACTIVE;
-  } else if (g_strcmp0 (tmp, "passive") == 0) {
+  } else if (kms_ice_candidate_field_equals (field, "passive")) {
     self->priv->tcp_type = KMS_ICE_TCP_CANDIDATE_TYPE_PASSIVE;
-  } else if (g_strcmp0 (tmp, "so") == 0) {
+  } else if (kms_ice_candidate_field_equals (field, "so")) {
     self->priv->tcp_type = KMS_ICE_TCP_CANDIDATE_TYPE_SO;
   } else {
     self->priv->tcp_type = KMS_ICE_TCP_CANDIDATE_TYPE_NONE;
   }
-  g_free (tmp);
 
-  tmp = g_match_info_fetch_named (match_info, "raddr");
-  if (tmp != NULL && g_strcmp0 (tmp, "") != 0) {
-    self->priv->related_addr = tmp;
-  } else {
-    self->priv->related_addr = NULL;
-    g_free (tmp);
+  field = kms_ice_candidate_fetch_field (match_info, candidate, "raddr");
+  if (field.len > 0) {
+    self->priv->related_addr = g_strndup (field.str, field.len);
   }
 
-  tmp = g_match_info_fetch_named (match_info, "rport");
-  if (tmp != NULL && g_strcmp0 (tmp, "") != 0) {
-    self->priv->related_port = atoi (tmp);
+  field = kms_ice_candidate_fetch_field (match_info, candidate, "rport");
+  if (field.len > 0) {
+    self->priv->related_port = kms_ice_candidate_field_to_uint (field);
   } else {
     self->priv->related_port = -1;
   }
 
-  self->priv->ip = g_match_info_fetch_named (match_info, "addr");
-
   if (g_str_has_suffix (self->priv->ip, ".local")) {
     // The IP is actually an mDNS address, try to resolve it.
     // https://datatracker.ietf.org/doc/draft-ietf-rtcweb-mdns-ice-candidates/
@@ -220,10 +271,7 @@ kms_ice_candidate_update_values (KmsIceCandidate * self)
   ret = TRUE;
 
 end:
-  g_free (tmp);
-
   g_match_info_free (match_info);
-  g_regex_unref (regex);
 
   return ret;
 }
@@ -21,6 +21,7 @@
 
 #include "kmswebrtcendpoint.h"
 #include "kmswebrtcsession.h"
+#include "kmswebrtcloops.h"
 #include <commons/constants.h>
 #include <commons/kmsloop.h>
 #include <commons/kmsutils.h>
@@ -99,6 +100,7 @@ static guint kms_webrtc_endpoint_signals[LAST_SIGNAL] = { 0 };
 struct _KmsWebrtcEndpointPrivate
 {
   KmsLoop *loop;
+  guint loop_shard;
   GMainContext *context;
 
   gchar *stun_server_ip;
@@ -323,6 +325,19 @@ kms_webrtc_endpoint_create_session_internal (KmsBaseSdpEndpoint * base_sdp,
   KmsWebrtcSessionCallbacks callbacks;
   KmsWebrtcSession *webrtc_sess;
 
+  KMS_ELEMENT_LOCK (self);
+
+  /* The loop is picked on first use so that the pool size configured by the
+   * server is already in place when the first endpoint needs it */
+  if (self->priv->loop == NULL) {
+    self->priv->loop = kms_webrtc_loops_acquire (&self->priv->loop_shard);
+    g_object_get (self->priv->loop, "context", &self->priv->context, NULL);
+    GST_DEBUG_OBJECT (self, "Using event loop shard %u",
+        self->priv->loop_shard);
+  }
+
+  KMS_ELEMENT_UNLOCK (self);
+
   webrtc_sess =
       kms_webrtc_session_new (base_sdp, id, manager, self->priv->context, self->priv->qos_dscp);
 
@@ -615,7 +630,10 @@ kms_webrtc_endpoint_dispose (GObject * object)
 
   KMS_ELEMENT_LOCK (self);
 
-  g_clear_object (&self->priv->loop);
+  if (self->priv->loop != NULL) {
+    kms_webrtc_loops_release (self->priv->loop, self->priv->loop_shard);
+    self->priv->loop = NULL;
+  }
 
   KMS_ELEMENT_UNLOCK (self);
 
@@ -638,7 +656,9 @@ kms_webrtc_endpoint_finalize (GObject * object)
   g_free (self->priv->external_ipv4);
   g_free (self->priv->external_ipv6);
 
-  g_main_context_unref (self->priv->context);
+  if (self->priv->context != NULL) {
+    g_main_context_unref (self->priv->context);
+  }
 
   /* chain up */
   G_OBJECT_CLASS (kms_webrtc_endpoint_parent_class)->finalize (object);
@@ -986,9 +1006,7 @@ kms_webrtc_endpoint_init (KmsWebrtcEndpoint * self)
   self->priv->external_ipv4 = DEFAULT_EXTERNAL_IPV4;
   self->priv->external_ipv6 = DEFAULT_EXTERNAL_IPV6;
   self->priv->ice_tcp = DEFAULT_ICE_TCP;
-
-  self->priv->loop = kms_loop_new ();
-  g_object_get (self->priv->loop, "context", &self->priv->context, NULL);
+  self->priv->loop_shard = KMS_WEBRTC_LOOPS_DEDICATED;
 }
 
 gboolean
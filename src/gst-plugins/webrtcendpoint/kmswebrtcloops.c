@@ -0,0 +1,51 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "kmswebrtcloops.h"
+#include "commons/kmsloopshards.h"
+
+G_STATIC_ASSERT (KMS_WEBRTC_LOOPS_DEDICATED == KMS_LOOP_SHARDS_DEDICATED);
+
+static KmsLoopShards webrtc_loops = KMS_LOOP_SHARDS_INIT ("webrtc");
+
+void
+kms_webrtc_loops_set_size (guint size)
+{
+  kms_loop_shards_set_size (&webrtc_loops, size);
+}
+
+guint
+kms_webrtc_loops_get_size (void)
+{
+  return kms_loop_shards_get_size (&webrtc_loops);
+}
+
+KmsLoop *
+kms_webrtc_loops_acquire (guint * shard)
+{
+  return kms_loop_shards_acquire (&webrtc_loops, shard);
+}
+
+void
+kms_webrtc_loops_release (KmsLoop * loop, guint shard)
+{
+  kms_loop_shards_release (&webrtc_loops, loop, shard);
+}
@@ -0,0 +1,45 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef __KMS_WEBRTC_LOOPS_H__
+#define __KMS_WEBRTC_LOOPS_H__
+
+#include <commons/kmsloop.h>
+
+G_BEGIN_DECLS
+
+/* Shard id used for loops that are not part of the shared pool */
+#define KMS_WEBRTC_LOOPS_DEDICATED G_MAXUINT
+
+/*
+ * Process-wide pool of event loop threads shared by all WebRtcEndpoints,
+ * a KmsLoopShards kept in this library so the server can size it.
+ *
+ * Every endpoint is pinned to one shard for its whole life, so all its ICE,
+ * SCTP and transport sources are dispatched from the same thread and keep
+ * their relative ordering. A size of 0 disables the pool and gives each
+ * endpoint its own dedicated loop.
+ */
+void kms_webrtc_loops_set_size (guint size);
+guint kms_webrtc_loops_get_size (void);
+
+KmsLoop * kms_webrtc_loops_acquire (guint * shard);
+void kms_webrtc_loops_release (KmsLoop * loop, guint shard);
+
+G_END_DECLS
+
+#endif /* __KMS_WEBRTC_LOOPS_H__ */
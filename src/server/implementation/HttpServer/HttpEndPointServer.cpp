@@ -30,6 +30,7 @@ std::recursive_mutex HttpEndPointServer::mutex;
 uint HttpEndPointServer::port;
 std::string HttpEndPointServer::interface;
 std::string HttpEndPointServer::announcedAddr;
+uint HttpEndPointServer::workers;
 
 static void
 check_port (int port)
@@ -41,7 +42,7 @@ check_port (int port)
 
 std::shared_ptr<HttpEndPointServer>
 HttpEndPointServer::getHttpEndPointServer (const uint port,
-    const std::string &iface, const std::string &addr)
+    const std::string &iface, const std::string &addr, const uint workers)
 {
   std::unique_lock <std::recursive_mutex> lock (mutex);
   uint finalPort = port;
@@ -66,6 +67,7 @@ HttpEndPointServer::getHttpEndPointServer (const uint port,
   HttpEndPointServer::port = finalPort;
   HttpEndPointServer::interface = iface;
   HttpEndPointServer::announcedAddr = addr;
+  HttpEndPointServer::workers = (workers == 0) ? DEFAULT_WORKERS : workers;
 
   instance = std::shared_ptr<HttpEndPointServer> (new HttpEndPointServer () );
   instance->start();
@@ -85,6 +87,8 @@ HttpEndPointServer::HttpEndPointServer ()
                              (HttpEndPointServer::announcedAddr.empty())
                                  ? nullptr
                                  : HttpEndPointServer::announcedAddr.c_str(),
+                             KMS_HTTP_EP_SERVER_WORKERS,
+                             HttpEndPointServer::workers,
                              NULL);
 
   logHandler = [&](GError *err) {
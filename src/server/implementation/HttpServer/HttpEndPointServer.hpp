@@ -33,7 +33,8 @@ class HttpEndPointServer
 {
 public:
   static std::shared_ptr<HttpEndPointServer> getHttpEndPointServer (
-    const uint port, const std::string &iface, const std::string &addr);
+    const uint port, const std::string &iface, const std::string &addr,
+    const uint workers = DEFAULT_WORKERS);
   void start ();
   void stop ();
   void registerEndPoint (GstElement *endpoint, guint timeout,
@@ -49,7 +50,7 @@ public:
 
   ~HttpEndPointServer ();
 
-  enum { DEFAULT_PORT = 9091 };
+  enum { DEFAULT_PORT = 9091, DEFAULT_WORKERS = 1 };
 
 private:
   static std::shared_ptr<HttpEndPointServer> instance;
@@ -57,6 +58,7 @@ private:
   static uint port;
   static std::string interface;
   static std::string announcedAddr;
+  static uint workers;
 
   HttpEndPointServer ();
   KmsHttpEPServer *server;
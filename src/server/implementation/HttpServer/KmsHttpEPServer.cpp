@@ -16,6 +16,7 @@
  */
 
 #include <ctime>
+#include <sys/socket.h>
 #include <libsoup/soup.h>
 #include <uuid/uuid.h>
 #include <cstring>
@@ -25,6 +26,7 @@
 
 #include "KmsHttpEPServer.h"
 #include "KmsHttpPost.h"
+#include "KmsTimerWheel.h"
 #include "http-enumtypes.h"
 #include "http-marshal.h"
 
@@ -62,23 +64,54 @@ G_DEFINE_QUARK (KEY_PARAM_POST_CONTROLLER, key_param_post_controller)
 #define KEY_PARAM_TIMEOUT "kms-param-timeout"
 G_DEFINE_QUARK (KEY_PARAM_TIMEOUT, key_param_timeout)
 
+#define KEY_SOUP_SERVER "kms-soup-server"
+G_DEFINE_QUARK (KEY_SOUP_SERVER, key_soup_server)
+
+#define KEY_SOUP_CONTEXT "kms-soup-context"
+G_DEFINE_QUARK (KEY_SOUP_CONTEXT, key_soup_context)
+
 #define GST_CAT_DEFAULT kms_http_ep_server_debug_category
 GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
 
 #define RESOLV_TIMEOUT 5000 /* 5 seconds */
+#define SESSION_TIMER_RESOLUTION 100 /* milliseconds */
+
+/* Workers need to listen on sockets created by us to share the port */
+#ifdef SOUP_CHECK_VERSION
+#if SOUP_CHECK_VERSION (2, 48, 0) && defined (SO_REUSEPORT)
+#define KMS_HTTP_EP_SERVER_HAVE_WORKERS 1
+#endif
+#endif
+
+/* Requests are served by every worker, each one running its own */
+/* SoupServer in its own loop on a socket bound with SO_REUSEPORT */
+typedef struct _KmsHttpEPServerWorker {
+  KmsLoop *loop;
+  SoupServer *server;
+  GSocket *socket;
+} KmsHttpEPServerWorker;
 
 #define KMS_HTTP_EP_SERVER_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE ((obj), KMS_TYPE_HTTP_EP_SERVER, KmsHttpEPServerPrivate))
 struct _KmsHttpEPServerPrivate {
   GHashTable *handlers;
+  GRWLock handlers_lock;
   SoupServer *server;
   gchar *announced_addr;
   gchar *got_addr;
   gchar *iface;
   gint port;
+  guint n_workers;
+  KmsHttpEPServerWorker *workers;
   GRand *rand;
   KmsLoop *loop;
+  /* Drives the expiration of all sessions */
+  KmsTimerWheel *sessions_wheel;
 };
 
+/* Protects the session state attached to endpoints, which can be */
+/* reached from the threads of all workers */
+static GRecMutex sessions_mutex;
+
 static GType http_t = G_TYPE_INVALID;
 
 #define KMS_IS_EXPECTED_TYPE(obj, objtype) \
@@ -98,6 +131,7 @@ enum {
   PROP_KMS_HTTP_EP_SERVER_PORT,
   PROP_KMS_HTTP_EP_SERVER_INTERFACE,
   PROP_KMS_HTTP_EP_SERVER_ANNOUNCED_ADDRESS,
+  PROP_KMS_HTTP_EP_SERVER_WORKERS,
 
   N_PROPERTIES
 };
@@ -106,6 +140,7 @@ enum {
 #define KMS_HTTP_EP_SERVER_DEFAULT_INTERFACE NULL
 #define KMS_HTTP_EP_SERVER_DEFAULT_ANNOUNCED_ADDRESS \
   KMS_HTTP_EP_SERVER_DEFAULT_INTERFACE
+#define KMS_HTTP_EP_SERVER_DEFAULT_WORKERS 1
 
 static GParamSpec *obj_properties[N_PROPERTIES] = {
     nullptr,
@@ -216,11 +251,30 @@ kms_http_ep_server_remove_timeout (KmsHttpEPServer *self, GstElement *httpep)
   }
 
   GST_DEBUG ("Remove timeout %d", *timeout_id);
-  kms_loop_remove (self->priv->loop, *timeout_id);
+  kms_timer_wheel_remove (self->priv->sessions_wheel, *timeout_id);
   g_object_set_qdata_full(G_OBJECT(httpep), key_timeout_id_quark(), nullptr,
                           nullptr);
 }
 
+/* Returns a new reference to the endpoint registered for @path */
+static GstElement *
+kms_http_ep_server_lookup_ep (KmsHttpEPServer *self, const char *path)
+{
+  GstElement *httpep;
+
+  g_rw_lock_reader_lock (&self->priv->handlers_lock);
+  httpep = (GstElement *) g_hash_table_lookup (self->priv->handlers, path);
+
+  if (httpep != nullptr) {
+    gst_object_ref (httpep);
+  }
+
+  g_rw_lock_reader_unlock (&self->priv->handlers_lock);
+
+  return httpep;
+}
+
+/* Returns a new reference to the endpoint @msg was sent to */
 static GstElement *
 kms_http_ep_server_get_ep_from_msg (KmsHttpEPServer *self, SoupMessage *msg)
 {
@@ -231,7 +285,7 @@ kms_http_ep_server_get_ep_from_msg (KmsHttpEPServer *self, SoupMessage *msg)
     return nullptr;
   }
 
-  return (GstElement *) g_hash_table_lookup (self->priv->handlers, uri);
+  return kms_http_ep_server_lookup_ep (self, uri);
 }
 
 static gboolean
@@ -247,10 +301,13 @@ emit_expiration_signal_cb (gpointer user_data)
   GST_DEBUG ("Cookie expired for %s", path);
   g_signal_emit (G_OBJECT (serv), obj_signals[URL_EXPIRED], 0, path);
 
-  httpep = (GstElement *) g_hash_table_lookup (serv->priv->handlers, path);
+  httpep = kms_http_ep_server_lookup_ep (serv, path);
 
   if (httpep != nullptr) {
+    g_rec_mutex_lock (&sessions_mutex);
     kms_http_ep_server_remove_timeout (serv, httpep);
+    g_rec_mutex_unlock (&sessions_mutex);
+    gst_object_unref (httpep);
   }
 
   return G_SOURCE_REMOVE;
@@ -282,11 +339,9 @@ emit_expiration_signal (SoupMessage *msg, GstElement *httpep)
   serv = (KmsHttpEPServer *) g_object_get_qdata (G_OBJECT (msg),
          key_http_ep_server_quark () );
   id = g_slice_new (guint);
-  *id = kms_loop_timeout_add_full (serv->priv->loop,
-                                   G_PRIORITY_DEFAULT, t_timeout * 1000,
-                                   emit_expiration_signal_cb,
-                                   g_object_ref (G_OBJECT (msg) ),
-                                   g_object_unref);
+  *id = kms_timer_wheel_add (serv->priv->sessions_wheel, t_timeout * 1000,
+                             emit_expiration_signal_cb,
+                             g_object_ref (G_OBJECT (msg) ), g_object_unref);
   g_object_set_qdata_full (G_OBJECT (httpep), key_timeout_id_quark (), id,
                            (GDestroyNotify) destroy_guint);
   soup_date_free (now);
@@ -298,24 +353,32 @@ destroy_ulong (gulong *handlerid)
   g_slice_free (gulong, handlerid);
 }
 
+static GstBuffer *
+kms_http_ep_server_wrap_soup_buffer (SoupBuffer *buffer)
+{
+  /* The GstBuffer keeps a reference on the libsoup data, no copy is done */
+  return gst_buffer_new_wrapped_full (GST_MEMORY_FLAG_READONLY,
+                                      (gpointer) buffer->data, buffer->length,
+                                      0, buffer->length, soup_buffer_copy (buffer),
+                                      (GDestroyNotify) soup_buffer_free);
+}
+
 static void
 got_post_data_cb (KmsHttpPost *post_obj, SoupBuffer *buffer, gpointer data)
 {
+  static guint push_buffer_signal = 0;
   GstElement *httpep = GST_ELEMENT (data);
   GstFlowReturn ret;
   GstBuffer *new_buffer;
-  GstMemory *memory;
-  GstMapInfo info{};
 
-  new_buffer = gst_buffer_new ();
-  memory = gst_allocator_alloc(nullptr, buffer->length, nullptr);
-  gst_buffer_append_memory (new_buffer, memory);
+  if (G_UNLIKELY (push_buffer_signal == 0) ) {
+    push_buffer_signal = g_signal_lookup ("push-buffer",
+                                          G_OBJECT_TYPE (httpep) );
+  }
 
-  gst_buffer_map (new_buffer, &info, GST_MAP_WRITE);
-  memcpy (info.data, buffer->data, info.size);
-  gst_buffer_unmap (new_buffer, &info);
+  new_buffer = kms_http_ep_server_wrap_soup_buffer (buffer);
 
-  g_signal_emit_by_name (httpep, "push-buffer", new_buffer, &ret);
+  g_signal_emit (httpep, push_buffer_signal, 0, new_buffer, &ret);
 
   if (ret != GST_FLOW_OK) {
     /* something wrong */
@@ -343,12 +406,16 @@ finished_post_cb (KmsHttpPost *post_obj, gpointer data)
                GST_ELEMENT_NAME (httpep), ret);
   }
 
+  g_rec_mutex_lock (&sessions_mutex);
+
   param = g_object_steal_qdata (G_OBJECT (httpep), key_message_quark () );
 
   if (SOUP_IS_MESSAGE (param) ) {
     emit_expiration_signal (SOUP_MESSAGE (param), httpep);
     g_object_unref (G_OBJECT (param) );
   }
+
+  g_rec_mutex_unlock (&sessions_mutex);
 }
 
 static void
@@ -482,24 +549,51 @@ kms_http_ep_server_clean_http_end_point (KmsHttpEPServer *self,
 }
 
 static void
-remove_http_end_point_cb (gpointer key, gpointer value, gpointer user_data)
+kms_http_ep_server_remove_handlers (KmsHttpEPServer *self)
 {
-  KmsHttpEPServer *self = KMS_HTTP_EP_SERVER (user_data);
-  GstElement *httpep = GST_ELEMENT (value);
+  GHashTableIter iter;
+  gpointer key, value;
+  GHashTable *handlers;
+  GList *uris, *l;
 
-  kms_http_ep_server_clean_http_end_point (self, httpep);
+  /* Endpoints are cleaned while they are still registered, without */
+  /* holding the table lock as pending messages look them up */
+  handlers = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                    g_object_unref);
 
-  /* Emit removed url signal for each key */
-  emit_removed_url_signal (self, (gchar *) key);
-}
+  g_rw_lock_reader_lock (&self->priv->handlers_lock);
+  g_hash_table_iter_init (&iter, self->priv->handlers);
 
-static void
-kms_http_ep_server_remove_handlers (KmsHttpEPServer *self)
-{
-  g_hash_table_foreach (self->priv->handlers, remove_http_end_point_cb, self);
+  while (g_hash_table_iter_next (&iter, &key, &value) ) {
+    g_hash_table_insert (handlers, g_strdup ( (gchar *) key),
+                         gst_object_ref (value) );
+  }
+
+  g_rw_lock_reader_unlock (&self->priv->handlers_lock);
+
+  g_rec_mutex_lock (&sessions_mutex);
+  g_hash_table_iter_init (&iter, handlers);
+
+  while (g_hash_table_iter_next (&iter, &key, &value) ) {
+    kms_http_ep_server_clean_http_end_point (self, GST_ELEMENT (value) );
+  }
+
+  g_rec_mutex_unlock (&sessions_mutex);
 
   /* Remove handlers */
+  g_rw_lock_writer_lock (&self->priv->handlers_lock);
   g_hash_table_remove_all (self->priv->handlers);
+  g_rw_lock_writer_unlock (&self->priv->handlers_lock);
+
+  /* Emit removed url signal for each key */
+  uris = g_hash_table_get_keys (handlers);
+
+  for (l = uris; l != nullptr; l = l->next) {
+    emit_removed_url_signal (self, (gchar *) l->data);
+  }
+
+  g_list_free (uris);
+  g_hash_table_unref (handlers);
 }
 
 static void
@@ -555,6 +649,82 @@ destroy_tmp_data (struct tmp_data *tdata)
   g_slice_free (struct tmp_data, tdata);
 }
 
+#ifdef KMS_HTTP_EP_SERVER_HAVE_WORKERS
+static gboolean
+kms_http_ep_server_worker_listen (KmsHttpEPServerWorker *worker)
+{
+  GMainContext *ctx;
+  GError *err = nullptr;
+
+  /* Servers listening on a socket use the thread default context, */
+  /* also for the connections they accept */
+  g_object_get (worker->loop, "context", &ctx, NULL);
+  g_main_context_push_thread_default (ctx);
+  g_main_context_unref (ctx);
+
+  if (!soup_server_listen_socket (worker->server, worker->socket,
+                                  (SoupServerListenOptions) 0, &err) ) {
+    GST_ERROR ("Http end point server worker can not listen: %s",
+               err->message);
+    g_error_free (err);
+  }
+
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+kms_http_ep_server_worker_disconnect (KmsHttpEPServerWorker *worker)
+{
+  GMainContext *ctx;
+
+  soup_server_disconnect (worker->server);
+
+  g_object_get (worker->loop, "context", &ctx, NULL);
+  g_main_context_pop_thread_default (ctx);
+  g_main_context_unref (ctx);
+
+  return G_SOURCE_REMOVE;
+}
+#endif
+
+static void
+kms_http_ep_server_stop_workers (KmsHttpEPServer *self)
+{
+#ifdef KMS_HTTP_EP_SERVER_HAVE_WORKERS
+  guint i;
+
+  for (i = 0; i < self->priv->n_workers; i++) {
+    kms_loop_idle_add_full (self->priv->workers[i].loop, G_PRIORITY_HIGH_IDLE,
+                            (GSourceFunc) kms_http_ep_server_worker_disconnect,
+                            &self->priv->workers[i], nullptr);
+  }
+
+#endif
+}
+
+static void
+kms_http_ep_server_free_workers (KmsHttpEPServer *self)
+{
+  guint i;
+
+  if (self->priv->workers == nullptr) {
+    return;
+  }
+
+  /* Stop the threads before releasing what they use */
+  for (i = 0; i < self->priv->n_workers; i++) {
+    g_clear_object (&self->priv->workers[i].loop);
+  }
+
+  for (i = 0; i < self->priv->n_workers; i++) {
+    g_clear_object (&self->priv->workers[i].server);
+    g_clear_object (&self->priv->workers[i].socket);
+  }
+
+  g_free (self->priv->workers);
+  self->priv->workers = nullptr;
+}
+
 static gboolean
 stop_http_ep_server_cb (struct tmp_data *tdata)
 {
@@ -570,7 +740,11 @@ stop_http_ep_server_cb (struct tmp_data *tdata)
   kms_http_ep_server_remove_handlers (tdata->server);
 
   /* Stops processing for server */
-  soup_server_quit (tdata->server->priv->server);
+  if (tdata->server->priv->workers != nullptr) {
+    kms_http_ep_server_stop_workers (tdata->server);
+  } else {
+    soup_server_quit (tdata->server->priv->server);
+  }
 
 end:
 
@@ -603,14 +777,29 @@ kms_http_ep_server_stop_impl (KmsHttpEPServer *self,
                           (GDestroyNotify) destroy_tmp_data);
 }
 
+struct pending_message {
+  SoupMessage *msg;
+  GstElement *httpep;
+};
+
 static void
-destroy_pending_message (SoupMessage *msg)
+free_pending_message (struct pending_message *pending)
 {
-  KmsHttpEPServer *serv = KMS_HTTP_EP_SERVER (g_object_get_qdata (G_OBJECT (msg),
-                          key_http_ep_server_quark () ) );
-  GstElement *httpep = kms_http_ep_server_get_ep_from_msg (serv, msg);
+  /* Remove internal msg reference */
+  g_object_unref (G_OBJECT (pending->msg) );
 
-  GST_DEBUG ("Destroy pending message %" GST_PTR_FORMAT, (gpointer) msg);
+  if (pending->httpep != nullptr) {
+    gst_object_unref (pending->httpep);
+  }
+
+  g_slice_free (struct pending_message, pending);
+}
+
+static gboolean
+finish_pending_message (struct pending_message *pending)
+{
+  SoupMessage *msg = pending->msg;
+  GstElement *httpep = pending->httpep;
 
   if (msg->method == SOUP_METHOD_GET) {
     gulong *handlerid;
@@ -625,7 +814,8 @@ destroy_pending_message (SoupMessage *msg)
                 key_finished_handler_id_quark () );
     g_signal_handler_disconnect (G_OBJECT (msg), *handlerid);
 
-    soup_server_unpause_message (serv->priv->server, msg);
+    soup_server_unpause_message (SOUP_SERVER (g_object_get_qdata (G_OBJECT (msg),
+                                 key_soup_server_quark () ) ), msg);
     soup_message_body_complete (msg->response_body);
 
   } else if (msg->method == SOUP_METHOD_POST) {
@@ -644,8 +834,31 @@ destroy_pending_message (SoupMessage *msg)
   g_object_set_qdata_full(G_OBJECT(msg), key_http_ep_server_quark(), nullptr,
                           nullptr);
 
-  /* Remove internal msg reference */
-  g_object_unref (G_OBJECT (msg) );
+  return G_SOURCE_REMOVE;
+}
+
+static void
+destroy_pending_message (SoupMessage *msg)
+{
+  KmsHttpEPServer *serv = KMS_HTTP_EP_SERVER (g_object_get_qdata (G_OBJECT (msg),
+                          key_http_ep_server_quark () ) );
+  struct pending_message *pending;
+  GMainContext *ctx;
+
+  GST_DEBUG ("Destroy pending message %" GST_PTR_FORMAT, (gpointer) msg);
+
+  /* The endpoint is looked up now, it may be unregistered right after */
+  pending = g_slice_new (struct pending_message);
+  pending->msg = msg;
+  pending->httpep = kms_http_ep_server_get_ep_from_msg (serv, msg);
+
+  /* libsoup is not thread safe, the message can only be finished by the */
+  /* worker serving it. This is done in place when called from it */
+  ctx = (GMainContext *) g_object_get_qdata (G_OBJECT (msg),
+        key_soup_context_quark () );
+  g_main_context_invoke_full (ctx, G_PRIORITY_HIGH_IDLE,
+                              (GSourceFunc) finish_pending_message, pending,
+                              (GDestroyNotify) free_pending_message);
 }
 
 static gboolean
@@ -654,16 +867,21 @@ kms_http_ep_server_register_handler (KmsHttpEPServer *self, gchar *uri,
 {
   GstElement *element;
 
+  g_rw_lock_writer_lock (&self->priv->handlers_lock);
+
   element = (GstElement *) g_hash_table_lookup (self->priv->handlers, uri);
 
   if (element != nullptr) {
     GST_ERROR ("URI %s is already registered for element %s.", uri,
                GST_ELEMENT_NAME (element) );
+    g_rw_lock_writer_unlock (&self->priv->handlers_lock);
     return FALSE;
   }
 
   g_hash_table_insert (self->priv->handlers, uri, g_object_ref (endpoint) );
 
+  g_rw_lock_writer_unlock (&self->priv->handlers_lock);
+
   return TRUE;
 }
 
@@ -777,29 +995,15 @@ kms_http_ep_server_options_handler (KmsHttpEPServer *self, SoupMessage *msg,
   add_access_control_headers (msg);
 }
 
-static void
-got_headers_handler (SoupMessage *msg, gpointer data)
+static gboolean
+kms_http_ep_server_start_session (KmsHttpEPServer *self, GstElement *httpep,
+                                  SoupMessage *msg, const char *path)
 {
-  KmsHttpEndPointAction action = KMS_HTTP_END_POINT_ACTION_UNDEFINED;
-  KmsHttpEPServer *self = KMS_HTTP_EP_SERVER (data);
-  SoupURI *uri = soup_message_get_uri (msg);
-  const char *path = soup_uri_get_path (uri);
-  GstElement *httpep;
-
-  httpep = (GstElement *) g_hash_table_lookup (self->priv->handlers, path);
-
-  if (httpep == nullptr) {
-    /* URI is not registered */
-    soup_message_set_status_full (msg, SOUP_STATUS_NOT_FOUND,
-                                  "Http end point not found");
-    return;
-  }
-
   if (!kms_http_ep_server_manage_cookie_session (self, httpep, msg, path) ) {
     GST_WARNING ("Request declined because of a cookie error");
     soup_message_set_status_full (msg, SOUP_STATUS_BAD_REQUEST,
                                   "Invalid cookie");
-    return;
+    return FALSE;
   }
 
   kms_http_ep_server_remove_timeout (self, httpep);
@@ -815,34 +1019,194 @@ got_headers_handler (SoupMessage *msg, gpointer data)
 
   if (msg->method == SOUP_METHOD_POST) {
     kms_http_ep_server_post_handler (self, msg, httpep);
-    action = KMS_HTTP_END_POINT_ACTION_POST;
+    return TRUE;
   } else if (msg->method == SOUP_METHOD_OPTIONS) {
     kms_http_ep_server_options_handler (self, msg, httpep);
-    return;
+    return FALSE;
   } else {
     GST_WARNING ("HTTP operation %s is not allowed", msg->method);
     soup_message_set_status_full (msg, SOUP_STATUS_METHOD_NOT_ALLOWED,
                                   "Not allowed");
+    return FALSE;
+  }
+}
+
+static void
+got_headers_handler (SoupMessage *msg, gpointer data)
+{
+  KmsHttpEndPointAction action = KMS_HTTP_END_POINT_ACTION_UNDEFINED;
+  KmsHttpEPServer *self = KMS_HTTP_EP_SERVER (data);
+  SoupURI *uri = soup_message_get_uri (msg);
+  const char *path = soup_uri_get_path (uri);
+  GstElement *httpep;
+
+  httpep = kms_http_ep_server_lookup_ep (self, path);
+
+  if (httpep == nullptr) {
+    /* URI is not registered */
+    soup_message_set_status_full (msg, SOUP_STATUS_NOT_FOUND,
+                                  "Http end point not found");
     return;
   }
 
-  g_signal_emit (G_OBJECT (self), obj_signals[ACTION_REQUESTED], 0, path,
-                 action);
+  g_rec_mutex_lock (&sessions_mutex);
+
+  if (kms_http_ep_server_start_session (self, httpep, msg, path) ) {
+    action = KMS_HTTP_END_POINT_ACTION_POST;
+  }
+
+  g_rec_mutex_unlock (&sessions_mutex);
+  gst_object_unref (httpep);
+
+  if (action != KMS_HTTP_END_POINT_ACTION_UNDEFINED) {
+    g_signal_emit (G_OBJECT (self), obj_signals[ACTION_REQUESTED], 0, path,
+                   action);
+  }
 }
 
 static void
 request_started_handler (SoupServer *server, SoupMessage *msg,
                          SoupClientContext *client, gpointer data)
 {
+  KmsHttpEPServer *self = KMS_HTTP_EP_SERVER (data);
+  KmsLoop *loop = self->priv->loop;
+  GMainContext *ctx;
+  guint i;
+
+  /* Messages are served by the worker whose server got them */
+  g_object_set_qdata (G_OBJECT (msg), key_soup_server_quark (), server);
+
+  for (i = 0; self->priv->workers != nullptr && i < self->priv->n_workers;
+       i++) {
+    if (self->priv->workers[i].server == server) {
+      loop = self->priv->workers[i].loop;
+      break;
+    }
+  }
+
+  g_object_get (loop, "context", &ctx, NULL);
+  g_object_set_qdata_full (G_OBJECT (msg), key_soup_context_quark (), ctx,
+                           (GDestroyNotify) g_main_context_unref);
+
   g_signal_connect (msg, "got-headers", G_CALLBACK (got_headers_handler), data);
 }
 
+#ifdef KMS_HTTP_EP_SERVER_HAVE_WORKERS
+static GSocket *
+kms_http_ep_server_create_socket (GInetAddress *inet, guint16 port,
+                                  GError **err)
+{
+  GSocketAddress *addr;
+  GSocket *socket;
+  gboolean ret;
+
+  socket = g_socket_new (g_inet_address_get_family (inet),
+                         G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_TCP, err);
+
+  if (socket == nullptr) {
+    return nullptr;
+  }
+
+  /* All workers bind the same port and the kernel balances connections */
+  addr = g_inet_socket_address_new (inet, port);
+  ret = g_socket_set_option (socket, SOL_SOCKET, SO_REUSEPORT, 1, err) &&
+        g_socket_bind (socket, addr, TRUE, err) && g_socket_listen (socket, err);
+  g_object_unref (addr);
+
+  if (!ret) {
+    g_clear_object (&socket);
+  }
+
+  return socket;
+}
+
+static void
+kms_http_ep_server_create_workers (KmsHttpEPServer *self, SoupAddress *addr)
+{
+  GInetAddress *inet;
+  GError *err = nullptr;
+  guint i;
+
+  if (addr != nullptr) {
+    GSocketAddress *sockaddr = soup_address_get_gsockaddr (addr);
+
+    inet = G_INET_ADDRESS (g_object_ref (g_inet_socket_address_get_address (
+                                           G_INET_SOCKET_ADDRESS (sockaddr) ) ) );
+    g_object_unref (sockaddr);
+  } else {
+    inet = g_inet_address_new_any (G_SOCKET_FAMILY_IPV4);
+  }
+
+  self->priv->workers = g_new0 (KmsHttpEPServerWorker, self->priv->n_workers);
+
+  for (i = 0; i < self->priv->n_workers; i++) {
+    KmsHttpEPServerWorker *worker = &self->priv->workers[i];
+
+    worker->socket = kms_http_ep_server_create_socket (inet, self->priv->port,
+                     &err);
+
+    if (worker->socket == nullptr) {
+      GST_ERROR ("Can not create socket for worker %u: %s", i, err->message);
+      g_error_free (err);
+      kms_http_ep_server_free_workers (self);
+      goto end;
+    }
+
+    if (self->priv->port == 0) {
+      /* Next workers share the port got by the first one */
+      GSocketAddress *local = g_socket_get_local_address (worker->socket,
+                              nullptr);
+
+      self->priv->port =
+        g_inet_socket_address_get_port (G_INET_SOCKET_ADDRESS (local) );
+      g_object_unref (local);
+    }
+
+    /* The first worker runs in the loop also used for registrations */
+    worker->loop = (i == 0) ? KMS_LOOP (g_object_ref (self->priv->loop) ) :
+                   kms_loop_new ();
+    worker->server = soup_server_new (nullptr, NULL);
+    g_signal_connect (worker->server, "request-started",
+                      G_CALLBACK (request_started_handler), self);
+  }
+
+  /* Start listening only once all sockets are bound */
+  for (i = 0; i < self->priv->n_workers; i++) {
+    kms_loop_idle_add_full (self->priv->workers[i].loop, G_PRIORITY_HIGH_IDLE,
+                            (GSourceFunc) kms_http_ep_server_worker_listen,
+                            &self->priv->workers[i], nullptr);
+  }
+
+  self->priv->server = self->priv->workers[0].server;
+
+  if (self->priv->iface == nullptr) {
+    self->priv->iface = g_inet_address_to_string (inet);
+  }
+
+  GST_DEBUG ("Http end point server running in %s:%d with %u workers",
+             self->priv->iface, self->priv->port, self->priv->n_workers);
+
+end:
+  g_object_unref (inet);
+}
+#endif
+
 static void
 kms_http_ep_server_create_server (KmsHttpEPServer *self, SoupAddress *addr)
 {
   SoupSocket *listener;
   GMainContext *ctx;
 
+  if (self->priv->n_workers > 1) {
+#ifdef KMS_HTTP_EP_SERVER_HAVE_WORKERS
+    kms_http_ep_server_create_workers (self, addr);
+    return;
+#else
+    GST_WARNING ("Http end point server workers are not supported by this"
+                 " build, running only one");
+#endif
+  }
+
   g_object_get (self->priv->loop, "context", &ctx, NULL);
   self->priv->server = soup_server_new (SOUP_SERVER_PORT, self->priv->port,
                                         SOUP_SERVER_INTERFACE, addr,
@@ -1092,21 +1456,24 @@ unregister_end_point_cb (struct tmp_unregister_data *tdata)
     goto error;
   }
 
-  if (!g_hash_table_contains (tdata->server->priv->handlers, tdata->uri) ) {
+  httpep = kms_http_ep_server_lookup_ep (tdata->server, tdata->uri);
+
+  if (httpep == nullptr) {
     g_set_error (&gerr, KMS_HTTP_EP_SERVER_ERROR,
                  HTTPEPSERVER_UNEXPECTED_ERROR,
                  "uri not registered");
     goto error;
   }
 
-  httpep = (GstElement *) g_hash_table_lookup (tdata->server->priv->handlers,
-           tdata->uri);
-
-  if (httpep != nullptr) {
-    kms_http_ep_server_clean_http_end_point (tdata->server, httpep);
-  }
+  g_rec_mutex_lock (&sessions_mutex);
+  kms_http_ep_server_clean_http_end_point (tdata->server, httpep);
+  g_rec_mutex_unlock (&sessions_mutex);
 
+  g_rw_lock_writer_lock (&tdata->server->priv->handlers_lock);
   g_hash_table_remove (tdata->server->priv->handlers, tdata->uri);
+  g_rw_lock_writer_unlock (&tdata->server->priv->handlers_lock);
+
+  gst_object_unref (httpep);
 
   if (tdata->cb != nullptr) {
     tdata->cb (tdata->server, gerr, tdata->data);
@@ -1176,6 +1543,17 @@ kms_http_ep_server_finalize (GObject *obj)
   g_free (self->priv->announced_addr);
   g_free (self->priv->got_addr);
 
+  if (self->priv->workers != nullptr) {
+    /* Servers are owned by the workers */
+    kms_http_ep_server_free_workers (self);
+    self->priv->server = nullptr;
+  }
+
+  if (self->priv->sessions_wheel != nullptr) {
+    kms_timer_wheel_free (self->priv->sessions_wheel);
+    self->priv->sessions_wheel = nullptr;
+  }
+
   if (self->priv->loop) {
     g_clear_object (&self->priv->loop);
   }
@@ -1185,6 +1563,8 @@ kms_http_ep_server_finalize (GObject *obj)
     self->priv->handlers = nullptr;
   }
 
+  g_rw_lock_clear (&self->priv->handlers_lock);
+
   if (self->priv->server != nullptr) {
     // soup_server_disconnect (self->priv->server);  g_clear_object -> dispose -> Already does soup_server_disconnect
     g_clear_object (&self->priv->server);
@@ -1231,6 +1611,10 @@ kms_http_ep_server_set_property (GObject *obj, guint prop_id,
     break;
   }
 
+  case PROP_KMS_HTTP_EP_SERVER_WORKERS:
+    self->priv->n_workers = g_value_get_uint (value);
+    break;
+
   default:
     /* We don't have any other property... */
     G_OBJECT_WARN_INVALID_PROPERTY_ID (obj, prop_id, pspec);
@@ -1257,6 +1641,10 @@ kms_http_ep_server_get_property (GObject *obj, guint prop_id, GValue *value,
     g_value_set_string (value, kms_http_ep_server_get_announced_addr (self) );
     break;
 
+  case PROP_KMS_HTTP_EP_SERVER_WORKERS:
+    g_value_set_uint (value, self->priv->n_workers);
+    break;
+
   default:
     /* We don't have any other property... */
     G_OBJECT_WARN_INVALID_PROPERTY_ID (obj, prop_id, pspec);
@@ -1303,6 +1691,16 @@ kms_http_ep_server_class_init (KmsHttpEPServerClass *klass)
                          KMS_HTTP_EP_SERVER_DEFAULT_INTERFACE,
                          (GParamFlags) (G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE) );
 
+  obj_properties[PROP_KMS_HTTP_EP_SERVER_WORKERS] =
+    g_param_spec_uint (KMS_HTTP_EP_SERVER_WORKERS,
+                       "Workers",
+                       "Servers accepting requests on the same port, each one "
+                       "with its own thread",
+                       1,
+                       G_MAXUINT16,
+                       KMS_HTTP_EP_SERVER_DEFAULT_WORKERS,
+                       (GParamFlags) (G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE) );
+
   g_object_class_install_properties (gobject_class,
                                      N_PROPERTIES,
                                      obj_properties);
@@ -1347,11 +1745,16 @@ kms_http_ep_server_init (KmsHttpEPServer *self)
   self->priv->iface = KMS_HTTP_EP_SERVER_DEFAULT_INTERFACE;
   self->priv->announced_addr = KMS_HTTP_EP_SERVER_DEFAULT_ANNOUNCED_ADDRESS;
   self->priv->got_addr = nullptr;
+  self->priv->n_workers = KMS_HTTP_EP_SERVER_DEFAULT_WORKERS;
+  self->priv->workers = nullptr;
   self->priv->handlers = g_hash_table_new_full (g_str_hash, equal_str_key,
                          g_free, g_object_unref);
+  g_rw_lock_init (&self->priv->handlers_lock);
 
   self->priv->rand = g_rand_new();
   self->priv->loop = kms_loop_new ();
+  self->priv->sessions_wheel = kms_timer_wheel_new (self->priv->loop,
+                               SESSION_TIMER_RESOLUTION);
 }
 
 /* Virtual public methods */
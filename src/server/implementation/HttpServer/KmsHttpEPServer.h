@@ -140,5 +140,6 @@ void kms_http_ep_server_unregister_end_point (KmsHttpEPServer * self,
 #define KMS_HTTP_EP_SERVER_PORT "port"
 #define KMS_HTTP_EP_SERVER_INTERFACE "interface"
 #define KMS_HTTP_EP_SERVER_ANNOUNCED_IP "announced-address"
+#define KMS_HTTP_EP_SERVER_WORKERS "workers"
 
 #endif /* __KMS_HTTP_EP_SERVER_H__ */
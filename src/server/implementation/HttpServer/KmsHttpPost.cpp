@@ -43,11 +43,19 @@ typedef struct _KmsHttpPostMultipart {
   ParseState state;
   gchar *tmp_buff;
   guint len;
+  /* "\r\n--boundary" and its Horspool bad character shifts */
+  gchar *delimiter;
+  guint delimiter_len;
+  guint skip[256];
+  /* Fixed window for delimiters split between chunks */
+  gchar *carry;
+  guint carry_len;
 } KmsHttpPostMultipart;
 
 struct _KmsHttpPostPrivate {
   KmsHttpPostMultipart *multipart;
   SoupMessage *msg;
+  SoupBuffer *chunk;
   gulong chunk_id;
   gulong finish_id;
 };
@@ -109,9 +117,19 @@ kms_http_post_concat_previous_buffer (KmsHttpPost *self, const char **start,
 static void
 kms_notify_buffer_data (KmsHttpPost *self, const char *start, const char *end)
 {
+  SoupBuffer *chunk = self->priv->chunk;
   SoupBuffer *buffer;
 
-  buffer = soup_buffer_new (SOUP_MEMORY_STATIC, start, end - start);
+  if (chunk != nullptr && chunk->data <= start &&
+      end <= chunk->data + chunk->length) {
+    /* Share the chunk memory so that receivers can keep a reference */
+    /* to it instead of copying the data */
+    buffer = soup_buffer_new_subbuffer (chunk, start - chunk->data,
+                                        end - start);
+  } else {
+    /* Data joined in the multipart temporary buffer, which is reused */
+    buffer = soup_buffer_new (SOUP_MEMORY_COPY, start, end - start);
+  }
 
   g_signal_emit (G_OBJECT (self), obj_signals[GOT_DATA], 0, buffer);
 
@@ -194,92 +212,169 @@ kms_http_post_skip_preamble (KmsHttpPost *self, const char **start,
   *start = *end;
 }
 
-static void
-kms_http_post_read_until_boundary (KmsHttpPost *self, const char **start,
-                                   const char **end, gboolean ignore)
+static gboolean
+kms_http_post_is_boundary_end (const char *b)
 {
-  const char *boundary = self->priv->multipart->boundary;
-  int boundary_len = strlen (boundary);
-  const char *b;
+  /* "--" closes the multipart body, "\r\n" starts the next part */
+  return (b[0] == '-' && b[1] == '-') || (b[0] == '\r' && b[1] == '\n');
+}
 
-  if (self->priv->multipart->tmp_buff != nullptr) {
-    kms_http_post_concat_previous_buffer (self, start, end);
-  }
+/*
+ * Looks for a delimiter followed by its two closing bytes in [start, end).
+ * Returns it, or nullptr setting @tail to the first byte that could still
+ * begin a delimiter once more data arrives (@end if there is none).
+ */
+static const char *
+kms_http_post_find_delimiter (KmsHttpPostMultipart *multipart,
+                              const char *start, const char *end, const char **tail)
+{
+  const char *delimiter = multipart->delimiter;
+  guint len = multipart->delimiter_len;
+  const char *b = start;
 
-  for (b = (const char *)memchr(*start, '\r', *end - *start); b != nullptr;
-       b = (const char *)memchr(b + 1, '\r', *end - (b + 1))) {
+  while (b + len <= end) {
+    guchar last = b[len - 1];
 
-    if (b + boundary_len + 6 > *end) {
-      /* boundary does not fit in this buffer */
-      gchar *mem = nullptr;
+    if (last == (guchar) delimiter[len - 1] &&
+        memcmp (b, delimiter, len - 1) == 0) {
+      if (b + len + 2 > end) {
+        break;
+      }
 
-      if (self->priv->multipart->tmp_buff != nullptr) {
-        mem = self->priv->multipart->tmp_buff;
+      if (kms_http_post_is_boundary_end (b + len) ) {
+        return b;
       }
+    }
 
-      self->priv->multipart->tmp_buff = (gchar *) g_memdup (b, *end - b);
-      self->priv->multipart->len = *end - b;
+    b += multipart->skip[last];
+  }
 
-      /* Notify data read so far */
-      if (!ignore && *start < b) {
-        kms_notify_buffer_data (self, *start, b );
-      }
+  /* Skipped positions can not hold a partial delimiter either */
+  if (b > end) {
+    b = end;
+  }
 
-      if (mem != nullptr) {
-        g_free (mem);
-      }
+  for (b = (const char *) memchr (b, '\r', end - b); b != nullptr;
+       b = (const char *) memchr (b + 1, '\r', end - (b + 1) ) ) {
+    gsize avail = end - b;
 
-      /* Move start pointer up to the end */
-      *start = *end;
-      return;
+    if (memcmp (b, delimiter, MIN (avail, len) ) == 0 &&
+        (avail <= len || b[len] == '-' || b[len] == '\r') ) {
+      break;
     }
+  }
+
+  *tail = (b != nullptr) ? b : end;
 
-    /* Check for "\r\n--boundary" */
-    if (b[1] != '\n' || b[2] != '-' || b[3] != '-' ||
-        memcmp (b + 4, boundary, boundary_len) != 0) {
-      continue;
+  return nullptr;
+}
+
+static void
+kms_http_post_found_delimiter (KmsHttpPost *self, const char *b)
+{
+  if (b[self->priv->multipart->delimiter_len] == '\r') {
+    /* End of this body part */
+    self->priv->multipart->state = MULTIPART_READ_HEADERS;
+  } else {
+    /* Double hyphens at the end of the boundary marks the end */
+    /* of the multipart post requets */
+    self->priv->multipart->state = MULTIPART_FINISHED;
+  }
+}
+
+static gboolean
+kms_http_post_read_carry (KmsHttpPost *self, const char **start,
+                          const char **end, gboolean ignore)
+{
+  KmsHttpPostMultipart *multipart = self->priv->multipart;
+  guint len = MIN ( (gsize) (*end - *start), multipart->delimiter_len + 1);
+  const char *b, *tail;
+
+  /* Enough data to know whether a delimiter starts in the carried bytes */
+  memcpy (multipart->carry + multipart->carry_len, *start, len);
+  b = kms_http_post_find_delimiter (multipart, multipart->carry,
+                                    multipart->carry + multipart->carry_len + len, &tail);
+
+  if (b != nullptr) {
+    if (!ignore && multipart->carry < b) {
+      kms_notify_buffer_data (self, multipart->carry, b);
     }
 
-    /* Check for "--" or "\r\n" after boundary */
-    if ( (b[boundary_len + 4] == '-' && b[boundary_len + 5] == '-') ||
-         (b[boundary_len + 4] == '\r' && b[boundary_len + 5] == '\n') ) {
+    kms_http_post_found_delimiter (self, b);
+    *start += b + multipart->delimiter_len + 2 -
+              (multipart->carry + multipart->carry_len);
+    multipart->carry_len = 0;
 
-      if (b[boundary_len + 4] == '\r' && b[boundary_len + 5] == '\n') {
-        /* End of this body part */
-        self->priv->multipart->state = MULTIPART_READ_HEADERS;
-      } else {
-        /* Double hyphens at the end of the boundary marks the end */
-        /* of the multipart post requets */
-        self->priv->multipart->state = MULTIPART_FINISHED;
-      }
+    return TRUE;
+  }
 
-      /* Notify data read so far */
-      if (!ignore && *start < b) {
-        kms_notify_buffer_data (self, *start, b);
-      }
+  if (len < (gsize) (*end - *start) ) {
+    /* Carried bytes are data, the rest is scanned from the chunk */
+    if (!ignore) {
+      kms_notify_buffer_data (self, multipart->carry,
+                              multipart->carry + multipart->carry_len);
+    }
 
-      if (*end <= b + boundary_len + 6) {
-        /* Free temporal buffer */
-        break;
-      }
+    multipart->carry_len = 0;
 
-      *start = b + boundary_len + 6;
-      return;
+    return FALSE;
+  }
+
+  /* The whole chunk fitted in the window */
+  if (!ignore && multipart->carry < tail) {
+    kms_notify_buffer_data (self, multipart->carry, tail);
+  }
+
+  multipart->carry_len = multipart->carry + multipart->carry_len + len - tail;
+  memmove (multipart->carry, tail, multipart->carry_len);
+  *start = *end;
+
+  return TRUE;
+}
+
+static void
+kms_http_post_read_until_boundary (KmsHttpPost *self, const char **start,
+                                   const char **end, gboolean ignore)
+{
+  KmsHttpPostMultipart *multipart = self->priv->multipart;
+  const char *b, *tail;
+
+  if (multipart->carry_len > 0 &&
+      kms_http_post_read_carry (self, start, end, ignore) ) {
+    goto end;
+  }
+
+  b = kms_http_post_find_delimiter (multipart, *start, *end, &tail);
+
+  if (b != nullptr) {
+    /* Notify data read so far */
+    if (!ignore && *start < b) {
+      kms_notify_buffer_data (self, *start, b);
     }
+
+    kms_http_post_found_delimiter (self, b);
+    *start = b + multipart->delimiter_len + 2;
+    goto end;
   }
 
   /* Notify data */
-  if (!ignore && b == nullptr) {
-    kms_notify_buffer_data (self, *start, *end);
+  if (!ignore && *start < tail) {
+    kms_notify_buffer_data (self, *start, tail);
   }
 
-  if (self->priv->multipart->tmp_buff != nullptr) {
-    g_free (self->priv->multipart->tmp_buff);
-    self->priv->multipart->tmp_buff = nullptr;
-  }
+  /* Keep what could be the beginning of a delimiter */
+  multipart->carry_len = *end - tail;
+  memcpy (multipart->carry, tail, multipart->carry_len);
 
   /* Move start pointer up to the end */
   *start = *end;
+
+end:
+
+  if (*start == *end && multipart->tmp_buff != nullptr) {
+    g_free (multipart->tmp_buff);
+    multipart->tmp_buff = nullptr;
+  }
 }
 
 static void
@@ -516,6 +611,8 @@ got_chunk_cb (SoupMessage *msg, SoupBuffer *chunk, gpointer data)
 {
   KmsHttpPost *self = KMS_HTTP_POST (data);
 
+  self->priv->chunk = chunk;
+
   if (self->priv->multipart != nullptr) {
     /* Extract data from body parts */
     kms_http_post_parse_multipart_data (self, chunk->data,
@@ -525,6 +622,8 @@ got_chunk_cb (SoupMessage *msg, SoupBuffer *chunk, gpointer data)
     /* provided as it is without any further processing */
     kms_notify_buffer_data (self, chunk->data, chunk->data + chunk->length);
   }
+
+  self->priv->chunk = nullptr;
 }
 
 static void
@@ -541,6 +640,8 @@ kms_http_post_destroy_multipart (KmsHttpPost *self)
   }
 
   g_free (self->priv->multipart->tmp_buff);
+  g_free (self->priv->multipart->delimiter);
+  g_free (self->priv->multipart->carry);
 
   g_slice_free (KmsHttpPostMultipart, self->priv->multipart);
   self->priv->multipart = nullptr;
@@ -559,6 +660,28 @@ kms_http_post_init_multipart (KmsHttpPost *self)
     soup_message_headers_new (SOUP_MESSAGE_HEADERS_MULTIPART);
 }
 
+static void
+kms_http_post_init_delimiter (KmsHttpPost *self)
+{
+  KmsHttpPostMultipart *multipart = self->priv->multipart;
+  guint i, len;
+
+  multipart->delimiter = g_strconcat ("\r\n--", multipart->boundary, NULL);
+  multipart->delimiter_len = len = strlen (multipart->delimiter);
+
+  for (i = 0; i < G_N_ELEMENTS (multipart->skip); i++) {
+    multipart->skip[i] = len;
+  }
+
+  for (i = 0; i < len - 1; i++) {
+    multipart->skip[ (guchar) multipart->delimiter[i]] = len - 1 - i;
+  }
+
+  /* Carried bytes plus the ones needed to check them */
+  multipart->carry = (gchar *) g_malloc (2 * (len + 1) );
+  multipart->carry_len = 0;
+}
+
 static void
 kms_http_post_release_message (KmsHttpPost *self)
 {
@@ -620,6 +743,8 @@ kms_http_post_configure_msg (KmsHttpPost *self)
         soup_message_set_status (self->priv->msg, SOUP_STATUS_NOT_ACCEPTABLE);
         goto end;
       }
+
+      kms_http_post_init_delimiter (self);
     } else {
       GST_WARNING ("Unsupported multipart format: %s", content_type);
       soup_message_set_status (self->priv->msg, SOUP_STATUS_NOT_ACCEPTABLE);
@@ -83,6 +83,8 @@ struct _KmsHttpPostClass
   GObjectClass parent_class;
 
   /* signal callbacks */
+  /* got-data buffers can be kept with soup_buffer_copy (), which only */
+  /* takes a reference on the received data */
   void (*got_data) (KmsHttpPost * self, SoupBuffer *buffer);
   void (*finished) (KmsHttpPost * self);
 };
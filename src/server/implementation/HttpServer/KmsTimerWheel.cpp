@@ -0,0 +1,335 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "KmsTimerWheel.h"
+
+/* Four levels of 64 slots, each slot of a level spans a full turn of */
+/* the level below it */
+#define WHEEL_BITS 6
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS 4
+
+/* Longer timeouts are clamped, the last level must never be armed in */
+/* the slot that is currently turning */
+#define WHEEL_MAX_TICKS \
+  ((guint64) WHEEL_MASK << (WHEEL_BITS * (WHEEL_LEVELS - 1)))
+
+typedef struct _KmsTimerWheelEntry {
+  guint id;
+  guint64 expires;
+  GSourceFunc function;
+  gpointer data;
+  GDestroyNotify notify;
+  /* Slot holding the entry, nullptr once it is due */
+  GQueue *slot;
+  GList link;
+  gboolean cancelled;
+} KmsTimerWheelEntry;
+
+struct _KmsTimerWheel {
+  GMutex mutex;
+  KmsLoop *loop;
+  guint resolution;
+  gint64 start;
+  /* Next tick to be processed */
+  guint64 now;
+  GQueue slots[WHEEL_LEVELS][WHEEL_SIZE];
+  GHashTable *entries;
+  guint last_id;
+  guint source_id;
+};
+
+static guint64
+kms_timer_wheel_get_clock (KmsTimerWheel *wheel)
+{
+  return (g_get_monotonic_time () - wheel->start) /
+         ( (gint64) wheel->resolution * 1000);
+}
+
+static void
+kms_timer_wheel_destroy_entry (KmsTimerWheelEntry *entry)
+{
+  if (entry->notify != nullptr) {
+    entry->notify (entry->data);
+  }
+
+  g_slice_free (KmsTimerWheelEntry, entry);
+}
+
+static void
+kms_timer_wheel_place (KmsTimerWheel *wheel, KmsTimerWheelEntry *entry)
+{
+  guint64 delta;
+  guint level;
+
+  if (entry->expires < wheel->now) {
+    entry->expires = wheel->now;
+  }
+
+  delta = entry->expires - wheel->now;
+
+  if (delta > WHEEL_MAX_TICKS) {
+    entry->expires = wheel->now + WHEEL_MAX_TICKS;
+    delta = WHEEL_MAX_TICKS;
+  }
+
+  for (level = 0; level < WHEEL_LEVELS - 1; level++) {
+    if (delta < ( (guint64) 1 << (WHEEL_BITS * (level + 1) ) ) ) {
+      break;
+    }
+  }
+
+  entry->slot = &wheel->slots[level][ (entry->expires >> (WHEEL_BITS * level) )
+                                      & WHEEL_MASK];
+  g_queue_push_tail_link (entry->slot, &entry->link);
+}
+
+static void
+kms_timer_wheel_cascade (KmsTimerWheel *wheel, guint level, guint index)
+{
+  GQueue pending = wheel->slots[level][index];
+  GList *l;
+
+  g_queue_init (&wheel->slots[level][index]);
+
+  /* Entries move to a lower level as their expiration gets closer */
+  while ( (l = g_queue_pop_head_link (&pending) ) != nullptr) {
+    kms_timer_wheel_place (wheel, (KmsTimerWheelEntry *) l->data);
+  }
+}
+
+static void
+kms_timer_wheel_step (KmsTimerWheel *wheel, GQueue *due)
+{
+  guint index = wheel->now & WHEEL_MASK;
+  GQueue *slot = &wheel->slots[0][index];
+  GList *l;
+
+  if (index == 0) {
+    guint level;
+
+    for (level = 1; level < WHEEL_LEVELS; level++) {
+      guint i = (wheel->now >> (WHEEL_BITS * level) ) & WHEEL_MASK;
+
+      kms_timer_wheel_cascade (wheel, level, i);
+
+      if (i != 0) {
+        break;
+      }
+    }
+  }
+
+  while ( (l = g_queue_pop_head_link (slot) ) != nullptr) {
+    ( (KmsTimerWheelEntry *) l->data)->slot = nullptr;
+    g_queue_push_tail_link (due, l);
+  }
+
+  wheel->now++;
+}
+
+static gboolean
+kms_timer_wheel_tick (KmsTimerWheel *wheel)
+{
+  GQueue due = G_QUEUE_INIT;
+  guint64 clock;
+  gboolean ret;
+  GList *l;
+
+  g_mutex_lock (&wheel->mutex);
+
+  clock = kms_timer_wheel_get_clock (wheel);
+
+  /* Catch up if the loop was late */
+  while (wheel->now <= clock) {
+    kms_timer_wheel_step (wheel, &due);
+  }
+
+  g_mutex_unlock (&wheel->mutex);
+
+  while ( (l = g_queue_pop_head_link (&due) ) != nullptr) {
+    KmsTimerWheelEntry *entry = (KmsTimerWheelEntry *) l->data;
+    gboolean cancelled;
+
+    g_mutex_lock (&wheel->mutex);
+    cancelled = entry->cancelled;
+
+    if (!cancelled) {
+      g_hash_table_remove (wheel->entries, GUINT_TO_POINTER (entry->id) );
+    }
+
+    g_mutex_unlock (&wheel->mutex);
+
+    if (!cancelled) {
+      entry->function (entry->data);
+    }
+
+    kms_timer_wheel_destroy_entry (entry);
+  }
+
+  g_mutex_lock (&wheel->mutex);
+
+  /* Do not wake up the loop while there is nothing to expire */
+  if (g_hash_table_size (wheel->entries) == 0) {
+    wheel->source_id = 0;
+    ret = G_SOURCE_REMOVE;
+  } else {
+    ret = G_SOURCE_CONTINUE;
+  }
+
+  g_mutex_unlock (&wheel->mutex);
+
+  return ret;
+}
+
+KmsTimerWheel *
+kms_timer_wheel_new (KmsLoop *loop, guint resolution)
+{
+  KmsTimerWheel *wheel = g_slice_new0 (KmsTimerWheel);
+  guint level, i;
+
+  g_mutex_init (&wheel->mutex);
+  wheel->loop = KMS_LOOP (g_object_ref (loop) );
+  wheel->resolution = MAX (resolution, 1);
+  wheel->start = g_get_monotonic_time ();
+  wheel->entries = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+  for (level = 0; level < WHEEL_LEVELS; level++) {
+    for (i = 0; i < WHEEL_SIZE; i++) {
+      g_queue_init (&wheel->slots[level][i]);
+    }
+  }
+
+  return wheel;
+}
+
+void
+kms_timer_wheel_free (KmsTimerWheel *wheel)
+{
+  GList *entries, *l;
+
+  g_mutex_lock (&wheel->mutex);
+
+  if (wheel->source_id != 0) {
+    kms_loop_remove (wheel->loop, wheel->source_id);
+    wheel->source_id = 0;
+  }
+
+  entries = g_hash_table_get_values (wheel->entries);
+  g_hash_table_remove_all (wheel->entries);
+
+  g_mutex_unlock (&wheel->mutex);
+
+  for (l = entries; l != nullptr; l = l->next) {
+    kms_timer_wheel_destroy_entry ( (KmsTimerWheelEntry *) l->data);
+  }
+
+  g_list_free (entries);
+  g_hash_table_unref (wheel->entries);
+  g_object_unref (wheel->loop);
+  g_mutex_clear (&wheel->mutex);
+  g_slice_free (KmsTimerWheel, wheel);
+}
+
+guint
+kms_timer_wheel_add (KmsTimerWheel *wheel, guint interval,
+                     GSourceFunc function, gpointer data, GDestroyNotify notify)
+{
+  KmsTimerWheelEntry *entry;
+  guint64 clock;
+  guint id;
+
+  g_return_val_if_fail (function != nullptr, 0);
+
+  entry = g_slice_new0 (KmsTimerWheelEntry);
+  entry->function = function;
+  entry->data = data;
+  entry->notify = notify;
+  entry->link.data = entry;
+
+  g_mutex_lock (&wheel->mutex);
+
+  clock = kms_timer_wheel_get_clock (wheel);
+
+  if (wheel->source_id == 0) {
+    /* Nothing is armed, the wheel can jump to the current time */
+    wheel->now = clock;
+    wheel->source_id = kms_loop_timeout_add_full (wheel->loop,
+                       G_PRIORITY_DEFAULT, wheel->resolution,
+                       (GSourceFunc) kms_timer_wheel_tick, wheel, nullptr);
+  }
+
+  do {
+    id = ++wheel->last_id;
+  } while (id == 0 ||
+           g_hash_table_contains (wheel->entries, GUINT_TO_POINTER (id) ) );
+
+  entry->id = id;
+
+  /* Round up and count the tick in progress, timeouts never expire early */
+  entry->expires = clock + 1 + (interval + wheel->resolution - 1) /
+                   wheel->resolution;
+  kms_timer_wheel_place (wheel, entry);
+  g_hash_table_insert (wheel->entries, GUINT_TO_POINTER (id), entry);
+
+  g_mutex_unlock (&wheel->mutex);
+
+  return id;
+}
+
+gboolean
+kms_timer_wheel_remove (KmsTimerWheel *wheel, guint id)
+{
+  KmsTimerWheelEntry *entry;
+
+  g_mutex_lock (&wheel->mutex);
+
+  entry = (KmsTimerWheelEntry *) g_hash_table_lookup (wheel->entries,
+          GUINT_TO_POINTER (id) );
+
+  if (entry == nullptr) {
+    g_mutex_unlock (&wheel->mutex);
+    return FALSE;
+  }
+
+  g_hash_table_remove (wheel->entries, GUINT_TO_POINTER (id) );
+
+  if (entry->slot == nullptr) {
+    /* Already due, it is released once the tick gets to it */
+    entry->cancelled = TRUE;
+    g_mutex_unlock (&wheel->mutex);
+    return TRUE;
+  }
+
+  g_queue_unlink (entry->slot, &entry->link);
+  g_mutex_unlock (&wheel->mutex);
+
+  kms_timer_wheel_destroy_entry (entry);
+
+  return TRUE;
+}
+
+guint
+kms_timer_wheel_get_size (KmsTimerWheel *wheel)
+{
+  guint size;
+
+  g_mutex_lock (&wheel->mutex);
+  size = g_hash_table_size (wheel->entries);
+  g_mutex_unlock (&wheel->mutex);
+
+  return size;
+}
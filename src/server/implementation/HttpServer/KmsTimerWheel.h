@@ -0,0 +1,45 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/* inclusion guard */
+#ifndef __KMS_TIMER_WHEEL_H__
+#define __KMS_TIMER_WHEEL_H__
+
+#include <glib.h>
+#include <commons/kmsloop.h>
+
+/*
+ * Hierarchical timer wheel driving many one-shot timeouts from a single
+ * periodic source attached to @loop. Adding and removing a timeout are
+ * O(1) and can be done from any thread; callbacks are dispatched in the
+ * loop thread, rounded up to the wheel resolution. The periodic source
+ * only exists while there are timeouts armed.
+ */
+typedef struct _KmsTimerWheel KmsTimerWheel;
+
+KmsTimerWheel * kms_timer_wheel_new (KmsLoop * loop, guint resolution);
+void kms_timer_wheel_free (KmsTimerWheel * wheel);
+
+/* Returns an id greater than 0. The value returned by @function is */
+/* ignored, timeouts are always removed once dispatched */
+guint kms_timer_wheel_add (KmsTimerWheel * wheel, guint interval,
+    GSourceFunc function, gpointer data, GDestroyNotify notify);
+gboolean kms_timer_wheel_remove (KmsTimerWheel * wheel, guint id);
+
+guint kms_timer_wheel_get_size (KmsTimerWheel * wheel);
+
+#endif /* __KMS_TIMER_WHEEL_H__ */
@@ -29,6 +29,7 @@ GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
 static const std::string HTTP_SERVICE_ADDRESS = "serverAddress";
 static const std::string HTTP_SERVICE_PORT = "serverPort";
 static const std::string HTTP_SERVICE_ANNOUNCED_ADDRESS = "announcedAddress";
+static const std::string HTTP_SERVICE_WORKERS = "serverWorkers";
 
 namespace kurento
 {
@@ -332,8 +333,12 @@ HttpEndpointImpl::HttpEndpointImpl (const boost::property_tree::ptree &conf,
   getConfigValue <std::string, HttpEndpoint> (&httpServiceAnnouncedAddress,
       HTTP_SERVICE_ANNOUNCED_ADDRESS, std::string());
 
+  uint httpServiceWorkers = 0;
+  getConfigValue <uint, HttpEndpoint> (&httpServiceWorkers,
+      HTTP_SERVICE_WORKERS, HttpEndPointServer::DEFAULT_WORKERS);
+
   server = HttpEndPointServer::getHttpEndPointServer (httpServicePort,
-      httpServiceAddress, httpServiceAnnouncedAddress);
+      httpServiceAddress, httpServiceAnnouncedAddress, httpServiceWorkers);
 
   if (server == nullptr) {
     throw KurentoException (HTTP_END_POINT_REGISTRATION_ERROR ,
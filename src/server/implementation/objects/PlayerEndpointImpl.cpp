@@ -35,8 +35,12 @@ GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
 #define POSITION "position"
 #define PIPELINE "pipeline"
 #define SET_POSITION "set-position"
+#define ENQUEUE_URI "enqueue-uri"
 #define NS_TO_MS 1000000
 #define RTSP_CLIENT_PORT_RANGE "rtspClientPortRange"
+#define SHARED_SOURCES "sharedSources"
+#define CLIP_CACHE_MEMORY_LIMIT "clipCacheMemoryLimit"
+#define MIB (1024 * 1024)
 
 namespace kurento
 {
@@ -104,19 +108,32 @@ void PlayerEndpointImpl::postConstructor()
 PlayerEndpointImpl::PlayerEndpointImpl (const boost::property_tree::ptree &conf,
                                         std::shared_ptr<MediaPipeline>
                                         mediaPipeline, const std::string &uri,
-                                        bool useEncodedMedia, int networkCache) : UriEndpointImpl (conf,
+                                        bool useEncodedMedia, int networkCache,
+                                        bool asFastAsPossible) : UriEndpointImpl (conf,
                                               std::dynamic_pointer_cast<MediaObjectImpl> (mediaPipeline), FACTORY_NAME, uri)
 {
   GstElement *element = getGstreamerElement();
 
   g_object_set (G_OBJECT (element), "use-encoded-media", useEncodedMedia,
-                "network-cache", networkCache, NULL);
+                "network-cache", networkCache, "sync", !asFastAsPossible, NULL);
 
   std::string portRange;
   if (getConfigValue <std::string, PlayerEndpoint> (&portRange,
       RTSP_CLIENT_PORT_RANGE)) {
     g_object_set (G_OBJECT (element), "port-range", portRange.c_str(), NULL);
   }
+
+  bool sharedSources = false;
+  getConfigValue <bool, PlayerEndpoint> (&sharedSources, SHARED_SOURCES,
+      false);
+  g_object_set (G_OBJECT (element), "shared-source", sharedSources, NULL);
+
+  int clipCacheMemoryLimit;
+  if (getConfigValue <int, PlayerEndpoint> (&clipCacheMemoryLimit,
+      CLIP_CACHE_MEMORY_LIMIT) && clipCacheMemoryLimit > 0) {
+    g_object_set (G_OBJECT (element), "clip-cache-size",
+                  (guint64) clipCacheMemoryLimit * MIB, NULL);
+  }
 }
 
 PlayerEndpointImpl::~PlayerEndpointImpl()
@@ -195,14 +212,26 @@ void PlayerEndpointImpl::play ()
   start();
 }
 
+void PlayerEndpointImpl::enqueue (const std::string &uri)
+{
+  gboolean ret;
+
+  g_signal_emit_by_name (element, ENQUEUE_URI, uri.c_str (), &ret);
+
+  if (!ret) {
+    throw KurentoException (MEDIA_OBJECT_ILLEGAL_PARAM_ERROR,
+                            "Cannot enqueue URI: " + uri);
+  }
+}
+
 MediaObjectImpl *
 PlayerEndpointImplFactory::createObject (const boost::property_tree::ptree
     &conf,
     std::shared_ptr<MediaPipeline> mediaPipeline, const std::string &uri,
-    bool useEncodedMedia, int networkCache) const
+    bool useEncodedMedia, int networkCache, bool asFastAsPossible) const
 {
   return new PlayerEndpointImpl (conf, mediaPipeline, uri, useEncodedMedia,
-                                 networkCache);
+                                 networkCache, asFastAsPossible);
 }
 
 PlayerEndpointImpl::StaticConstructor PlayerEndpointImpl::staticConstructor;
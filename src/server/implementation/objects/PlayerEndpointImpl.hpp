@@ -39,12 +39,15 @@ public:
 
   PlayerEndpointImpl (const boost::property_tree::ptree &conf,
                       std::shared_ptr<MediaPipeline> mediaPipeline, const std::string &uri,
-                      bool useEncodedMedia, int networkCache);
+                      bool useEncodedMedia, int networkCache,
+                      bool asFastAsPossible);
 
   virtual ~PlayerEndpointImpl ();
 
   void play () override;
 
+  void enqueue (const std::string &uri) override;
+
   virtual std::shared_ptr<VideoInfo> getVideoInfo () override;
 
   virtual int64_t getPosition() override;
@@ -43,6 +43,32 @@ GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
 #define PARAM_GAPS_FIX "gapsFix"
 #define PROP_GAPS_FIX "gaps-fix"
 
+#define PARAM_QUEUE_MEMORY_LIMIT "queueMemoryLimit"
+#define PARAM_QUEUE_SPILL_LIMIT "queueSpillLimit"
+#define PARAM_QUEUE_SPILL_DIR "queueSpillDir"
+#define PROP_MAX_QUEUE_BYTES "max-queue-bytes"
+#define PROP_MAX_SPILL_BYTES "max-spill-bytes"
+#define PROP_SPILL_DIR "spill-dir"
+#define PARAM_MP4_FRAGMENT_DURATION "mp4FragmentDuration"
+#define PROP_MP4_FRAGMENT_DURATION "mp4-fragment-duration"
+#define PARAM_SEGMENT_DURATION "segmentDuration"
+#define PARAM_SEGMENT_MAX_SIZE "segmentMaxSize"
+#define PROP_SEGMENT_DURATION "segment-duration"
+#define PROP_MAX_SEGMENT_BYTES "max-segment-bytes"
+#define PARAM_FILE_DIRECT_IO "fileDirectIo"
+#define PARAM_FILE_WRITE_SIZE "fileWriteSize"
+#define PARAM_FILE_EXPECTED_BITRATE "fileExpectedBitrate"
+#define PARAM_FILE_FLUSH_POLICY "fileFlushPolicy"
+#define PARAM_S3_PART_SIZE "s3PartSize"
+#define PARAM_S3_MAX_UPLOADS "s3MaxUploads"
+#define PARAM_S3_MAX_PENDING_PARTS "s3MaxPendingParts"
+#define PARAM_S3_MAX_RETRIES "s3MaxRetries"
+#define PROP_SINK_PROPERTIES "sink-properties"
+#define PARAM_MUXING_PIPELINES "muxingPipelines"
+#define PROP_MUXING_PIPELINES "muxing-pipelines"
+
+#define MIB (1024 * 1024)
+
 #define TIMEOUT 4 /* seconds */
 
 namespace kurento
@@ -75,11 +101,153 @@ RecorderEndpointImpl::RecorderEndpointImpl (const boost::property_tree::ptree
     &conf,
     std::shared_ptr<MediaPipeline> mediaPipeline, const std::string &uri,
     std::shared_ptr<MediaProfileSpecType> mediaProfile,
-    bool stopOnEndOfStream) : UriEndpointImpl (conf,
+    bool stopOnEndOfStream, bool avoidTranscoding) : UriEndpointImpl (conf,
           std::dynamic_pointer_cast<MediaObjectImpl> (mediaPipeline), FACTORY_NAME, uri)
 {
   g_object_set (G_OBJECT (getGstreamerElement() ), "accept-eos",
-                stopOnEndOfStream, NULL);
+                stopOnEndOfStream, "passthrough", avoidTranscoding, NULL);
+
+  // Queue limits are read by the muxer, so they go before the profile
+  int queueMemoryLimit;
+  if (getConfigValue<int, RecorderEndpoint> (&queueMemoryLimit,
+      PARAM_QUEUE_MEMORY_LIMIT) && queueMemoryLimit >= 0) {
+    GST_INFO ("Set RecorderEndpoint queue memory limit: %d MiB",
+        queueMemoryLimit);
+    g_object_set (getGstreamerElement (), PROP_MAX_QUEUE_BYTES,
+        (guint64) queueMemoryLimit * MIB, NULL);
+  }
+
+  int queueSpillLimit;
+  if (getConfigValue<int, RecorderEndpoint> (&queueSpillLimit,
+      PARAM_QUEUE_SPILL_LIMIT) && queueSpillLimit >= 0) {
+    GST_INFO ("Set RecorderEndpoint queue spill limit: %d MiB",
+        queueSpillLimit);
+    g_object_set (getGstreamerElement (), PROP_MAX_SPILL_BYTES,
+        (guint64) queueSpillLimit * MIB, NULL);
+  }
+
+  std::string queueSpillDir;
+  if (getConfigValue<std::string, RecorderEndpoint> (&queueSpillDir,
+      PARAM_QUEUE_SPILL_DIR)) {
+    GST_INFO ("Set RecorderEndpoint queue spill dir: %s",
+        queueSpillDir.c_str ());
+    g_object_set (getGstreamerElement (), PROP_SPILL_DIR,
+        queueSpillDir.c_str (), NULL);
+  }
+
+  int mp4FragmentDuration;
+  if (getConfigValue<int, RecorderEndpoint> (&mp4FragmentDuration,
+      PARAM_MP4_FRAGMENT_DURATION) && mp4FragmentDuration >= 0) {
+    GST_INFO ("Set RecorderEndpoint MP4 fragment duration: %d ms",
+        mp4FragmentDuration);
+    g_object_set (getGstreamerElement (), PROP_MP4_FRAGMENT_DURATION,
+        (guint) mp4FragmentDuration, NULL);
+  }
+
+  int segmentDuration;
+  if (getConfigValue<int, RecorderEndpoint> (&segmentDuration,
+      PARAM_SEGMENT_DURATION) && segmentDuration >= 0) {
+    GST_INFO ("Set RecorderEndpoint segment duration: %d ms",
+        segmentDuration);
+    g_object_set (getGstreamerElement (), PROP_SEGMENT_DURATION,
+        (guint) segmentDuration, NULL);
+  }
+
+  int segmentMaxSize;
+  if (getConfigValue<int, RecorderEndpoint> (&segmentMaxSize,
+      PARAM_SEGMENT_MAX_SIZE) && segmentMaxSize >= 0) {
+    GST_INFO ("Set RecorderEndpoint segment max size: %d MiB",
+        segmentMaxSize);
+    g_object_set (getGstreamerElement (), PROP_MAX_SEGMENT_BYTES,
+        (guint64) segmentMaxSize * MIB, NULL);
+  }
+
+  // Options of the sinks writing local files and S3 objects, each sink
+  // ignores those of the other
+  GstStructure *sinkProperties = gst_structure_new_empty ("sink-properties");
+
+  bool fileDirectIo;
+  if (getConfigValue<bool, RecorderEndpoint> (&fileDirectIo,
+      PARAM_FILE_DIRECT_IO)) {
+    GST_INFO ("Set RecorderEndpoint file direct I/O: %d", fileDirectIo);
+    gst_structure_set (sinkProperties, "direct-io", G_TYPE_BOOLEAN,
+        fileDirectIo, NULL);
+  }
+
+  int fileWriteSize;
+  if (getConfigValue<int, RecorderEndpoint> (&fileWriteSize,
+      PARAM_FILE_WRITE_SIZE) && fileWriteSize > 0) {
+    GST_INFO ("Set RecorderEndpoint file write size: %d KiB", fileWriteSize);
+    gst_structure_set (sinkProperties, "write-size", G_TYPE_UINT,
+        (guint) fileWriteSize * 1024, NULL);
+  }
+
+  int fileExpectedBitrate;
+  if (getConfigValue<int, RecorderEndpoint> (&fileExpectedBitrate,
+      PARAM_FILE_EXPECTED_BITRATE) && fileExpectedBitrate >= 0) {
+    GST_INFO ("Set RecorderEndpoint file expected bitrate: %d bps",
+        fileExpectedBitrate);
+    gst_structure_set (sinkProperties, "expected-bitrate", G_TYPE_UINT,
+        (guint) fileExpectedBitrate, NULL);
+  }
+
+  std::string fileFlushPolicy;
+  if (getConfigValue<std::string, RecorderEndpoint> (&fileFlushPolicy,
+      PARAM_FILE_FLUSH_POLICY)) {
+    GST_INFO ("Set RecorderEndpoint file flush policy: %s",
+        fileFlushPolicy.c_str ());
+    gst_structure_set (sinkProperties, "flush-policy", G_TYPE_STRING,
+        fileFlushPolicy.c_str (), NULL);
+  }
+
+  int s3PartSize;
+  if (getConfigValue<int, RecorderEndpoint> (&s3PartSize,
+      PARAM_S3_PART_SIZE) && s3PartSize > 0) {
+    GST_INFO ("Set RecorderEndpoint S3 part size: %d MiB", s3PartSize);
+    gst_structure_set (sinkProperties, "part-size", G_TYPE_UINT,
+        (guint) s3PartSize * MIB, NULL);
+  }
+
+  int s3MaxUploads;
+  if (getConfigValue<int, RecorderEndpoint> (&s3MaxUploads,
+      PARAM_S3_MAX_UPLOADS) && s3MaxUploads > 0) {
+    GST_INFO ("Set RecorderEndpoint S3 max uploads: %d", s3MaxUploads);
+    gst_structure_set (sinkProperties, "max-uploads", G_TYPE_UINT,
+        (guint) s3MaxUploads, NULL);
+  }
+
+  int s3MaxPendingParts;
+  if (getConfigValue<int, RecorderEndpoint> (&s3MaxPendingParts,
+      PARAM_S3_MAX_PENDING_PARTS) && s3MaxPendingParts > 0) {
+    GST_INFO ("Set RecorderEndpoint S3 max pending parts: %d",
+        s3MaxPendingParts);
+    gst_structure_set (sinkProperties, "max-pending-parts", G_TYPE_UINT,
+        (guint) s3MaxPendingParts, NULL);
+  }
+
+  int s3MaxRetries;
+  if (getConfigValue<int, RecorderEndpoint> (&s3MaxRetries,
+      PARAM_S3_MAX_RETRIES) && s3MaxRetries >= 0) {
+    GST_INFO ("Set RecorderEndpoint S3 max retries: %d", s3MaxRetries);
+    gst_structure_set (sinkProperties, "max-retries", G_TYPE_UINT,
+        (guint) s3MaxRetries, NULL);
+  }
+
+  if (gst_structure_n_fields (sinkProperties) > 0) {
+    g_object_set (getGstreamerElement (), PROP_SINK_PROPERTIES,
+        sinkProperties, NULL);
+  }
+
+  gst_structure_free (sinkProperties);
+
+  // Shared by all recorders, only the value set before the first one counts
+  int muxingPipelines;
+  if (getConfigValue<int, RecorderEndpoint> (&muxingPipelines,
+      PARAM_MUXING_PIPELINES) && muxingPipelines >= 0) {
+    GST_DEBUG ("Set RecorderEndpoint muxing pipelines: %d", muxingPipelines);
+    g_object_set (getGstreamerElement (), PROP_MUXING_PIPELINES,
+        (guint) muxingPipelines, NULL);
+  }
 
   switch (mediaProfile->getValue() ) {
   case MediaProfileSpecType::WEBM:
@@ -348,10 +516,10 @@ RecorderEndpointImplFactory::createObject (const boost::property_tree::ptree
     &conf, std::shared_ptr<MediaPipeline>
     mediaPipeline, const std::string &uri,
     std::shared_ptr<MediaProfileSpecType> mediaProfile,
-    bool stopOnEndOfStream) const
+    bool stopOnEndOfStream, bool avoidTranscoding) const
 {
   return new RecorderEndpointImpl (conf, mediaPipeline, uri, mediaProfile,
-                                   stopOnEndOfStream);
+                                   stopOnEndOfStream, avoidTranscoding);
 }
 
 RecorderEndpointImpl::StaticConstructor RecorderEndpointImpl::staticConstructor;
@@ -40,7 +40,8 @@ public:
 
   RecorderEndpointImpl (const boost::property_tree::ptree &conf,
                         std::shared_ptr<MediaPipeline> mediaPipeline, const std::string &uri,
-                        std::shared_ptr<MediaProfileSpecType> mediaProfile, bool stopOnEndOfStream);
+                        std::shared_ptr<MediaProfileSpecType> mediaProfile, bool stopOnEndOfStream,
+                        bool avoidTranscoding);
 
   virtual ~RecorderEndpointImpl ();
 
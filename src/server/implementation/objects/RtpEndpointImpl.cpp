@@ -24,8 +24,12 @@
 #include <CryptoSuite.hpp>
 #include <SDES.hpp>
 #include <SignalHandler.hpp>
+#include <StatsType.hpp>
+#include <RtpPortPoolStats.hpp>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <rtpendpoint/kmssocketutils.h>
 
 #define GST_CAT_DEFAULT kurento_rtp_endpoint_impl
 GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
@@ -33,6 +37,11 @@ GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
 
 #define FACTORY_NAME "rtpendpoint"
 
+#define PARAM_PORT_QUARANTINE "portQuarantine"
+
+#define PORT_POOL_STATS_FIELD "port-pool"
+#define PORT_POOL_STATS_ID "rtpPortPool"
+
 /* In theory the Master key can be shorter than the maximum length, but
  * the GStreamer's SRTP plugin enforces using the maximum length possible
  * for the type of cypher used (in file 'gstsrtpenc.c'). So, KMS also expects
@@ -43,6 +52,26 @@ GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
 namespace kurento
 {
 
+static std::once_flag port_pool_flag;
+
+void
+RtpEndpointImpl::configurePortPool ()
+{
+  int portQuarantine;
+
+  if (getConfigValue <int, RtpEndpoint> (&portQuarantine,
+                                         PARAM_PORT_QUARANTINE) ) {
+    if (portQuarantine < 0) {
+      GST_WARNING ("Invalid %s value: %d; released ports are reused at once",
+                   PARAM_PORT_QUARANTINE, portQuarantine);
+      return;
+    }
+
+    GST_INFO ("Quarantine of released RTP ports: %d ms", portQuarantine);
+    kms_socket_port_pool_set_quarantine (portQuarantine);
+  }
+}
+
 RtpEndpointImpl::RtpEndpointImpl (const boost::property_tree::ptree &conf,
                                   std::shared_ptr<MediaPipeline> mediaPipeline,
                                   std::shared_ptr<SDES> crypto, bool useIpv6)
@@ -50,6 +79,9 @@ RtpEndpointImpl::RtpEndpointImpl (const boost::property_tree::ptree &conf,
                          std::dynamic_pointer_cast<MediaObjectImpl> (mediaPipeline),
                          FACTORY_NAME, useIpv6)
 {
+  std::call_once (port_pool_flag,
+                  std::bind (&RtpEndpointImpl::configurePortPool, this) );
+
   if (!crypto->isSetCrypto() ) {
     return;
   }
@@ -159,6 +191,40 @@ RtpEndpointImpl::onKeySoftLimit (gchar *media)
   }
 }
 
+void
+RtpEndpointImpl::fillStatsReport (std::map
+                                  <std::string, std::shared_ptr<Stats>>
+                                  &report, const GstStructure *stats,
+                                  double timestamp, int64_t timestampMillis)
+{
+  GstStructure *pool;
+  guint allocated = 0, quarantined = 0, busy = 0;
+  guint64 allocations = 0, failed = 0, bindFailures = 0;
+
+  BaseRtpEndpointImpl::fillStatsReport (report, stats, timestamp,
+                                        timestampMillis);
+
+  if (!gst_structure_get (stats, PORT_POOL_STATS_FIELD, GST_TYPE_STRUCTURE,
+                          &pool, NULL) ) {
+    return;
+  }
+
+  gst_structure_get (pool, "allocated-pairs", G_TYPE_UINT, &allocated,
+                     "quarantined-pairs", G_TYPE_UINT, &quarantined,
+                     "busy-pairs", G_TYPE_UINT, &busy,
+                     "allocations", G_TYPE_UINT64, &allocations,
+                     "failed-allocations", G_TYPE_UINT64, &failed,
+                     "bind-failures", G_TYPE_UINT64, &bindFailures, NULL);
+  gst_structure_free (pool);
+
+  /* The pool is shared by every RtpEndpoint, so is its id */
+  report[PORT_POOL_STATS_ID] = std::make_shared <RtpPortPoolStats>
+                               (PORT_POOL_STATS_ID,
+                                std::make_shared <StatsType> (StatsType::element),
+                                timestamp, timestampMillis, allocated, quarantined, busy,
+                                allocations, failed, bindFailures);
+}
+
 MediaObjectImpl *
 RtpEndpointImplFactory::createObject (const boost::property_tree::ptree &conf,
                                       std::shared_ptr<MediaPipeline> mediaPipeline,
@@ -56,12 +56,17 @@ public:
 
 protected:
   virtual void postConstructor () override;
+  virtual void fillStatsReport (std::map <std::string, std::shared_ptr<Stats>>
+                                &report, const GstStructure *stats,
+                                double timestamp, int64_t timestampMillis) override;
 
 private:
 
   gulong handlerOnKeySoftLimit = 0;
   void onKeySoftLimit (gchar *media);
 
+  void configurePortPool ();
+
   class StaticConstructor
   {
   public:
@@ -29,6 +29,7 @@
 #include <IceComponentState.hpp>
 #include <SignalHandler.hpp>
 #include <webrtcendpoint/kmsicebaseagent.h>
+#include <webrtcendpoint/kmswebrtcloops.h>
 
 #include <StatsType.hpp>
 #include <RTCDataChannelState.hpp>
@@ -59,6 +60,7 @@ GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
 #define PARAM_EXTERNAL_IPV6 "externalIPv6"
 #define PARAM_NETWORK_INTERFACES "networkInterfaces"
 #define PARAM_ICE_TCP "iceTcp"
+#define PARAM_EVENT_LOOP_THREADS "eventLoopThreads"
 
 #define PROP_EXTERNAL_ADDRESS "external-address"
 #define PROP_EXTERNAL_IPV4 "external-ipv4"
@@ -73,7 +75,7 @@ namespace kurento
 
 static const uint DEFAULT_STUN_PORT = 3478;
 
-static std::once_flag check_openh264, certificates_flag;
+static std::once_flag check_openh264, certificates_flag, event_loops_flag;
 static std::string defaultCertificateRSA, defaultCertificateECDSA;
 
 // "H264" gets added at runtime by check_support_for_h264()
@@ -180,6 +182,28 @@ WebRtcEndpointImpl::generateDefaultCertificates ()
   }
 }
 
+void
+WebRtcEndpointImpl::configureEventLoops ()
+{
+  int eventLoopThreads;
+
+  if (getConfigValue <int, WebRtcEndpoint> (&eventLoopThreads,
+      PARAM_EVENT_LOOP_THREADS)) {
+    if (eventLoopThreads < 0) {
+      GST_WARNING ("Invalid %s value: %d; using one thread per CPU core",
+                   PARAM_EVENT_LOOP_THREADS, eventLoopThreads);
+      return;
+    }
+
+    GST_INFO ("Event loop threads for WebRtcEndpoints: %d%s", eventLoopThreads,
+              eventLoopThreads == 0 ? " (one dedicated thread per endpoint)" : "");
+    kms_webrtc_loops_set_size (eventLoopThreads);
+  } else {
+    GST_DEBUG ("Event loop threads not found in config;"
+               " using one thread per CPU core (%u)", kms_webrtc_loops_get_size () );
+  }
+}
+
 void WebRtcEndpointImpl::checkUri (std::string &uri)
 {
   //Check if uri is an absolute or relative path.
@@ -629,6 +653,8 @@ WebRtcEndpointImpl::WebRtcEndpointImpl (const boost::property_tree::ptree &conf,
   std::call_once (check_openh264, check_support_for_h264);
   std::call_once (certificates_flag,
                   std::bind (&WebRtcEndpointImpl::generateDefaultCertificates, this) );
+  std::call_once (event_loops_flag,
+                  std::bind (&WebRtcEndpointImpl::configureEventLoops, this) );
 
   this->qosDscp = qosDscp;
   if (qosDscp->getValue () == DSCPValue::NO_VALUE) {
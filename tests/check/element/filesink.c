@@ -0,0 +1,331 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/check/gstcheck.h>
+#include <gst/gst.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <string.h>
+
+/* Not a multiple of the block size, so writes get unaligned */
+#define BUFFER_SIZE 3000
+#define N_BUFFERS 20
+
+static gboolean
+bus_msg (GstBus * bus, GstMessage * msg, gpointer data)
+{
+  GstMessageType *type = data;
+
+  switch (GST_MESSAGE_TYPE (msg)) {
+    case GST_MESSAGE_EOS:
+    case GST_MESSAGE_ERROR:
+      *type = GST_MESSAGE_TYPE (msg);
+      break;
+    default:
+      break;
+  }
+
+  return TRUE;
+}
+
+static void
+write_buffers (const gchar * location, const gchar * flush_policy)
+{
+  GstElement *pipeline, *appsrc, *sink;
+  GstMessageType type = GST_MESSAGE_UNKNOWN;
+  GstFlowReturn ret;
+  GstBus *bus;
+  guint i;
+
+  pipeline = gst_pipeline_new (__FUNCTION__);
+  appsrc = gst_element_factory_make ("appsrc", NULL);
+  sink = gst_element_factory_make ("kmsfilesink", NULL);
+
+  g_object_set (sink, "location", location, "write-size", 8192,
+      "expected-bitrate", 1000000, NULL);
+  gst_util_set_object_arg (G_OBJECT (sink), "flush-policy", flush_policy);
+
+  gst_bin_add_many (GST_BIN (pipeline), appsrc, sink, NULL);
+  fail_unless (gst_element_link (appsrc, sink));
+
+  bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+  gst_bus_add_watch (bus, bus_msg, &type);
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  for (i = 0; i < N_BUFFERS; i++) {
+    GstBuffer *buffer = gst_buffer_new_allocate (NULL, BUFFER_SIZE, NULL);
+
+    gst_buffer_memset (buffer, 0, i, BUFFER_SIZE);
+    g_signal_emit_by_name (appsrc, "push-buffer", buffer, &ret);
+    gst_buffer_unref (buffer);
+  }
+
+  g_signal_emit_by_name (appsrc, "end-of-stream", &ret);
+
+  while (type == GST_MESSAGE_UNKNOWN) {
+    g_main_context_iteration (NULL, TRUE);
+  }
+
+  fail_unless (type == GST_MESSAGE_EOS);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_bus_remove_watch (bus);
+  g_object_unref (bus);
+  g_object_unref (pipeline);
+}
+
+static void
+check_file (const gchar * location)
+{
+  gchar *contents;
+  gsize length, i;
+
+  fail_unless (g_file_get_contents (location, &contents, &length, NULL));
+
+  /* Preallocated space is released and the data kept in order */
+  fail_unless (length == N_BUFFERS * BUFFER_SIZE);
+
+  for (i = 0; i < length; i++) {
+    fail_unless (contents[i] == i / BUFFER_SIZE);
+  }
+
+  g_free (contents);
+}
+
+GST_START_TEST (check_batched_writes)
+{
+  const gchar *policies[] = { "none", "steady", "eos" };
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (policies); i++) {
+    gchar *location;
+    gint fd;
+
+    fd = g_file_open_tmp ("filesink-XXXXXX", &location, NULL);
+    fail_unless (fd >= 0);
+    g_close (fd, NULL);
+
+    GST_INFO ("Writing to %s, flush policy %s", location, policies[i]);
+    write_buffers (location, policies[i]);
+    check_file (location);
+
+    g_unlink (location);
+    g_free (location);
+  }
+}
+
+GST_END_TEST;
+
+/* Same as muxers rewriting a header once the rest is written */
+#define PATCH_OFFSET 5000
+#define PATCH_SIZE 100
+#define PATCH_BYTE 0x7f
+
+static void
+push_segment (GstElement * appsrc, guint64 offset)
+{
+  GstSegment segment;
+  GstPad *srcpad;
+
+  gst_segment_init (&segment, GST_FORMAT_BYTES);
+  segment.start = offset;
+  segment.time = offset;
+
+  srcpad = gst_element_get_static_pad (appsrc, "src");
+  fail_unless (gst_pad_push_event (srcpad, gst_event_new_segment (&segment)));
+  g_object_unref (srcpad);
+}
+
+static GstPadProbeReturn
+patch_header (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  GstElement *appsrc = user_data;
+  GstBuffer *buffer;
+  GstFlowReturn ret;
+
+  if (GST_EVENT_TYPE (GST_PAD_PROBE_INFO_EVENT (info)) != GST_EVENT_EOS) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  push_segment (appsrc, PATCH_OFFSET);
+
+  buffer = gst_buffer_new_allocate (NULL, PATCH_SIZE, NULL);
+  gst_buffer_memset (buffer, 0, PATCH_BYTE, PATCH_SIZE);
+  ret = gst_pad_push (pad, buffer);
+  fail_unless (ret == GST_FLOW_OK);
+
+  push_segment (appsrc, N_BUFFERS * BUFFER_SIZE);
+
+  return GST_PAD_PROBE_REMOVE;
+}
+
+GST_START_TEST (check_unaligned_patch)
+{
+  GstElement *pipeline, *appsrc, *sink;
+  GstMessageType type = GST_MESSAGE_UNKNOWN;
+  gchar *location, *contents;
+  GstFlowReturn ret;
+  gsize length, i;
+  GstPad *srcpad;
+  GstBus *bus;
+  gint fd;
+
+  fd = g_file_open_tmp ("filesink-XXXXXX", &location, NULL);
+  fail_unless (fd >= 0);
+  g_close (fd, NULL);
+
+  pipeline = gst_pipeline_new (__FUNCTION__);
+  appsrc = gst_element_factory_make ("appsrc", NULL);
+  sink = gst_element_factory_make ("kmsfilesink", NULL);
+  g_object_set (sink, "location", location, "write-size", 8192, NULL);
+
+  gst_bin_add_many (GST_BIN (pipeline), appsrc, sink, NULL);
+  fail_unless (gst_element_link (appsrc, sink));
+
+  srcpad = gst_element_get_static_pad (appsrc, "src");
+  gst_pad_add_probe (srcpad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+      patch_header, appsrc, NULL);
+  g_object_unref (srcpad);
+
+  bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+  gst_bus_add_watch (bus, bus_msg, &type);
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  for (i = 0; i < N_BUFFERS; i++) {
+    GstBuffer *buffer = gst_buffer_new_allocate (NULL, BUFFER_SIZE, NULL);
+
+    gst_buffer_memset (buffer, 0, i, BUFFER_SIZE);
+    g_signal_emit_by_name (appsrc, "push-buffer", buffer, &ret);
+    gst_buffer_unref (buffer);
+  }
+
+  g_signal_emit_by_name (appsrc, "end-of-stream", &ret);
+
+  while (type == GST_MESSAGE_UNKNOWN) {
+    g_main_context_iteration (NULL, TRUE);
+  }
+
+  fail_unless (type == GST_MESSAGE_EOS);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_bus_remove_watch (bus);
+  g_object_unref (bus);
+  g_object_unref (pipeline);
+
+  /* Only the patched bytes change, those around them are kept */
+  fail_unless (g_file_get_contents (location, &contents, &length, NULL));
+  fail_unless (length == N_BUFFERS * BUFFER_SIZE);
+
+  for (i = 0; i < length; i++) {
+    if (i >= PATCH_OFFSET && i < PATCH_OFFSET + PATCH_SIZE) {
+      fail_unless (contents[i] == PATCH_BYTE);
+    } else {
+      fail_unless (contents[i] == i / BUFFER_SIZE);
+    }
+  }
+
+  g_free (contents);
+  g_unlink (location);
+  g_free (location);
+}
+
+GST_END_TEST;
+
+static gchar *
+create_tmp_file (void)
+{
+  gchar *location;
+  gint fd;
+
+  fd = g_file_open_tmp ("filesink-XXXXXX.webm", &location, NULL);
+  fail_unless (fd >= 0);
+  g_close (fd, NULL);
+
+  return location;
+}
+
+/* matroskamux seeks back at EOS to write sizes, duration and cues */
+GST_START_TEST (check_matroska_recording)
+{
+  gchar *kms_location, *location, *desc, *kms_contents, *contents;
+  gsize kms_length, length;
+  GstElement *pipeline;
+  GstMessage *msg;
+  GstBus *bus;
+
+  kms_location = create_tmp_file ();
+  location = create_tmp_file ();
+
+  /* Same stream to both sinks, so both files must be equal */
+  desc = g_strdup_printf ("videotestsrc num-buffers=90 ! vp8enc ! "
+      "matroskamux ! tee name=t ! queue ! kmsfilesink location=%s "
+      "write-size=8192 t. ! queue ! filesink location=%s", kms_location,
+      location);
+  pipeline = gst_parse_launch (desc, NULL);
+  g_free (desc);
+  fail_if (pipeline == NULL);
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  bus = gst_element_get_bus (pipeline);
+  msg = gst_bus_timed_pop_filtered (bus, GST_CLOCK_TIME_NONE,
+      GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+  fail_unless (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_EOS);
+  gst_message_unref (msg);
+  g_object_unref (bus);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (pipeline);
+
+  fail_unless (g_file_get_contents (kms_location, &kms_contents, &kms_length,
+          NULL));
+  fail_unless (g_file_get_contents (location, &contents, &length, NULL));
+
+  fail_unless (kms_length == length);
+  fail_unless (memcmp (kms_contents, contents, length) == 0);
+
+  g_free (kms_contents);
+  g_free (contents);
+  g_unlink (kms_location);
+  g_unlink (location);
+  g_free (kms_location);
+  g_free (location);
+}
+
+GST_END_TEST;
+
+static Suite *
+filesink_suite (void)
+{
+  Suite *s = suite_create ("filesink");
+  TCase *tc_chain = tcase_create ("element");
+
+  suite_add_tcase (s, tc_chain);
+
+  tcase_add_test (tc_chain, check_batched_writes);
+  tcase_add_test (tc_chain, check_unaligned_patch);
+  tcase_add_test (tc_chain, check_matroska_recording);
+
+  return s;
+}
+
+GST_CHECK_MAIN (filesink);
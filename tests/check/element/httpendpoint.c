@@ -21,12 +21,20 @@
 #include <gst/check/gstcheck.h>
 #include <gst/gst.h>
 #include <glib.h>
+#include <string.h>
+#include <time.h>
 
 #include "kmshttpendpointmethod.h"
 
 #define WAIT_TIMEOUT 3
 #define VIDEO_PATH BINARY_LOCATION "/video/format/small.webm"
 
+/* libsoup delivers request bodies in chunks of this size */
+#define UPLOAD_CHUNK_SIZE 8192
+#define UPLOAD_BLOCK_SIZE (1 << 20)
+#define UPLOAD_SIZE (256 << 20)
+#define WAV_HEADER_SIZE 44
+
 static GMainLoop *loop = NULL;
 static KmsHttpEndpointMethod method;
 GstElement *src_pipeline, *souphttpsrc, *appsink, *uridecodebin;
@@ -353,6 +361,91 @@ GST_START_TEST (check_emit_encoded_media)
   g_main_loop_unref (loop);
 }
 
+GST_END_TEST
+/* End of test check_emit_encoded_media */
+static GBytes *
+create_wav_upload (void)
+{
+  guint8 *data = g_malloc0 (UPLOAD_BLOCK_SIZE);
+
+  /* 48 KHz stereo S16LE with silence, big enough for the whole upload */
+  memcpy (data, "RIFF", 4);
+  GST_WRITE_UINT32_LE (data + 4, UPLOAD_SIZE - 8);
+  memcpy (data + 8, "WAVEfmt ", 8);
+  GST_WRITE_UINT32_LE (data + 16, 16);
+  GST_WRITE_UINT16_LE (data + 20, 1);
+  GST_WRITE_UINT16_LE (data + 22, 2);
+  GST_WRITE_UINT32_LE (data + 24, 48000);
+  GST_WRITE_UINT32_LE (data + 28, 48000 * 4);
+  GST_WRITE_UINT16_LE (data + 32, 4);
+  GST_WRITE_UINT16_LE (data + 34, 16);
+  memcpy (data + 36, "data", 4);
+  GST_WRITE_UINT32_LE (data + 40, UPLOAD_SIZE - WAV_HEADER_SIZE);
+
+  return g_bytes_new_take (data, UPLOAD_BLOCK_SIZE);
+}
+
+static gint64
+get_thread_cpu_time (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_THREAD_CPUTIME_ID, &ts);
+
+  return (gint64) ts.tv_sec * G_USEC_PER_SEC + ts.tv_nsec / 1000;
+}
+
+GST_START_TEST (benchmark_post_throughput)
+{
+  GBytes *upload = create_wav_upload ();
+  const guint8 *data = g_bytes_get_data (upload, NULL);
+  gsize offset = 0, pushed = 0;
+  gint64 start, cpu_start;
+  GstFlowReturn ret;
+
+  test_pipeline = gst_pipeline_new ("test-pipeline");
+  httpep = gst_element_factory_make ("httppostendpoint", NULL);
+  gst_bin_add (GST_BIN (test_pipeline), httpep);
+  gst_element_set_state (test_pipeline, GST_STATE_PLAYING);
+
+  start = g_get_monotonic_time ();
+  cpu_start = get_thread_cpu_time ();
+
+  /* Chunks are pushed the way the HTTP server does, wrapping the */
+  /* received data instead of copying it */
+  while (pushed < UPLOAD_SIZE) {
+    gsize size = MIN (UPLOAD_CHUNK_SIZE, UPLOAD_BLOCK_SIZE - offset);
+    GstBuffer *buffer;
+
+    buffer = gst_buffer_new_wrapped_full (GST_MEMORY_FLAG_READONLY,
+        (gpointer) (data + offset), size, 0, size, g_bytes_ref (upload),
+        (GDestroyNotify) g_bytes_unref);
+
+    g_signal_emit_by_name (httpep, "push-buffer", buffer, &ret);
+    gst_buffer_unref (buffer);
+    fail_unless (ret == GST_FLOW_OK);
+
+    pushed += size;
+    offset += size;
+    if (offset == UPLOAD_BLOCK_SIZE) {
+      offset = WAV_HEADER_SIZE;
+    }
+  }
+
+  cpu_start = MAX (get_thread_cpu_time () - cpu_start, 1);
+  start = MAX (g_get_monotonic_time () - start, 1);
+
+  GST_INFO ("Pushed %u MB in %u KB chunks in %" G_GINT64_FORMAT
+      " ms: %" G_GINT64_FORMAT " MB/s, %" G_GINT64_FORMAT " MB/s per core",
+      UPLOAD_SIZE >> 20, UPLOAD_CHUNK_SIZE >> 10, start / 1000,
+      (gint64) (UPLOAD_SIZE >> 20) * G_USEC_PER_SEC / start,
+      (gint64) (UPLOAD_SIZE >> 20) * G_USEC_PER_SEC / cpu_start);
+
+  gst_element_set_state (test_pipeline, GST_STATE_NULL);
+  gst_object_unref (GST_OBJECT (test_pipeline));
+  g_bytes_unref (upload);
+}
+
 GST_END_TEST
 /******************************/
 /* HttpEndpoint test suit */
@@ -371,6 +464,9 @@ httpendpoint_suite (void)
   /* Simulates POST behaviour with encoded media */
   tcase_add_test (tc_chain, check_emit_encoded_media);
 
+  /* Measures the ingest path of POST requests */
+  tcase_add_test (tc_chain, benchmark_post_throughput);
+
   return s;
 }
 
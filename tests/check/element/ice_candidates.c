@@ -16,8 +16,20 @@
  */
 
 #include <gst/check/gstcheck.h>
+#include <string.h>
 #include "webrtcendpoint/kmsicecandidate.h"
 
+#define FUZZ_ITERATIONS 50000
+#define BENCHMARK_ITERATIONS 100000
+
+static const gchar *seed_candidates[] = {
+  "candidate:1 1 TCP 1015022079 192.168.1.183 38907 typ host tcptype passive",
+  "candidate:2 1 UDP 2013266431 fe80::a00:27ff:fee0:4ebf 45067 typ relay",
+  "candidate:4 1 UDP 2013266431 192.168.1.183 55079 typ relay raddr 127.0.0.1 rport 9999 tcptype active",
+  "candidate:842163049 1 udp 1677729535 193.147.51.8 59803 typ srflx raddr 172.17.0.9 rport 59803 generation 0 ufrag B+z2Krpxf2R3uR0S",
+  "candidate:qwert+/456 1 TCP 935331583 fe80::a00:27ff:fee0:4ebf 38878 typ prflx tcptype active",
+};
+
 static void
 check_candidate (KmsIceCandidate * c, const gchar * mid, const gchar * addr,
     gint port, guint ipv, const gchar * stream_id, const gchar * foundation,
@@ -152,6 +164,132 @@ GST_START_TEST (test_expr)
 
 GST_END_TEST;
 
+static const gchar fuzz_bytes[] = " :.+/-0123456789abcdefxyzACPTU\t\r\n\x80\xc3\xff";
+
+static gchar *
+mutate_candidate (GRand * rand, const gchar * seed)
+{
+  GString *str = g_string_new (seed);
+  gint mutations = g_rand_int_range (rand, 1, 4);
+
+  while (mutations-- > 0) {
+    gint pos = g_rand_int_range (rand, 0, str->len + 1);
+    gchar byte = fuzz_bytes[g_rand_int_range (rand, 0, sizeof (fuzz_bytes) - 1)];
+
+    switch (g_rand_int_range (rand, 0, 5)) {
+      case 0:
+        if (pos < str->len) {
+          str->str[pos] = byte;
+        }
+        break;
+      case 1:
+        g_string_insert_c (str, pos, byte);
+        break;
+      case 2:
+        g_string_erase (str, pos, MIN (g_rand_int_range (rand, 0, 8),
+                str->len - pos));
+        break;
+      case 3:
+        g_string_truncate (str, pos);
+        break;
+      default:{
+        gint len = g_rand_int_range (rand, 0, str->len - pos + 1);
+        gchar *chunk = g_strndup (str->str + pos, len);
+
+        g_string_insert (str, g_rand_int_range (rand, 0, str->len + 1), chunk);
+        g_free (chunk);
+        break;
+      }
+    }
+  }
+
+  return g_string_free (str, FALSE);
+}
+
+GST_START_TEST (test_fuzz)
+{
+  GRand *rand = g_rand_new_with_seed (0x1ce);
+  guint i, accepted = 0;
+
+  for (i = 0; i < FUZZ_ITERATIONS; i++) {
+    const gchar *seed =
+        seed_candidates[g_rand_int_range (rand, 0,
+            G_N_ELEMENTS (seed_candidates))];
+    gchar *str = mutate_candidate (rand, seed);
+    KmsIceCandidate *cand;
+    gchar *addr, *foundation, *sdp_line;
+
+    /* mDNS names would be resolved on the network */
+    if (strstr (str, ".local") != NULL) {
+      g_free (str);
+      continue;
+    }
+
+    cand = kms_ice_candidate_new (str, "test", 1, "8");
+    if (cand == NULL) {
+      g_free (str);
+      continue;
+    }
+
+    accepted++;
+
+    addr = kms_ice_candidate_get_address (cand);
+    fail_if (addr == NULL || strstr (str, addr) == NULL,
+        "Address not taken from '%s'", str);
+    g_free (addr);
+
+    foundation = kms_ice_candidate_get_foundation (cand);
+    fail_if (foundation == NULL || strstr (str, foundation) == NULL,
+        "Foundation not taken from '%s'", str);
+    g_free (foundation);
+
+    fail_unless (kms_ice_candidate_get_protocol (cand) ==
+        KMS_ICE_PROTOCOL_UDP || kms_ice_candidate_get_protocol (cand) ==
+        KMS_ICE_PROTOCOL_TCP);
+    fail_unless (kms_ice_candidate_get_candidate_type (cand) <=
+        KMS_ICE_CANDIDATE_TYPE_RELAY);
+
+    sdp_line = kms_ice_candidate_get_sdp_line (cand);
+    fail_if (sdp_line == NULL);
+    g_free (sdp_line);
+
+    g_object_unref (cand);
+    g_free (str);
+  }
+
+  GST_INFO ("%u of %u mutated candidates accepted", accepted,
+      FUZZ_ITERATIONS);
+
+  g_rand_free (rand);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (benchmark_parse)
+{
+  gint64 start;
+  guint i;
+
+  start = g_get_monotonic_time ();
+
+  for (i = 0; i < BENCHMARK_ITERATIONS; i++) {
+    KmsIceCandidate *cand;
+
+    cand = kms_ice_candidate_new (seed_candidates[i %
+            G_N_ELEMENTS (seed_candidates)], "test", 1, "8");
+    fail_if (cand == NULL);
+    g_object_unref (cand);
+  }
+
+  start = MAX (g_get_monotonic_time () - start, 1);
+
+  GST_INFO ("Parsed %d candidates in %" G_GINT64_FORMAT " ms (%"
+      G_GINT64_FORMAT " candidates/s)", BENCHMARK_ITERATIONS, start / 1000,
+      BENCHMARK_ITERATIONS * G_USEC_PER_SEC / start);
+}
+
+GST_END_TEST;
+
 static Suite *
 ice_candidates_suite (void)
 {
@@ -160,6 +298,8 @@ ice_candidates_suite (void)
 
   suite_add_tcase (s, tc_chain);
   tcase_add_test (tc_chain, test_expr);
+  tcase_add_test (tc_chain, test_fuzz);
+  tcase_add_test (tc_chain, benchmark_parse);
 
   return s;
 }
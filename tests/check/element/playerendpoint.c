@@ -20,6 +20,7 @@
 
 #include <gst/check/gstcheck.h>
 #include <gst/gst.h>
+#include <glib/gstdio.h>
 #include <commons/kmsuriendpointstate.h>
 
 #include <kmstestutils.h>
@@ -487,6 +488,805 @@ GST_START_TEST (check_eos)
 
 GST_END_TEST
 
+#define N_PLAYERS 200
+
+static guint
+count_process_threads (void)
+{
+  GDir *dir;
+  guint count = 0;
+
+  dir = g_dir_open ("/proc/self/task", 0, NULL);
+  if (dir == NULL) {
+    return 0;
+  }
+
+  while (g_dir_read_name (dir) != NULL) {
+    count++;
+  }
+
+  g_dir_close (dir);
+
+  return count;
+}
+
+/* Players must not own one thread each while they are idle */
+GST_START_TEST (check_threads_per_player)
+{
+  GstElement *players[N_PLAYERS];
+  guint i, threads_before, threads_after;
+  gint64 start;
+
+  threads_before = count_process_threads ();
+  if (threads_before == 0) {
+    GST_WARNING ("Cannot read /proc/self/task, skipping thread count");
+    return;
+  }
+
+  start = g_get_monotonic_time ();
+
+  for (i = 0; i < N_PLAYERS; i++) {
+    players[i] = gst_element_factory_make ("playerendpoint", NULL);
+    g_object_set (G_OBJECT (players[i]), "uri", VIDEO_PATH3, NULL);
+  }
+
+  threads_after = count_process_threads ();
+
+  GST_INFO ("%d players: %u new threads (%.3f threads/player),"
+      " created in %" G_GINT64_FORMAT " us", N_PLAYERS,
+      threads_after - threads_before,
+      (gdouble) (threads_after - threads_before) / N_PLAYERS,
+      g_get_monotonic_time () - start);
+
+  fail_unless (threads_after - threads_before <= g_get_num_processors ());
+
+  for (i = 0; i < N_PLAYERS; i++) {
+    gst_object_unref (players[i]);
+  }
+}
+
+GST_END_TEST
+
+#define N_SHARED_PLAYERS 3
+
+static gint shared_players_pending;
+
+static void
+shared_handoff (GstElement * sink, GstBuffer * buffer, GstPad * pad,
+    gpointer user_data)
+{
+  /* Count each player only once */
+  g_signal_handlers_disconnect_by_func (sink, shared_handoff, user_data);
+
+  if (g_atomic_int_dec_and_test (&shared_players_pending)) {
+    g_idle_add (quit_main_loop_idle, user_data);
+  }
+}
+
+static void
+shared_srcpad_added (GstElement * player, GstPad * new_pad, gpointer user_data)
+{
+  GstElement *sink;
+  GstPad *sinkpad;
+
+  GST_INFO_OBJECT (player, "Pad added %" GST_PTR_FORMAT, new_pad);
+
+  sink = gst_element_factory_make ("fakesink", NULL);
+  g_object_set (G_OBJECT (sink), "async", FALSE, "sync", FALSE,
+      "signal-handoffs", TRUE, NULL);
+  g_signal_connect (sink, "handoff", G_CALLBACK (shared_handoff), loop);
+
+  gst_bin_add (GST_BIN (pipeline), sink);
+
+  sinkpad = gst_element_get_static_pad (sink, "sink");
+  fail_if (gst_pad_link (new_pad, sinkpad) != GST_PAD_LINK_OK);
+  g_object_unref (sinkpad);
+
+  gst_element_sync_state_with_parent (sink);
+}
+
+#define STREAMING_EXTRA_PLAYERS 8
+#define STREAMING_THREADS_SLACK 4
+
+static GstElement *
+create_streaming_player (void)
+{
+  GstElement *player;
+
+  player = gst_element_factory_make ("playerendpoint", NULL);
+  g_object_set (G_OBJECT (player), "uri", VIDEO_PATH2, NULL);
+  g_signal_connect (player, "pad-added", G_CALLBACK (shared_srcpad_added),
+      NULL);
+
+  return player;
+}
+
+/* Returns once every player has delivered its first buffer */
+static void
+start_streaming_players (GstElement ** players, guint n_players)
+{
+  gchar *padname;
+  guint i;
+
+  shared_players_pending = n_players;
+
+  for (i = 0; i < n_players; i++) {
+    gst_bin_add (GST_BIN (pipeline), players[i]);
+    gst_element_sync_state_with_parent (players[i]);
+
+    g_signal_emit_by_name (players[i], "request-new-pad",
+        KMS_ELEMENT_PAD_TYPE_VIDEO, NULL, GST_PAD_SRC, &padname);
+    fail_if (padname == NULL);
+    g_free (padname);
+
+    g_object_set (G_OBJECT (players[i]), "state",
+        KMS_URI_ENDPOINT_STATE_START, NULL);
+  }
+
+  g_main_loop_run (loop);
+}
+
+/*
+ * Streaming players only add their own streaming threads. With one loop
+ * thread per player, the extra threads would exceed the number of cores.
+ */
+GST_START_TEST (check_threads_while_streaming)
+{
+  guint n_players, bus_watch_id, i, threads_warm, threads_one, threads_all;
+  GstElement **players;
+  gint per_player, extra;
+  GstBus *bus;
+
+  if (count_process_threads () == 0) {
+    GST_WARNING ("Cannot read /proc/self/task, skipping thread count");
+    return;
+  }
+
+  n_players = g_get_num_processors () + STREAMING_EXTRA_PLAYERS;
+  players = g_new0 (GstElement *, n_players + 2);
+
+  loop = g_main_loop_new (NULL, FALSE);
+  pipeline = gst_pipeline_new (__FUNCTION__);
+  bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+
+  bus_watch_id = gst_bus_add_watch (bus, gst_bus_async_signal_func, NULL);
+  g_signal_connect (bus, "message", G_CALLBACK (bus_msg_cb), pipeline);
+  g_object_unref (bus);
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  /* First player creates the loop pool and any lazily started thread */
+  players[0] = create_streaming_player ();
+  start_streaming_players (players, 1);
+
+  /* Second one tells how many streaming threads a player owns */
+  players[1] = create_streaming_player ();
+  threads_warm = count_process_threads ();
+  start_streaming_players (players + 1, 1);
+  threads_one = count_process_threads ();
+  per_player = (gint) threads_one - (gint) threads_warm;
+
+  for (i = 2; i < n_players + 2; i++) {
+    players[i] = create_streaming_player ();
+  }
+
+  start_streaming_players (players + 2, n_players);
+  threads_all = count_process_threads ();
+
+  extra = (gint) threads_all - (gint) threads_one - (gint) n_players *
+      per_player;
+
+  GST_INFO ("%u streaming players: %u new threads, %d per player, %d extra",
+      n_players, threads_all - threads_one, per_player, extra);
+
+  fail_unless (extra <= (gint) g_get_num_processors () +
+      STREAMING_THREADS_SLACK);
+
+  for (i = 0; i < n_players + 2; i++) {
+    g_object_set (G_OBJECT (players[i]), "state",
+        KMS_URI_ENDPOINT_STATE_STOP, NULL);
+  }
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (GST_OBJECT (pipeline));
+  g_source_remove (bus_watch_id);
+  g_main_loop_unref (loop);
+  g_free (players);
+}
+
+GST_END_TEST
+
+/* Players of the same URI play from one source, not from their own */
+GST_START_TEST (check_shared_source)
+{
+  GstElement *players[N_SHARED_PLAYERS];
+  guint bus_watch_id, i;
+  gchar *padname;
+  GstBus *bus;
+
+  loop = g_main_loop_new (NULL, FALSE);
+  pipeline = gst_pipeline_new (__FUNCTION__);
+  bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+
+  bus_watch_id = gst_bus_add_watch (bus, gst_bus_async_signal_func, NULL);
+  g_signal_connect (bus, "message", G_CALLBACK (bus_msg_cb), pipeline);
+  g_object_unref (bus);
+
+  shared_players_pending = N_SHARED_PLAYERS;
+
+  for (i = 0; i < N_SHARED_PLAYERS; i++) {
+    players[i] = gst_element_factory_make ("playerendpoint", NULL);
+    g_object_set (G_OBJECT (players[i]), "uri", VIDEO_PATH2, "shared-source",
+        TRUE, NULL);
+    g_signal_connect (players[i], "pad-added",
+        G_CALLBACK (shared_srcpad_added), NULL);
+    gst_bin_add (GST_BIN (pipeline), players[i]);
+  }
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  for (i = 0; i < N_SHARED_PLAYERS; i++) {
+    g_signal_emit_by_name (players[i], "request-new-pad",
+        KMS_ELEMENT_PAD_TYPE_VIDEO, NULL, GST_PAD_SRC, &padname);
+    fail_if (padname == NULL);
+    g_free (padname);
+
+    g_object_set (G_OBJECT (players[i]), "state",
+        KMS_URI_ENDPOINT_STATE_START, NULL);
+  }
+
+  g_timeout_add_seconds (4, print_timedout_pipeline, NULL);
+  g_main_loop_run (loop);
+
+  for (i = 0; i < N_SHARED_PLAYERS; i++) {
+    GstElement *internal;
+    GstState current;
+
+    g_object_get (players[i], "pipeline", &internal, NULL);
+    gst_element_get_state (internal, &current, NULL, 0);
+    fail_unless (current == GST_STATE_NULL);
+    g_object_unref (internal);
+
+    g_object_set (G_OBJECT (players[i]), "state",
+        KMS_URI_ENDPOINT_STATE_STOP, NULL);
+  }
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (GST_OBJECT (pipeline));
+  g_source_remove (bus_watch_id);
+  g_main_loop_unref (loop);
+}
+
+GST_END_TEST
+
+#define CLIP_CACHE_SIZE (16 * 1024 * 1024)
+
+static gchar *
+create_local_clip (guint num_buffers)
+{
+  GstElement *encoder;
+  GstMessage *msg;
+  GstBus *bus;
+  gchar *dir, *filename, *desc;
+
+  dir = g_dir_make_tmp ("playerendpoint_XXXXXX", NULL);
+  fail_if (dir == NULL);
+  filename = g_build_filename (dir, "clip.webm", NULL);
+  g_free (dir);
+
+  desc = g_strdup_printf ("videotestsrc num-buffers=%u ! "
+      "video/x-raw,width=320,height=240,framerate=30/1 ! vp8enc ! webmmux ! "
+      "filesink location=%s", num_buffers, filename);
+  encoder = gst_parse_launch (desc, NULL);
+  g_free (desc);
+  fail_if (encoder == NULL);
+
+  gst_element_set_state (encoder, GST_STATE_PLAYING);
+
+  bus = gst_element_get_bus (encoder);
+  msg = gst_bus_timed_pop_filtered (bus, GST_CLOCK_TIME_NONE,
+      GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+  fail_unless (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_EOS);
+  gst_message_unref (msg);
+  g_object_unref (bus);
+
+  gst_element_set_state (encoder, GST_STATE_NULL);
+  gst_object_unref (encoder);
+
+  return filename;
+}
+
+/* Once a local file is cached, players do not read it again */
+GST_START_TEST (check_clip_cache)
+{
+  GstElement *cached, *internal;
+  gchar *filename, *uri, *dir, *padname;
+  guint bus_watch_id;
+  GstState current;
+  GstBus *bus;
+
+  filename = create_local_clip (30);
+  uri = g_filename_to_uri (filename, NULL, NULL);
+
+  loop = g_main_loop_new (NULL, FALSE);
+  pipeline = gst_pipeline_new (__FUNCTION__);
+  bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+
+  bus_watch_id = gst_bus_add_watch (bus, gst_bus_async_signal_func, NULL);
+  g_signal_connect (bus, "message", G_CALLBACK (bus_msg_cb), pipeline);
+  g_object_unref (bus);
+
+  player = gst_element_factory_make ("playerendpoint", NULL);
+  cached = gst_element_factory_make ("playerendpoint", NULL);
+  g_object_set (G_OBJECT (player), "uri", uri, "clip-cache-size",
+      (guint64) CLIP_CACHE_SIZE, NULL);
+  g_object_set (G_OBJECT (cached), "uri", uri, "clip-cache-size",
+      (guint64) CLIP_CACHE_SIZE, NULL);
+  g_signal_connect (G_OBJECT (player), "eos", G_CALLBACK (player_eos), loop);
+  g_signal_connect (cached, "pad-added", G_CALLBACK (shared_srcpad_added),
+      NULL);
+  gst_bin_add_many (GST_BIN (pipeline), player, cached, NULL);
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  /* The first play loads the file in the cache */
+  g_object_set (G_OBJECT (player), "state", KMS_URI_ENDPOINT_STATE_START, NULL);
+
+  g_timeout_add_seconds (4, print_timedout_pipeline, NULL);
+  g_main_loop_run (loop);
+
+  g_signal_emit_by_name (cached, "request-new-pad",
+      KMS_ELEMENT_PAD_TYPE_VIDEO, NULL, GST_PAD_SRC, &padname);
+  fail_if (padname == NULL);
+  g_free (padname);
+
+  shared_players_pending = 1;
+  g_object_set (G_OBJECT (cached), "state", KMS_URI_ENDPOINT_STATE_START, NULL);
+
+  g_object_get (cached, "pipeline", &internal, NULL);
+  gst_element_get_state (internal, &current, NULL, 0);
+  fail_unless (current == GST_STATE_NULL);
+  g_object_unref (internal);
+
+  g_main_loop_run (loop);
+
+  g_object_set (G_OBJECT (cached), "state", KMS_URI_ENDPOINT_STATE_STOP, NULL);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (GST_OBJECT (pipeline));
+  g_source_remove (bus_watch_id);
+  g_main_loop_unref (loop);
+
+  dir = g_path_get_dirname (filename);
+  g_unlink (filename);
+  g_rmdir (dir);
+  g_free (dir);
+  g_free (filename);
+  g_free (uri);
+}
+
+GST_END_TEST
+
+#define FAST_CLIP_BUFFERS 300
+#define FAST_CLIP_DURATION (FAST_CLIP_BUFFERS * G_USEC_PER_SEC / 30)
+
+static void
+fast_srcpad_added (GstElement * player, GstPad * new_pad, gpointer user_data)
+{
+  GstElement *sink;
+  GstPad *sinkpad;
+
+  sink = gst_element_factory_make ("fakesink", NULL);
+  g_object_set (G_OBJECT (sink), "async", FALSE, "sync", FALSE, NULL);
+  gst_bin_add (GST_BIN (pipeline), sink);
+
+  sinkpad = gst_element_get_static_pad (sink, "sink");
+  fail_if (gst_pad_link (new_pad, sinkpad) != GST_PAD_LINK_OK);
+  g_object_unref (sinkpad);
+
+  gst_element_sync_state_with_parent (sink);
+}
+
+/* Without sync, a file is played faster than in real time */
+GST_START_TEST (check_not_synchronized)
+{
+  gchar *filename, *uri, *dir, *padname;
+  guint bus_watch_id;
+  gint64 start, elapsed;
+  GstBus *bus;
+
+  filename = create_local_clip (FAST_CLIP_BUFFERS);
+  uri = g_filename_to_uri (filename, NULL, NULL);
+
+  loop = g_main_loop_new (NULL, FALSE);
+  pipeline = gst_pipeline_new (__FUNCTION__);
+  bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+
+  bus_watch_id = gst_bus_add_watch (bus, gst_bus_async_signal_func, NULL);
+  g_signal_connect (bus, "message", G_CALLBACK (bus_msg_cb), pipeline);
+  g_object_unref (bus);
+
+  player = gst_element_factory_make ("playerendpoint", NULL);
+  g_object_set (G_OBJECT (player), "uri", uri, "use-encoded-media", TRUE,
+      "sync", FALSE, NULL);
+  g_signal_connect (G_OBJECT (player), "eos", G_CALLBACK (player_eos), loop);
+  g_signal_connect (player, "pad-added", G_CALLBACK (fast_srcpad_added),
+      NULL);
+  gst_bin_add (GST_BIN (pipeline), player);
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  g_signal_emit_by_name (player, "request-new-pad",
+      KMS_ELEMENT_PAD_TYPE_VIDEO, NULL, GST_PAD_SRC, &padname);
+  fail_if (padname == NULL);
+  g_free (padname);
+
+  start = g_get_monotonic_time ();
+  g_object_set (G_OBJECT (player), "state", KMS_URI_ENDPOINT_STATE_START, NULL);
+
+  g_main_loop_run (loop);
+  elapsed = g_get_monotonic_time () - start;
+
+  GST_INFO ("Played %" G_GINT64_FORMAT " us of media in %" G_GINT64_FORMAT
+      " us", (gint64) FAST_CLIP_DURATION, elapsed);
+  fail_unless (elapsed < FAST_CLIP_DURATION / 2);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (GST_OBJECT (pipeline));
+  g_source_remove (bus_watch_id);
+  g_main_loop_unref (loop);
+
+  dir = g_path_get_dirname (filename);
+  g_unlink (filename);
+  g_rmdir (dir);
+  g_free (dir);
+  g_free (filename);
+  g_free (uri);
+}
+
+GST_END_TEST
+
+#define SCRUBBING_SEEKS 10
+
+static gboolean
+scrub_player (gpointer user_data)
+{
+  GstStructure *stats;
+  const GstStructure *seeks;
+  guint count, coalesced, skipped;
+  gboolean ret;
+  gint i;
+
+  /* A burst of seeks, like the ones of a user dragging a time slider */
+  for (i = 0; i < SCRUBBING_SEEKS; i++) {
+    g_signal_emit_by_name (player, "set-position",
+        (gint64) (i * 100 * GST_MSECOND), &ret);
+    fail_unless (ret);
+  }
+
+  g_signal_emit_by_name (player, "stats", NULL, &stats);
+  fail_if (stats == NULL);
+
+  seeks = gst_value_get_structure (gst_structure_get_value (stats, "seeks"));
+  fail_unless (gst_structure_get_uint (seeks, "count", &count));
+  fail_unless (gst_structure_get_uint (seeks, "coalesced", &coalesced));
+  fail_unless (gst_structure_get_uint (seeks, "skipped", &skipped));
+  GST_INFO ("Seeks: %" GST_PTR_FORMAT, seeks);
+
+  fail_unless (count >= 1);
+  fail_unless (count + coalesced + skipped == SCRUBBING_SEEKS);
+  gst_structure_free (stats);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Seeks sent while another one is in progress are coalesced */
+GST_START_TEST (check_scrubbing_seeks)
+{
+  gchar *filename, *uri, *dir, *padname;
+  guint bus_watch_id;
+  GstBus *bus;
+
+  filename = create_local_clip (FAST_CLIP_BUFFERS);
+  uri = g_filename_to_uri (filename, NULL, NULL);
+
+  loop = g_main_loop_new (NULL, FALSE);
+  pipeline = gst_pipeline_new (__FUNCTION__);
+  bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+
+  bus_watch_id = gst_bus_add_watch (bus, gst_bus_async_signal_func, NULL);
+  g_signal_connect (bus, "message", G_CALLBACK (bus_msg_cb), pipeline);
+  g_object_unref (bus);
+
+  player = gst_element_factory_make ("playerendpoint", NULL);
+  g_object_set (G_OBJECT (player), "uri", uri, "use-encoded-media", TRUE,
+      NULL);
+  g_signal_connect (G_OBJECT (player), "eos", G_CALLBACK (player_eos), loop);
+  g_signal_connect (player, "pad-added", G_CALLBACK (fast_srcpad_added),
+      NULL);
+  gst_bin_add (GST_BIN (pipeline), player);
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  g_signal_emit_by_name (player, "request-new-pad",
+      KMS_ELEMENT_PAD_TYPE_VIDEO, NULL, GST_PAD_SRC, &padname);
+  fail_if (padname == NULL);
+  g_free (padname);
+
+  g_object_set (G_OBJECT (player), "state", KMS_URI_ENDPOINT_STATE_START, NULL);
+
+  g_timeout_add_seconds (1, scrub_player, NULL);
+  g_main_loop_run (loop);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (GST_OBJECT (pipeline));
+  g_source_remove (bus_watch_id);
+  g_main_loop_unref (loop);
+
+  dir = g_path_get_dirname (filename);
+  g_unlink (filename);
+  g_rmdir (dir);
+  g_free (dir);
+  g_free (filename);
+  g_free (uri);
+}
+
+GST_END_TEST
+
+#define OVERHEAD_CLIP_BUFFERS 3000
+
+static void
+count_buffer (GstElement * sink, GstBuffer * buffer, GstPad * pad,
+    gpointer user_data)
+{
+  g_atomic_int_inc ((gint *) user_data);
+}
+
+static void
+counted_srcpad_added (GstElement * player, GstPad * new_pad,
+    gpointer user_data)
+{
+  GstElement *sink;
+  GstPad *sinkpad;
+
+  sink = gst_element_factory_make ("fakesink", NULL);
+  g_object_set (G_OBJECT (sink), "async", FALSE, "sync", FALSE,
+      "signal-handoffs", TRUE, NULL);
+  g_signal_connect (sink, "handoff", G_CALLBACK (count_buffer), user_data);
+  gst_bin_add (GST_BIN (pipeline), sink);
+
+  sinkpad = gst_element_get_static_pad (sink, "sink");
+  fail_if (gst_pad_link (new_pad, sinkpad) != GST_PAD_LINK_OK);
+  g_object_unref (sinkpad);
+
+  gst_element_sync_state_with_parent (sink);
+}
+
+/* Time added to each buffer by the player, over just demuxing the file */
+#define OVERHEAD_MAX_NS 50000
+
+/* Start up is left out, only the time between buffers is measured */
+typedef struct _BufferTiming
+{
+  gint buffers;
+  gint64 first;
+  gint64 last;
+} BufferTiming;
+
+static void
+time_buffer (GstElement * sink, GstBuffer * buffer, GstPad * pad,
+    gpointer user_data)
+{
+  BufferTiming *timing = user_data;
+
+  timing->last = g_get_monotonic_time ();
+
+  if (timing->buffers++ == 0) {
+    timing->first = timing->last;
+  }
+}
+
+/* ns per buffer */
+static gint64
+buffer_timing_get_cost (BufferTiming * timing)
+{
+  fail_unless (timing->buffers > 1);
+
+  return (timing->last - timing->first) * 1000 / (timing->buffers - 1);
+}
+
+static void
+timed_srcpad_added (GstElement * player, GstPad * new_pad, gpointer user_data)
+{
+  GstElement *sink;
+  GstPad *sinkpad;
+
+  sink = gst_element_factory_make ("fakesink", NULL);
+  g_object_set (G_OBJECT (sink), "async", FALSE, "sync", FALSE,
+      "signal-handoffs", TRUE, NULL);
+  g_signal_connect (sink, "handoff", G_CALLBACK (time_buffer), user_data);
+  gst_bin_add (GST_BIN (pipeline), sink);
+
+  sinkpad = gst_element_get_static_pad (sink, "sink");
+  fail_if (gst_pad_link (new_pad, sinkpad) != GST_PAD_LINK_OK);
+  g_object_unref (sinkpad);
+
+  gst_element_sync_state_with_parent (sink);
+}
+
+/* Plays @filename without a player */
+static void
+measure_demux (const gchar * filename, BufferTiming * timing)
+{
+  GstElement *demux_pipeline, *sink;
+  GstMessage *msg;
+  gchar *desc;
+  GstBus *bus;
+
+  desc = g_strdup_printf ("filesrc location=%s ! matroskademux ! "
+      "fakesink name=sink async=false sync=false signal-handoffs=true",
+      filename);
+  demux_pipeline = gst_parse_launch (desc, NULL);
+  g_free (desc);
+  fail_if (demux_pipeline == NULL);
+
+  sink = gst_bin_get_by_name (GST_BIN (demux_pipeline), "sink");
+  g_signal_connect (sink, "handoff", G_CALLBACK (time_buffer), timing);
+  g_object_unref (sink);
+
+  gst_element_set_state (demux_pipeline, GST_STATE_PLAYING);
+
+  bus = gst_element_get_bus (demux_pipeline);
+  msg = gst_bus_timed_pop_filtered (bus, GST_CLOCK_TIME_NONE,
+      GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+  fail_unless (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_EOS);
+  gst_message_unref (msg);
+  g_object_unref (bus);
+
+  gst_element_set_state (demux_pipeline, GST_STATE_NULL);
+  gst_object_unref (demux_pipeline);
+}
+
+/* Bounds the cost per buffer of passing encoded media through a player */
+GST_START_TEST (check_buffer_overhead)
+{
+  BufferTiming played = { 0, }, demuxed = { 0, };
+  gchar *filename, *uri, *dir, *padname;
+  gint64 player_cost, demux_cost;
+  guint bus_watch_id;
+  GstBus *bus;
+
+  filename = create_local_clip (OVERHEAD_CLIP_BUFFERS);
+  uri = g_filename_to_uri (filename, NULL, NULL);
+
+  loop = g_main_loop_new (NULL, FALSE);
+  pipeline = gst_pipeline_new (__FUNCTION__);
+  bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+
+  bus_watch_id = gst_bus_add_watch (bus, gst_bus_async_signal_func, NULL);
+  g_signal_connect (bus, "message", G_CALLBACK (bus_msg_cb), pipeline);
+  g_object_unref (bus);
+
+  player = gst_element_factory_make ("playerendpoint", NULL);
+  g_object_set (G_OBJECT (player), "uri", uri, "use-encoded-media", TRUE,
+      "sync", FALSE, NULL);
+  g_signal_connect (G_OBJECT (player), "eos", G_CALLBACK (player_eos), loop);
+  g_signal_connect (player, "pad-added", G_CALLBACK (timed_srcpad_added),
+      &played);
+  gst_bin_add (GST_BIN (pipeline), player);
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  g_signal_emit_by_name (player, "request-new-pad",
+      KMS_ELEMENT_PAD_TYPE_VIDEO, NULL, GST_PAD_SRC, &padname);
+  fail_if (padname == NULL);
+  g_free (padname);
+
+  g_object_set (G_OBJECT (player), "state", KMS_URI_ENDPOINT_STATE_START, NULL);
+
+  g_main_loop_run (loop);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (GST_OBJECT (pipeline));
+  g_source_remove (bus_watch_id);
+  g_main_loop_unref (loop);
+
+  measure_demux (filename, &demuxed);
+
+  player_cost = buffer_timing_get_cost (&played);
+  demux_cost = buffer_timing_get_cost (&demuxed);
+
+  GST_INFO ("Player: %d buffers, %" G_GINT64_FORMAT " ns/buffer. Demuxing "
+      "only: %d buffers, %" G_GINT64_FORMAT " ns/buffer", played.buffers,
+      player_cost, demuxed.buffers, demux_cost);
+
+  fail_unless (player_cost - demux_cost < OVERHEAD_MAX_NS,
+      "Player adds %" G_GINT64_FORMAT " ns to each buffer",
+      player_cost - demux_cost);
+
+  dir = g_path_get_dirname (filename);
+  g_unlink (filename);
+  g_rmdir (dir);
+  g_free (dir);
+  g_free (filename);
+  g_free (uri);
+}
+
+GST_END_TEST
+
+#define PLAYLIST_CLIP_BUFFERS 30
+
+/* Queued URIs are played one after the other, with a single EOS */
+GST_START_TEST (check_playlist)
+{
+  gchar *first, *second, *first_uri, *second_uri, *dir, *padname;
+  guint bus_watch_id;
+  gint buffers = 0;
+  gboolean ret;
+  GstBus *bus;
+
+  first = create_local_clip (PLAYLIST_CLIP_BUFFERS);
+  second = create_local_clip (PLAYLIST_CLIP_BUFFERS);
+  first_uri = g_filename_to_uri (first, NULL, NULL);
+  second_uri = g_filename_to_uri (second, NULL, NULL);
+
+  loop = g_main_loop_new (NULL, FALSE);
+  pipeline = gst_pipeline_new (__FUNCTION__);
+  bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+
+  bus_watch_id = gst_bus_add_watch (bus, gst_bus_async_signal_func, NULL);
+  g_signal_connect (bus, "message", G_CALLBACK (bus_msg_cb), pipeline);
+  g_object_unref (bus);
+
+  player = gst_element_factory_make ("playerendpoint", NULL);
+  g_object_set (G_OBJECT (player), "uri", first_uri, "use-encoded-media",
+      TRUE, NULL);
+  g_signal_connect (G_OBJECT (player), "eos", G_CALLBACK (player_eos), loop);
+  g_signal_connect (player, "pad-added", G_CALLBACK (counted_srcpad_added),
+      &buffers);
+  gst_bin_add (GST_BIN (pipeline), player);
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  g_signal_emit_by_name (player, "request-new-pad",
+      KMS_ELEMENT_PAD_TYPE_VIDEO, NULL, GST_PAD_SRC, &padname);
+  fail_if (padname == NULL);
+  g_free (padname);
+
+  g_signal_emit_by_name (player, "enqueue-uri", second_uri, &ret);
+  fail_unless (ret);
+  g_signal_emit_by_name (player, "enqueue-uri", "not a uri", &ret);
+  fail_if (ret);
+
+  g_object_set (G_OBJECT (player), "state", KMS_URI_ENDPOINT_STATE_START, NULL);
+
+  g_main_loop_run (loop);
+
+  /* Both items were played before the EOS */
+  GST_INFO ("Played %d buffers", g_atomic_int_get (&buffers));
+  fail_unless (g_atomic_int_get (&buffers) > PLAYLIST_CLIP_BUFFERS);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (GST_OBJECT (pipeline));
+  g_source_remove (bus_watch_id);
+  g_main_loop_unref (loop);
+
+  dir = g_path_get_dirname (first);
+  g_unlink (first);
+  g_rmdir (dir);
+  g_free (dir);
+  dir = g_path_get_dirname (second);
+  g_unlink (second);
+  g_rmdir (dir);
+  g_free (dir);
+  g_free (first);
+  g_free (second);
+  g_free (first_uri);
+  g_free (second_uri);
+}
+
+GST_END_TEST
+
 #ifdef ENABLE_EXPERIMENTAL_TESTS
 
 GST_START_TEST (check_set_encoded_media)
@@ -549,6 +1349,14 @@ playerendpoint_suite (void)
   tcase_add_test (tc_chain, check_states);
   tcase_add_test (tc_chain, check_live_stream);
   tcase_add_test (tc_chain, check_eos);
+  tcase_add_test (tc_chain, check_threads_per_player);
+  tcase_add_test (tc_chain, check_threads_while_streaming);
+  tcase_add_test (tc_chain, check_shared_source);
+  tcase_add_test (tc_chain, check_clip_cache);
+  tcase_add_test (tc_chain, check_not_synchronized);
+  tcase_add_test (tc_chain, check_scrubbing_seeks);
+  tcase_add_test (tc_chain, check_buffer_overhead);
+  tcase_add_test (tc_chain, check_playlist);
 #ifdef ENABLE_EXPERIMENTAL_TESTS
   tcase_add_test (tc_chain, check_set_encoded_media);
 #endif
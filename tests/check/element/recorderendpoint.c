@@ -17,6 +17,9 @@
 #include <gst/check/gstcheck.h>
 #include <gst/gst.h>
 #include <glib.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <time.h>
 #include <valgrind/valgrind.h>
 
 #include <commons/kmsrecordingprofile.h>
@@ -545,6 +548,659 @@ GST_START_TEST (check_video_only)
 
 GST_END_TEST;
 
+#define FRAGMENTED_FILE "/tmp/check_fragmented_mp4.mp4"
+
+static gboolean
+contains_box (const gchar * contents, gsize length, const gchar * type)
+{
+  gsize i;
+
+  for (i = 0; i + 4 <= length; i++) {
+    if (memcmp (contents + i, type, 4) == 0) {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+/* Records three seconds of H.264 video with the recorder properties given,
+ * which are set before the profile. Returns FALSE if there is no encoder */
+static gboolean
+record_h264_video (const gchar * uri, const gchar * first_property, ...)
+{
+  GstElement *pipeline, *videotestsrc, *vencoder;
+  GMainLoop *loop;
+  guint bus_watch_id;
+  va_list args;
+  GstBus *bus;
+
+  vencoder = gst_element_factory_make ("x264enc", NULL);
+  if (vencoder == NULL) {
+    GST_WARNING ("No H.264 encoder. Test skipped");
+    return FALSE;
+  }
+
+  loop = g_main_loop_new (NULL, FALSE);
+  expected_warnings = FALSE;
+
+  pipeline = gst_pipeline_new (__FUNCTION__);
+  videotestsrc = gst_element_factory_make ("videotestsrc", NULL);
+  recorder = gst_element_factory_make ("recorderendpoint", NULL);
+
+  g_object_set (G_OBJECT (vencoder), "tune", 4 /* zerolatency */ ,
+      "key-int-max", 15, NULL);
+  g_object_set (G_OBJECT (videotestsrc), "is-live", TRUE, "do-timestamp", TRUE,
+      NULL);
+
+  va_start (args, first_property);
+  g_object_set_valist (G_OBJECT (recorder), first_property, args);
+  va_end (args);
+
+  g_object_set (G_OBJECT (recorder), "uri", uri, "profile",
+      KMS_RECORDING_PROFILE_MP4_VIDEO_ONLY, NULL);
+
+  bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+  bus_watch_id = gst_bus_add_watch (bus, gst_bus_async_signal_func, NULL);
+  g_signal_connect (bus, "message", G_CALLBACK (bus_msg), pipeline);
+  g_object_unref (bus);
+
+  gst_bin_add_many (GST_BIN (pipeline), videotestsrc, vencoder, recorder,
+      NULL);
+  gst_element_link (videotestsrc, vencoder);
+
+  link_to_recorder (recorder, vencoder, pipeline, SINK_VIDEO_STREAM);
+
+  g_signal_connect (recorder, "state-changed", G_CALLBACK (state_changed_cb3),
+      loop);
+
+  g_object_set (G_OBJECT (recorder), "state",
+      KMS_URI_ENDPOINT_STATE_START, NULL);
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  g_main_loop_run (loop);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (GST_OBJECT (pipeline));
+  g_source_remove (bus_watch_id);
+  g_main_loop_unref (loop);
+
+  return TRUE;
+}
+
+GST_START_TEST (check_fragmented_mp4)
+{
+  gchar *contents;
+  gsize length;
+
+  g_unlink (FRAGMENTED_FILE);
+
+  if (!record_h264_video ("file://" FRAGMENTED_FILE, "mp4-fragment-duration",
+          500, NULL)) {
+    return;
+  }
+
+  /* Three seconds of media give several movie fragments */
+  fail_unless (g_file_get_contents (FRAGMENTED_FILE, &contents, &length,
+          NULL));
+  fail_unless (contains_box (contents, length, "mvex"));
+  fail_unless (contains_box (contents, length, "moof"));
+  g_free (contents);
+}
+
+GST_END_TEST;
+
+#define SEGMENTED_FILE "/tmp/check_segmented_recording"
+
+GST_START_TEST (check_segmented_recording)
+{
+  gchar *contents, *first, *second;
+  gsize length;
+
+  g_unlink (SEGMENTED_FILE ".mp4");
+  g_unlink (SEGMENTED_FILE "_00000.mp4");
+  g_unlink (SEGMENTED_FILE "_00001.mp4");
+  g_unlink (SEGMENTED_FILE ".m3u8");
+
+  if (!record_h264_video ("file://" SEGMENTED_FILE ".mp4", "segment-duration",
+          1000, NULL)) {
+    return;
+  }
+
+  /* Three seconds of media are split in several files */
+  fail_unless (g_file_test (SEGMENTED_FILE "_00000.mp4", G_FILE_TEST_EXISTS));
+  fail_if (g_file_test (SEGMENTED_FILE ".mp4", G_FILE_TEST_EXISTS));
+
+  /* Every segment is a whole file, not a fragment of the first one */
+  fail_unless (g_file_get_contents (SEGMENTED_FILE "_00001.mp4", &contents,
+          &length, NULL));
+  fail_unless (contains_box (contents, length, "ftyp"));
+  fail_unless (contains_box (contents, length, "moov"));
+  fail_if (contains_box (contents, length, "moof"));
+  g_free (contents);
+
+  /* Listed in recording order, as a plain extended M3U */
+  fail_unless (g_file_get_contents (SEGMENTED_FILE ".m3u8", &contents, NULL,
+          NULL));
+  fail_unless (g_str_has_prefix (contents, "#EXTM3U\n#EXTINF:"));
+  fail_if (strstr (contents, "#EXT-X-") != NULL);
+  first = strstr (contents, "check_segmented_recording_00000.mp4");
+  second = strstr (contents, "check_segmented_recording_00001.mp4");
+  fail_unless (first != NULL && second != NULL && first < second);
+  g_free (contents);
+}
+
+GST_END_TEST;
+
+#define N_CONCURRENT_RECORDERS 3
+
+typedef struct _ConcurrentData
+{
+  GMainLoop *loop;
+  guint stopped;
+} ConcurrentData;
+
+static gboolean
+stop_concurrent_recorder (gpointer data)
+{
+  GST_DEBUG_OBJECT (data, "Setting recorder to STOP");
+
+  g_object_set (G_OBJECT (data), "state", KMS_URI_ENDPOINT_STATE_STOP, NULL);
+
+  return FALSE;
+}
+
+static void
+concurrent_state_changed_cb (GstElement * recorder,
+    KmsUriEndpointState newState, gpointer user_data)
+{
+  ConcurrentData *data = user_data;
+  guint index;
+
+  GST_DEBUG_OBJECT (recorder, "State changed %s.", state2string (newState));
+
+  index = GPOINTER_TO_UINT (g_object_get_data (G_OBJECT (recorder), "index"));
+
+  if (newState == KMS_URI_ENDPOINT_STATE_START) {
+    /* Stop them one by one, the others must keep recording */
+    g_timeout_add (1000 * (index + 1), stop_concurrent_recorder, recorder);
+  } else if (newState == KMS_URI_ENDPOINT_STATE_STOP) {
+    fail_unless (data->stopped == index);
+
+    if (++data->stopped == N_CONCURRENT_RECORDERS) {
+      g_idle_add (quit_main_loop_idle, data->loop);
+    }
+  }
+}
+
+GST_START_TEST (check_concurrent_recorders)
+{
+  GstElement *pipeline;
+  ConcurrentData data;
+  guint bus_watch_id;
+  GstBus *bus;
+  guint i;
+
+  data.loop = g_main_loop_new (NULL, FALSE);
+  data.stopped = 0;
+
+  expected_warnings = FALSE;
+
+  pipeline = gst_pipeline_new ("recorderendpoint-concurrent-test");
+
+  bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+  bus_watch_id = gst_bus_add_watch (bus, gst_bus_async_signal_func, NULL);
+  g_signal_connect (bus, "message", G_CALLBACK (bus_msg), pipeline);
+  g_object_unref (bus);
+
+  /* Muxing bins of all of them end up sharing the internal pipelines */
+  for (i = 0; i < N_CONCURRENT_RECORDERS; i++) {
+    GstElement *videotestsrc, *vencoder, *rec;
+    gchar *uri;
+
+    videotestsrc = gst_element_factory_make ("videotestsrc", NULL);
+    vencoder = gst_element_factory_make ("vp8enc", NULL);
+    rec = gst_element_factory_make ("recorderendpoint", NULL);
+    fail_unless (videotestsrc != NULL && vencoder != NULL && rec != NULL);
+
+    uri = g_strdup_printf ("file:///tmp/check_concurrent_recorders_%u.webm",
+        i);
+    g_object_set (G_OBJECT (rec), "uri", uri,
+        "profile", KMS_RECORDING_PROFILE_WEBM_VIDEO_ONLY, NULL);
+    g_free (uri);
+
+    g_object_set (G_OBJECT (videotestsrc), "is-live", TRUE, "do-timestamp",
+        TRUE, NULL);
+
+    gst_bin_add_many (GST_BIN (pipeline), videotestsrc, vencoder, rec, NULL);
+    gst_element_link (videotestsrc, vencoder);
+    link_to_recorder (rec, vencoder, pipeline, SINK_VIDEO_STREAM);
+
+    g_object_set_data (G_OBJECT (rec), "index", GUINT_TO_POINTER (i));
+    g_signal_connect (rec, "state-changed",
+        G_CALLBACK (concurrent_state_changed_cb), &data);
+
+    g_object_set (G_OBJECT (rec), "state", KMS_URI_ENDPOINT_STATE_START,
+        NULL);
+  }
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  g_main_loop_run (data.loop);
+
+  fail_unless (data.stopped == N_CONCURRENT_RECORDERS);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (GST_OBJECT (pipeline));
+
+  g_source_remove (bus_watch_id);
+  g_main_loop_unref (data.loop);
+}
+
+GST_END_TEST;
+
+#define LATE_START_DELAY 2000      /* ms */
+#define LATE_START_LENGTH 4000     /* ms */
+#define EARLY_FILE "/tmp/check_late_recorder_0.webm"
+#define LATE_FILE "/tmp/check_late_recorder_1.webm"
+
+typedef struct _LateStartData
+{
+  GMainLoop *loop;
+  GstElement *recorders[2];
+  guint stopped;
+} LateStartData;
+
+static GstElement *
+add_video_recorder (GstElement * pipeline, const gchar * uri)
+{
+  GstElement *videotestsrc, *vencoder, *rec;
+
+  videotestsrc = gst_element_factory_make ("videotestsrc", NULL);
+  vencoder = gst_element_factory_make ("vp8enc", NULL);
+  rec = gst_element_factory_make ("recorderendpoint", NULL);
+  fail_unless (videotestsrc != NULL && vencoder != NULL && rec != NULL);
+
+  /* Both in the same muxing pipeline */
+  g_object_set (G_OBJECT (rec), "muxing-pipelines", 1, "uri", uri,
+      "profile", KMS_RECORDING_PROFILE_WEBM_VIDEO_ONLY, NULL);
+  g_object_set (G_OBJECT (videotestsrc), "is-live", TRUE, "do-timestamp",
+      TRUE, NULL);
+
+  gst_bin_add_many (GST_BIN (pipeline), videotestsrc, vencoder, rec, NULL);
+  gst_element_link (videotestsrc, vencoder);
+  link_to_recorder (rec, vencoder, pipeline, SINK_VIDEO_STREAM);
+
+  return rec;
+}
+
+static gboolean
+start_late_recorder (gpointer user_data)
+{
+  LateStartData *data = user_data;
+
+  g_object_set (G_OBJECT (data->recorders[1]), "state",
+      KMS_URI_ENDPOINT_STATE_START, NULL);
+
+  return FALSE;
+}
+
+static gboolean
+stop_late_start_recorders (gpointer user_data)
+{
+  LateStartData *data = user_data;
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (data->recorders); i++) {
+    g_object_set (G_OBJECT (data->recorders[i]), "state",
+        KMS_URI_ENDPOINT_STATE_STOP, NULL);
+  }
+
+  return FALSE;
+}
+
+static void
+late_start_state_changed_cb (GstElement * recorder,
+    KmsUriEndpointState newState, gpointer user_data)
+{
+  LateStartData *data = user_data;
+
+  if (newState == KMS_URI_ENDPOINT_STATE_STOP &&
+      ++data->stopped == G_N_ELEMENTS (data->recorders)) {
+    g_idle_add (quit_main_loop_idle, data->loop);
+  }
+}
+
+static void
+keep_last_pts (GstElement * sink, GstBuffer * buffer, GstPad * pad,
+    gpointer user_data)
+{
+  GstClockTime *last_pts = user_data;
+
+  if (GST_BUFFER_PTS_IS_VALID (buffer)) {
+    *last_pts = MAX (*last_pts, GST_BUFFER_PTS (buffer));
+  }
+}
+
+/* Timestamp of the last frame of a recording */
+static GstClockTime
+get_recording_end (const gchar * filename)
+{
+  GstClockTime last_pts = 0;
+  GstElement *pipeline, *sink;
+  GstMessage *msg;
+  gchar *desc;
+  GstBus *bus;
+
+  desc = g_strdup_printf ("filesrc location=%s ! matroskademux ! "
+      "fakesink name=sink sync=false signal-handoffs=true", filename);
+  pipeline = gst_parse_launch (desc, NULL);
+  g_free (desc);
+  fail_if (pipeline == NULL);
+
+  sink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+  g_signal_connect (sink, "handoff", G_CALLBACK (keep_last_pts), &last_pts);
+  g_object_unref (sink);
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  bus = gst_element_get_bus (pipeline);
+  msg = gst_bus_timed_pop_filtered (bus, GST_CLOCK_TIME_NONE,
+      GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+  fail_unless (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_EOS);
+  gst_message_unref (msg);
+  g_object_unref (bus);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (pipeline);
+
+  return last_pts;
+}
+
+/* A recorder joining a muxing pipeline that is already running must be */
+/* timed from its own start, not from the start of that pipeline */
+GST_START_TEST (check_late_recorder)
+{
+  GstClockTime early_end, late_end;
+  GstElement *pipeline;
+  LateStartData data;
+  guint bus_watch_id;
+  GstBus *bus;
+  guint i;
+
+  data.loop = g_main_loop_new (NULL, FALSE);
+  data.stopped = 0;
+
+  expected_warnings = FALSE;
+
+  g_unlink (EARLY_FILE);
+  g_unlink (LATE_FILE);
+
+  pipeline = gst_pipeline_new ("recorderendpoint-late-test");
+
+  bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+  bus_watch_id = gst_bus_add_watch (bus, gst_bus_async_signal_func, NULL);
+  g_signal_connect (bus, "message", G_CALLBACK (bus_msg), pipeline);
+  g_object_unref (bus);
+
+  data.recorders[0] = add_video_recorder (pipeline, "file://" EARLY_FILE);
+  data.recorders[1] = add_video_recorder (pipeline, "file://" LATE_FILE);
+
+  for (i = 0; i < G_N_ELEMENTS (data.recorders); i++) {
+    g_signal_connect (data.recorders[i], "state-changed",
+        G_CALLBACK (late_start_state_changed_cb), &data);
+  }
+
+  g_object_get (G_OBJECT (data.recorders[0]), "muxing-pipelines", &i, NULL);
+  fail_unless (i == 1);
+
+  g_object_set (G_OBJECT (data.recorders[0]), "state",
+      KMS_URI_ENDPOINT_STATE_START, NULL);
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  g_timeout_add (LATE_START_DELAY, start_late_recorder, &data);
+  g_timeout_add (LATE_START_LENGTH, stop_late_start_recorders, &data);
+
+  g_main_loop_run (data.loop);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (GST_OBJECT (pipeline));
+
+  g_source_remove (bus_watch_id);
+  g_main_loop_unref (data.loop);
+
+  early_end = get_recording_end (EARLY_FILE);
+  late_end = get_recording_end (LATE_FILE);
+
+  GST_INFO ("Early recording ends at %" GST_TIME_FORMAT ", late one at %"
+      GST_TIME_FORMAT, GST_TIME_ARGS (early_end), GST_TIME_ARGS (late_end));
+
+  /* Both were stopped at the same time, the late one recorded half of it */
+  fail_unless (early_end > (LATE_START_LENGTH - 1000) * GST_MSECOND);
+  fail_unless (late_end > (LATE_START_LENGTH - LATE_START_DELAY - 1000) *
+      GST_MSECOND);
+  fail_unless (late_end < (LATE_START_LENGTH - LATE_START_DELAY + 500) *
+      GST_MSECOND);
+}
+
+GST_END_TEST;
+
+#define BENCHMARK_PACKETS 10000
+#define BENCHMARK_PACKET_SIZE 1000
+
+typedef struct _BenchmarkData
+{
+  GMainLoop *loop;
+  GstElement *recorder;
+  GstElement *appsrc;
+  GThread *thread;
+  guint packets;
+  guint list_size;              /* 0 to push single buffers */
+  gint64 cpu_start;
+  gint64 cpu_time;
+} BenchmarkData;
+
+static gint64
+get_process_cpu_time (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_PROCESS_CPUTIME_ID, &ts);
+
+  return ts.tv_sec * G_USEC_PER_SEC + ts.tv_nsec / 1000;
+}
+
+static gboolean
+stop_benchmark_recorder (gpointer user_data)
+{
+  BenchmarkData *data = user_data;
+
+  g_object_set (G_OBJECT (data->recorder), "state",
+      KMS_URI_ENDPOINT_STATE_STOP, NULL);
+
+  return FALSE;
+}
+
+/* Takes the list. appsrc accepts whole lists since GStreamer 1.14 */
+static GstFlowReturn
+push_buffer_list (GstElement * appsrc, GstBufferList * list)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+
+#if GST_CHECK_VERSION (1, 14, 0)
+  g_signal_emit_by_name (appsrc, "push-buffer-list", list, &ret);
+#else
+  guint i;
+
+  for (i = 0; i < gst_buffer_list_length (list) && ret == GST_FLOW_OK; i++) {
+    g_signal_emit_by_name (appsrc, "push-buffer",
+        gst_buffer_list_get (list, i), &ret);
+  }
+#endif
+
+  gst_buffer_list_unref (list);
+
+  return ret;
+}
+
+/* Packets are 1 ms apart, so every 1000 of them are 1 second of media */
+static gpointer
+push_benchmark_packets (gpointer user_data)
+{
+  BenchmarkData *data = user_data;
+  GstBufferList *list = NULL;
+  GstFlowReturn ret = GST_FLOW_OK;
+  guint i;
+
+  data->cpu_start = get_process_cpu_time ();
+
+  for (i = 0; i < data->packets && ret == GST_FLOW_OK; i++) {
+    GstBuffer *buffer;
+
+    buffer = gst_buffer_new_allocate (NULL, BENCHMARK_PACKET_SIZE, NULL);
+    gst_buffer_memset (buffer, 0, 0, BENCHMARK_PACKET_SIZE);
+    GST_BUFFER_PTS (buffer) = i * GST_MSECOND;
+    GST_BUFFER_DTS (buffer) = i * GST_MSECOND;
+    GST_BUFFER_DURATION (buffer) = GST_MSECOND;
+
+    if (i % 100 != 0) {
+      GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+    }
+
+    if (data->list_size == 0) {
+      g_signal_emit_by_name (data->appsrc, "push-buffer", buffer, &ret);
+      gst_buffer_unref (buffer);
+      continue;
+    }
+
+    if (list == NULL) {
+      list = gst_buffer_list_new_sized (data->list_size);
+    }
+
+    gst_buffer_list_add (list, buffer);
+
+    if (gst_buffer_list_length (list) == data->list_size) {
+      ret = push_buffer_list (data->appsrc, list);
+      list = NULL;
+    }
+  }
+
+  if (list != NULL) {
+    ret = push_buffer_list (data->appsrc, list);
+  }
+
+  data->cpu_time = get_process_cpu_time () - data->cpu_start;
+  g_idle_add (stop_benchmark_recorder, data);
+
+  return NULL;
+}
+
+static void
+benchmark_state_changed_cb (GstElement * recorder,
+    KmsUriEndpointState newState, gpointer user_data)
+{
+  BenchmarkData *data = user_data;
+
+  GST_DEBUG ("State changed %s.", state2string (newState));
+
+  if (newState == KMS_URI_ENDPOINT_STATE_START && data->thread == NULL) {
+    data->thread = g_thread_new ("benchmark", push_benchmark_packets, data);
+  } else if (newState == KMS_URI_ENDPOINT_STATE_STOP) {
+    g_idle_add (quit_main_loop_idle, data->loop);
+  }
+}
+
+static void
+run_packets_through_recorder (BenchmarkData * data, const gchar * uri)
+{
+  GstElement *pipeline, *tee, *queue, *fakesink;
+  guint bus_watch_id;
+  GstCaps *caps;
+  GstBus *bus;
+
+  data->loop = g_main_loop_new (NULL, FALSE);
+
+  expected_warnings = FALSE;
+
+  /* The tee shares every buffer with another branch, like an agnosticbin */
+  pipeline = gst_pipeline_new ("recorderendpoint-benchmark");
+  data->appsrc = gst_element_factory_make ("appsrc", NULL);
+  tee = gst_element_factory_make ("tee", NULL);
+  queue = gst_element_factory_make ("queue", NULL);
+  fakesink = gst_element_factory_make ("fakesink", NULL);
+  data->recorder = gst_element_factory_make ("recorderendpoint", NULL);
+
+  caps = gst_caps_from_string ("video/x-vp8,width=320,height=240,"
+      "framerate=30/1");
+  g_object_set (data->appsrc, "caps", caps, "format", GST_FORMAT_TIME,
+      "block", TRUE, NULL);
+  gst_caps_unref (caps);
+
+  g_object_set (fakesink, "sync", FALSE, "async", FALSE, NULL);
+  g_object_set (G_OBJECT (data->recorder), "uri", uri,
+      "profile", KMS_RECORDING_PROFILE_WEBM_VIDEO_ONLY, NULL);
+
+  bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+  bus_watch_id = gst_bus_add_watch (bus, gst_bus_async_signal_func, NULL);
+  g_signal_connect (bus, "message", G_CALLBACK (bus_msg), pipeline);
+  g_object_unref (bus);
+
+  gst_bin_add_many (GST_BIN (pipeline), data->appsrc, tee, queue, fakesink,
+      data->recorder, NULL);
+  gst_element_link_many (data->appsrc, tee, queue, fakesink, NULL);
+  link_to_recorder (data->recorder, tee, pipeline, SINK_VIDEO_STREAM);
+
+  g_signal_connect (data->recorder, "state-changed",
+      G_CALLBACK (benchmark_state_changed_cb), data);
+
+  g_object_set (G_OBJECT (data->recorder), "state",
+      KMS_URI_ENDPOINT_STATE_START, NULL);
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  g_main_loop_run (data->loop);
+
+  fail_unless (data->thread != NULL);
+  g_thread_join (data->thread);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (GST_OBJECT (pipeline));
+
+  g_source_remove (bus_watch_id);
+  g_main_loop_unref (data->loop);
+}
+
+GST_START_TEST (benchmark_recv_sample)
+{
+  BenchmarkData data = { 0 };
+
+  data.packets = BENCHMARK_PACKETS;
+  run_packets_through_recorder (&data,
+      "file:///tmp/benchmark_recv_sample.webm");
+
+  GST_INFO ("Recorder CPU for %d packets of %d bytes: %" G_GINT64_FORMAT
+      " ms (%" G_GINT64_FORMAT " ms per 1000 packets/s)", BENCHMARK_PACKETS,
+      BENCHMARK_PACKET_SIZE, data.cpu_time / 1000,
+      data.cpu_time / BENCHMARK_PACKETS);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (check_buffer_lists)
+{
+  BenchmarkData data = { 0 };
+  GStatBuf st;
+
+  data.packets = 1000;
+  data.list_size = 10;
+  run_packets_through_recorder (&data, "file:///tmp/check_buffer_lists.webm");
+
+  fail_unless (g_stat ("/tmp/check_buffer_lists.webm", &st) == 0);
+  fail_unless (st.st_size > data.packets * BENCHMARK_PACKET_SIZE / 2,
+      "Buffer lists were not recorded");
+}
+
+GST_END_TEST;
+
 GST_START_TEST (check_audio_only)
 {
   GstElement *pipeline, *audiotestsrc, *encoder;
@@ -723,6 +1379,71 @@ GST_START_TEST (check_ksm_sink_request)
   g_main_loop_unref (loop);
 }
 
+GST_END_TEST;
+
+static GstCaps *
+query_video_sink_caps (const gchar * uri, gboolean passthrough,
+    KmsRecordingProfile profile)
+{
+  GstElement *pipeline, *element;
+  GstCaps *caps;
+  GstPad *pad;
+
+  pipeline = gst_pipeline_new (__FUNCTION__);
+  element = gst_element_factory_make ("recorderendpoint", NULL);
+  g_object_set (G_OBJECT (element), "uri", uri, "passthrough", passthrough,
+      "profile", profile, NULL);
+
+  gst_bin_add (GST_BIN (pipeline), element);
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  /* Sink pads are added when recording starts */
+  g_object_set (G_OBJECT (element), "state", KMS_URI_ENDPOINT_STATE_START,
+      NULL);
+
+  pad = gst_element_get_static_pad (element, SINK_VIDEO_STREAM);
+  fail_unless (pad != NULL);
+
+  caps = gst_pad_query_caps (pad, NULL);
+  g_object_unref (pad);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (pipeline);
+
+  return caps;
+}
+
+GST_START_TEST (check_passthrough_caps)
+{
+  GstCaps *vp8, *fixed, *passthrough, *named;
+
+  vp8 = gst_caps_from_string ("video/x-vp8");
+
+  fixed = query_video_sink_caps ("file:///tmp/passthrough", FALSE,
+      KMS_RECORDING_PROFILE_MP4_VIDEO_ONLY);
+  passthrough = query_video_sink_caps ("file:///tmp/passthrough", TRUE,
+      KMS_RECORDING_PROFILE_MP4_VIDEO_ONLY);
+  named = query_video_sink_caps ("file:///tmp/passthrough.mp4", TRUE,
+      KMS_RECORDING_PROFILE_MP4_VIDEO_ONLY);
+
+  GST_DEBUG ("Fixed caps: %" GST_PTR_FORMAT, fixed);
+  GST_DEBUG ("Passthrough caps: %" GST_PTR_FORMAT, passthrough);
+  GST_DEBUG ("Passthrough caps for an .mp4 URI: %" GST_PTR_FORMAT, named);
+
+  /* Until media arrives, the recorder takes the codecs of every container */
+  fail_unless (gst_caps_is_subset (fixed, passthrough));
+  fail_unless (gst_caps_can_intersect (passthrough, vp8));
+
+  /* Unless the URI names the container */
+  fail_unless (gst_caps_is_equal (fixed, named));
+  fail_if (gst_caps_can_intersect (named, vp8));
+
+  gst_caps_unref (named);
+  gst_caps_unref (passthrough);
+  gst_caps_unref (fixed);
+  gst_caps_unref (vp8);
+}
+
 GST_END_TEST
 /******************************/
 /* RecorderEndpoint test suit */
@@ -738,8 +1459,15 @@ recorderendpoint_suite (void)
 /* Enable test when recorder is able to emit dropable buffers for the muxer */
   tcase_add_test (tc_chain, check_video_only);
   tcase_add_test (tc_chain, check_audio_only);
+  tcase_add_test (tc_chain, check_concurrent_recorders);
+  tcase_add_test (tc_chain, check_late_recorder);
+  tcase_add_test (tc_chain, benchmark_recv_sample);
+  tcase_add_test (tc_chain, check_buffer_lists);
   tcase_add_test (tc_chain, check_states_pipeline);
   tcase_add_test (tc_chain, warning_pipeline);
+  tcase_add_test (tc_chain, check_passthrough_caps);
+  tcase_add_test (tc_chain, check_fragmented_mp4);
+  tcase_add_test (tc_chain, check_segmented_recording);
 
   if (check_support_for_ksr ()) {
     tcase_add_test (tc_chain, check_ksm_sink_request);
@@ -23,6 +23,7 @@
 #include <kmstestutils.h>
 
 #include <commons/kmselementpadtype.h>
+#include <rtpendpoint/kmssocketutils.h>
 
 #define KMS_VIDEO_PREFIX "video_src_"
 #define KMS_AUDIO_PREFIX "audio_src_"
@@ -839,6 +840,87 @@ GST_START_TEST (test_not_enough_ports)
   g_free (offerer_sess_id);
 }
 
+GST_END_TEST;
+
+static guint
+generate_offer_first_port (GstElement * rtpendpoint, guint min_port,
+    guint max_port)
+{
+  GArray *audio_codecs_array;
+  gchar *audio_codecs[] = { "opus/48000/1", NULL };
+  gchar *sess_id;
+  GstSDPMessage *offer;
+  guint port;
+
+  audio_codecs_array = create_codecs_array (audio_codecs);
+  g_object_set (rtpendpoint, "num-audio-medias", 1,
+      "audio-codecs", g_array_ref (audio_codecs_array),
+      "min-port", min_port, "max-port", max_port, NULL);
+  g_array_unref (audio_codecs_array);
+
+  g_signal_emit_by_name (rtpendpoint, "create-session", &sess_id);
+  g_signal_emit_by_name (rtpendpoint, "generate-offer", sess_id, &offer);
+  fail_unless (offer != NULL);
+
+  port = gst_sdp_media_get_port (gst_sdp_message_get_media (offer, 0));
+
+  gst_sdp_message_free (offer);
+  g_free (sess_id);
+
+  return port;
+}
+
+GST_START_TEST (test_port_quarantine)
+{
+  GstElement *rtpendpoint;
+  guint min_port = 60100, max_port = 60101;
+  guint port;
+
+  /* Released ports go back to the pool immediately by default */
+  rtpendpoint = gst_element_factory_make ("rtpendpoint", NULL);
+  port = generate_offer_first_port (rtpendpoint, min_port, max_port);
+  fail_unless_equals_int (port, min_port);
+  g_object_unref (rtpendpoint);
+
+  rtpendpoint = gst_element_factory_make ("rtpendpoint", NULL);
+  port = generate_offer_first_port (rtpendpoint, min_port, max_port);
+  fail_unless_equals_int (port, min_port);
+  g_object_unref (rtpendpoint);
+
+  /* With quarantine, the only pair in the range is not available */
+  kms_socket_port_pool_set_quarantine (60000);
+
+  rtpendpoint = gst_element_factory_make ("rtpendpoint", NULL);
+  port = generate_offer_first_port (rtpendpoint, min_port, max_port);
+  fail_unless_equals_int (port, min_port);
+  g_object_unref (rtpendpoint);
+
+  rtpendpoint = gst_element_factory_make ("rtpendpoint", NULL);
+  port = generate_offer_first_port (rtpendpoint, min_port, max_port);
+  fail_unless_equals_int (port, 0);
+  g_object_unref (rtpendpoint);
+
+  kms_socket_port_pool_set_quarantine (0);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_privileged_ports)
+{
+  GstElement *rtpendpoint;
+  guint port;
+
+  rtpendpoint = gst_element_factory_make ("rtpendpoint", NULL);
+  port = generate_offer_first_port (rtpendpoint, 0, 1023);
+  fail_unless_equals_int (port, 0);
+  g_object_unref (rtpendpoint);
+
+  rtpendpoint = gst_element_factory_make ("rtpendpoint", NULL);
+  port = generate_offer_first_port (rtpendpoint, 1000, 1025);
+  fail_unless_equals_int (port, 1024);
+  g_object_unref (rtpendpoint);
+}
+
 GST_END_TEST;
 /*
  * End of test cases
@@ -858,6 +940,8 @@ sdp_suite (void)
   tcase_add_test (tc_chain, generate_offer_bw_limited);
   tcase_add_test (tc_chain, test_port_range);
   tcase_add_test (tc_chain, test_not_enough_ports);
+  tcase_add_test (tc_chain, test_port_quarantine);
+  tcase_add_test (tc_chain, test_privileged_ports);
 
   return s;
 }
@@ -0,0 +1,127 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/check/gstcheck.h>
+#include <gst/gst.h>
+#include <gst/app/gstappsrc.h>
+#include <glib.h>
+
+#include "kmsspillqueue.h"
+
+#define MAX_BYTES (256 * 1024)
+#define MAX_SPILL_BYTES (1024 * 1024)
+#define BUFFER_SIZE (64 * 1024)
+#define N_BUFFERS 100
+
+GST_START_TEST (check_default_limit)
+{
+  GstElement *recorder;
+  guint64 max_bytes;
+
+  recorder = gst_element_factory_make ("recorderendpoint", NULL);
+  g_object_get (recorder, "max-queue-bytes", &max_bytes, NULL);
+
+  /* Without configuration the memory of each stream must be bounded */
+  fail_unless (max_bytes > 0);
+
+  g_object_unref (recorder);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (check_slow_sink)
+{
+  GstElement *pipeline, *appsrc, *sink;
+  guint64 memory_bytes, spilled_bytes, peak = 0;
+  GstStructure *stats;
+  GstMessage *msg;
+  guint dropped;
+  GstBus *bus;
+  guint i;
+
+  pipeline = gst_pipeline_new (__FUNCTION__);
+  appsrc = gst_element_factory_make ("appsrc", NULL);
+  sink = gst_element_factory_make ("fakesink", NULL);
+
+  /* One second per buffer: the sink consumes far slower than we push */
+  g_object_set (appsrc, "format", GST_FORMAT_TIME, NULL);
+  g_object_set (sink, "sync", TRUE, NULL);
+  kms_spill_queue_attach (appsrc, MAX_BYTES, MAX_SPILL_BYTES, NULL);
+
+  gst_bin_add_many (GST_BIN (pipeline), appsrc, sink, NULL);
+  fail_unless (gst_element_link (appsrc, sink));
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  for (i = 0; i < N_BUFFERS; i++) {
+    GstBuffer *buffer = gst_buffer_new_allocate (NULL, BUFFER_SIZE, NULL);
+
+    GST_BUFFER_PTS (buffer) = i * GST_SECOND;
+    GST_BUFFER_DURATION (buffer) = GST_SECOND;
+    fail_unless (kms_spill_queue_push_buffer (GST_APP_SRC (appsrc),
+            buffer) == GST_FLOW_OK);
+
+    stats = kms_spill_queue_get_stats (GST_APP_SRC (appsrc));
+    gst_structure_get_uint64 (stats, "memory-bytes", &memory_bytes);
+    gst_structure_free (stats);
+
+    peak = MAX (peak, memory_bytes);
+  }
+
+  stats = kms_spill_queue_get_stats (GST_APP_SRC (appsrc));
+  GST_DEBUG ("Stats: %" GST_PTR_FORMAT, stats);
+  gst_structure_get_uint64 (stats, "spilled-bytes", &spilled_bytes);
+  gst_structure_get_uint (stats, "dropped-buffers", &dropped);
+  gst_structure_free (stats);
+
+  /* The appsrc accepts a buffer while it is below the limit */
+  fail_unless (peak <= MAX_BYTES + BUFFER_SIZE);
+  fail_unless (spilled_bytes > 0 && spilled_bytes <= MAX_SPILL_BYTES);
+  fail_unless (dropped > 0);
+
+  /* Drops are never silent */
+  bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+  msg = gst_bus_pop_filtered (bus, GST_MESSAGE_WARNING);
+  fail_unless (msg != NULL);
+  fail_unless (GST_MESSAGE_SRC (msg) == GST_OBJECT (appsrc));
+  gst_message_unref (msg);
+  g_object_unref (bus);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  g_object_unref (pipeline);
+}
+
+GST_END_TEST;
+
+static Suite *
+spillqueue_suite (void)
+{
+  Suite *s = suite_create ("spillqueue");
+  TCase *tc_chain = tcase_create ("element");
+
+  suite_add_tcase (s, tc_chain);
+
+  tcase_add_test (tc_chain, check_default_limit);
+  tcase_add_test (tc_chain, check_slow_sink);
+
+  return s;
+}
+
+GST_CHECK_MAIN (spillqueue);
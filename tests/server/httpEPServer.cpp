@@ -0,0 +1,194 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#define BOOST_TEST_STATIC_LINK
+#define BOOST_TEST_PROTECTED_VIRTUAL
+
+#include <boost/test/included/unit_test.hpp>
+#include <gst/gst.h>
+#include <gio/gio.h>
+#include <KmsHttpEPServer.h>
+#include <future>
+#include <string>
+
+using namespace boost::unit_test;
+
+#define WORKERS 4
+#define ITERATIONS 32
+#define BODY_SIZE (1024 * 1024)
+#define SENT_SIZE (64 * 1024)
+
+struct GF {
+  GF();
+};
+
+BOOST_GLOBAL_FIXTURE (GF);
+
+GF::GF()
+{
+  gst_init (nullptr, nullptr);
+}
+
+static void
+notify_cb (KmsHttpEPServer *server, GError *err, gpointer data)
+{
+  std::promise<bool> *done = (std::promise<bool> *) data;
+
+  done->set_value (err == nullptr);
+}
+
+static void
+register_cb (KmsHttpEPServer *server, const gchar *uri, GstElement *e,
+             GError *err, gpointer data)
+{
+  std::promise<std::string> *done = (std::promise<std::string> *) data;
+
+  done->set_value (uri != nullptr ? uri : "");
+}
+
+static void
+action_requested_cb (KmsHttpEPServer *server, gchar *uri,
+                     KmsHttpEndPointAction action, gpointer data)
+{
+  std::promise<bool> *requested = (std::promise<bool> *) data;
+
+  requested->set_value (action == KMS_HTTP_END_POINT_ACTION_POST);
+}
+
+static std::string
+register_end_point (KmsHttpEPServer *server, GstElement *httpep)
+{
+  std::promise<std::string> done;
+
+  kms_http_ep_server_register_end_point (server, httpep, 10, register_cb, &done,
+                                         nullptr);
+
+  return done.get_future().get();
+}
+
+static void
+send_body (GSocketConnection *conn, gsize size)
+{
+  GOutputStream *out = g_io_stream_get_output_stream (G_IO_STREAM (conn) );
+  gchar *data = (gchar *) g_malloc0 (size);
+
+  g_output_stream_write_all (out, data, size, nullptr, nullptr, nullptr);
+  g_free (data);
+}
+
+/* Sends the headers and only the beginning of the body */
+static GSocketConnection *
+start_post (guint port, const std::string &uri)
+{
+  GSocketClient *client = g_socket_client_new ();
+  GSocketConnection *conn;
+  GOutputStream *out;
+  gchar *headers;
+
+  conn = g_socket_client_connect_to_host (client, "127.0.0.1", port, nullptr,
+                                          nullptr);
+  g_object_unref (client);
+
+  if (conn == nullptr) {
+    return nullptr;
+  }
+
+  headers = g_strdup_printf ("POST %s HTTP/1.1\r\n"
+                             "Host: 127.0.0.1:%u\r\n"
+                             "Content-Type: application/octet-stream\r\n"
+                             "Content-Length: %d\r\n\r\n", uri.c_str(), port,
+                             BODY_SIZE);
+
+  out = g_io_stream_get_output_stream (G_IO_STREAM (conn) );
+  g_output_stream_write_all (out, headers, strlen (headers), nullptr, nullptr,
+                             nullptr);
+  g_free (headers);
+
+  send_body (conn, SENT_SIZE);
+
+  return conn;
+}
+
+/* Endpoints are unregistered from the control loop while their POST is */
+/* still being received by one of the workers */
+static void
+unregister_during_post ()
+{
+  KmsHttpEPServer *server;
+  std::promise<bool> started;
+  guint port = 0;
+
+  server = kms_http_ep_server_new (KMS_HTTP_EP_SERVER_INTERFACE, "127.0.0.1",
+                                   KMS_HTTP_EP_SERVER_PORT, 0,
+                                   KMS_HTTP_EP_SERVER_WORKERS, WORKERS, NULL);
+
+  kms_http_ep_server_start (server, notify_cb, &started, nullptr);
+  BOOST_REQUIRE (started.get_future().get() );
+
+  g_object_get (server, KMS_HTTP_EP_SERVER_PORT, &port, NULL);
+  BOOST_REQUIRE (port != 0);
+
+  for (guint i = 0; i < ITERATIONS; i++) {
+    GstElement *httpep = gst_element_factory_make ("httppostendpoint", nullptr);
+    std::promise<bool> requested, unregistered;
+    GSocketConnection *conn;
+    std::string uri;
+    gulong handler;
+
+    BOOST_REQUIRE (httpep != nullptr);
+    gst_object_ref_sink (httpep);
+
+    uri = register_end_point (server, httpep);
+    BOOST_REQUIRE (!uri.empty() );
+
+    handler = g_signal_connect (server, "action-requested",
+                                G_CALLBACK (action_requested_cb), &requested);
+
+    conn = start_post (port, uri);
+    BOOST_REQUIRE (conn != nullptr);
+    BOOST_CHECK (requested.get_future().get() );
+    g_signal_handler_disconnect (server, handler);
+
+    kms_http_ep_server_unregister_end_point (server, uri.c_str(), notify_cb,
+        &unregistered, nullptr);
+    BOOST_CHECK (unregistered.get_future().get() );
+
+    /* Rest of the body arrives to a message no longer bound to the endpoint */
+    send_body (conn, SENT_SIZE);
+    g_io_stream_close (G_IO_STREAM (conn), nullptr, nullptr);
+    g_object_unref (conn);
+
+    gst_object_unref (httpep);
+  }
+
+  std::promise<bool> stopped;
+
+  kms_http_ep_server_stop (server, notify_cb, &stopped, nullptr);
+  BOOST_CHECK (stopped.get_future().get() );
+
+  g_object_unref (server);
+}
+
+test_suite *
+init_unit_test_suite ( int , char *[] )
+{
+  test_suite *test = BOOST_TEST_SUITE ( "HttpEPServer" );
+
+  test->add (BOOST_TEST_CASE ( &unregister_during_post ), 0, /* timeout */ 60);
+
+  return test;
+}
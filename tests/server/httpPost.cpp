@@ -0,0 +1,161 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#define BOOST_TEST_STATIC_LINK
+#define BOOST_TEST_PROTECTED_VIRTUAL
+
+#include <boost/test/included/unit_test.hpp>
+#include <gst/gst.h>
+#include <libsoup/soup.h>
+#include <KmsHttpPost.h>
+#include <chrono>
+#include <random>
+
+using namespace boost::unit_test;
+
+#define BOUNDARY "----KurentoFormBoundary7MA4YWxkTrZu0gW"
+
+/* libsoup delivers request bodies in chunks of this size */
+static const gsize CHUNK_SIZE = 8192;
+static const gsize BENCHMARK_SIZE = 64 << 20;
+/* MB/s, far below what the delimiter search does even on slow machines */
+static const double MIN_THROUGHPUT = 50;
+
+struct GF {
+  GF();
+};
+
+BOOST_GLOBAL_FIXTURE (GF);
+
+GF::GF()
+{
+  gst_init (nullptr, nullptr);
+}
+
+static const std::string PREAMBLE = "--" BOUNDARY "\r\n"
+                                    "Content-Disposition: form-data; name=\"file\"; filename=\"video.webm\"\r\n"
+                                    "Content-Type: application/octet-stream\r\n\r\n";
+static const std::string EPILOGUE = "\r\n--" BOUNDARY "--\r\n";
+
+static void
+got_data_cb (KmsHttpPost *post, SoupBuffer *buffer, gpointer data)
+{
+  std::string *received = (std::string *) data;
+
+  received->append (buffer->data, buffer->length);
+}
+
+static void
+send_chunk (SoupMessage *msg, const char *data, gsize len)
+{
+  /* Data outlives the message, like the reference counted chunks of */
+  /* libsoup it can be shared without copies */
+  SoupBuffer *chunk = soup_buffer_new (SOUP_MEMORY_STATIC, data, len);
+
+  g_signal_emit_by_name (msg, "got-chunk", chunk);
+  soup_buffer_free (chunk);
+}
+
+/* Sends headers in a chunk and then content split in chunks of @size */
+static std::string
+post_multipart (const std::string &content, gsize size)
+{
+  SoupMessage *msg = soup_message_new ("POST", "http://localhost/");
+  KmsHttpPost *post = kms_http_post_new ();
+  std::string received;
+  std::string body = content + EPILOGUE;
+
+  soup_message_headers_replace (msg->request_headers, "Content-Type",
+                                "multipart/form-data; boundary=" BOUNDARY);
+  g_signal_connect (post, "got-data", G_CALLBACK (got_data_cb), &received);
+  g_object_set (post, "soup-message", msg, NULL);
+
+  send_chunk (msg, PREAMBLE.data(), PREAMBLE.size() );
+
+  for (gsize i = 0; i < body.size(); i += size) {
+    send_chunk (msg, body.data() + i, MIN (size, body.size() - i) );
+  }
+
+  g_object_unref (post);
+  g_object_unref (msg);
+
+  return received;
+}
+
+/* Binary media is full of CR bytes and of near misses of the delimiter */
+static std::string
+create_content (gsize size, std::mt19937 &rng)
+{
+  static const char *pieces[] = { "\r", "\r\n", "\r\n-", "\r\n--",
+                                  "\r\n--" BOUNDARY "-x", "\r\n--" BOUNDARY "\rx"
+                                };
+  std::string content;
+
+  while (content.size() < size) {
+    if (rng() % 4 == 0) {
+      content += pieces[rng() % G_N_ELEMENTS (pieces)];
+    } else {
+      content += (char) (rng() % 256);
+    }
+  }
+
+  return content;
+}
+
+static void
+multipart_split_delimiters ()
+{
+  std::mt19937 rng (1);
+  std::string content = create_content (64 * 1024, rng);
+  gsize sizes[] = { 1, 2, 7, 41, 42, 43, 512, CHUNK_SIZE };
+
+  for (gsize size : sizes) {
+    BOOST_TEST_MESSAGE ("Chunk size " << size);
+    BOOST_CHECK (post_multipart (content, size) == content);
+  }
+}
+
+static void
+multipart_benchmark ()
+{
+  std::mt19937 rng (2);
+  std::string content = create_content (BENCHMARK_SIZE, rng);
+  auto start = std::chrono::steady_clock::now();
+  std::string received = post_multipart (content, CHUNK_SIZE);
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() -
+                                          start;
+  double throughput = (BENCHMARK_SIZE >> 20) / elapsed.count();
+
+  BOOST_CHECK (received.size() == content.size() );
+
+  BOOST_TEST_MESSAGE ("Parsed " << (BENCHMARK_SIZE >> 20) <<
+                      " MB multipart body in " << (CHUNK_SIZE >> 10) << " KB chunks: " <<
+                      throughput << " MB/s");
+  BOOST_CHECK_MESSAGE (throughput >= MIN_THROUGHPUT, "Multipart parsing at " <<
+                       throughput << " MB/s, expected at least " << MIN_THROUGHPUT);
+}
+
+test_suite *
+init_unit_test_suite ( int , char *[] )
+{
+  test_suite *test = BOOST_TEST_SUITE ( "HttpPost" );
+
+  test->add (BOOST_TEST_CASE ( &multipart_split_delimiters ), 0, /* timeout */ 30);
+  test->add (BOOST_TEST_CASE ( &multipart_benchmark ), 0, /* timeout */ 60);
+
+  return test;
+}
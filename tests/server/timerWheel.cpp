@@ -0,0 +1,259 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#define BOOST_TEST_STATIC_LINK
+#define BOOST_TEST_PROTECTED_VIRTUAL
+
+#include <boost/test/included/unit_test.hpp>
+#include <KmsTimerWheel.h>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <vector>
+
+using namespace boost::unit_test;
+
+static const guint RESOLUTION = 10;
+static const guint SESSIONS = 50000;
+static const guint SESSION_TIMEOUT = 30000;
+static const guint STRESS_ROUNDS = 4;
+static const guint PROBE_INTERVAL = 10;
+
+struct Timer {
+  KmsTimerWheel *wheel;
+  guint id;
+  guint interval;
+  gint64 armed;
+  gint64 fired;
+  gboolean removed_when_fired;
+  gint destroyed;
+};
+
+static std::mutex mutex;
+static std::condition_variable cond;
+static guint fired;
+
+static gboolean
+timer_fired_cb (gpointer data)
+{
+  Timer *timer = (Timer *) data;
+  std::unique_lock <std::mutex> lock (mutex);
+
+  timer->fired = g_get_monotonic_time ();
+  /* Sessions remove their timeout when it expires */
+  timer->removed_when_fired = kms_timer_wheel_remove (timer->wheel, timer->id);
+  fired++;
+  cond.notify_all ();
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+timer_destroyed_cb (gpointer data)
+{
+  g_atomic_int_inc (& ( (Timer *) data)->destroyed);
+}
+
+static void
+timeouts_expire ()
+{
+  KmsLoop *loop = kms_loop_new ();
+  KmsTimerWheel *wheel = kms_timer_wheel_new (loop, RESOLUTION);
+  std::vector<Timer> timers (500);
+  std::mt19937 rng (1);
+  guint expected = 0;
+
+  fired = 0;
+
+  for (guint i = 0; i < timers.size (); i++) {
+    Timer &timer = timers[i];
+
+    timer = Timer ();
+    timer.wheel = wheel;
+    /* Also covers intervals longer than the first level of the wheel, */
+    /* the ones cancelled below must not expire before */
+    timer.interval = (i % 4 == 0) ? 1000 + rng () % 1000 : rng () % 2000;
+    timer.armed = g_get_monotonic_time ();
+    timer.id = kms_timer_wheel_add (wheel, timer.interval, timer_fired_cb,
+                                    &timer, timer_destroyed_cb);
+    BOOST_REQUIRE (timer.id > 0);
+  }
+
+  for (guint i = 0; i < timers.size (); i++) {
+    if (i % 4 == 0) {
+      BOOST_CHECK (kms_timer_wheel_remove (wheel, timers[i].id) );
+      BOOST_CHECK (!kms_timer_wheel_remove (wheel, timers[i].id) );
+    } else {
+      expected++;
+    }
+  }
+
+  {
+    std::unique_lock <std::mutex> lock (mutex);
+
+    BOOST_REQUIRE (cond.wait_for (lock, std::chrono::seconds (10), [&] () {
+      return fired == expected;
+    }) );
+  }
+
+  BOOST_CHECK (kms_timer_wheel_get_size (wheel) == 0);
+  kms_timer_wheel_free (wheel);
+  g_object_unref (loop);
+
+  for (guint i = 0; i < timers.size (); i++) {
+    Timer &timer = timers[i];
+
+    BOOST_CHECK (timer.destroyed == 1);
+
+    if (i % 4 == 0) {
+      BOOST_CHECK (timer.fired == 0);
+      continue;
+    }
+
+    BOOST_CHECK (!timer.removed_when_fired);
+    /* Never early, and late only by the resolution and scheduling */
+    BOOST_CHECK (timer.fired - timer.armed >= (gint64) timer.interval * 1000);
+    BOOST_CHECK (timer.fired - timer.armed <
+                 (gint64) (timer.interval + 2 * RESOLUTION + 100) * 1000);
+  }
+}
+
+struct Probe {
+  gint64 last;
+  gint64 max;
+  gint64 total;
+  guint count;
+};
+
+static gboolean
+probe_cb (gpointer data)
+{
+  Probe *probe = (Probe *) data;
+  gint64 now = g_get_monotonic_time ();
+
+  if (probe->last != 0) {
+    gint64 latency = MAX (now - probe->last - PROBE_INTERVAL * 1000, 0);
+
+    probe->max = MAX (probe->max, latency);
+    probe->total += latency;
+    probe->count++;
+  }
+
+  probe->last = now;
+
+  return G_SOURCE_CONTINUE;
+}
+
+static gboolean
+never_fired_cb (gpointer data)
+{
+  g_atomic_int_inc ( (gint *) data);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Arms and cancels the timeouts of SESSIONS endpoints while a probe */
+/* measures how late the loop dispatches. Returns ns per session */
+static double
+run_sessions (KmsLoop *loop, const char *name,
+              std::function<guint (gint *) > arm, std::function<void (guint) > cancel)
+{
+  std::vector<guint> ids (SESSIONS);
+  Probe probe = Probe ();
+  std::chrono::duration<double> armed (0), cancelled (0);
+  gint expired = 0;
+  guint probe_id;
+
+  probe_id = kms_loop_timeout_add_full (loop, G_PRIORITY_DEFAULT,
+                                        PROBE_INTERVAL, probe_cb, &probe, nullptr);
+
+  for (guint round = 0; round < STRESS_ROUNDS; round++) {
+    auto start = std::chrono::steady_clock::now ();
+
+    for (guint &id : ids) {
+      id = arm (&expired);
+    }
+
+    auto middle = std::chrono::steady_clock::now ();
+
+    for (guint id : ids) {
+      cancel (id);
+    }
+
+    armed += middle - start;
+    cancelled += std::chrono::steady_clock::now () - middle;
+  }
+
+  /* Let the probe see the loop once everything is cancelled */
+  g_usleep (5 * PROBE_INTERVAL * 1000);
+  kms_loop_remove (loop, probe_id);
+
+  BOOST_CHECK (expired == 0);
+
+  BOOST_TEST_MESSAGE (name << ": " << SESSIONS << " sessions, arm " <<
+                      armed.count () * 1e9 / (SESSIONS * STRESS_ROUNDS) << " ns, cancel " <<
+                      cancelled.count () * 1e9 / (SESSIONS * STRESS_ROUNDS) <<
+                      " ns, loop latency avg " << (probe.count > 0 ? probe.total / probe.count :
+                          0) / 1000.0 << " ms max " << probe.max / 1000.0 << " ms");
+
+  return (armed + cancelled).count () * 1e9 / (SESSIONS * STRESS_ROUNDS);
+}
+
+static void
+sessions_stress ()
+{
+  KmsLoop *loop = kms_loop_new ();
+  KmsTimerWheel *wheel = kms_timer_wheel_new (loop, 100);
+  double wheel_cost, sources_cost;
+
+  wheel_cost = run_sessions (loop, "Timer wheel", [wheel] (gint * expired) {
+    return kms_timer_wheel_add (wheel, SESSION_TIMEOUT, never_fired_cb, expired,
+                                nullptr);
+  }, [wheel] (guint id) {
+    kms_timer_wheel_remove (wheel, id);
+  });
+
+  BOOST_CHECK (kms_timer_wheel_get_size (wheel) == 0);
+
+  /* One source per session, as sessions used to expire */
+  sources_cost = run_sessions (loop, "Loop sources", [loop] (gint * expired) {
+    return kms_loop_timeout_add_full (loop, G_PRIORITY_DEFAULT, SESSION_TIMEOUT,
+                                      never_fired_cb, expired, nullptr);
+  }, [loop] (guint id) {
+    kms_loop_remove (loop, id);
+  });
+
+  /* The reason to have a wheel at all */
+  BOOST_CHECK_MESSAGE (wheel_cost < sources_cost, "Timer wheel takes " <<
+                       wheel_cost << " ns per session, loop sources " << sources_cost);
+
+  kms_timer_wheel_free (wheel);
+  g_object_unref (loop);
+}
+
+test_suite *
+init_unit_test_suite ( int , char *[] )
+{
+  test_suite *test = BOOST_TEST_SUITE ( "TimerWheel" );
+
+  test->add (BOOST_TEST_CASE ( &timeouts_expire ), 0, /* timeout */ 30);
+  test->add (BOOST_TEST_CASE ( &sessions_stress ), 0, /* timeout */ 120);
+
+  return test;
+}